@@ -0,0 +1,457 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "fakes.h"
+
+#include "modules/base/codec.h"
+#include "modules/base/generic_fun.h"
+#include "modules/core/adapt_core.h"
+#include "modules/core/adc_core.h"
+#include "modules/core/alarm_core.h"
+#include "modules/core/bench_core.h"
+#include "modules/core/ct_core.h"
+#include "modules/core/decim_core.h"
+#include "modules/core/frame_core.h"
+#include "modules/core/jitter_core.h"
+#include "modules/core/notify_core.h"
+#include "modules/core/plan_core.h"
+#include "modules/core/pwm_core.h"
+#include "modules/core/relay_core.h"
+#include "modules/core/spectrum_core.h"
+#include "modules/core/step_core.h"
+#include "modules/core/trace_core.h"
+#include "modules/hal/hal_adc.h"
+
+// host counterparts of the target 'bench' command, same BENCH lines so tools/bench_compare.py reads both
+
+static struct {
+    uint32_t samples[BENCH_MAX_RUNS];
+    char buffer[11 + 11 + 11 + 11];
+    AdcCoreConfig adc;
+    CtCoreConfig ct;
+    CtZero zero;
+    RelayBank bank;
+    JitterHistogram jitter;
+    TraceBuffer trace;
+    DecimConfig decim;
+    DecimFilter filters[2];
+    uint16_t frames[64 * 2];
+    float outputs[64];
+    float signal[SPECTRUM_MAX_SAMPLES];
+    float spectrum[SPECTRUM_MAX_SAMPLES];
+    int64_t timestamp;
+    unsigned step;
+    PlanProgram plan;
+    uint8_t packet[200];
+    uint8_t frame[FRAME_ENCODED_SIZE(200)];
+    uint8_t chunk[FRAME_ENCODED_SIZE(200)];
+    size_t frame_length;
+    int32_t values[64];
+    int32_t decoded[64];
+    uint8_t coded[64 * CODEC_SIMPLE8B_WORD];
+    size_t coded_length;
+    unsigned coded_packing;     // 1 varint, 2 simple-8b
+    int64_t clock;
+    volatile int sink;
+} ctx = {
+    .adc = { .resistor_r1 = 1500, .resistor_r2 = 8300, .samples = 100, .step = 10,
+             .model = { .kind = kCalibPolynomial, .coeffs = { -45.7f, 1.000991f, -0.00000169f } } },
+    .ct = { .ratio = 4, .step = 0.0125, .samples = 100, .sample_step = 10,
+            .model = { .kind = kCalibPolynomial, .coeffs = { 0, 1 } } },
+};
+
+static void bench_adc_read(void *arg) {
+    ctx.sink = ADC_CORE_read(&ctx.adc);
+}
+
+static void bench_adc_read_single(void *arg) {
+    ctx.sink = ADC_CORE_read_single(&ctx.adc);
+}
+
+static void bench_ct_read(void *arg) {
+    ctx.sink = CT_CORE_read(&ctx.ct, NULL);
+}
+
+static void bench_ct_read_zeroed(void *arg) {
+    ctx.sink = CT_CORE_read(&ctx.ct, &ctx.zero);
+}
+
+static void bench_fmt_voltage(void *arg) {
+    ctx.sink = snprintf(ctx.buffer, sizeof(ctx.buffer), "%d,%d,%d,%d", 12034, 12810, 11502, 12001);
+}
+
+static void bench_fmt_current(void *arg) {
+    ctx.sink = snprintf(ctx.buffer, sizeof(ctx.buffer), "%.2f,%.2f,%.2f,%.2f", 12.34f, 15.02f, 0.41f, 9.87f);
+}
+
+static void bench_fmt_temperature(void *arg) {
+    ctx.sink = snprintf(ctx.buffer, sizeof(ctx.buffer), "%f,%f", 23.5625f, 81.125f);
+}
+
+static void bench_ble_update(void *arg) {
+    snprintf(ctx.buffer, sizeof(ctx.buffer), "%d,%d,%d,%d", 12034, 12810, 11502, 12001);
+    BLE_update_value(kVoltage, ctx.buffer);
+}
+
+static void bench_parse_list(void *arg) {
+    unsigned values[6];
+    ctx.sink = ParseUnsignedList("1,0,2048,20000,4096,512", values, 6, 0);
+}
+
+static void bench_pwm_parse(void *arg) {
+    PwmCommand command;
+    ctx.sink = PWM_CORE_parse_ble_command("1,30,50,1000", &command);
+}
+
+static void bench_relay_set_mask(void *arg) {
+    ctx.step += 1;
+    RELAY_CORE_set_mask(&ctx.bank, 0xFF, ctx.step);
+}
+
+static void bench_jitter_add(void *arg) {
+    ctx.timestamp += 1000000 + (ctx.step++ & 0xFF);
+    JITTER_CORE_add(&ctx.jitter, ctx.timestamp);
+}
+
+static void bench_trace_record(void *arg) {
+    TRACE_CORE_record(&ctx.trace, 0, ctx.step++, kTraceSample, 0);
+}
+
+// one 64 frame block of both channels, the firmware 'decim' inner loop
+static void bench_decim_block(void *arg) {
+    for (unsigned channel = 0; channel < 2; ++channel)
+        ctx.sink = DECIM_CORE_process(&ctx.filters[channel], &ctx.frames[channel], 64, 2, ctx.outputs, 64);
+}
+
+static void bench_decim_design(void *arg) {
+    ctx.sink = DECIM_CORE_design(&ctx.decim, 3, 50, 21, 0.2f);
+}
+
+// limits of the default 'decim' chain, a design change that misses them fails ctest
+#define RESPONSE_MAX_RIPPLE_DB 0.1f
+#define RESPONSE_MAX_STOPBAND_DB -40.0f
+
+// frequency response of the default 'decim' chain, 10 kHz in, 100 Hz out
+static bool print_response(void) {
+    const float output_rate = 100;
+    const float input_rate = 10000;
+    DecimConfig config;
+    DECIM_CORE_design(&config, 3, 50, 21, 0.2f);
+
+    float ripple = 0;
+    float stopband = -1000;
+    printf("RESPONSE,frequency_hz,gain_db\n");
+    for (float frequency = 0; frequency <= 5 * output_rate; frequency += output_rate / 40) {
+        float gain = 20 * log10f(DECIM_CORE_response(&config, frequency / input_rate) + 1e-12f);
+        printf("RESPONSE,%.1f,%.2f\n", frequency, gain);
+        // passband up to a quarter of the output rate, everything from 3/4 aliases into it
+        if (frequency <= 0.25f * output_rate && fabsf(gain) > ripple)
+            ripple = fabsf(gain);
+        if (frequency >= 0.75f * output_rate && gain > stopband)
+            stopband = gain;
+    }
+    bool passed = ripple < RESPONSE_MAX_RIPPLE_DB && stopband < RESPONSE_MAX_STOPBAND_DB;
+    printf("RESPONSE,passband_ripple_db,%.3f,%.3f\n", ripple, RESPONSE_MAX_RIPPLE_DB);
+    printf("RESPONSE,stopband_db,%.1f,%.1f\n", stopband, RESPONSE_MAX_STOPBAND_DB);
+    printf("RESPONSE,%s\n", passed ? "PASS" : "FAIL");
+    return passed;
+}
+
+static void bench_goertzel(void *arg) {
+    ctx.sink = SPECTRUM_CORE_goertzel(ctx.signal, SPECTRUM_MAX_SAMPLES, 0.05f);
+}
+
+static void bench_rfft(void *arg) {
+    memcpy(ctx.spectrum, ctx.signal, sizeof(ctx.spectrum));
+    ctx.sink = SPECTRUM_CORE_rfft(ctx.spectrum, SPECTRUM_MAX_SAMPLES);
+}
+
+// PWM ripple like test signal: 1000 Hz fundamental, 2nd and 3rd harmonic, 20 kHz sampling
+static void fill_ripple(float *data, unsigned count, float fundamental) {
+    for (unsigned i = 0; i < count; ++i) {
+        double phase = 2 * M_PI * fundamental * i;
+        data[i] = 2000 + 100 * sin(phase) + 10 * sin(2 * phase + 0.3) + 5 * sin(3 * phase + 1.1);
+    }
+}
+
+#define SPECTRUM_AMPLITUDE_TOLERANCE 1e-3     // relative, amplitudes of the synthetic tones
+#define SPECTRUM_THD_TOLERANCE 1e-4
+#define SPECTRUM_RFFT_TOLERANCE 1e-5          // relative to the fundamental bin, against a direct DFT
+
+static bool near_amplitude(float value, float expected) {
+    return fabsf(value - expected) <= SPECTRUM_AMPLITUDE_TOLERANCE * expected;
+}
+
+// accuracy of the ripple kernels against a direct DFT and the known amplitudes
+static bool print_spectrum(void) {
+    const unsigned n = SPECTRUM_MAX_SAMPLES;
+    const float fundamental = 1000.0f / 20000;
+    const float expected[] = { 100, 10, 5 };
+    const double expected_thd = sqrt(10 * 10 + 5 * 5) / 100;
+    static float reference[SPECTRUM_MAX_SAMPLES];
+    bool passed = true;
+
+    fill_ripple(ctx.signal, n, fundamental);
+    for (unsigned i = 0; i < n; ++i)
+        ctx.signal[i] -= 2000;
+    float window_sum = SPECTRUM_CORE_window(ctx.signal, n);
+    memcpy(reference, ctx.signal, sizeof(reference));
+
+    SpectrumHarmonics harmonics;
+    SPECTRUM_CORE_harmonics(ctx.signal, n, window_sum, fundamental, 3, &harmonics);
+    passed = passed && harmonics.count == 3;
+    for (unsigned h = 0; h < harmonics.count; ++h) {
+        printf("SPECTRUM,goertzel_h%u,%.4f,%.4f\n", h + 1, harmonics.amplitudes[h], expected[h]);
+        passed = passed && near_amplitude(harmonics.amplitudes[h], expected[h]);
+    }
+    printf("SPECTRUM,thd,%.5f,%.5f\n", harmonics.thd, expected_thd);
+    passed = passed && fabs(harmonics.thd - expected_thd) <= SPECTRUM_THD_TOLERANCE;
+
+    SPECTRUM_CORE_rfft(ctx.signal, n);
+    double worst = 0;
+    for (unsigned bin = 0; bin <= n / 2; ++bin) {
+        double re = 0;
+        double im = 0;
+        for (unsigned i = 0; i < n; ++i) {
+            re += reference[i] * cos(2 * M_PI * bin * i / n);
+            im -= reference[i] * sin(2 * M_PI * bin * i / n);
+        }
+        double error = fabs(SPECTRUM_CORE_rfft_bin(ctx.signal, n, bin) - sqrt(re * re + im * im));
+        worst = error > worst ? error : worst;
+    }
+    double relative = worst / (window_sum * 100 / 2);
+    printf("SPECTRUM,rfft_max_error,%.6f,%.2e\n", worst, relative);
+    passed = passed && relative <= SPECTRUM_RFFT_TOLERANCE;
+
+    // the same tones on exact bins through the FFT harmonic path
+    const unsigned bin = n / 16;
+    fill_ripple(ctx.signal, n, (float)bin / n);
+    for (unsigned i = 0; i < n; ++i)
+        ctx.signal[i] -= 2000;
+    window_sum = SPECTRUM_CORE_window(ctx.signal, n);
+    SPECTRUM_CORE_rfft(ctx.signal, n);
+    SPECTRUM_CORE_harmonics_fft(ctx.signal, n, window_sum, bin, 3, &harmonics);
+    passed = passed && harmonics.count == 3;
+    for (unsigned h = 0; h < harmonics.count; ++h) {
+        printf("SPECTRUM,fft_h%u,%.4f,%.4f\n", h + 1, harmonics.amplitudes[h], expected[h]);
+        passed = passed && near_amplitude(harmonics.amplitudes[h], expected[h]);
+    }
+    printf("SPECTRUM,fft_thd,%.5f,%.5f\n", harmonics.thd, expected_thd);
+    passed = passed && fabs(harmonics.thd - expected_thd) <= SPECTRUM_THD_TOLERANCE;
+
+    printf("SPECTRUM,%s\n", passed ? "PASS" : "FAIL");
+    return passed;
+}
+
+// post-step pass of the 'step' analysis over the default 3584 frames
+static void bench_step_analyse(void *arg) {
+    StepAnalysis analysis;
+    STEP_CORE_begin(&analysis, 100, 2100, 8, 0.02f, 358);
+    for (unsigned i = 0; i < 3584; ++i)
+        STEP_CORE_add(&analysis, ctx.signal[i % SPECTRUM_MAX_SAMPLES]);
+
+    StepMetrics metrics;
+    STEP_CORE_finish(&analysis, &metrics);
+    ctx.sink = metrics.settling;
+}
+
+// activity detection of the adaptive loop, 1000 samples at 1 kHz
+static void bench_adapt_update(void *arg) {
+    static const AdaptConfig config = { .idle_rate = 10, .active_rate = 1000, .hold = 2000, .deltas = { 100, 100 } };
+    AdaptState state;
+    ADAPT_CORE_reset(&state);
+
+    unsigned changes = 0;
+    for (unsigned i = 0; i < 1000; ++i) {
+        int32_t values[ADAPT_CHANNELS] = { ctx.signal[i], ctx.signal[i] / 2 };
+        changes += ADAPT_CORE_update(&config, &state, i * 1000, values, 3);
+    }
+    ctx.sink = changes;
+}
+
+// per-sample cost the acquisition loops pay, 1000 samples crossing the limits
+static void bench_alarm_update(void *arg) {
+    static const AlarmThreshold threshold = { .low = 1950, .high = 2050, .hysteresis = 20, .debounce = 3 };
+    AlarmState state;
+    ALARM_CORE_reset(&state);
+
+    unsigned transitions = 0;
+    for (unsigned i = 0; i < 1000; ++i)
+        transitions += ALARM_CORE_update(&threshold, &state, ctx.signal[i]);
+    ctx.sink = transitions;
+}
+
+// on change policy over 1000 ripple samples, most of them suppressed before formatting
+static void bench_notify_due(void *arg) {
+    static const NotifyPolicy policy = { .mode = kNotifyOnChange, .min_interval = 0, .deadband = 50, .relative = 0.01f };
+    NotifyState state;
+    NOTIFY_CORE_reset(&state);
+
+    unsigned sent = 0;
+    for (unsigned i = 0; i < 1000; ++i) {
+        int32_t value = ctx.signal[i];
+        sent += NOTIFY_CORE_due(&policy, &state, i * 1000, &value, 1);
+    }
+    ctx.sink = sent;
+}
+
+static const char plan_text[] =
+    "relay on; wait 100; measure voltage 20; expect avg 1500 2500\n"
+    "loop 10; pwm 1000 80; wait 5; measure current 4; expect pp 0 500; pwm off; wait 5; end\n"
+    "relay off";
+
+static void bench_plan_compile(void *arg) {
+    unsigned statement;
+    ctx.sink = PLAN_CORE_compile(plan_text, &ctx.plan, &statement);
+}
+
+// the interpreter alone, time is simulated and the hooks do nothing
+static bool plan_output(uint32_t a, uint32_t b, void *arg) { return true; }
+static int64_t plan_now(void *arg) { return ctx.clock; }
+static void plan_wait_until(int64_t time, void *arg) { ctx.clock = time > ctx.clock ? time : ctx.clock; }
+static int32_t plan_sample(PlanChannel channel, void *arg) { return ctx.signal[ctx.clock / 1000 % SPECTRUM_MAX_SAMPLES]; }
+static void plan_record(const PlanRecord *record, void *arg) { ctx.sink = record->pass; }
+static bool plan_stopped(void *arg) { return false; }
+
+static const PlanHooks plan_hooks = {
+    .relay      = plan_output,
+    .pwm        = plan_output,
+    .now        = plan_now,
+    .wait_until = plan_wait_until,
+    .sample     = plan_sample,
+    .record     = plan_record,
+    .stopped    = plan_stopped,
+};
+
+static void bench_plan_run(void *arg) {
+    PlanResult result;
+    PLAN_CORE_run(&ctx.plan, &plan_hooks, NULL, &result);
+    ctx.sink = result.failed;
+}
+
+// one full stream packet of sample records, delimiters stripped for the decode
+static void bench_frame_encode(void *arg) {
+    ctx.frame_length = FRAME_CORE_encode(1, 0, ctx.packet, sizeof(ctx.packet), ctx.frame, sizeof(ctx.frame));
+    ctx.sink = ctx.frame_length;
+}
+
+static void bench_frame_decode(void *arg) {
+    Frame frame;
+    memcpy(ctx.chunk, ctx.frame + 1, ctx.frame_length - 2);
+    ctx.sink = FRAME_CORE_decode(ctx.chunk, ctx.frame_length - 2, &frame);
+}
+
+// the target codec cases on the same 64 value voltage record
+static void bench_varint_enc(void *arg) {
+    unsigned encoded;
+    ctx.coded_length = CODEC_encode_varint(ctx.values, 64, 0, ctx.coded, sizeof(ctx.coded), &encoded);
+    ctx.coded_packing = 1;
+}
+
+// the warm up run encodes the block when the case runs on its own
+static void bench_varint_dec(void *arg) {
+    if (ctx.coded_packing != 1)
+        bench_varint_enc(NULL);
+    ctx.sink = CODEC_decode_varint(ctx.coded, ctx.coded_length, 0, ctx.decoded, 64);
+}
+
+static void bench_s8b_enc(void *arg) {
+    unsigned encoded;
+    ctx.coded_length = CODEC_encode_simple8b(ctx.values, 64, 0, ctx.coded, sizeof(ctx.coded), &encoded);
+    ctx.coded_packing = 2;
+}
+
+static void bench_s8b_dec(void *arg) {
+    if (ctx.coded_packing != 2)
+        bench_s8b_enc(NULL);
+    ctx.sink = CODEC_decode_simple8b(ctx.coded, ctx.coded_length, 0, ctx.decoded, 64);
+}
+
+static const BenchCase cases[] = {
+    { .name = "adc_read",           .fn = bench_adc_read,           .runs = 100 },
+    { .name = "adc_read_single",    .fn = bench_adc_read_single,    .runs = 1000 },
+    { .name = "ct_read",            .fn = bench_ct_read,            .runs = 100 },
+    { .name = "ct_read_zeroed",     .fn = bench_ct_read_zeroed,     .runs = 100 },
+    { .name = "fmt_voltage",        .fn = bench_fmt_voltage,        .runs = 1000 },
+    { .name = "fmt_current",        .fn = bench_fmt_current,        .runs = 1000 },
+    { .name = "fmt_temperature",    .fn = bench_fmt_temperature,    .runs = 1000 },
+    { .name = "ble_update",         .fn = bench_ble_update,         .runs = 1000 },
+    { .name = "parse_list",         .fn = bench_parse_list,         .runs = 1000 },
+    { .name = "pwm_parse",          .fn = bench_pwm_parse,          .runs = 1000 },
+    { .name = "relay_set_mask",     .fn = bench_relay_set_mask,     .runs = 1000 },
+    { .name = "jitter_add",         .fn = bench_jitter_add,         .runs = 1000 },
+    { .name = "trace_record",       .fn = bench_trace_record,       .runs = 1000 },
+    { .name = "decim_block",        .fn = bench_decim_block,        .runs = 1000 },
+    { .name = "decim_design",       .fn = bench_decim_design,       .runs = 100 },
+    { .name = "goertzel_1024",      .fn = bench_goertzel,           .runs = 1000 },
+    { .name = "rfft_1024",          .fn = bench_rfft,               .runs = 1000 },
+    { .name = "step_analyse",       .fn = bench_step_analyse,       .runs = 100 },
+    { .name = "adapt_update",       .fn = bench_adapt_update,       .runs = 100 },
+    { .name = "alarm_update",       .fn = bench_alarm_update,       .runs = 100 },
+    { .name = "notify_due",         .fn = bench_notify_due,         .runs = 100 },
+    { .name = "plan_compile",       .fn = bench_plan_compile,       .runs = 100 },
+    { .name = "plan_run",           .fn = bench_plan_run,           .runs = 100 },
+    { .name = "frame_encode",       .fn = bench_frame_encode,       .runs = 1000 },
+    { .name = "frame_decode",       .fn = bench_frame_decode,       .runs = 1000 },
+    { .name = "codec_varint_enc",   .fn = bench_varint_enc,         .runs = 1000 },
+    { .name = "codec_varint_dec",   .fn = bench_varint_dec,         .runs = 1000 },
+    { .name = "codec_s8b_enc",      .fn = bench_s8b_enc,            .runs = 1000 },
+    { .name = "codec_s8b_dec",      .fn = bench_s8b_dec,            .runs = 1000 },
+};
+
+int main(int argc, char **argv) {
+    const char *name = argc > 1 ? argv[1] : NULL;
+
+    FAKES_reset();
+    HAL_ADC_init(kHalAdcVoltage);
+    HAL_ADC_init(kHalAdcCurrent);
+    HAL_ADC_init(kHalAdcCurrentRef);
+    FAKE_ADC_set_voltage(kHalAdcVoltage, 1800);
+    // outputs off, burden sits at the doubled reference
+    FAKE_ADC_set_voltage(kHalAdcCurrent, 1600);
+    CT_CORE_zero_update(&ctx.zero, HAL_ADC_read_raw(kHalAdcCurrent), 1, 0);
+    FAKE_ADC_set_voltage(kHalAdcCurrent, 1700);
+    FAKE_ADC_set_voltage(kHalAdcCurrentRef, 800);
+
+    const int pins[] = { 12, 13, 14, 15, 16, 17, 18, 19 };
+    RELAY_CORE_configure(&ctx.bank, pins, sizeof(pins) / sizeof(pins[0]));
+
+    ctx.trace.enabled = true;
+
+    DECIM_CORE_design(&ctx.decim, 3, 50, 21, 0.2f);
+    for (unsigned channel = 0; channel < 2; ++channel)
+        DECIM_CORE_init(&ctx.filters[channel], &ctx.decim);
+    for (unsigned i = 0; i < 64 * 2; ++i)
+        ctx.frames[i] = 2000 + (i * 37) % 64;
+
+    fill_ripple(ctx.signal, SPECTRUM_MAX_SAMPLES, 0.05f);
+    bench_plan_compile(NULL);
+    // 9 byte records of a slow ramp, zeros and small values like real samples
+    for (unsigned i = 0; i < sizeof(ctx.packet); ++i)
+        ctx.packet[i] = i % 9 == 0 ? i % 4 : i % 9 < 5 ? (i % 9 == 1 ? 100 : 0) : (i % 9 == 5 ? 2000 + i : 0) & 0xFF;
+    bench_frame_encode(NULL);
+    for (unsigned i = 0; i < 64; ++i)
+        ctx.values[i] = 12000 + i / 8 + (int32_t)(i * 7919 % 7) - 3;
+
+    if (name != NULL && strcmp(name, "response") == 0)
+        return print_response() ? 0 : 1;
+    if (name != NULL && strcmp(name, "spectrum") == 0)
+        return print_spectrum() ? 0 : 1;
+
+    printf("BENCH,name,runs,min,median,p99,max,median_ns\n");
+    for (unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        if (name != NULL && strcmp(name, cases[i].name) != 0)
+            continue;
+
+        BenchResult result;
+        if (BENCH_CORE_run(&cases[i], cases[i].runs, ctx.samples, &result) == false)
+            continue;
+
+        char line[96];
+        BENCH_CORE_format(&result, line, sizeof(line));
+        printf("%s\n", line);
+    }
+    printf("BENCH END\n");
+    return 0;
+}
@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "modules/base/codec.h"
+
+// Round trip and throughput of the sample codec, with the size against int32
+// and against the decimal text the CLI and BLE values use.
+//   controller_codec                   built in voltage, current, temperature and capture records
+//   controller_codec samples.csv       tools/datalog_reader.py or tools/stream_capture.py output,
+//                                      one block per channel, channel and value in the last two columns
+
+#define MAX_VALUES 200000
+#define MAX_CHANNELS 16
+#define MIN_TIMING_NS 20000000      // repeat each pass for at least 20 ms
+
+typedef size_t (*EncodeFn)(const int32_t *, unsigned, int32_t, uint8_t *, size_t, unsigned *);
+typedef size_t (*DecodeFn)(const uint8_t *, size_t, int32_t, int32_t *, unsigned);
+
+typedef struct {
+    char name[32];
+    int32_t *values;
+    unsigned count;
+} Block;
+
+static struct {
+    Block blocks[MAX_CHANNELS];
+    unsigned block_count;
+    int32_t decoded[MAX_VALUES];
+    uint8_t coded[MAX_VALUES * CODEC_SIMPLE8B_WORD];
+    uint32_t noise;
+} ctx = { .noise = 12345 };
+
+static int64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// small deterministic noise in [-amplitude, amplitude]
+static int32_t noise(int32_t amplitude) {
+    ctx.noise = ctx.noise * 1103515245 + 12345;
+    return (int32_t)((ctx.noise >> 16) % (2 * amplitude + 1)) - amplitude;
+}
+
+static Block *add_block(const char *name) {
+    if (ctx.block_count == MAX_CHANNELS)
+        return NULL;
+
+    Block *block = &ctx.blocks[ctx.block_count++];
+    snprintf(block->name, sizeof(block->name), "%s", name);
+    block->values = calloc(MAX_VALUES, sizeof(int32_t));
+    return block->values != NULL ? block : NULL;
+}
+
+static void profiles(void) {
+    // 6 h of 1 Hz 'adc' readings, mV: slow discharge, a few counts of noise
+    Block *voltage = add_block("voltage_mV");
+    for (unsigned i = 0; i < 6 * 3600; ++i)
+        voltage->values[voltage->count++] = 12600 - i * 1500 / (6 * 3600) + noise(4);
+
+    // mA, PWM load switched every 30 s
+    Block *current = add_block("current_mA");
+    for (unsigned i = 0; i < 6 * 3600; ++i)
+        current->values[current->count++] = (i / 30 % 2 ? 4200 : 150) + noise(12);
+
+    // 0.01 C, 1/16 C sensor steps
+    Block *temperature = add_block("temperature_cC");
+    for (unsigned i = 0; i < 6 * 3600; ++i) {
+        float celsius = 22 + 8 * sinf(2 * (float)M_PI * i / (6 * 3600)) + noise(1) / 16.0f;
+        temperature->values[temperature->count++] = (int32_t)(roundf(celsius * 16) * 100 / 16);
+    }
+
+    // 10 kHz 'capture' codes of the current channel, 50 Hz ripple
+    Block *capture = add_block("capture_codes");
+    for (unsigned i = 0; i < 16384; ++i) {
+        double phase = 2 * M_PI * 50 * i / 10000;
+        capture->values[capture->count++] = (int32_t)(2000 + 100 * sin(phase) + 10 * sin(2 * phase + 0.3)) + noise(3);
+    }
+}
+
+static Block *find_block(const char *name) {
+    for (unsigned i = 0; i < ctx.block_count; ++i) {
+        if (strcmp(ctx.blocks[i].name, name) == 0)
+            return &ctx.blocks[i];
+    }
+    return add_block(name);
+}
+
+static bool load(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return false;
+
+    char line[256];
+    unsigned total = 0;
+    while (fgets(line, sizeof(line), file) != NULL && total < MAX_VALUES) {
+        char *value = strrchr(line, ',');
+        if (value == NULL)
+            continue;
+        *value++ = '\0';
+
+        char *end;
+        long number = strtol(value, &end, 10);
+        if (end == value)
+            continue;
+
+        char *channel = strrchr(line, ',');
+        Block *block = find_block(channel != NULL ? channel + 1 : line);
+        if (block == NULL || block->count == MAX_VALUES)
+            continue;
+        block->values[block->count++] = (int32_t)number;
+        total += 1;
+    }
+    fclose(file);
+    return total > 0;
+}
+
+static size_t text_size(const Block *block) {
+    size_t size = 0;
+    char buffer[16];
+    for (unsigned i = 0; i < block->count; ++i)
+        size += snprintf(buffer, sizeof(buffer), "%d,", block->values[i]);
+    return size;
+}
+
+// MB/s of int32 input, false when the block doesn't survive the round trip
+static bool measure(const Block *block, EncodeFn encode, DecodeFn decode, size_t *size, double *encode_rate,
+                    double *decode_rate) {
+    const double bytes = (double)block->count * sizeof(int32_t);
+    unsigned encoded = 0;
+    unsigned runs = 0;
+    int64_t start = now_ns();
+    int64_t elapsed;
+    do {
+        *size = encode(block->values, block->count, 0, ctx.coded, sizeof(ctx.coded), &encoded);
+        runs += 1;
+        elapsed = now_ns() - start;
+    } while (elapsed < MIN_TIMING_NS);
+    *encode_rate = bytes * runs / elapsed * 1000;
+
+    size_t used = 0;
+    runs = 0;
+    start = now_ns();
+    do {
+        used = decode(ctx.coded, *size, 0, ctx.decoded, block->count);
+        runs += 1;
+        elapsed = now_ns() - start;
+    } while (elapsed < MIN_TIMING_NS);
+    *decode_rate = bytes * runs / elapsed * 1000;
+
+    return encoded == block->count && used == *size
+           && memcmp(ctx.decoded, block->values, block->count * sizeof(int32_t)) == 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && load(argv[1]) == false) {
+        fprintf(stderr, "no values in %s\n", argv[1]);
+        return 1;
+    }
+    if (argc == 1)
+        profiles();
+
+    bool ok = true;
+    printf("CODEC,name,values,text_bytes,int32_bytes,varint_bytes,simple8b_bytes,varint_ratio,simple8b_ratio,"
+           "varint_enc_MBps,varint_dec_MBps,simple8b_enc_MBps,simple8b_dec_MBps\n");
+    for (unsigned i = 0; i < ctx.block_count; ++i) {
+        const Block *block = &ctx.blocks[i];
+        if (block->count == 0)
+            continue;
+
+        size_t varint;
+        size_t simple8b;
+        double rates[4];
+        bool same = measure(block, CODEC_encode_varint, CODEC_decode_varint, &varint, &rates[0], &rates[1]);
+        same &= measure(block, CODEC_encode_simple8b, CODEC_decode_simple8b, &simple8b, &rates[2], &rates[3]);
+        if (same == false)
+            printf("CODEC round trip of %s FAILED\n", block->name);
+        ok &= same;
+
+        const double raw = (double)block->count * sizeof(int32_t);
+        printf("CODEC,%s,%u,%zu,%.0f,%zu,%zu,%.2f,%.2f,%.0f,%.0f,%.0f,%.0f\n", block->name, block->count,
+               text_size(block), raw, varint, simple8b, raw / varint, raw / simple8b, rates[0], rates[1], rates[2],
+               rates[3]);
+    }
+
+    printf("CODEC round trip %s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,73 @@
+#include "fakes.h"
+
+#include "modules/hal/hal_adc.h"
+#include "modules/hal/hal_time.h"
+
+#define FAKE_ADC_FULL_SCALE 3100    // mV at 11 dB attenuation
+#define FAKE_ADC_MAX_VALUE 4095
+
+static struct {
+    struct {
+        bool initialized;
+        Millivolt voltage;
+        FakeAdcSource source;
+        void *arg;
+        unsigned reads;
+    } channels[kHalAdcLastChannel];
+} ctx = { 0 };
+
+void FAKE_ADC_reset(void) {
+    for (unsigned i = 0; i < kHalAdcLastChannel; ++i) {
+        ctx.channels[i].voltage = 0;
+        ctx.channels[i].source = NULL;
+        ctx.channels[i].reads = 0;
+    }
+}
+
+void FAKE_ADC_set_voltage(HalAdcChannel channel, Millivolt voltage) {
+    ctx.channels[channel].voltage = voltage;
+    ctx.channels[channel].source = NULL;
+}
+
+void FAKE_ADC_set_source(HalAdcChannel channel, FakeAdcSource source, void *arg) {
+    ctx.channels[channel].source = source;
+    ctx.channels[channel].arg = arg;
+}
+
+unsigned FAKE_ADC_get_reads(HalAdcChannel channel) {
+    return ctx.channels[channel].reads;
+}
+
+bool HAL_ADC_init(HalAdcChannel channel) {
+    ctx.channels[channel].initialized = true;
+    return true;
+}
+
+int HAL_ADC_read_raw(HalAdcChannel channel) {
+    Millivolt voltage = ctx.channels[channel].voltage;
+    if (ctx.channels[channel].source != NULL)
+        voltage = ctx.channels[channel].source(HAL_TIME_now(), ctx.channels[channel].arg);
+
+    ctx.channels[channel].reads += 1;
+    if (voltage <= 0)
+        return 0;
+    if (voltage >= FAKE_ADC_FULL_SCALE)
+        return FAKE_ADC_MAX_VALUE;
+    return (voltage * FAKE_ADC_MAX_VALUE + FAKE_ADC_FULL_SCALE / 2) / FAKE_ADC_FULL_SCALE;
+}
+
+Millivolt HAL_ADC_raw_to_voltage(HalAdcChannel channel, int raw) {
+    if (ctx.channels[channel].initialized == false)
+        return 0;
+    return (raw * FAKE_ADC_FULL_SCALE + FAKE_ADC_MAX_VALUE / 2) / FAKE_ADC_MAX_VALUE;
+}
+
+void HAL_ADC_deinit(HalAdcChannel channel) {
+    ctx.channels[channel].initialized = false;
+}
+
+bool HAL_ADC_ulp_enable(HalAdcChannel channel, unsigned *ulp_channel) {
+    ctx.channels[channel].initialized = false;
+    *ulp_channel = channel;
+    return channel == kHalAdcVoltage;
+}
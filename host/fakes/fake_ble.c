@@ -0,0 +1,69 @@
+#include "fakes.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "modules/ble.h"
+
+#define FAKE_BLE_VALUE_SIZE 128
+#define FAKE_BLE_PAYLOAD_SIZE 20    // default ATT MTU 23 without the notification header
+
+static struct {
+    CharacteristicCallback callbacks[kLastChr];
+    char values[kLastChr][FAKE_BLE_VALUE_SIZE];
+    unsigned notifications[kLastChr];
+} ctx = { 0 };
+
+void FAKE_BLE_reset(void) {
+    for (unsigned i = 0; i < kLastChr; ++i) {
+        ctx.values[i][0] = '\0';
+        ctx.notifications[i] = 0;
+    }
+}
+
+void FAKE_BLE_write(Characteristic name, const char *text) {
+    char buffer[FAKE_BLE_VALUE_SIZE];
+    snprintf(buffer, sizeof(buffer), "%s", text);
+    if (ctx.callbacks[name] != NULL)
+        ctx.callbacks[name](buffer, strlen(buffer));
+}
+
+const char *FAKE_BLE_get_value(Characteristic name) {
+    return ctx.values[name];
+}
+
+unsigned FAKE_BLE_get_notifications(Characteristic name) {
+    return ctx.notifications[name];
+}
+
+bool BLE_init(void) {
+    return true;
+}
+
+void BLE_setup_characteristic_callback(Characteristic name, CharacteristicCallback callback) {
+    ctx.callbacks[name] = callback;
+}
+
+void BLE_update_value(Characteristic name, char *buffer) {
+    snprintf(ctx.values[name], FAKE_BLE_VALUE_SIZE, "%s", buffer);
+    ctx.notifications[name] += 1;
+}
+
+bool BLE_notify_raw(Characteristic name, const uint8_t *data, unsigned length) {
+    // NimBLE cuts notifications down to the payload size, the last one is kept for inspection
+    if (length > FAKE_BLE_PAYLOAD_SIZE)
+        length = FAKE_BLE_PAYLOAD_SIZE;
+
+    memcpy(ctx.values[name], data, length);
+    ctx.values[name][length] = '\0';
+    ctx.notifications[name] += 1;
+    return true;
+}
+
+bool BLE_stream_raw(Characteristic name, const uint8_t *data, unsigned length) {
+    return BLE_notify_raw(name, data, length);
+}
+
+unsigned BLE_get_payload_size(void) {
+    return FAKE_BLE_PAYLOAD_SIZE;
+}
@@ -0,0 +1,35 @@
+#include "fakes.h"
+
+#include <string.h>
+
+#include "modules/hal/hal_gpio.h"
+
+#define FAKE_GPIO_COUNT 40
+
+static FakeGpio ctx = { 0 };
+
+void FAKE_GPIO_reset(void) {
+    memset(&ctx, 0, sizeof(ctx));
+}
+
+const FakeGpio *FAKE_GPIO_get(void) {
+    return &ctx;
+}
+
+bool HAL_GPIO_is_valid_output(int pin) {
+    // GPIO34-39 are input only on the ESP32
+    return pin >= 0 && pin < 34;
+}
+
+bool HAL_GPIO_config_outputs(uint64_t pin_mask) {
+    if (pin_mask >> FAKE_GPIO_COUNT)
+        return false;
+
+    ctx.outputs |= pin_mask;
+    return true;
+}
+
+void HAL_GPIO_write(uint32_t set, uint32_t clear) {
+    ctx.levels = (ctx.levels & ~clear) | set;
+    ctx.writes += 1;
+}
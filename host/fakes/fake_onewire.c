@@ -0,0 +1,41 @@
+#include "fakes.h"
+
+#include "modules/hal/hal_onewire.h"
+
+static struct {
+    float temperatures[HAL_ONEWIRE_MAX_DEVICES];
+    unsigned count;
+    bool initialized;
+} ctx = { 0 };
+
+void FAKE_ONEWIRE_reset(void) {
+    ctx.count = 0;
+}
+
+void FAKE_ONEWIRE_set(const float *temperatures, unsigned count) {
+    if (count > HAL_ONEWIRE_MAX_DEVICES)
+        count = HAL_ONEWIRE_MAX_DEVICES;
+
+    for (unsigned i = 0; i < count; ++i)
+        ctx.temperatures[i] = temperatures[i];
+    ctx.count = count;
+}
+
+unsigned HAL_ONEWIRE_init(int pin) {
+    ctx.initialized = true;
+    return ctx.count;
+}
+
+unsigned HAL_ONEWIRE_read(float *temperatures, unsigned max_count) {
+    if (ctx.initialized == false)
+        return 0;
+
+    unsigned count = ctx.count < max_count ? ctx.count : max_count;
+    for (unsigned i = 0; i < count; ++i)
+        temperatures[i] = ctx.temperatures[i];
+    return count;
+}
+
+void HAL_ONEWIRE_deinit(void) {
+    ctx.initialized = false;
+}
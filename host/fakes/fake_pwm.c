@@ -0,0 +1,47 @@
+#include "fakes.h"
+
+#include <string.h>
+
+#include "modules/hal/hal_pwm.h"
+
+static FakePwm ctx = { 0 };
+
+void FAKE_PWM_reset(void) {
+    memset(&ctx, 0, sizeof(ctx));
+}
+
+const FakePwm *FAKE_PWM_get(void) {
+    return &ctx;
+}
+
+bool HAL_PWM_init(int pin, Herz freq, unsigned resolution_bits) {
+    ctx.pin = pin;
+    ctx.freq = freq;
+    ctx.resolution_bits = resolution_bits;
+    ctx.duty = 0;
+    return true;
+}
+
+bool HAL_PWM_set_freq(Herz freq) {
+    if (freq == 0)
+        return false;
+
+    ctx.freq = freq;
+    return true;
+}
+
+bool HAL_PWM_set_duty(uint32_t duty) {
+    if (duty >= (1UL << ctx.resolution_bits))
+        return false;
+
+    ctx.duty = duty;
+    ctx.running = true;
+    ctx.updates += 1;
+    return true;
+}
+
+bool HAL_PWM_stop(void) {
+    ctx.running = false;
+    ctx.duty = 0;
+    return true;
+}
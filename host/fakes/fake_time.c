@@ -0,0 +1,42 @@
+#include "fakes.h"
+
+#include <time.h>
+
+#include "modules/hal/hal_time.h"
+
+static struct {
+    int64_t now;
+} ctx = { 0 };
+
+void FAKE_TIME_set(int64_t now) {
+    ctx.now = now;
+}
+
+void FAKE_TIME_advance(int64_t delta) {
+    ctx.now += delta;
+}
+
+int64_t HAL_TIME_now(void) {
+    return ctx.now;
+}
+
+void HAL_TIME_delay_ms(Milliseconds delay) {
+    ctx.now += (int64_t)delay * 1000;
+}
+
+int64_t HAL_TIME_wait_until(int64_t deadline) {
+    if (ctx.now < deadline)
+        ctx.now = deadline;
+    return ctx.now;
+}
+
+uint32_t HAL_TIME_cycles(void) {
+    // wall clock, benchmarks measure real work and must not see the virtual time
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec);
+}
+
+uint32_t HAL_TIME_cycles_per_us(void) {
+    return 1000;
+}
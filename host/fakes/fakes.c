@@ -0,0 +1,10 @@
+#include "fakes.h"
+
+void FAKES_reset(void) {
+    FAKE_TIME_set(0);
+    FAKE_ADC_reset();
+    FAKE_GPIO_reset();
+    FAKE_PWM_reset();
+    FAKE_ONEWIRE_reset();
+    FAKE_BLE_reset();
+}
@@ -0,0 +1,56 @@
+#ifndef FAKES_H
+#define FAKES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/base/types.h"
+#include "modules/ble.h"
+#include "modules/hal/hal_adc.h"
+
+// pin voltage of an ADC channel as a function of virtual time [us]
+typedef Millivolt (*FakeAdcSource)(int64_t now, void *arg);
+
+void FAKE_ADC_set_voltage(HalAdcChannel channel, Millivolt voltage);
+void FAKE_ADC_set_source(HalAdcChannel channel, FakeAdcSource source, void *arg);
+unsigned FAKE_ADC_get_reads(HalAdcChannel channel);
+
+// virtual clock, every HAL delay advances it instead of sleeping
+void FAKE_TIME_set(int64_t now);
+void FAKE_TIME_advance(int64_t delta);
+
+typedef struct {
+    uint64_t outputs;           // pins configured as outputs
+    uint32_t levels;            // GPIO0-31 output levels
+    unsigned writes;
+} FakeGpio;
+
+const FakeGpio *FAKE_GPIO_get(void);
+
+typedef struct {
+    bool running;
+    int pin;
+    Herz freq;
+    unsigned resolution_bits;
+    uint32_t duty;
+    unsigned updates;
+} FakePwm;
+
+const FakePwm *FAKE_PWM_get(void);
+
+void FAKE_ONEWIRE_set(const float *temperatures, unsigned count);
+
+// runs the characteristic callback as if a client wrote the text
+void FAKE_BLE_write(Characteristic name, const char *text);
+const char *FAKE_BLE_get_value(Characteristic name);
+unsigned FAKE_BLE_get_notifications(Characteristic name);
+
+void FAKE_ADC_reset(void);
+void FAKE_GPIO_reset(void);
+void FAKE_PWM_reset(void);
+void FAKE_ONEWIRE_reset(void);
+void FAKE_BLE_reset(void);
+// all of the above and the virtual clock back to 0
+void FAKES_reset(void);
+
+#endif // FAKES_H
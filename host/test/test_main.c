@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "fakes.h"
+
+#include "modules/base/generic_fun.h"
+#include "modules/core/adc_core.h"
+#include "modules/core/calib_core.h"
+#include "modules/core/ct_core.h"
+#include "modules/core/pwm_core.h"
+#include "modules/core/relay_core.h"
+#include "modules/hal/hal_adc.h"
+
+// unit checks of the core math and protocol parsers against the fakes, run by ctest
+//   controller_test            every group
+//   controller_test <group>    one group, see kGroups
+
+static struct {
+    unsigned checks;
+    unsigned failures;
+} ctx = { 0 };
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+#define CHECK_NEAR(value, expected, tolerance) \
+    check(fabs((double)(value) - (double)(expected)) <= (tolerance), #value " ~ " #expected, __FILE__, __LINE__)
+#define CHECK_STR(value, expected) check(strcmp((value), (expected)) == 0, #value " == " #expected, __FILE__, __LINE__)
+
+static void check(bool passed, const char *text, const char *file, int line) {
+    ctx.checks += 1;
+    if (passed)
+        return;
+
+    ctx.failures += 1;
+    printf("FAIL %s:%d %s\n", file, line, text);
+}
+
+static void setup_adc(void) {
+    FAKES_reset();
+    HAL_ADC_init(kHalAdcVoltage);
+    HAL_ADC_init(kHalAdcCurrent);
+    HAL_ADC_init(kHalAdcCurrentRef);
+}
+
+static void test_parse_unsigned_list(void) {
+    unsigned values[4] = { 0 };
+    CHECK(ParseUnsignedList("1,30,50,1000", values, 4, 10) == 4);
+    CHECK(values[0] == 1 && values[1] == 30 && values[2] == 50 && values[3] == 1000);
+
+    CHECK(ParseUnsignedList("0x10,017,9", values, 4, 0) == 3);
+    CHECK(values[0] == 16 && values[1] == 15 && values[2] == 9);
+
+    // leading and repeated separators are skipped, parsing stops at the first non number
+    CHECK(ParseUnsignedList(",,5,,6", values, 4, 10) == 2);
+    CHECK(values[0] == 5 && values[1] == 6);
+    CHECK(ParseUnsignedList("7,x,8", values, 4, 10) == 1);
+    CHECK(ParseUnsignedList("", values, 4, 10) == 0);
+    CHECK(ParseUnsignedList("abc", values, 4, 10) == 0);
+
+    // never more than max_values
+    values[2] = 99;
+    CHECK(ParseUnsignedList("1,2,3", values, 2, 10) == 2);
+    CHECK(values[2] == 99);
+
+    CHECK(AreStringsTheSame("dump packed", "dump packed", sizeof("dump packed")));
+    CHECK(AreStringsTheSame("dump", "dump packed", strlen("dump")));
+    CHECK(AreStringsTheSame("dump", "dum", sizeof("dump")) == false);
+}
+
+static void test_pwm_parse(void) {
+    PwmCommand command;
+    CHECK(PWM_CORE_parse_ble_command("1,30,50,1000", &command));
+    CHECK(command.force && command.duration == 30 && command.duty == 50 && command.freq == 1000);
+
+    CHECK(PWM_CORE_parse_ble_command("0,0,25", &command));
+    CHECK(command.force == false && command.duty == 25 && command.freq == 0);
+    CHECK(PWM_CORE_parse_ble_command("", &command) == false);
+    CHECK(PWM_CORE_parse_ble_command("on", &command) == false);
+
+    CHECK(PWM_CORE_duty_from_percent(0, 10) == 0);
+    CHECK(PWM_CORE_duty_from_percent(50, 10) == 511);
+    CHECK(PWM_CORE_duty_from_percent(100, 10) == 1023);
+    CHECK(PWM_CORE_duty_from_percent(150, 10) == 1023);
+}
+
+static void test_relay_parse(void) {
+    RelaySeqStep steps[4];
+    CHECK(RELAY_CORE_parse_pattern("1:50000,0:20000", steps, 4) == 2);
+    CHECK(steps[0].state && steps[0].hold == 50000);
+    CHECK(steps[1].state == false && steps[1].hold == 20000);
+    CHECK(RELAY_CORE_parse_pattern("1:10,0:10,1:10,0:10,1:10", steps, 4) == 4);
+    CHECK(RELAY_CORE_parse_pattern("1-50000", steps, 4) == 0);
+    CHECK(RELAY_CORE_parse_pattern("1:", steps, 4) == 0);
+
+    int pins[RELAY_MAX_OUTPUTS];
+    CHECK(RELAY_CORE_parse_pins("14,27", pins, RELAY_MAX_OUTPUTS) == 2);
+    CHECK(pins[0] == 14 && pins[1] == 27);
+    CHECK(RELAY_CORE_parse_pins("x", pins, RELAY_MAX_OUTPUTS) == 0);
+
+    FAKES_reset();
+    RelayBank bank = { 0 };
+    const int bank_pins[] = { 12, 13, 14 };
+    CHECK(RELAY_CORE_configure(&bank, bank_pins, 3));
+    CHECK(RELAY_CORE_all_outputs(&bank) == 0x7);
+    CHECK(RELAY_CORE_set_mask(&bank, 0x5, 0x5));
+    CHECK(bank.state == 0x5);
+    CHECK((FAKE_GPIO_get()->levels & ((1U << 12) | (1U << 14))) == ((1U << 12) | (1U << 14)));
+    // a bit outside the bank changes nothing
+    CHECK(RELAY_CORE_set_mask(&bank, 0x8, 0x8) == false);
+    CHECK(bank.state == 0x5);
+}
+
+static void test_adc(void) {
+    setup_adc();
+    AdcCoreConfig config = { .resistor_r1 = 1500, .resistor_r2 = 8300, .samples = 10, .step = 1 };
+    CALIB_CORE_identity(&config.model);
+
+    // divider only: 1000 mV at the pin is 1000 * 9800 / 1500 at the input
+    CHECK(ADC_CORE_to_input_voltage(&config, 1000) == 6533);
+
+    // one fake ADC code is about 0.76 mV at the pin, 5 mV at the input
+    FAKE_ADC_set_voltage(kHalAdcVoltage, 1800);
+    CHECK_NEAR(ADC_CORE_read_uncorrected(&config), 11760, 10);
+    CHECK_NEAR(ADC_CORE_read(&config), 11760, 10);
+    CHECK(FAKE_ADC_get_reads(kHalAdcVoltage) == 2 * config.samples);
+
+    // the model corrects on top of the divider
+    config.model.coeffs[0] = -50;
+    CHECK_NEAR(ADC_CORE_read(&config), 11710, 10);
+    CHECK_NEAR(ADC_CORE_read_single(&config), 11710, 10);
+
+    // fractional codes interpolate between the neighbouring ones
+    CalibModel identity;
+    CALIB_CORE_identity(&identity);
+    config.model = identity;
+    float low = ADC_CORE_counts_to_input(&config, 2000);
+    float high = ADC_CORE_counts_to_input(&config, 2001);
+    CHECK_NEAR(ADC_CORE_counts_to_input(&config, 2000.5f), (low + high) / 2, 0.01);
+}
+
+static void test_ct(void) {
+    setup_adc();
+    CtCoreConfig config = { .ratio = 4, .step = 0.0125f, .samples = 10, .sample_step = 1 };
+    CALIB_CORE_identity(&config.model);
+
+    // 100 mV over the doubled reference through 4 * 12.5 mV/A
+    CHECK_NEAR(CT_CORE_to_current(&config, 1.7f, 0.8f), 2.0, 0.001);
+    CHECK_NEAR(CT_CORE_to_current(&config, 1.5f, 0.8f), 2.0, 0.001);
+
+    // without a zero both channels are read and the result is a magnitude
+    FAKE_ADC_set_voltage(kHalAdcCurrent, 1700);
+    FAKE_ADC_set_voltage(kHalAdcCurrentRef, 800);
+    CHECK_NEAR(CT_CORE_read(&config, NULL), 2.0, 0.05);
+
+    CtZero zero;
+    CT_CORE_zero_reset(&zero);
+    CHECK(CT_CORE_zero_valid(&zero) == false);
+    CHECK_NEAR(CT_CORE_read_uncorrected(&config, &zero), 2.0, 0.05);
+
+    // the first update seeds the zero, later ones move it by 1 / 2^shift
+    CT_CORE_zero_update(&zero, 1000 * 4, 4, 2);
+    CHECK(CT_CORE_zero_valid(&zero));
+    CHECK(zero.offset == 1000 << CT_ZERO_FRACTION_BITS);
+    CT_CORE_zero_update(&zero, 1100 * 4, 4, 2);
+    CHECK(zero.offset == 1025 << CT_ZERO_FRACTION_BITS);
+
+    // with a zero only the burden is read and the result is signed
+    FAKE_ADC_set_voltage(kHalAdcCurrent, 1600);
+    CT_CORE_zero_reset(&zero);
+    CT_CORE_zero_update(&zero, HAL_ADC_read_raw(kHalAdcCurrent), 1, 0);
+    unsigned ref_reads = FAKE_ADC_get_reads(kHalAdcCurrentRef);
+    FAKE_ADC_set_voltage(kHalAdcCurrent, 1700);
+    CHECK_NEAR(CT_CORE_read(&config, &zero), 2.0, 0.05);
+    FAKE_ADC_set_voltage(kHalAdcCurrent, 1500);
+    CHECK_NEAR(CT_CORE_read(&config, &zero), -2.0, 0.05);
+    CHECK(FAKE_ADC_get_reads(kHalAdcCurrentRef) == ref_reads);
+
+    // the zero is removed before the model, a0 only adds the residual offset
+    float counts = HAL_ADC_read_raw(kHalAdcCurrent);
+    CHECK_NEAR(CT_CORE_counts_to_current(&config, &zero, counts), -2.0, 0.05);
+    config.model.coeffs[0] = 0.1f;
+    CHECK_NEAR(CT_CORE_counts_to_current(&config, &zero, counts), -1.9, 0.05);
+    FAKE_ADC_set_voltage(kHalAdcCurrent, 1600);
+    CHECK_NEAR(CT_CORE_counts_to_current(&config, &zero, HAL_ADC_read_raw(kHalAdcCurrent)), 0.1, 0.001);
+}
+
+static void test_ble_format(void) {
+    // same buffer size as the acquisition loops
+    char buffer[11 + 11 + 11 + 11];
+    CHECK(ADC_CORE_format_ble(buffer, sizeof(buffer), 12034, 12810, 11502, 12001) == 23);
+    CHECK_STR(buffer, "12034,12810,11502,12001");
+    ADC_CORE_format_ble(buffer, sizeof(buffer), -5, 0, -2147483647, 2147483647);
+    CHECK_STR(buffer, "-5,0,-2147483647,2147483647");
+
+    CHECK(CT_CORE_format_ble(buffer, sizeof(buffer), 1.254f, 2.5f, -0.1f, 1.0f) == 20);
+    CHECK_STR(buffer, "1.25,2.50,-0.10,1.00");
+
+    // a short buffer truncates, never overflows
+    char small[8];
+    memset(small, 'x', sizeof(small));
+    CHECK(ADC_CORE_format_ble(small, sizeof(small), 12034, 12810, 11502, 12001) == 23);
+    CHECK_STR(small, "12034,1");
+}
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+} TestGroup;
+
+static const TestGroup kGroups[] = {
+    { "parse",      test_parse_unsigned_list },
+    { "pwm",        test_pwm_parse },
+    { "relay",      test_relay_parse },
+    { "adc",        test_adc },
+    { "ct",         test_ct },
+    { "ble_format", test_ble_format },
+};
+
+int main(int argc, char **argv) {
+    const char *name = argc > 1 ? argv[1] : NULL;
+
+    unsigned groups = 0;
+    for (unsigned i = 0; i < sizeof(kGroups) / sizeof(kGroups[0]); ++i) {
+        if (name != NULL && strcmp(name, kGroups[i].name) != 0)
+            continue;
+
+        unsigned failures = ctx.failures;
+        kGroups[i].run();
+        groups += 1;
+        printf("TEST %s %s\n", kGroups[i].name, ctx.failures == failures ? "ok" : "FAILED");
+    }
+
+    if (groups == 0) {
+        printf("Unknown test group: %s\n", name);
+        return 1;
+    }
+    printf("TEST END %u checks, %u failures\n", ctx.checks, ctx.failures);
+    return ctx.failures == 0 ? 0 : 1;
+}
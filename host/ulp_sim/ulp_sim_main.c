@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "modules/core/ulp_core.h"
+
+// Runs the ULP sampling program the firmware loads, one timer run per sample,
+// and checks its records and wakeups against a plain C model of the same rules.
+//   controller_ulp_sim                 built in discharge profile with a dip and a spike
+//   controller_ulp_sim samples.txt     raw ADC counts, one per line
+
+#define MAX_SAMPLES 100000
+
+static const UlpSettings kSettings = {
+    .low = 1900, .low_clear = 1950,
+    .high = 2800, .high_clear = 2750,
+    .interval = 60, .batch = 30,
+};
+
+static struct {
+    uint16_t samples[MAX_SAMPLES];
+    unsigned count;
+    unsigned index;
+    unsigned conversion;
+    uint32_t memory[kUlpVarLastWord];
+    UlpOp ops[ULP_MAX_OPS];
+} ctx;
+
+// the model the program has to match
+static struct {
+    uint8_t level;
+    uint16_t min;
+    uint16_t max;
+    unsigned ticks;
+    uint16_t records[ULP_RECORDS][3];
+    unsigned count;
+    unsigned dropped;
+    unsigned wake;
+} model = { .min = 0xFFFF };
+
+static void model_sample(uint16_t value) {
+    model.min = value < model.min ? value : model.min;
+    model.max = value > model.max ? value : model.max;
+
+    uint8_t level = model.level;
+    if (model.level == 0)
+        level = value < kSettings.low ? 1 : value > kSettings.high ? 2 : 0;
+    else if (model.level == 1 && value >= kSettings.low_clear)
+        level = 0;
+    else if (model.level == 2 && value <= kSettings.high_clear)
+        level = 0;
+    if (level != model.level)
+        model.wake |= kUlpWakeLevel;
+    model.level = level;
+
+    if (++model.ticks < kSettings.interval)
+        return;
+
+    if (model.count < ULP_RECORDS) {
+        model.records[model.count][0] = model.min;
+        model.records[model.count][1] = model.max;
+        model.records[model.count][2] = value;
+        model.count += 1;
+    } else {
+        model.dropped += 1;
+    }
+    model.ticks = 0;
+    model.min = 0xFFFF;
+    model.max = 0;
+    if (model.count >= kSettings.batch)
+        model.wake |= kUlpWakeBatch;
+}
+
+// the four conversions of a sample straddle the value, the average is exact
+static uint16_t adc(void *arg) {
+    uint16_t value = ctx.samples[ctx.index];
+    return ctx.conversion++ % 2 ? value + 1 : value - 1;
+}
+
+static void profile(void) {
+    // 6 h at one sample a second: slow discharge, a 5 s dip under the low limit, a 3 s spike
+    for (unsigned i = 0; i < 6 * 3600 && ctx.count < MAX_SAMPLES; ++i) {
+        uint16_t value = 2600 - i * 500 / (6 * 3600);
+        if (i >= 4000 && i < 4005)
+            value = 1700;
+        if (i >= 9000 && i < 9003)
+            value = 3000;
+        ctx.samples[ctx.count++] = value;
+    }
+}
+
+static bool load(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return false;
+
+    unsigned value;
+    while (ctx.count < MAX_SAMPLES && fscanf(file, "%u", &value) == 1)
+        ctx.samples[ctx.count++] = value > 4094 ? 4094 : value < 1 ? 1 : value;
+    fclose(file);
+    return ctx.count > 0;
+}
+
+static bool check_flush(unsigned sample) {
+    unsigned count = ULP_CORE_read(ctx.memory, kUlpVarCount);
+    bool same = count == model.count && ULP_CORE_read(ctx.memory, kUlpVarDropped) == model.dropped
+                && ULP_CORE_read(ctx.memory, kUlpVarWake) == model.wake
+                && ULP_CORE_read(ctx.memory, kUlpVarLevel) == model.level;
+    for (unsigned i = 0; same && i < count; ++i) {
+        for (unsigned word = 0; word < 3; ++word)
+            same &= ULP_CORE_read(ctx.memory, kUlpVarRecords + 3 * i + word) == model.records[i][word];
+    }
+    if (same == false)
+        printf("ULP mismatch at sample %u [records %u/%u] [wake %u/%u]\n", sample, count, model.count,
+               ULP_CORE_read(ctx.memory, kUlpVarWake), model.wake);
+    return same;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && load(argv[1]) == false) {
+        fprintf(stderr, "no samples in %s\n", argv[1]);
+        return 1;
+    }
+    if (argc == 1)
+        profile();
+
+    unsigned count = 0;
+    if (ULP_CORE_program(6, ctx.ops, ULP_MAX_OPS, &count) == false || ULP_CORE_validate(&kSettings) == false) {
+        fprintf(stderr, "program of %u ops or settings rejected\n", count);
+        return 1;
+    }
+    ULP_CORE_setup(ctx.memory, &kSettings);
+
+    unsigned wakeups[3] = { 0 };
+    uint32_t instructions = 0;
+    uint32_t max_instructions = 0;
+    bool ok = true;
+    for (ctx.index = 0; ctx.index < ctx.count && ok; ++ctx.index) {
+        UlpRun run;
+        if (ULP_CORE_simulate(ctx.ops, count, ctx.memory, adc, NULL, &run) == false) {
+            printf("ULP fault at sample %u\n", ctx.index);
+            return 1;
+        }
+        model_sample(ctx.samples[ctx.index]);
+        instructions += run.instructions;
+        max_instructions = run.instructions > max_instructions ? run.instructions : max_instructions;
+
+        if (run.woke != (model.wake != 0) || run.woke != run.timer_stopped) {
+            printf("ULP wakeup mismatch at sample %u\n", ctx.index);
+            return 1;
+        }
+        if (run.woke == false)
+            continue;
+
+        // the main CPU flushes, then starts the timer again
+        ok = check_flush(ctx.index);
+        unsigned wake = ULP_CORE_read(ctx.memory, kUlpVarWake);
+        wakeups[0] += 1;
+        wakeups[1] += (wake & kUlpWakeBatch) != 0;
+        wakeups[2] += (wake & kUlpWakeLevel) != 0;
+        if (wake & kUlpWakeLevel)
+            printf("ULP level %u at sample %u [value %u]\n", model.level, ctx.index, ctx.samples[ctx.index]);
+        ULP_CORE_clear_records(ctx.memory);
+        model.count = model.dropped = model.wake = 0;
+    }
+
+    printf("ULP [program %u ops] [samples %u] [wakeups %u: batch %u level %u] [instructions avg %u max %u] %s\n",
+           count, ctx.count, wakeups[0], wakeups[1], wakeups[2], ctx.count ? instructions / ctx.count : 0,
+           max_instructions, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -6,34 +6,80 @@
 
 #include "modules/ble.h"
 #include "modules/cli.c"
+#include "modules/adapt.h"
 #include "modules/adc.h"
+#include "modules/alarm.h"
+#include "modules/bench.h"
+#include "modules/calib.h"
+#include "modules/capture.h"
+#include "modules/config.h"
 #include "modules/ct.h"
+#include "modules/datalog.h"
+#include "modules/decim.h"
 #include "modules/ds_sensor.h"
+#include "modules/latency.h"
+#include "modules/plan.h"
+#include "modules/power.h"
 #include "modules/pwm.h"
 #include "modules/relay.h"
+#include "modules/relay_seq.h"
+#include "modules/ripple.h"
+#include "modules/rollup.h"
+#include "modules/soak.h"
+#include "modules/stats.h"
+#include "modules/step.h"
+#include "modules/stream.h"
+#include "modules/trace.h"
+#include "modules/ulp.h"
+#include "modules/worker.h"
 
 
 void app_main(void) {
     esp_log_level_set("*", ESP_LOG_DEBUG);
     CLI_init();
+    WORKER_init();
+    // NVS and stored calibration, before every module that reads it
+    if (CONFIG_init() == false)
+        ESP_LOGE("Starting", "Config not initilized, defaults used");
+    // PM locks exist before any module takes one
+    POWER_init();
+
+    // thresholds in place before the first sample
+    ALARM_init();
     CT_init();
     ADC_init();
     DS_SENSOR_init();
+    CAPTURE_init();
+    ROLLUP_init();
 
     if (RELAY_init() == false)
         ESP_LOGE("Starting", "Relay not initilized");
+    else
+        RELAY_SEQ_init();
 
     if (PWM_init() == false)
         ESP_LOGE("Starting", "PWM not initilized");
 
+    if (DATALOG_init() == false)
+        ESP_LOGE("Starting", "Datalog not initilized");
+
+    BENCH_init();
+    STATS_init();
+    TRACE_init();
+    LATENCY_init();
+    CALIB_init();
+    DECIM_init();
+    RIPPLE_init();
+    STEP_init();
+    PLAN_init();
+    SOAK_init();
+    STREAM_init();
+    // last, adapt.enabled starts the acquisition with every module in place
+    ADAPT_init();
+    // a ULP wakeup flushes its batch with every module up, then sleeps again
+    ULP_init();
+    // after every handler is registered, a write arriving before that is dropped by ble.c
     if (BLE_init() == false)
         ESP_LOGE("Starting", "Ble not initilized");
-
-    while (1) {
-        vTaskDelay(pdMS_TO_TICKS(2000));
-    }
-
-    CT_deinit();
-    ADC_deinit();
-    DS_SENSOR_deinit();
+    // every module runs on its own tasks, the main task ends here and its idle time can sleep
 }
@@ -0,0 +1,217 @@
+#include "modules/adapt.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "modules/base/generic_fun.h"
+#include "modules/cli.h"
+#include "modules/adc.h"
+#include "modules/alarm.h"
+#include "modules/config.h"
+#include "modules/ct.h"
+#include "modules/datalog.h"
+#include "modules/power.h"
+#include "modules/rollup.h"
+#include "modules/stats.h"
+#include "modules/stream.h"
+#include "modules/worker.h"
+
+// config set adapt.idle 5
+// config set adapt.enabled 1
+// config commit
+// adapt status
+
+static struct {
+    AdaptConfig config;
+    AdaptState state;
+    volatile bool ongoing;
+    volatile bool stop;
+    volatile bool command;      // PWM or relay command since the last sample
+    volatile Herz rate;
+    bool active;
+
+    uint32_t changes;
+    uint64_t samples;
+    int64_t start;
+    int64_t active_since;
+    int64_t active_time;        // us at the active rate, closed periods
+} ctx = { 0 };
+
+// the loop runs on the ADC read_for worker, a read_for and adapt exclude each other
+BUDGET_CHECK(sizeof(ctx), BUDGET_ADAPT);
+
+static unsigned sample(int64_t now, int32_t *values) {
+    unsigned valid = 1 << 0;
+    values[0] = ADC_counts_to_voltage(ADC_read_raw());
+    DATALOG_append(kDatalogVoltage, now, values[0]);
+    ROLLUP_add(kRollupVoltage, now, values[0]);
+    STATS_sample(kStatsVoltage, now);
+    ALARM_sample(kAlarmVoltage, now, values[0]);
+    STREAM_sample(kDatalogVoltage, now, values[0]);
+
+    Amper current;
+    if (CT_counts_to_current(CT_read_raw(), &current)) {
+        valid |= 1 << 1;
+        values[1] = current * 1000;
+        DATALOG_append(kDatalogCurrent, now, values[1]);
+        ROLLUP_add(kRollupCurrent, now, values[1]);
+        STATS_sample(kStatsCurrent, now);
+        ALARM_sample(kAlarmCurrent, now, values[1]);
+        STREAM_sample(kDatalogCurrent, now, values[1]);
+    }
+    return valid;
+}
+
+static void set_rate(int64_t now, bool active, Herz rate) {
+    // the idle rate leaves the chip to DFS and light sleep between samples
+    if (ctx.active && active == false) {
+        ctx.active_time += now - ctx.active_since;
+        POWER_unlock(kPowerCpu);
+    } else if (ctx.active == false && active) {
+        ctx.active_since = now;
+        POWER_lock(kPowerCpu);
+    }
+
+    ctx.active = active;
+    ctx.rate = rate;
+    // the stream carries the rate the following samples were taken at
+    DATALOG_append(kDatalogRate, now, rate);
+}
+
+static void run(void *arg) {
+    ADAPT_CORE_reset(&ctx.state);
+    ctx.changes = 0;
+    ctx.samples = 0;
+    ctx.active_time = 0;
+    ctx.start = esp_timer_get_time();
+    set_rate(ctx.start, false, ctx.config.idle_rate);
+    ulTaskNotifyTake(pdTRUE, 0);
+
+    TickType_t next = xTaskGetTickCount();
+    while (ctx.stop == false) {
+        int64_t now = esp_timer_get_time();
+        int32_t values[ADAPT_CHANNELS] = { 0 };
+        unsigned valid = sample(now, values);
+        ctx.samples += 1;
+
+        bool changed = ADAPT_CORE_update(&ctx.config, &ctx.state, now, values, valid);
+        if (ctx.command) {
+            ctx.command = false;
+            changed |= ADAPT_CORE_trigger(&ctx.config, &ctx.state, now);
+        }
+
+        TickType_t period = configTICK_RATE_HZ / ctx.rate;
+        if (changed) {
+            set_rate(now, ctx.state.active, ADAPT_CORE_rate(&ctx.config, &ctx.state));
+            ctx.changes += 1;
+            period = configTICK_RATE_HZ / ctx.rate;
+            // a new rate starts from now, no catching up on the old schedule
+            next = xTaskGetTickCount();
+        }
+
+        next += period > 0 ? period : 1;
+        TickType_t ticks = xTaskGetTickCount();
+        if ((int32_t)(next - ticks) <= 0) {
+            next = ticks;
+            continue;
+        }
+        // a command or a stop wakes the loop before the next sample is due
+        if (ulTaskNotifyTake(pdTRUE, next - ticks) > 0)
+            next = xTaskGetTickCount();
+    }
+
+    set_rate(esp_timer_get_time(), false, 0);
+    ctx.ongoing = false;
+}
+
+bool ADAPT_start(void) {
+    if (ctx.ongoing)
+        return false;
+
+    if (CT_has_zero() == false)
+        ESP_LOGW(__func__, "No CT zero yet, voltage only until 'ct zero now'");
+
+    ctx.stop = false;
+    ctx.command = false;
+    ctx.ongoing = true;
+    if (ADC_run(run, NULL) == false) {
+        ctx.ongoing = false;
+        return false;
+    }
+    return true;
+}
+
+void ADAPT_stop(void) {
+    if (ctx.ongoing == false)
+        return;
+
+    ctx.stop = true;
+    ADC_notify();
+}
+
+void ADAPT_notify_command(void) {
+    if (ctx.ongoing == false)
+        return;
+
+    ctx.command = true;
+    ADC_notify();
+}
+
+Herz ADAPT_get_rate(void) {
+    return ctx.ongoing ? ctx.rate : 0;
+}
+
+static void apply_config(const Config *config) {
+    // the loop reads the rates once per sample, a 32 bit store each
+    ctx.config = config->adapt.rates;
+    if (config->adapt.enabled && ctx.ongoing == false)
+        ADAPT_start();
+    else if (config->adapt.enabled == false)
+        ADAPT_stop();
+}
+
+static void log_status(void) {
+    if (ctx.ongoing == false) {
+        ESP_LOGI(__func__, "ADAPT: stopped");
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    int64_t active = ctx.active_time + (ctx.active ? now - ctx.active_since : 0);
+
+    ESP_LOGI(__func__, "ADAPT: [rate %" PRIu32 " Hz] [idle %" PRIu32 " Hz] [active %" PRIu32 " Hz] [changes %" PRIu32 "] [samples %" PRIu64 "] [active time %" PRId64 " of %" PRId64 " ms]",
+             ctx.rate, ctx.config.idle_rate, ctx.config.active_rate, ctx.changes, ctx.samples,
+             active / 1000, (now - ctx.start) / 1000);
+}
+
+static int adapt_command_execution(int argc, char **argv) {
+    if (argc == 1 || AreStringsTheSame("status", argv[1], sizeof("status"))) {
+        log_status();
+        return 0;
+    }
+
+    if (AreStringsTheSame("start", argv[1], sizeof("start"))) {
+        ESP_LOGI(__func__, "ADAPT: %s", ADAPT_start() ? "ongoing" : "errors occurs");
+        return 0;
+    }
+
+    if (AreStringsTheSame("stop", argv[1], sizeof("stop"))) {
+        ADAPT_stop();
+        return 0;
+    }
+
+    ESP_LOGW(__func__, "Unknown subcommand: %s", argv[1]);
+    return 0;
+}
+
+void ADAPT_init(void) {
+    CONFIG_register_listener(apply_config);
+    CLI_register_command("adapt", "[status] [start] [stop]", adapt_command_execution);
+}
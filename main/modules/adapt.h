@@ -0,0 +1,23 @@
+#ifndef ADAPT_H
+#define ADAPT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/base/types.h"
+#include "modules/core/adapt_core.h"
+
+void ADAPT_init(void);
+
+// continuous voltage and current acquisition, idle rate while the signals are stable
+// and the active rate after a change; adapt.enabled starts it at boot
+bool ADAPT_start(void);
+void ADAPT_stop(void);
+
+// PWM and relay commands switch to the active rate before their effect shows
+void ADAPT_notify_command(void);
+
+// 0 while stopped
+Herz ADAPT_get_rate(void);
+
+#endif // ADAPT_H
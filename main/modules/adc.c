@@ -3,22 +3,25 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "driver/gpio.h"
 #include "esp_log.h"
 
-#include "hal/adc_types.h"
-#include "esp_adc/adc_cali.h"
-#include "esp_adc/adc_cali_scheme.h"
-#include "esp_adc/adc_oneshot.h"
-
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
+#include "modules/alarm.h"
 #include "modules/cli.h"
 #include "modules/ble.h"
-
-// Define constants
-#define ADC_MAX_VALUE 4095
+#include "modules/config.h"
+#include "modules/datalog.h"
+#include "modules/power.h"
+#include "modules/rollup.h"
+#include "modules/stats.h"
+#include "modules/stream.h"
+#include "modules/trace.h"
+#include "modules/worker.h"
+#include "modules/core/adc_core.h"
+#include "modules/hal/hal_adc.h"
+#include "modules/hal/hal_time.h"
 
 typedef struct {
     Millivolt min;
@@ -28,27 +31,26 @@ typedef struct {
 
 static struct {
     bool interupt_measurements;
-    bool calibrated;
 
     bool ongoing;
     Seconds duration;
-    unsigned resistor_r1;
-    unsigned resistor_r2;
-
-    adc_oneshot_unit_handle_t adc1_handle;
-    adc_cali_handle_t  adc1_cali_handle;
-    adc_channel_t default_channel;
-    adc_atten_t default_atten;
-    adc_bitwidth_t default_width;
-} ctx = {
-    .resistor_r1        = 1500,
-    .resistor_r2        = 8300,
+    WorkerJob job;
+    void *job_arg;
 
-    .default_channel    = ADC_CHANNEL_6,
-    .default_atten      = ADC_ATTEN_DB_11,
-    .default_width      = ADC_BITWIDTH_DEFAULT
+    // written by the config listener, the read paths work on a copy taken under the lock
+    AdcCoreConfig config;
+    portMUX_TYPE lock;
+} ctx = {
+    .config = {
+        .step           = 10,
+    },
+    .lock = portMUX_INITIALIZER_UNLOCKED,
 };
 
+// adapt runs on this worker too, its state is paid out of this budget
+WORKER_DEFINE(worker, "adc_read_for", TASK_STACK_SIZE, TASK_PRIORITY_MEASUREMENT, TASK_CORE_ACQUISITION);
+BUDGET_CHECK(sizeof(ctx) + WORKER_FOOTPRINT(TASK_STACK_SIZE) + BUDGET_ADAPT, BUDGET_ADC);
+
 
 static int adc_command_execution(int argc, char **argv) {
     if (argc == 1){
@@ -77,119 +79,61 @@ static void parse_ble_command(char *buffer, unsigned length) {
     ADC_read_for(strtoul(buffer, NULL, 0));
 }
 
-static bool adc_calibration_init(adc_unit_t unit, adc_channel_t channel, adc_atten_t atten, adc_cali_handle_t *out_handle) {
-    adc_cali_handle_t handle = NULL;
-    esp_err_t ret = ESP_FAIL;
-    bool calibrated = false;
-
-#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
-    if (!calibrated) {
-        ESP_LOGI(__func__`, "calibration scheme version is %s", "Curve Fitting");
-        adc_cali_curve_fitting_config_t cali_config = {
-            .unit_id = unit,
-            .chan = channel,
-            .atten = atten,
-            .bitwidth = ADC_BITWIDTH_DEFAULT,
-        };
-        ret = adc_cali_create_scheme_curve_fitting(&cali_config, &handle);
-        if (ret == ESP_OK) {
-            calibrated = true;
-        }
-    }
-#endif
-
-#if ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
-    if (!calibrated) {
-        ESP_LOGI(__func__, "calibration scheme version is %s", "Line Fitting");
-        adc_cali_line_fitting_config_t cali_config = {
-            .unit_id = unit,
-            .atten = atten,
-            .bitwidth = ctx.default_width,
-        };
-        ret = adc_cali_create_scheme_line_fitting(&cali_config, &handle);
-        if (ret == ESP_OK) {
-            calibrated = true;
-        }
-    }
-#endif
-
-    *out_handle = handle;
-    if (ret == ESP_OK) {
-        ESP_LOGI(__func__, "Calibration Success");
-    } else if (ret == ESP_ERR_NOT_SUPPORTED || !calibrated) {
-        ESP_LOGW(__func__, "eFuse not burnt, skip software calibration");
-    } else {
-        ESP_LOGE(__func__, "Invalid arg or no memory");
-    }
+static void apply_config(const Config *config) {
+    taskENTER_CRITICAL(&ctx.lock);
+    ctx.config.resistor_r1 = config->adc.resistor_r1;
+    ctx.config.resistor_r2 = config->adc.resistor_r2;
+    ctx.config.samples = config->adc.samples;
+    ctx.config.model = config->adc.model;
+    taskEXIT_CRITICAL(&ctx.lock);
+}
 
-    return calibrated;
+static AdcCoreConfig snapshot(void) {
+    taskENTER_CRITICAL(&ctx.lock);
+    AdcCoreConfig config = ctx.config;
+    taskEXIT_CRITICAL(&ctx.lock);
+    return config;
 }
 
 void ADC_init() {
-    
-    // Initialize ADC configuration here
-    adc_oneshot_unit_init_cfg_t init_config = {
-        .unit_id = ADC_UNIT_1,
-    };
-    ESP_ERROR_CHECK(adc_oneshot_new_unit(&init_config, &ctx.adc1_handle));
-
-    //-------------ADC1 Config---------------//
-    const adc_oneshot_chan_cfg_t config = {
-        .bitwidth = ctx.default_width,
-        .atten = ctx.default_atten,
-    };
-    ESP_ERROR_CHECK(adc_oneshot_config_channel(ctx.adc1_handle, ctx.default_channel, &config));
-
-    //-------------ADC1 Calibration Init---------------//
-    ctx.calibrated = adc_calibration_init(ADC_UNIT_1, ctx.default_channel, ctx.default_atten, &ctx.adc1_cali_handle);
+    CONFIG_register_listener(apply_config);
+    if (HAL_ADC_init(kHalAdcVoltage) == false) {
+        ESP_LOGE(__func__, "ADC channel initialization failed");
+        return;
+    }
 
+    WORKER_start(&worker);
     CLI_register_command("adc", "[now] [duration <time>]", adc_command_execution);
     BLE_setup_characteristic_callback(kVoltage, parse_ble_command);
 }
 
 Millivolt ADC_read() {
-    // Initialize variables
-    Millivolt meas;
-    unsigned sample = 0;
-    unsigned samples = 100;
-    unsigned step = 10;
-
-    int voltage = 0;
-    unsigned sum = 0;
-
-    while (sample < samples) {
-        // Read ADC value
-        int adc_value;
-        ESP_ERROR_CHECK(adc_oneshot_read(ctx.adc1_handle, ctx.default_channel, &adc_value));
+    AdcCoreConfig config = snapshot();
+    Millivolt meas = ADC_CORE_read(&config);
+    ESP_LOGD(__func__, "ADC Cali Voltage Avg: %d mV", meas);
+    return meas;
+}
 
-        if (ctx.calibrated) {
-            ESP_ERROR_CHECK(adc_cali_raw_to_voltage(ctx.adc1_cali_handle, adc_value, &voltage));
-        }
+float ADC_read_uncorrected(void) {
+    AdcCoreConfig config = snapshot();
+    return ADC_CORE_read_uncorrected(&config);
+}
 
-        sum += voltage;
-        sample += 1;
-        vTaskDelay(pdMS_TO_TICKS(step));
-        // ESP_LOGI(__func__, "ADCRaw raw: %d mV after Rs: %d", voltage, voltage * (ctx.resistor_r1 + ctx.resistor_r2) / ctx.resistor_r1);
-    }
+float ADC_counts_to_voltage(float counts) {
+    AdcCoreConfig config = snapshot();
+    return ADC_CORE_counts_to_input(&config, counts);
+}
 
-    // Calculate average
-    meas = sum / samples;
-
-    ESP_LOGD(__func__, "ADC%d Channel[%d] Raw Avg: %d mV", ADC_UNIT_1 + 1, ctx.default_channel, meas);
-    // Voltage divider
-    meas = meas * (ctx.resistor_r1 + ctx.resistor_r2) / ctx.resistor_r1;
-    // use calibration value
-    // -46 + 0,0225x + 4,94E-07x^2
-    // -20.1 + 0.0138 x + 9,75E-07 x^2
-    // meas -= 0.000000494 * (meas * meas) + 0.0225 * meas - 46;
-    meas -= 0.00000169 * (meas * meas) - 0.000991 * meas + 45,7
-    // meas -= 0.000000975 * (meas * meas) + 0.0138 * meas - 20.1;
-    ESP_LOGD(__func__, "ADC%d Channel[%d] Cali Voltage Avg: %d mV", ADC_UNIT_1 + 1, ctx.default_channel, meas);
+Millivolt ADC_read_single(void) {
+    AdcCoreConfig config = snapshot();
+    return ADC_CORE_read_single(&config);
+}
 
-    return meas;
+uint16_t ADC_read_raw(void) {
+    return HAL_ADC_read_raw(kHalAdcVoltage);
 }
 
-static void read_for() {
+static void read_for(void *arg) {
     AdcMeas meas;
     // Initialize variables
     unsigned time = 0;
@@ -205,8 +149,17 @@ static void read_for() {
     // Perform measurements for the specified duration
     while (time < endTime) {
         memset(buffer, 0, sizeof(buffer));
-        // Read ADC value
+        // Read ADC value, full speed for the burst only, the delay below may sleep
+        POWER_lock(kPowerCpu);
         voltage = ADC_read();
+        POWER_unlock(kPowerCpu);
+        int64_t now = HAL_TIME_now();
+        DATALOG_append(kDatalogVoltage, now, voltage);
+        ROLLUP_add(kRollupVoltage, now, voltage);
+        STATS_sample(kStatsVoltage, now);
+        ALARM_sample(kAlarmVoltage, now, voltage);
+        STREAM_sample(kDatalogVoltage, now, voltage);
+        TRACE_event(kTraceSample, kVoltage);
         // Update sum, min, and max
         sum += voltage;
         if (voltage < meas.min)
@@ -216,38 +169,67 @@ static void read_for() {
             meas.max = voltage;
 
         time += step;
-        ESP_LOGI(__func__, "ADC: [now: %u] [max %u mV] [min %u mv]", voltage, meas.max, meas.min);
-        snprintf(buffer, sizeof(buffer), "%d,%d,%d,%d", voltage, meas.max, meas.min, meas.avg);
-        BLE_update_value(kVoltage, buffer);
-        vTaskDelay(pdMS_TO_TICKS(step));
+        // the frames carry every sample while streaming, no text per sample
+        if (STREAM_is_active() == false)
+            ESP_LOGI(__func__, "ADC: [now: %u] [max %u mV] [min %u mv]", voltage, meas.max, meas.min);
+        int32_t value = voltage;
+        if (BLE_notify_due(kVoltage, now, &value, 1)) {
+            ADC_CORE_format_ble(buffer, sizeof(buffer), voltage, meas.max, meas.min, meas.avg);
+            BLE_update_value(kVoltage, buffer);
+        }
+        HAL_TIME_delay_ms(step);
     }
 
     // Calculate average
     meas.avg = sum / (endTime / step);  // Calculate average over the measurement period
     ESP_LOGI(__func__, "ADC: [avg %u mV] [max %u mV] [min %u mv]", meas.avg, meas.max, meas.min);
-    vTaskDelete(NULL);
+    ctx.ongoing = false;
 }
 
-void ADC_read_for(Seconds duration) {
+// check and set under the lock, the CLI, BLE and other modules start sessions concurrently
+static bool claim(void) {
+    taskENTER_CRITICAL(&ctx.lock);
+    bool busy = ctx.ongoing;
     ctx.ongoing = true;
+    taskEXIT_CRITICAL(&ctx.lock);
+    return busy == false;
+}
+
+bool ADC_read_for(Seconds duration) {
+    if (duration == 0 || claim() == false)
+        return false;
+
     ctx.duration = duration;
-    xTaskCreate(read_for, "adc_read_for", 4096, NULL, 5, NULL);
+    if (WORKER_submit(&worker, read_for, NULL) == false) {
+        ctx.ongoing = false;
+        return false;
+    }
+    return true;
+}
+
+static void run_job(void *arg) {
+    ctx.job(ctx.job_arg);
+    ctx.ongoing = false;
 }
 
-static void example_adc_calibration_deinit(adc_cali_handle_t handle) {
-#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
-    ESP_LOGD(__func__, "deregister %s calibration scheme", "Curve Fitting");
-    ESP_ERROR_CHECK(adc_cali_delete_scheme_curve_fitting(handle));
+bool ADC_run(WorkerJob job, void *arg) {
+    if (claim() == false)
+        return false;
 
-#elif ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
-    ESP_LOGD(__func__, "deregister %s calibration scheme", "Line Fitting");
-    ESP_ERROR_CHECK(adc_cali_delete_scheme_line_fitting(handle));
-#endif
+    ctx.job = job;
+    ctx.job_arg = arg;
+    if (WORKER_submit(&worker, run_job, NULL) == false) {
+        ctx.ongoing = false;
+        return false;
+    }
+    return true;
+}
+
+void ADC_notify(void) {
+    if (worker.task != NULL)
+        xTaskNotifyGive(worker.task);
 }
 
 void ADC_deinit() {
-    ESP_ERROR_CHECK(adc_oneshot_del_unit(ctx.adc1_handle));
-    if (ctx.calibrated) {
-        example_adc_calibration_deinit(ctx.adc1_cali_handle);
-    }
+    HAL_ADC_deinit(kHalAdcVoltage);
 }
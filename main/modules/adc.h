@@ -2,14 +2,26 @@
 #define ADC_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "modules/base/types.h"
+#include "modules/worker.h"
 
 
 void ADC_init(void);
 
 Millivolt ADC_read(void);
-void ADC_read_for(Seconds duration);
+Millivolt ADC_read_single(void);
+// divider output without the calibration model
+float ADC_read_uncorrected(void);
+// filtered raw code -> input voltage
+float ADC_counts_to_voltage(float counts);
+bool ADC_read_for(Seconds duration);
+// continuous acquisition on the read_for worker in its place, false while either runs
+bool ADC_run(WorkerJob job, void *arg);
+// wakes a job started with ADC_run from ulTaskNotifyTake
+void ADC_notify(void);
+uint16_t ADC_read_raw(void);
 
 void ADC_deinit(void);
 
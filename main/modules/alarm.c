@@ -0,0 +1,206 @@
+#include "modules/alarm.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "modules/base/generic_fun.h"
+#include "modules/cli.h"
+#include "modules/ble.h"
+#include "modules/config.h"
+#include "modules/worker.h"
+
+// config set alarm.voltage.high 14500
+// config set alarm.voltage.debounce 3
+// config commit
+// alarm status
+
+#define EVENT_RING 16
+#define INDICATE_ATTEMPTS 50        // the previous indication may still wait for its confirmation
+
+static const char *channel_names[kAlarmLastChannel] = {
+    [kAlarmVoltage]     = "voltage",
+    [kAlarmCurrent]     = "current",
+    [kAlarmTemperature] = "temperature",
+};
+
+typedef struct {
+    int64_t timestamp;      // triggering sample
+    int32_t value;
+    uint8_t channel;
+    uint8_t level;
+} AlarmEvent;
+
+static struct {
+    AlarmThreshold thresholds[kAlarmLastChannel];
+    AlarmState states[kAlarmLastChannel];
+    AlarmEvent last[kAlarmLastChannel];
+
+    // samplers run on several tasks, the lock covers the states and the ring
+    AlarmEvent events[EVENT_RING];
+    uint32_t head;
+    uint32_t tail;
+    uint32_t dropped;
+    portMUX_TYPE lock;
+} ctx = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+WORKER_DEFINE(worker, "alarm", TASK_STACK_SIZE_SMALL, TASK_PRIORITY_ALARM, TASK_CORE_COMMS);
+BUDGET_CHECK(sizeof(ctx) + WORKER_FOOTPRINT(TASK_STACK_SIZE_SMALL), BUDGET_ALARM);
+
+static bool indicate(const char *line) {
+    for (unsigned attempt = 0; attempt < INDICATE_ATTEMPTS; ++attempt) {
+        if (BLE_indicate_raw(kAlarm, (const uint8_t *)line, strlen(line)))
+            return true;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return false;
+}
+
+static void publish(void *arg) {
+    while (true) {
+        taskENTER_CRITICAL(&ctx.lock);
+        bool empty = ctx.tail == ctx.head;
+        AlarmEvent event = ctx.events[ctx.tail % EVENT_RING];
+        if (empty == false)
+            ctx.tail += 1;
+        taskEXIT_CRITICAL(&ctx.lock);
+
+        if (empty)
+            break;
+
+        const char *level = ALARM_CORE_level_name(event.level);
+        if (event.level == kAlarmNormal)
+            ESP_LOGI("alarm", "ALARM %s %s: [value %" PRId32 "] [t %" PRId64 " us]",
+                     channel_names[event.channel], level, event.value, event.timestamp);
+        else
+            ESP_LOGW("alarm", "ALARM %s %s: [value %" PRId32 "] [t %" PRId64 " us]",
+                     channel_names[event.channel], level, event.value, event.timestamp);
+
+        char line[64];
+        snprintf(line, sizeof(line), "alarm,%s,%s,%" PRId32 ",%" PRId64,
+                 channel_names[event.channel], level, event.value, event.timestamp);
+        indicate(line);
+    }
+}
+
+void ALARM_sample(AlarmChannel channel, int64_t timestamp, int32_t value) {
+    if (channel >= kAlarmLastChannel)
+        return;
+
+    bool queued = false;
+    taskENTER_CRITICAL(&ctx.lock);
+    if (ALARM_CORE_update(&ctx.thresholds[channel], &ctx.states[channel], value)) {
+        AlarmEvent event = {
+            .timestamp  = timestamp,
+            .value      = value,
+            .channel    = channel,
+            .level      = ctx.states[channel].level,
+        };
+        ctx.last[channel] = event;
+
+        if (ctx.head - ctx.tail < EVENT_RING) {
+            ctx.events[ctx.head % EVENT_RING] = event;
+            ctx.head += 1;
+            queued = true;
+        } else {
+            ctx.dropped += 1;
+        }
+    }
+    taskEXIT_CRITICAL(&ctx.lock);
+
+    // a full job queue still has a publish pending that takes this event along
+    if (queued)
+        WORKER_submit(&worker, publish, NULL);
+}
+
+AlarmLevel ALARM_get_level(AlarmChannel channel) {
+    return channel < kAlarmLastChannel ? ctx.states[channel].level : kAlarmNormal;
+}
+
+void ALARM_reset(void) {
+    taskENTER_CRITICAL(&ctx.lock);
+    for (unsigned channel = 0; channel < kAlarmLastChannel; ++channel)
+        ALARM_CORE_reset(&ctx.states[channel]);
+    taskEXIT_CRITICAL(&ctx.lock);
+}
+
+static void apply_config(const Config *config) {
+    taskENTER_CRITICAL(&ctx.lock);
+    for (unsigned channel = 0; channel < kAlarmLastChannel; ++channel) {
+        // new limits judge from a clean state, a channel still out of range raises again
+        if (memcmp(&ctx.thresholds[channel], &config->alarm[channel], sizeof(AlarmThreshold)) != 0)
+            ALARM_CORE_reset(&ctx.states[channel]);
+        ctx.thresholds[channel] = config->alarm[channel];
+    }
+    taskEXIT_CRITICAL(&ctx.lock);
+}
+
+static void log_status(void) {
+    for (unsigned channel = 0; channel < kAlarmLastChannel; ++channel) {
+        const AlarmThreshold *threshold = &ctx.thresholds[channel];
+        const AlarmEvent *last = &ctx.last[channel];
+        if (threshold->debounce == 0) {
+            ESP_LOGI(__func__, "ALARM %s: disabled", channel_names[channel]);
+            continue;
+        }
+
+        ESP_LOGI(__func__, "ALARM %s %s: [low %" PRId32 "] [high %" PRId32 "] [hyst %" PRId32 "] [debounce %" PRIu32 "] [last %s %" PRId32 " at %" PRId64 " us]",
+                 channel_names[channel], ALARM_CORE_level_name(ctx.states[channel].level),
+                 threshold->low, threshold->high, threshold->hysteresis, threshold->debounce,
+                 ALARM_CORE_level_name(last->level), last->value, last->timestamp);
+    }
+    if (ctx.dropped > 0)
+        ESP_LOGW(__func__, "ALARM: %" PRIu32 " events dropped", ctx.dropped);
+}
+
+static int alarm_command_execution(int argc, char **argv) {
+    if (argc == 1 || AreStringsTheSame("status", argv[1], sizeof("status"))) {
+        log_status();
+        return 0;
+    }
+
+    if (AreStringsTheSame("reset", argv[1], sizeof("reset"))) {
+        ALARM_reset();
+        return 0;
+    }
+
+    ESP_LOGW(__func__, "Unknown subcommand: %s", argv[1]);
+    return 0;
+}
+
+// "status" answered with state,<channel>,<level>,<enabled 0|1> per channel then end,
+// transitions arrive unasked as alarm,<channel>,<normal|low|high>,<value>,<timestamp us>
+static void status_report(void *arg) {
+    char line[48];
+    for (unsigned channel = 0; channel < kAlarmLastChannel; ++channel) {
+        snprintf(line, sizeof(line), "state,%s,%s,%d", channel_names[channel],
+                 ALARM_CORE_level_name(ctx.states[channel].level), ctx.thresholds[channel].debounce != 0);
+        indicate(line);
+    }
+    indicate("end");
+}
+
+static void parse_ble_command(char *buffer, unsigned length) {
+    if (AreStringsTheSame("status", buffer, strlen("status"))) {
+        WORKER_submit(&worker, status_report, NULL);
+    } else if (AreStringsTheSame("reset", buffer, strlen("reset"))) {
+        ALARM_reset();
+    } else {
+        // on the NimBLE host task, no retries here
+        BLE_indicate_raw(kAlarm, (const uint8_t *)"error", strlen("error"));
+    }
+}
+
+void ALARM_init(void) {
+    CONFIG_register_listener(apply_config);
+    WORKER_start(&worker);
+    CLI_register_command("alarm", "[status] [reset]", alarm_command_execution);
+    BLE_setup_characteristic_callback(kAlarm, parse_ble_command);
+}
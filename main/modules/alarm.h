@@ -0,0 +1,20 @@
+#ifndef ALARM_H
+#define ALARM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/core/alarm_core.h"
+
+void ALARM_init(void);
+
+// called by the acquisition loops with every sample, value in the channel unit;
+// transitions are published at once on the CLI and the alarm characteristic
+void ALARM_sample(AlarmChannel channel, int64_t timestamp, int32_t value);
+
+AlarmLevel ALARM_get_level(AlarmChannel channel);
+
+// every channel back to normal, active alarms are raised again by the next samples
+void ALARM_reset(void);
+
+#endif // ALARM_H
@@ -0,0 +1,51 @@
+#ifndef BUDGET_H
+#define BUDGET_H
+
+// Static RAM budget per module in bytes. Tasks, stacks, queues and buffers are
+// all static objects, so the footprint is known at link time and the heap is
+// left to IDF and NimBLE. Every module checks its ctx and workers against its
+// line at compile time, tools/memory_budget.py reports the linked .bss/.data
+// per module from the map file.
+#define BUDGET_ADC              (5 * 1024)      // read_for worker, also runs adapt
+#define BUDGET_CT               (5 * 1024)
+#define BUDGET_DS_SENSOR        (5 * 1024)
+#define BUDGET_CAPTURE          (22 * 1024)     // 16 KiB frame ring
+#define BUDGET_RELAY_SEQ        (5 * 1024)
+#define BUDGET_DATALOG          (17 * 1024)     // two page buffers, scratch page, writer stack
+#define BUDGET_ROLLUP           (19 * 1024)
+#define BUDGET_STATS            (1 * 1024)
+#define BUDGET_TRACE            (13 * 1024)
+#define BUDGET_BENCH            (5 * 1024)
+#define BUDGET_LATENCY          (9 * 1024)      // core 1 sampler is the session worker
+#define BUDGET_SOAK             (4 * 1024)
+#define BUDGET_CONFIG           (2 * 1024)      // active, spare and staged copy
+#define BUDGET_CALIB            (1 * 1024)      // points measured on the session worker
+#define BUDGET_DECIM            (1 * 1024)      // filters only, runs on the session worker
+#define BUDGET_RIPPLE           (3 * 1024)      // analysis runs on the session worker
+#define BUDGET_STEP             (1 * 1024)      // frames stay in the capture buffer
+#define BUDGET_PLAN             (2 * 1024)      // one program and the record ring, runs on the session worker
+#define BUDGET_ALARM            (4 * 1024)
+#define BUDGET_POWER            (1 * 1024)      // report runs on the session worker
+#define BUDGET_ULP              (2 * 1024)      // program ops and instructions, jobs on the report worker
+#define BUDGET_STREAM           (1 * 1024)      // two packets and one frame, sent by the report worker
+#define BUDGET_WORKER           (10 * 1024)     // shared report and session workers
+// adapt state, inside BUDGET_ADC
+#define BUDGET_ADAPT            (256)
+
+#define BUDGET_TOTAL            (BUDGET_ADC + BUDGET_CT + BUDGET_DS_SENSOR + BUDGET_CAPTURE + BUDGET_RELAY_SEQ \
+                                 + BUDGET_DATALOG + BUDGET_ROLLUP + BUDGET_STATS + BUDGET_TRACE + BUDGET_BENCH \
+                                 + BUDGET_LATENCY + BUDGET_SOAK + BUDGET_CONFIG + BUDGET_CALIB + BUDGET_DECIM \
+                                 + BUDGET_RIPPLE + BUDGET_STEP + BUDGET_PLAN + BUDGET_ALARM + BUDGET_POWER \
+                                 + BUDGET_ULP + BUDGET_STREAM + BUDGET_WORKER)
+
+// ESP32 static DRAM is shared with IDF and the BT controller, check the linked
+// total with tools/memory_budget.py on a BT build before raising it, a module
+// that grows pays for it out of the others
+#define BUDGET_LIMIT            (140 * 1024)
+
+_Static_assert(BUDGET_TOTAL <= BUDGET_LIMIT, "module budgets exceed the static RAM limit");
+
+#define BUDGET_CHECK(footprint, budget) \
+    _Static_assert((footprint) <= (budget), "static RAM over the module budget: " #budget)
+
+#endif // BUDGET_H
@@ -0,0 +1,150 @@
+#include "modules/base/codec.h"
+
+#include <string.h>
+
+typedef struct {
+    uint8_t count;
+    uint8_t bits;
+} Simple8bSelector;
+
+// widest run first, the encoder takes the first selector its next values fit in
+static const Simple8bSelector selectors[16] = {
+    { 240, 0 }, { 120, 0 }, { 60, 1 }, { 30, 2 }, { 20, 3 }, { 15, 4 }, { 12, 5 }, { 10, 6 },
+    { 8, 7 }, { 7, 8 }, { 6, 10 }, { 5, 12 }, { 4, 15 }, { 3, 20 }, { 2, 30 }, { 1, 60 },
+};
+
+#define SIMPLE8B_LAST_SELECTOR 15
+
+static inline uint32_t delta_at(const int32_t *values, unsigned index, int32_t previous) {
+    int32_t last = index > 0 ? values[index - 1] : previous;
+    return CODEC_zigzag((int32_t)((uint32_t)values[index] - (uint32_t)last));
+}
+
+unsigned CODEC_put_varint(uint8_t *out, uint64_t value) {
+    unsigned length = 0;
+    while (value >= 0x80) {
+        out[length++] = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    out[length++] = (uint8_t)value;
+    return length;
+}
+
+unsigned CODEC_get_varint(const uint8_t *in, size_t length, uint64_t *value) {
+    uint64_t result = 0;
+    for (unsigned i = 0; i < length && i < CODEC_VARINT_MAX; ++i) {
+        result |= (uint64_t)(in[i] & 0x7F) << (7 * i);
+        if (in[i] < 0x80) {
+            *value = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+size_t CODEC_encode_varint(const int32_t *values, unsigned count, int32_t previous, uint8_t *out, size_t max,
+                           unsigned *encoded) {
+    size_t pos = 0;
+    unsigned i = 0;
+    for (; i < count; ++i) {
+        uint32_t delta = delta_at(values, i, previous);
+        if (max - pos >= CODEC_VARINT32_MAX) {
+            pos += CODEC_put_varint(out + pos, delta);
+            continue;
+        }
+
+        // close to the end, stage the value to see whether it fits
+        uint8_t staged[CODEC_VARINT32_MAX];
+        unsigned length = CODEC_put_varint(staged, delta);
+        if (pos + length > max)
+            break;
+        memcpy(out + pos, staged, length);
+        pos += length;
+    }
+    *encoded = i;
+    return pos;
+}
+
+size_t CODEC_decode_varint(const uint8_t *in, size_t length, int32_t previous, int32_t *values, unsigned count) {
+    size_t pos = 0;
+    uint32_t last = previous;
+    for (unsigned i = 0; i < count; ++i) {
+        uint64_t delta;
+        unsigned used = CODEC_get_varint(in + pos, length - pos, &delta);
+        if (used == 0 || delta > UINT32_MAX)
+            return 0;
+
+        pos += used;
+        last += (uint32_t)CODEC_unzigzag((uint32_t)delta);
+        values[i] = (int32_t)last;
+    }
+    return pos;
+}
+
+static bool run_fits(const int32_t *values, unsigned first, unsigned count, int32_t previous, unsigned bits) {
+    const uint32_t limit = bits == 0 ? 0 : (1u << bits) - 1;
+    for (unsigned i = first; i < first + count; ++i) {
+        if (delta_at(values, i, previous) > limit)
+            return false;
+    }
+    return true;
+}
+
+size_t CODEC_encode_simple8b(const int32_t *values, unsigned count, int32_t previous, uint8_t *out, size_t max,
+                             unsigned *encoded) {
+    size_t pos = 0;
+    unsigned i = 0;
+    while (i < count && pos + CODEC_SIMPLE8B_WORD <= max) {
+        unsigned remaining = count - i;
+        unsigned selector = 0;
+        // the last selector holds any 32 bit difference
+        for (; selector < SIMPLE8B_LAST_SELECTOR; ++selector) {
+            if (selectors[selector].count <= remaining
+                && run_fits(values, i, selectors[selector].count, previous, selectors[selector].bits))
+                break;
+        }
+
+        const unsigned n = selectors[selector].count;
+        const unsigned bits = selectors[selector].bits;
+        uint64_t word = (uint64_t)selector << 60;
+        for (unsigned j = 0; j < n && bits > 0; ++j)
+            word |= (uint64_t)delta_at(values, i + j, previous) << (j * bits);
+
+        for (unsigned byte = 0; byte < CODEC_SIMPLE8B_WORD; ++byte)
+            out[pos + byte] = (uint8_t)(word >> (8 * byte));
+        pos += CODEC_SIMPLE8B_WORD;
+        i += n;
+    }
+    *encoded = i;
+    return pos;
+}
+
+size_t CODEC_decode_simple8b(const uint8_t *in, size_t length, int32_t previous, int32_t *values, unsigned count) {
+    size_t pos = 0;
+    unsigned i = 0;
+    uint32_t last = previous;
+    while (i < count) {
+        if (pos + CODEC_SIMPLE8B_WORD > length)
+            return 0;
+
+        uint64_t word = 0;
+        for (unsigned byte = 0; byte < CODEC_SIMPLE8B_WORD; ++byte)
+            word |= (uint64_t)in[pos + byte] << (8 * byte);
+        pos += CODEC_SIMPLE8B_WORD;
+
+        const Simple8bSelector *selector = &selectors[word >> 60];
+        // the encoder never packs past the end of a block
+        if (selector->count > count - i)
+            return 0;
+
+        const uint64_t mask = selector->bits == 0 ? 0 : (UINT64_C(1) << selector->bits) - 1;
+        for (unsigned j = 0; j < selector->count; ++j) {
+            uint64_t delta = (word >> (j * selector->bits)) & mask;
+            if (delta > UINT32_MAX)
+                return 0;
+            last += (uint32_t)CODEC_unzigzag((uint32_t)delta);
+            values[i++] = (int32_t)last;
+        }
+    }
+    return pos;
+}
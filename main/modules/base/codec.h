@@ -0,0 +1,45 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Sample codec of the flash log, the UART stream and the BLE capture dump.
+// Slowly changing values go out as the difference to the previous value,
+// zigzag maps small signed differences to small unsigned numbers, then either
+//   varint     7 bits a byte, low group first, bit 7 set on all but the last byte
+//   simple-8b  little endian 64 bit words: selector in bits 60..63, then
+//              1 to 240 values of equal width from bit 0 up
+// A block starts from a previous value kept by the caller, 0 for a fresh start.
+// Differences wrap at 32 bits, so every int32_t sequence round trips.
+#define CODEC_VARINT_MAX 10         // bytes of a 64 bit varint
+#define CODEC_VARINT32_MAX 5
+#define CODEC_SIMPLE8B_WORD 8
+
+static inline uint32_t CODEC_zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t CODEC_unzigzag(uint32_t value) {
+    return (int32_t)((value >> 1) ^ (0 - (value & 1)));
+}
+
+unsigned CODEC_put_varint(uint8_t *out, uint64_t value);
+
+// bytes read, 0 when truncated or longer than CODEC_VARINT_MAX
+unsigned CODEC_get_varint(const uint8_t *in, size_t length, uint64_t *value);
+
+// bytes written; values stop at the first one that doesn't fit in max, *encoded tells how many went in
+size_t CODEC_encode_varint(const int32_t *values, unsigned count, int32_t previous, uint8_t *out, size_t max,
+                           unsigned *encoded);
+
+// bytes read for count values, 0 on a truncated or malformed block
+size_t CODEC_decode_varint(const uint8_t *in, size_t length, int32_t previous, int32_t *values, unsigned count);
+
+// same contract as the varint pair, whole words only
+size_t CODEC_encode_simple8b(const int32_t *values, unsigned count, int32_t previous, uint8_t *out, size_t max,
+                             unsigned *encoded);
+size_t CODEC_decode_simple8b(const uint8_t *in, size_t length, int32_t previous, int32_t *values, unsigned count);
+
+#endif // CODEC_H
@@ -1,7 +1,25 @@
 #include "modules/base/generic_fun.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 bool AreStringsTheSame(const char *first, const char *second, unsigned length) {
     return strncmp(first, second, length) == 0;
 }
+
+unsigned ParseUnsignedList(const char *buffer, unsigned *values, unsigned max_values, int base) {
+    unsigned count = 0;
+    while (*buffer && count < max_values) {
+        while (*buffer == ',')
+            buffer++;
+
+        char *end;
+        unsigned long value = strtoul(buffer, &end, base);
+        if (end == buffer)
+            break;
+
+        values[count++] = value;
+        buffer = end;
+    }
+    return count;
+}
@@ -5,5 +5,7 @@
 #include <stdbool.h>
 
 bool AreStringsTheSame(const char *first, const char *second, unsigned length);
+// "12,0x10,,7" -> { 12, 16, 7 }, returns the number of parsed values
+unsigned ParseUnsignedList(const char *buffer, unsigned *values, unsigned max_values, int base);
 
 #endif // GENERIC_FUN_H
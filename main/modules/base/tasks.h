@@ -0,0 +1,26 @@
+#ifndef TASKS_H
+#define TASKS_H
+
+// Threading model. Core 1 runs acquisition and control only, everything that
+// talks to the outside world (NimBLE host, console, flash, reporting) stays on
+// core 0, so a busy BLE link or a long CLI dump can't delay a sample.
+// Higher priority runs first. IDF tasks keep their own: ipc 24, esp_timer 22,
+// NimBLE host 21 (pinned to core 0 in sdkconfig.defaults), console REPL 2.
+#define TASK_CORE_ACQUISITION   1
+#define TASK_CORE_COMMS         0
+
+// core 1
+#define TASK_PRIORITY_CAPTURE       20      // spins for the whole capture window
+#define TASK_PRIORITY_RELAY_SEQ     19      // spins around relay edges
+#define TASK_PRIORITY_MEASUREMENT   18      // adc/ct/ds read_for loops, latency test
+
+// core 0
+#define TASK_PRIORITY_ALARM         7       // alarm transitions, ahead of logging and reports
+#define TASK_PRIORITY_LOAD          6       // latency test load generators
+#define TASK_PRIORITY_DATALOG       6
+#define TASK_PRIORITY_REPORT        5       // BLE dumps, queries and reports
+
+#define TASK_STACK_SIZE             4096
+#define TASK_STACK_SIZE_SMALL       3072    // loops without float formatting
+
+#endif // TASKS_H
@@ -1,3 +1,6 @@
+#ifndef TYPES_H
+#define TYPES_H
+
 #include <stdint.h>
 #include <stddef.h>
 // #include <stdlib.h>
@@ -5,6 +8,7 @@
 
 typedef uint32_t Seconds;
 typedef uint32_t Milliseconds;
+typedef uint32_t Microseconds;
 
 typedef int Volt;
 typedef int Millivolt;
@@ -14,3 +18,5 @@ typedef uint32_t Milliamper;
 
 typedef uint32_t Herz;
 typedef uint32_t Percent;
+
+#endif // TYPES_H
@@ -0,0 +1,190 @@
+#include "modules/bench.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "esp_log.h"
+
+#include "modules/base/generic_fun.h"
+#include "modules/base/budget.h"
+#include "modules/base/codec.h"
+#include "modules/cli.h"
+#include "modules/ble.h"
+#include "modules/adc.h"
+#include "modules/ct.h"
+#include "modules/ds_sensor.h"
+#include "modules/power.h"
+#include "modules/core/bench_core.h"
+
+// bench
+// bench fmt_current runs 500
+
+#define CODEC_VALUES 64
+
+typedef enum {
+    kCodedNone = 0,
+    kCodedVarint,
+    kCodedSimple8b,
+} CodedPacking;
+
+static struct {
+    uint32_t samples[BENCH_MAX_RUNS];
+    char buffer[11 + 11 + 11 + 11];
+    volatile int sink;
+    int32_t values[CODEC_VALUES];
+    int32_t decoded[CODEC_VALUES];
+    uint8_t coded[CODEC_VALUES * CODEC_SIMPLE8B_WORD];
+    size_t coded_length;
+    CodedPacking coded_packing;
+} ctx = { 0 };
+
+BUDGET_CHECK(sizeof(ctx), BUDGET_BENCH);
+
+static void bench_adc_read(void *arg) {
+    ctx.sink = ADC_read();
+}
+
+static void bench_adc_read_single(void *arg) {
+    ctx.sink = ADC_read_single();
+}
+
+static void bench_adc_read_raw(void *arg) {
+    ctx.sink = ADC_read_raw();
+}
+
+static void bench_ct_read(void *arg) {
+    ctx.sink = CT_read();
+}
+
+static void bench_ct_read_raw(void *arg) {
+    ctx.sink = CT_read_raw();
+}
+
+static void bench_ds_read(void *arg) {
+    ctx.sink = DS_SENSOR_read().first_sensor;
+}
+
+static void bench_fmt_voltage(void *arg) {
+    ctx.sink = snprintf(ctx.buffer, sizeof(ctx.buffer), "%d,%d,%d,%d", 12034, 12810, 11502, 12001);
+}
+
+static void bench_fmt_current(void *arg) {
+    ctx.sink = snprintf(ctx.buffer, sizeof(ctx.buffer), "%.2f,%.2f,%.2f,%.2f", 12.34f, 15.02f, 0.41f, 9.87f);
+}
+
+static void bench_fmt_temperature(void *arg) {
+    ctx.sink = snprintf(ctx.buffer, sizeof(ctx.buffer), "%f,%f", 23.5625f, 81.125f);
+}
+
+static void bench_ble_update(void *arg) {
+    snprintf(ctx.buffer, sizeof(ctx.buffer), "%d,%d,%d,%d", 12034, 12810, 11502, 12001);
+    BLE_update_value(kVoltage, ctx.buffer);
+}
+
+// ADC_read, CT_read and DS_SENSOR_read block for about a second each, keep their runs low
+static void bench_varint_enc(void *arg) {
+    unsigned encoded;
+    ctx.coded_length = CODEC_encode_varint(ctx.values, CODEC_VALUES, 0, ctx.coded, sizeof(ctx.coded), &encoded);
+    ctx.coded_packing = kCodedVarint;
+}
+
+static void bench_s8b_enc(void *arg) {
+    unsigned encoded;
+    ctx.coded_length = CODEC_encode_simple8b(ctx.values, CODEC_VALUES, 0, ctx.coded, sizeof(ctx.coded), &encoded);
+    ctx.coded_packing = kCodedSimple8b;
+}
+
+// the warm up run encodes the block when the case runs on its own
+static void bench_varint_dec(void *arg) {
+    if (ctx.coded_packing != kCodedVarint)
+        bench_varint_enc(NULL);
+    ctx.sink = CODEC_decode_varint(ctx.coded, ctx.coded_length, 0, ctx.decoded, CODEC_VALUES);
+}
+
+static void bench_s8b_dec(void *arg) {
+    if (ctx.coded_packing != kCodedSimple8b)
+        bench_s8b_enc(NULL);
+    ctx.sink = CODEC_decode_simple8b(ctx.coded, ctx.coded_length, 0, ctx.decoded, CODEC_VALUES);
+}
+
+static const BenchCase cases[] = {
+    { .name = "adc_read",           .fn = bench_adc_read,           .runs = 5 },
+    { .name = "adc_read_single",    .fn = bench_adc_read_single,    .runs = 1000 },
+    { .name = "adc_read_raw",       .fn = bench_adc_read_raw,       .runs = 1000 },
+    { .name = "ct_read",            .fn = bench_ct_read,            .runs = 5 },
+    { .name = "ct_read_raw",        .fn = bench_ct_read_raw,        .runs = 1000 },
+    { .name = "ds_read",            .fn = bench_ds_read,            .runs = 5 },
+    { .name = "fmt_voltage",        .fn = bench_fmt_voltage,        .runs = 1000 },
+    { .name = "fmt_current",        .fn = bench_fmt_current,        .runs = 1000 },
+    { .name = "fmt_temperature",    .fn = bench_fmt_temperature,    .runs = 1000 },
+    { .name = "ble_update",         .fn = bench_ble_update,         .runs = 200 },
+    { .name = "codec_varint_enc",   .fn = bench_varint_enc,         .runs = 1000 },
+    { .name = "codec_varint_dec",   .fn = bench_varint_dec,         .runs = 1000 },
+    { .name = "codec_s8b_enc",      .fn = bench_s8b_enc,            .runs = 1000 },
+    { .name = "codec_s8b_dec",      .fn = bench_s8b_dec,            .runs = 1000 },
+};
+
+static bool run_case(const BenchCase *bench, unsigned runs) {
+    BenchResult result;
+    // figures at the full clock, comparable with and without power management
+    POWER_lock(kPowerCpu);
+    bool ret = BENCH_CORE_run(bench, runs != 0 ? runs : bench->runs, ctx.samples, &result);
+    POWER_unlock(kPowerCpu);
+    if (ret == false)
+        return false;
+
+    char line[96];
+    BENCH_CORE_format(&result, line, sizeof(line));
+    printf("%s\n", line);
+    return true;
+}
+
+bool BENCH_execute(const char *name, unsigned runs) {
+    bool found = false;
+    printf("BENCH,name,runs,min,median,p99,max,median_ns\n");
+    for (unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        if (name != NULL && AreStringsTheSame(cases[i].name, name, strlen(cases[i].name) + 1) == false)
+            continue;
+
+        found = true;
+        if (run_case(&cases[i], runs) == false)
+            ESP_LOGW(__func__, "Bench %s failed", cases[i].name);
+    }
+    printf("BENCH END\n");
+    return found;
+}
+
+static int bench_command_execution(int argc, char **argv) {
+    if (argc > 1 && AreStringsTheSame("list", argv[1], sizeof("list"))) {
+        for (unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+            ESP_LOGI(__func__, "%s [runs %u]", cases[i].name, cases[i].runs);
+        return 0;
+    }
+
+    const char *name = NULL;
+    unsigned runs = 0;
+    for (int i = 1; i < argc; i++) {
+        if (AreStringsTheSame("runs", argv[i], sizeof("runs")) && i + 1 < argc) {
+            runs = strtoul(argv[++i], NULL, 10);
+            continue;
+        }
+        name = argv[i];
+    }
+
+    if (runs > BENCH_MAX_RUNS) {
+        ESP_LOGW(__func__, "At most %u runs", BENCH_MAX_RUNS);
+        return 0;
+    }
+
+    if (BENCH_execute(name, runs) == false)
+        ESP_LOGW(__func__, "Unknown bench: %s", name);
+    return 0;
+}
+
+void BENCH_init(void) {
+    // a voltage record: slow drift with a few counts of noise
+    for (unsigned i = 0; i < CODEC_VALUES; ++i)
+        ctx.values[i] = 12000 + i / 8 + (int32_t)(i * 7919 % 7) - 3;
+    CLI_register_command("bench", "[list] [<name>] [runs <n>]", bench_command_execution);
+}
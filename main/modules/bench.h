@@ -0,0 +1,12 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+void BENCH_init(void);
+
+// runs one case by name or all of them when name is NULL, 0 runs uses the case default
+bool BENCH_execute(const char *name, unsigned runs);
+
+#endif // BENCH_H
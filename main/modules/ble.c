@@ -14,6 +14,9 @@
 
 // #include "nvs_flash.h"
 #include "modules/ble.h"
+#include "modules/config.h"
+#include "modules/power.h"
+#include "modules/trace.h"
 
 #define CONFIG_LOG_DEFAULT_LEVEL DEBUG
 #include <esp_log.h>
@@ -26,8 +29,6 @@
 
 #include <../src/ble_store_config.c>
 
-#include "nvs_flash.h"
-
 #define GATT_SVR_SVC_ALERT_UUID 0x1811
 #define GATT_MY_UUID 0x5000
 #define GATT_CURRENT_MEASURE_CTRL 0x5001
@@ -38,6 +39,24 @@
 #define GATT_RELAY 0x5006
 #define GATT_TEMPERATURE_CTRL 0x5007
 #define GATT_TEMPERATURE 0x5008
+#define GATT_CAPTURE_CTRL 0x5009
+#define GATT_CAPTURE 0x500A
+#define GATT_LOG_CTRL 0x500B
+#define GATT_LOG 0x500C
+#define GATT_ROLLUP_CTRL 0x500D
+#define GATT_ROLLUP 0x500E
+#define GATT_DIAGNOSTICS_CTRL 0x500F
+#define GATT_DIAGNOSTICS 0x5010
+#define GATT_CONFIG_CTRL 0x5011
+#define GATT_CONFIG 0x5012
+#define GATT_CALIBRATION_CTRL 0x5013
+#define GATT_CALIBRATION 0x5014
+#define GATT_RIPPLE_CTRL 0x5015
+#define GATT_RIPPLE 0x5016
+#define GATT_PLAN_CTRL 0x5017
+#define GATT_PLAN 0x5018
+#define GATT_ALARM_CTRL 0x5019
+#define GATT_ALARM 0x501A
 
 static uint8_t own_addr_type = 0;
 static uint16_t conn_handle;
@@ -52,6 +71,8 @@ static struct {
         uint16_t handle;
         CharacteristicCallback callback;
     } notify_chr[kLastMeasurementChr];
+    NotifyPolicy policies[kNotifyLastChannel];
+    NotifyState states[kNotifyLastChannel];
 } ctx = {
     .callback_pwm = NULL,
     .callback_relay = NULL,
@@ -59,9 +80,31 @@ static struct {
         { .name = kVoltage,     .handle = 0, .callback = NULL},
         { .name = kCurrent,     .handle = 0, .callback = NULL},
         { .name = kTemperature, .handle = 0, .callback = NULL},
+        { .name = kCapture,     .handle = 0, .callback = NULL},
+        { .name = kLog,         .handle = 0, .callback = NULL},
+        { .name = kRollup,      .handle = 0, .callback = NULL},
+        { .name = kDiagnostics, .handle = 0, .callback = NULL},
+        { .name = kConfig,      .handle = 0, .callback = NULL},
+        { .name = kCalibration, .handle = 0, .callback = NULL},
+        { .name = kRipple,      .handle = 0, .callback = NULL},
+        { .name = kPlan,        .handle = 0, .callback = NULL},
+        { .name = kAlarm,       .handle = 0, .callback = NULL},
     },
 };
 
+// modules register their handlers after BLE_init, a module that failed to
+// start never does, the write is dropped instead of calling NULL
+static void run_callback(Characteristic name, char *parameters, unsigned len) {
+    CharacteristicCallback callback = name == kPWM ? ctx.callback_pwm
+                                    : name == kRelay ? ctx.callback_relay
+                                    : ctx.notify_chr[name].callback;
+    if (callback == NULL) {
+        ESP_LOGW(__func__, "No handler for characteristic %d", name);
+        return;
+    }
+    callback(parameters, len);
+}
+
 static int voltage_ctrl_callback(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg) {
     ESP_LOGI(__func__, "Voltage callback");
 
@@ -78,7 +121,8 @@ static int voltage_ctrl_callback(uint16_t conn_handle, uint16_t attr_handle, str
         // parameters[len] = '\0';
         ESP_LOG_BUFFER_HEX("Incomming bytes:", parameters, len);
         ESP_LOGI(__func__, "Value: %s", parameters);
-        ctx.notify_chr[kVoltage].callback(parameters, len);
+        TRACE_event(kTraceCommand, kVoltage);
+        run_callback(kVoltage, parameters, len);
         return 0;
     }
 
@@ -105,7 +149,8 @@ static int current_ctrl_callback(uint16_t conn_handle, uint16_t attr_handle, str
         // parameters[len] = '\0';
         ESP_LOG_BUFFER_HEX("Bytes:", parameters, len);
         ESP_LOGI(__func__, "Value: %s", parameters);
-        ctx.notify_chr[kCurrent].callback(parameters, len);
+        TRACE_event(kTraceCommand, kCurrent);
+        run_callback(kCurrent, parameters, len);
         return 0;
     }
 
@@ -135,7 +180,8 @@ static int temperature_ctrl_callback(uint16_t conn_handle, uint16_t attr_handle,
         // parameters[len] = '\0';
         ESP_LOG_BUFFER_HEX("Incomming bytes:", parameters, len);
         ESP_LOGI(__func__, "Value: %s", parameters);
-        ctx.notify_chr[kTemperature].callback(parameters, len);
+        TRACE_event(kTraceCommand, kTemperature);
+        run_callback(kTemperature, parameters, len);
         return 0;
     }
 
@@ -147,6 +193,198 @@ static int temperature_ctrl_callback(uint16_t conn_handle, uint16_t attr_handle,
     return 0;
 }
 
+static int capture_ctrl_callback(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    ESP_LOGI(__func__, "Capture callback");
+
+    ESP_LOGI(__func__, "Operation type: %d", ctxt->op);
+    if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        char parameters[6 * (10 + 1) + 1] = { 0 };
+        struct os_mbuf *om;
+        om = ctxt->om;
+        uint8_t len = os_mbuf_len(om);
+        len = len < sizeof(parameters) - 1 ? len : sizeof(parameters) - 1;
+        assert(os_mbuf_copydata(om, 0, len, parameters) == 0);
+
+        ESP_LOG_BUFFER_HEX("Bytes:", parameters, len);
+        ESP_LOGI(__func__, "Value: %s", parameters);
+        TRACE_event(kTraceCommand, kCapture);
+        run_callback(kCapture, parameters, len);
+        return 0;
+    }
+
+    return 0;
+}
+
+static int log_ctrl_callback(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    ESP_LOGI(__func__, "Log callback");
+
+    ESP_LOGI(__func__, "Operation type: %d", ctxt->op);
+    if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        char parameters[10 + 1] = { 0 };
+        struct os_mbuf *om;
+        om = ctxt->om;
+        uint8_t len = os_mbuf_len(om);
+        len = len < sizeof(parameters) - 1 ? len : sizeof(parameters) - 1;
+        assert(os_mbuf_copydata(om, 0, len, parameters) == 0);
+
+        ESP_LOG_BUFFER_HEX("Bytes:", parameters, len);
+        ESP_LOGI(__func__, "Value: %s", parameters);
+        TRACE_event(kTraceCommand, kLog);
+        run_callback(kLog, parameters, len);
+        return 0;
+    }
+
+    return 0;
+}
+
+static int rollup_ctrl_callback(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    ESP_LOGI(__func__, "Rollup callback");
+
+    ESP_LOGI(__func__, "Operation type: %d", ctxt->op);
+    if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        char parameters[3 * (10 + 1) + 1] = { 0 };
+        struct os_mbuf *om;
+        om = ctxt->om;
+        uint8_t len = os_mbuf_len(om);
+        len = len < sizeof(parameters) - 1 ? len : sizeof(parameters) - 1;
+        assert(os_mbuf_copydata(om, 0, len, parameters) == 0);
+
+        ESP_LOG_BUFFER_HEX("Bytes:", parameters, len);
+        ESP_LOGI(__func__, "Value: %s", parameters);
+        TRACE_event(kTraceCommand, kRollup);
+        run_callback(kRollup, parameters, len);
+        return 0;
+    }
+
+    return 0;
+}
+
+static int diagnostics_ctrl_callback(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    ESP_LOGI(__func__, "Diagnostics callback");
+
+    ESP_LOGI(__func__, "Operation type: %d", ctxt->op);
+    if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        char parameters[10 + 1] = { 0 };
+        struct os_mbuf *om;
+        om = ctxt->om;
+        uint8_t len = os_mbuf_len(om);
+        len = len < sizeof(parameters) - 1 ? len : sizeof(parameters) - 1;
+        assert(os_mbuf_copydata(om, 0, len, parameters) == 0);
+
+        ESP_LOGI(__func__, "Value: %s", parameters);
+        TRACE_event(kTraceCommand, kDiagnostics);
+        run_callback(kDiagnostics, parameters, len);
+        return 0;
+    }
+
+    return 0;
+}
+
+static int config_ctrl_callback(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    ESP_LOGI(__func__, "Config callback");
+
+    ESP_LOGI(__func__, "Operation type: %d", ctxt->op);
+    if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        char parameters[4 + 16 + 4 * (10 + 1) + 1] = { 0 };
+        struct os_mbuf *om;
+        om = ctxt->om;
+        uint8_t len = os_mbuf_len(om);
+        len = len < sizeof(parameters) - 1 ? len : sizeof(parameters) - 1;
+        assert(os_mbuf_copydata(om, 0, len, parameters) == 0);
+
+        ESP_LOGI(__func__, "Value: %s", parameters);
+        TRACE_event(kTraceCommand, kConfig);
+        run_callback(kConfig, parameters, len);
+        return 0;
+    }
+
+    return 0;
+}
+
+static int calibration_ctrl_callback(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    ESP_LOGI(__func__, "Calibration callback");
+
+    ESP_LOGI(__func__, "Operation type: %d", ctxt->op);
+    if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        char parameters[4 + 16 + 4 * (10 + 1) + 1] = { 0 };
+        struct os_mbuf *om;
+        om = ctxt->om;
+        uint8_t len = os_mbuf_len(om);
+        len = len < sizeof(parameters) - 1 ? len : sizeof(parameters) - 1;
+        assert(os_mbuf_copydata(om, 0, len, parameters) == 0);
+
+        ESP_LOGI(__func__, "Value: %s", parameters);
+        TRACE_event(kTraceCommand, kCalibration);
+        run_callback(kCalibration, parameters, len);
+        return 0;
+    }
+
+    return 0;
+}
+
+static int ripple_ctrl_callback(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    ESP_LOGI(__func__, "Ripple callback");
+
+    ESP_LOGI(__func__, "Operation type: %d", ctxt->op);
+    if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        char parameters[4 + 16 + 4 * (10 + 1) + 1] = { 0 };
+        struct os_mbuf *om;
+        om = ctxt->om;
+        uint8_t len = os_mbuf_len(om);
+        len = len < sizeof(parameters) - 1 ? len : sizeof(parameters) - 1;
+        assert(os_mbuf_copydata(om, 0, len, parameters) == 0);
+
+        ESP_LOGI(__func__, "Value: %s", parameters);
+        TRACE_event(kTraceCommand, kRipple);
+        run_callback(kRipple, parameters, len);
+        return 0;
+    }
+
+    return 0;
+}
+
+static int plan_ctrl_callback(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    ESP_LOGI(__func__, "Plan callback");
+
+    ESP_LOGI(__func__, "Operation type: %d", ctxt->op);
+    if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        char parameters[4 + 16 + 4 * (10 + 1) + 1] = { 0 };
+        struct os_mbuf *om;
+        om = ctxt->om;
+        uint8_t len = os_mbuf_len(om);
+        len = len < sizeof(parameters) - 1 ? len : sizeof(parameters) - 1;
+        assert(os_mbuf_copydata(om, 0, len, parameters) == 0);
+
+        ESP_LOGI(__func__, "Value: %s", parameters);
+        TRACE_event(kTraceCommand, kPlan);
+        run_callback(kPlan, parameters, len);
+        return 0;
+    }
+
+    return 0;
+}
+
+static int alarm_ctrl_callback(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    ESP_LOGI(__func__, "Alarm callback");
+
+    ESP_LOGI(__func__, "Operation type: %d", ctxt->op);
+    if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        char parameters[4 + 16 + 4 * (10 + 1) + 1] = { 0 };
+        struct os_mbuf *om;
+        om = ctxt->om;
+        uint8_t len = os_mbuf_len(om);
+        len = len < sizeof(parameters) - 1 ? len : sizeof(parameters) - 1;
+        assert(os_mbuf_copydata(om, 0, len, parameters) == 0);
+
+        ESP_LOGI(__func__, "Value: %s", parameters);
+        TRACE_event(kTraceCommand, kAlarm);
+        run_callback(kAlarm, parameters, len);
+        return 0;
+    }
+
+    return 0;
+}
+
 static int pwm_ctrl_callback(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg) {
     ESP_LOGI(__func__, "PWM control callback");
 
@@ -162,7 +400,8 @@ static int pwm_ctrl_callback(uint16_t conn_handle, uint16_t attr_handle, struct
         // parameters[len] = '\0';
         ESP_LOG_BUFFER_HEX("Bytes:", parameters, len);
         ESP_LOGI(__func__, "Value: %s", parameters);
-        ctx.callback_pwm(parameters, len);
+        TRACE_event(kTraceCommand, kPWM);
+        run_callback(kPWM, parameters, len);
         return 0;
     }
 
@@ -174,17 +413,18 @@ static int relay_ctrl_callback(uint16_t conn_handle, uint16_t attr_handle, struc
 
     ESP_LOGI(__func__, "Operation type: %d", ctxt->op);
     if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
-        uint8_t parameters[10 + 1] = { 0 };
+        uint8_t parameters[3 + 4 * (1 + 10) + 1] = { 0 };
         struct os_mbuf *om;
         om = ctxt->om;
         uint8_t len = os_mbuf_len(om);
-        len = len < sizeof(parameters) ? len : sizeof(parameters);
+        len = len < sizeof(parameters) - 1 ? len : sizeof(parameters) - 1;
         assert(os_mbuf_copydata(om, 0, len, parameters) == 0);
 
         // parameters[len] = '\0';
         ESP_LOG_BUFFER_HEX("Bytes:", parameters, len);
         ESP_LOGI(__func__, "Value: %s", parameters);
-        ctx.callback_relay((char*)parameters, len);
+        TRACE_event(kTraceCommand, kRelay);
+        run_callback(kRelay, (char*)parameters, len);
         return 0;
     }
 
@@ -272,6 +512,18 @@ static int on_ble_gap_event(struct ble_gap_event *event, void *arg) {
             ESP_LOGD("BLE_GAP_SUBSCRIBE_EVENT", "conn_handle from subscribe=%d", conn_handle);
             break;
 
+        case BLE_GAP_EVENT_NOTIFY_TX:
+            if (event->notify_tx.status != 0)
+                break;
+
+            for (unsigned i = 0; i < kLastMeasurementChr; ++i) {
+                if (ctx.notify_chr[i].handle == event->notify_tx.attr_handle) {
+                    TRACE_event(kTraceNotifySent, ctx.notify_chr[i].name);
+                    break;
+                }
+            }
+            break;
+
         case BLE_GAP_EVENT_ADV_COMPLETE:
             MODLOG_DFLT(INFO, "advertise complete; reason = %d", event->adv_complete.reason);
             start_advertisement();
@@ -332,6 +584,105 @@ static const struct ble_gatt_svc_def kBleServices[] = {
              .val_handle = &ctx.notify_chr[kTemperature].handle,
              .flags = BLE_GATT_CHR_F_NOTIFY,
          },
+         {
+             .uuid = BLE_UUID16_DECLARE(GATT_CAPTURE_CTRL),
+             .access_cb = capture_ctrl_callback,
+             .flags = BLE_GATT_CHR_F_WRITE,
+         },
+         {
+             .uuid = BLE_UUID16_DECLARE(GATT_CAPTURE),
+             .access_cb = capture_ctrl_callback,
+             .val_handle = &ctx.notify_chr[kCapture].handle,
+             .flags = BLE_GATT_CHR_F_NOTIFY,
+         },
+         {
+             .uuid = BLE_UUID16_DECLARE(GATT_LOG_CTRL),
+             .access_cb = log_ctrl_callback,
+             .flags = BLE_GATT_CHR_F_WRITE,
+         },
+         {
+             .uuid = BLE_UUID16_DECLARE(GATT_LOG),
+             .access_cb = log_ctrl_callback,
+             .val_handle = &ctx.notify_chr[kLog].handle,
+             .flags = BLE_GATT_CHR_F_NOTIFY,
+         },
+         {
+             .uuid = BLE_UUID16_DECLARE(GATT_ROLLUP_CTRL),
+             .access_cb = rollup_ctrl_callback,
+             .flags = BLE_GATT_CHR_F_WRITE,
+         },
+         {
+             .uuid = BLE_UUID16_DECLARE(GATT_ROLLUP),
+             .access_cb = rollup_ctrl_callback,
+             .val_handle = &ctx.notify_chr[kRollup].handle,
+             .flags = BLE_GATT_CHR_F_NOTIFY,
+         },
+         {
+             .uuid = BLE_UUID16_DECLARE(GATT_DIAGNOSTICS_CTRL),
+             .access_cb = diagnostics_ctrl_callback,
+             .flags = BLE_GATT_CHR_F_WRITE,
+         },
+         {
+             .uuid = BLE_UUID16_DECLARE(GATT_DIAGNOSTICS),
+             .access_cb = diagnostics_ctrl_callback,
+             .val_handle = &ctx.notify_chr[kDiagnostics].handle,
+             .flags = BLE_GATT_CHR_F_NOTIFY,
+         },
+         {
+             .uuid = BLE_UUID16_DECLARE(GATT_CONFIG_CTRL),
+             .access_cb = config_ctrl_callback,
+             .flags = BLE_GATT_CHR_F_WRITE,
+         },
+         {
+             .uuid = BLE_UUID16_DECLARE(GATT_CONFIG),
+             .access_cb = config_ctrl_callback,
+             .val_handle = &ctx.notify_chr[kConfig].handle,
+             .flags = BLE_GATT_CHR_F_NOTIFY,
+         },
+         {
+             .uuid = BLE_UUID16_DECLARE(GATT_CALIBRATION_CTRL),
+             .access_cb = calibration_ctrl_callback,
+             .flags = BLE_GATT_CHR_F_WRITE,
+         },
+         {
+             .uuid = BLE_UUID16_DECLARE(GATT_CALIBRATION),
+             .access_cb = calibration_ctrl_callback,
+             .val_handle = &ctx.notify_chr[kCalibration].handle,
+             .flags = BLE_GATT_CHR_F_NOTIFY,
+         },
+         {
+             .uuid = BLE_UUID16_DECLARE(GATT_RIPPLE_CTRL),
+             .access_cb = ripple_ctrl_callback,
+             .flags = BLE_GATT_CHR_F_WRITE,
+         },
+         {
+             .uuid = BLE_UUID16_DECLARE(GATT_RIPPLE),
+             .access_cb = ripple_ctrl_callback,
+             .val_handle = &ctx.notify_chr[kRipple].handle,
+             .flags = BLE_GATT_CHR_F_NOTIFY,
+         },
+         {
+             .uuid = BLE_UUID16_DECLARE(GATT_PLAN_CTRL),
+             .access_cb = plan_ctrl_callback,
+             .flags = BLE_GATT_CHR_F_WRITE,
+         },
+         {
+             .uuid = BLE_UUID16_DECLARE(GATT_PLAN),
+             .access_cb = plan_ctrl_callback,
+             .val_handle = &ctx.notify_chr[kPlan].handle,
+             .flags = BLE_GATT_CHR_F_NOTIFY,
+         },
+         {
+             .uuid = BLE_UUID16_DECLARE(GATT_ALARM_CTRL),
+             .access_cb = alarm_ctrl_callback,
+             .flags = BLE_GATT_CHR_F_WRITE,
+         },
+         {
+             .uuid = BLE_UUID16_DECLARE(GATT_ALARM),
+             .access_cb = alarm_ctrl_callback,
+             .val_handle = &ctx.notify_chr[kAlarm].handle,
+             .flags = BLE_GATT_CHR_F_INDICATE,
+         },
          {
              0,
          },
@@ -420,15 +771,6 @@ static void setup_callbacks(void) {
     ble_hs_cfg.store_status_cb = ble_store_util_status_rr;
 }
 
-static bool init_nvs(void) {
-    esp_err_t ret = nvs_flash_init();
-    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        ret = nvs_flash_init();
-    }
-    return ret == ESP_OK ? true : false;
-}
-
 static void start_ble_server(void *param) {
     ESP_LOGI("BLE task", "BLE Host Task Started");
 
@@ -436,10 +778,28 @@ static void start_ble_server(void *param) {
     nimble_port_freertos_deinit();
 }
 
-bool BLE_init(void) {
-    if (init_nvs() == false)
-        return false;
+// NVS has to be initialized before, see CONFIG_init
+// the policed characteristics lead the enum in the order of the policies
+_Static_assert(kVoltage == (int)kNotifyVoltage && kCurrent == (int)kNotifyCurrent
+               && kTemperature == (int)kNotifyTemperature, "notify policy order");
+
+bool BLE_notify_due(Characteristic name, int64_t timestamp, const int32_t *values, unsigned count) {
+    if (name >= kNotifyLastChannel)
+        return true;
+    return NOTIFY_CORE_due(&ctx.policies[name], &ctx.states[name], timestamp, values, count);
+}
+
+static void apply_config(const Config *config) {
+    for (unsigned i = 0; i < kNotifyLastChannel; ++i) {
+        // a changed policy starts with a notification
+        if (memcmp(&ctx.policies[i], &config->notify[i], sizeof(NotifyPolicy)) != 0)
+            NOTIFY_CORE_reset(&ctx.states[i]);
+        ctx.policies[i] = config->notify[i];
+    }
+}
 
+bool BLE_init(void) {
+    CONFIG_register_listener(apply_config);
     if (init_ble_controller_and_stack() != true)
         return false;
 
@@ -486,9 +846,58 @@ void BLE_update_value(Characteristic name, char *buffer) {
     struct os_mbuf *om;
     om = ble_hs_mbuf_from_flat(&ctx.notify_chr[name].value, sizeof(ctx.notify_chr[name].value));
     // rc =
+    TRACE_event(kTraceNotifyQueued, name);
     int rc = ble_gatts_notify_custom(conn_handle, ctx.notify_chr[name].handle, om);
     if (rc != 0) {
         ESP_LOGE(__func__, "error notifying; rc=%d", rc);
         return;
     }
 }
+
+bool BLE_notify_raw(Characteristic name, const uint8_t *data, unsigned length) {
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(data, length);
+    if (om == NULL)
+        return false;
+
+    TRACE_event(kTraceNotifyQueued, name);
+    int rc = ble_gatts_notify_custom(conn_handle, ctx.notify_chr[name].handle, om);
+    if (rc != 0) {
+        ESP_LOGD(__func__, "error notifying; rc=%d", rc);
+        return false;
+    }
+    return true;
+}
+
+bool BLE_indicate_raw(Characteristic name, const uint8_t *data, unsigned length) {
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(data, length);
+    if (om == NULL)
+        return false;
+
+    TRACE_event(kTraceNotifyQueued, name);
+    int rc = ble_gatts_indicate_custom(conn_handle, ctx.notify_chr[name].handle, om);
+    if (rc != 0) {
+        ESP_LOGD(__func__, "error indicating; rc=%d", rc);
+        return false;
+    }
+    return true;
+}
+
+bool BLE_stream_raw(Characteristic name, const uint8_t *data, unsigned length) {
+    // the host drains the mbufs in the gaps, they are too short to sleep through
+    POWER_lock(kPowerNoSleep);
+    bool ret = false;
+    for (unsigned attempt = 0; attempt < 50 && ret == false; ++attempt) {
+        ret = BLE_notify_raw(name, data, length);
+        // NimBLE mbuf pool exhausted, let the host drain it
+        if (ret == false)
+            vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    POWER_unlock(kPowerNoSleep);
+    return ret;
+}
+
+unsigned BLE_get_payload_size(void) {
+    // ATT notification header: opcode + attribute handle
+    uint16_t mtu = ble_att_mtu(conn_handle);
+    return (mtu > BLE_ATT_MTU_DFLT ? mtu : BLE_ATT_MTU_DFLT) - 3;
+}
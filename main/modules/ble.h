@@ -9,6 +9,15 @@ typedef enum {
     kVoltage = 0,
     kCurrent,
     kTemperature,
+    kCapture,
+    kLog,
+    kRollup,
+    kDiagnostics,
+    kConfig,
+    kCalibration,
+    kRipple,
+    kPlan,
+    kAlarm,
 // sentinel
     kLastMeasurementChr,
 
@@ -24,5 +33,13 @@ bool BLE_init(void);
 
 void BLE_setup_characteristic_callback(Characteristic name, CharacteristicCallback callback);
 void BLE_update_value(Characteristic name, char *buffer);
+// report policy of the voltage, current and temperature characteristics (notify.* in
+// the config), asked before formatting; the value then counts as sent
+bool BLE_notify_due(Characteristic name, int64_t timestamp, const int32_t *values, unsigned count);
+bool BLE_notify_raw(Characteristic name, const uint8_t *data, unsigned length);
+bool BLE_stream_raw(Characteristic name, const uint8_t *data, unsigned length);
+// acknowledged by the client, false while the previous indication is unconfirmed
+bool BLE_indicate_raw(Characteristic name, const uint8_t *data, unsigned length);
+unsigned BLE_get_payload_size(void);
 
 #endif  // BLE_H
\ No newline at end of file
@@ -0,0 +1,323 @@
+#include "modules/calib.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "modules/base/generic_fun.h"
+#include "modules/cli.h"
+#include "modules/ble.h"
+#include "modules/adc.h"
+#include "modules/ct.h"
+#include "modules/config.h"
+#include "modules/power.h"
+#include "modules/worker.h"
+
+// calib start voltage
+// calib point 5000
+// calib point 12000 averages 8
+// calib fit poly2
+// calib save
+
+#define DEFAULT_AVERAGES 4
+#define MAX_AVERAGES 100
+
+static const char *channel_names[kCalibLastChannel] = {
+    [kCalibVoltage] = "voltage",
+    [kCalibCurrent] = "current",
+};
+
+static struct {
+    CalibChannel channel;
+    CalibPoint points[CALIB_MAX_POINTS];
+    unsigned count;
+
+    // point being measured
+    float reference;
+    unsigned averages;
+    bool reply_ble;
+    volatile bool ongoing;
+
+    CalibModel fit;
+    bool fitted;
+} ctx = { 0 };
+
+// points are measured on the session worker
+BUDGET_CHECK(sizeof(ctx), BUDGET_CALIB);
+
+static char *FindArgumentValue(int argc, char **argv, const char *arg) {
+    for (int i = 1; i < argc - 1; i++) {
+        if (AreStringsTheSame(arg, argv[i], strlen(arg) + 1))
+            return argv[i + 1];
+    }
+    return NULL;
+}
+
+static bool parse_channel(const char *name, CalibChannel *channel) {
+    for (unsigned i = 0; i < kCalibLastChannel; ++i) {
+        if (AreStringsTheSame(channel_names[i], name, strlen(channel_names[i]) + 1)) {
+            *channel = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// "poly1".."poly3" -> degree, "piecewise" -> 0
+static bool parse_kind(const char *name, unsigned *degree) {
+    if (AreStringsTheSame("piecewise", name, sizeof("piecewise"))) {
+        *degree = 0;
+        return true;
+    }
+
+    if (AreStringsTheSame("poly", name, strlen("poly")) == false)
+        return false;
+
+    char *end = NULL;
+    unsigned long value = strtoul(name + strlen("poly"), &end, 10);
+    if (end == name + strlen("poly") || *end != '\0' || value < 1 || value > CALIB_MAX_DEGREE)
+        return false;
+
+    *degree = value;
+    return true;
+}
+
+static const CalibModel *active_model(void) {
+    const Config *config = CONFIG_get();
+    return ctx.channel == kCalibVoltage ? &config->adc.model : &config->ct.model;
+}
+
+static void reply(const char *text) {
+    BLE_notify_raw(kCalibration, (const uint8_t *)text, strlen(text));
+}
+
+static void measure_point(void *arg) {
+    float sum = 0;
+    POWER_lock(kPowerCpu);
+    for (unsigned i = 0; i < ctx.averages; ++i)
+        sum += ctx.channel == kCalibVoltage ? ADC_read_uncorrected() : CT_read_uncorrected();
+    POWER_unlock(kPowerCpu);
+
+    unsigned index = ctx.count;
+    ctx.points[index].measured = sum / ctx.averages;
+    ctx.points[index].reference = ctx.reference;
+    ctx.count = index + 1;
+    ctx.fitted = false;
+
+    ESP_LOGI(__func__, "CALIB %s point %u: [measured %f] [reference %f]",
+             channel_names[ctx.channel], index, ctx.points[index].measured, ctx.reference);
+    if (ctx.reply_ble) {
+        char line[64];
+        snprintf(line, sizeof(line), "point,%u,%g,%g", index, ctx.points[index].measured, ctx.reference);
+        reply(line);
+    }
+    ctx.ongoing = false;
+}
+
+static bool zero_missing(CalibChannel channel) {
+    // current points are zero corrected like the read path, a point without it would carry the offset into a0
+    if (channel != kCalibCurrent || CT_has_zero())
+        return false;
+    ESP_LOGW(__func__, "No CT zero yet, run 'ct zero now' with the outputs off");
+    return true;
+}
+
+static bool add_point(float reference, unsigned averages, bool reply_ble) {
+    if (ctx.ongoing || ctx.count >= CALIB_MAX_POINTS || zero_missing(ctx.channel))
+        return false;
+
+    if (averages == 0 || averages > MAX_AVERAGES)
+        return false;
+
+    ctx.reference = reference;
+    ctx.averages = averages;
+    ctx.reply_ble = reply_ble;
+    ctx.ongoing = true;
+    if (WORKER_session(measure_point, NULL) == false) {
+        ctx.ongoing = false;
+        return false;
+    }
+    return true;
+}
+
+bool CALIB_start(CalibChannel channel) {
+    if (ctx.ongoing || channel >= kCalibLastChannel || zero_missing(channel))
+        return false;
+
+    ctx.channel = channel;
+    ctx.count = 0;
+    ctx.fitted = false;
+    return true;
+}
+
+bool CALIB_add_point(float reference, unsigned averages) {
+    return add_point(reference, averages, false);
+}
+
+bool CALIB_fit(unsigned degree, CalibResiduals *residuals) {
+    if (ctx.ongoing)
+        return false;
+
+    ctx.fitted = degree == 0 ? CALIB_CORE_fit_piecewise(ctx.points, ctx.count, &ctx.fit)
+                             : CALIB_CORE_fit_polynomial(ctx.points, ctx.count, degree, &ctx.fit);
+    if (ctx.fitted && residuals != NULL)
+        *residuals = CALIB_CORE_residuals(&ctx.fit, ctx.points, ctx.count, NULL);
+    return ctx.fitted;
+}
+
+static void store_model(Config *config, const void *arg) {
+    CalibModel *model = ctx.channel == kCalibVoltage ? &config->adc.model : &config->ct.model;
+    *model = *(const CalibModel *)arg;
+}
+
+bool CALIB_save(void) {
+    if (ctx.fitted == false)
+        return false;
+
+    // only the model, whatever 'config set' staged is left for its own commit
+    return CONFIG_apply(store_model, &ctx.fit);
+}
+
+static void log_model(const CalibModel *model) {
+    if (model->kind == kCalibPolynomial) {
+        ESP_LOGI(__func__, "CALIB model: [a0 %g] [a1 %g] [a2 %g] [a3 %g]",
+                 model->coeffs[0], model->coeffs[1], model->coeffs[2], model->coeffs[3]);
+        return;
+    }
+
+    for (unsigned i = 0; i < model->count; ++i)
+        ESP_LOGI(__func__, "CALIB node %u: [x %g] [y %g]", i, model->x[i], model->y[i]);
+}
+
+static void log_residuals(const CalibModel *model) {
+    float residuals[CALIB_MAX_POINTS];
+    CalibResiduals summary = CALIB_CORE_residuals(model, ctx.points, ctx.count, residuals);
+    for (unsigned i = 0; i < ctx.count; ++i) {
+        ESP_LOGI(__func__, "CALIB point %u: [measured %g] [reference %g] [residual %g]",
+                 i, ctx.points[i].measured, ctx.points[i].reference, residuals[i]);
+    }
+    ESP_LOGI(__func__, "CALIB residuals: [rms %g] [max %g]", summary.rms, summary.max);
+}
+
+static int calib_command_execution(int argc, char **argv) {
+    if (argc == 1) {
+        ESP_LOGI(__func__, "No arguments");
+        return 0;
+    }
+
+    if (AreStringsTheSame("start", argv[1], sizeof("start"))) {
+        CalibChannel channel;
+        bool ret = argc > 2 && parse_channel(argv[2], &channel) && CALIB_start(channel);
+        ESP_LOGI(__func__, "CALIB: %s", ret ? "started" : "errors occurs");
+        return 0;
+    }
+
+    if (AreStringsTheSame("point", argv[1], sizeof("point"))) {
+        if (argc < 3) {
+            ESP_LOGW(__func__, "Missing reference");
+            return 0;
+        }
+
+        unsigned averages = DEFAULT_AVERAGES;
+        char *value = FindArgumentValue(argc, argv, "averages");
+        if (value != NULL)
+            averages = strtoul(value, NULL, 10);
+
+        ESP_LOGI(__func__, "CALIB: %s", CALIB_add_point(strtof(argv[2], NULL), averages) ? "measuring" : "errors occurs");
+        return 0;
+    }
+
+    if (AreStringsTheSame("fit", argv[1], sizeof("fit"))) {
+        unsigned degree;
+        if (argc < 3 || parse_kind(argv[2], &degree) == false) {
+            ESP_LOGW(__func__, "Expected poly1, poly2, poly3 or piecewise");
+            return 0;
+        }
+
+        if (CALIB_fit(degree, NULL) == false) {
+            ESP_LOGW(__func__, "CALIB: fit failed with %u points", ctx.count);
+            return 0;
+        }
+        log_model(&ctx.fit);
+        log_residuals(&ctx.fit);
+        return 0;
+    }
+
+    if (AreStringsTheSame("save", argv[1], sizeof("save"))) {
+        ESP_LOGI(__func__, "CALIB: %s", CALIB_save() ? "saved" : "errors occurs");
+        return 0;
+    }
+
+    if (AreStringsTheSame("clear", argv[1], sizeof("clear"))) {
+        CALIB_start(ctx.channel);
+        return 0;
+    }
+
+    if (AreStringsTheSame("status", argv[1], sizeof("status"))) {
+        // how well the model in use fits the collected points
+        ESP_LOGI(__func__, "CALIB %s: %u points%s", channel_names[ctx.channel], ctx.count, ctx.ongoing ? ", measuring" : "");
+        if (ctx.channel == kCalibCurrent)
+            ESP_LOGI(__func__, "CALIB current: points and model input are zero corrected, refit models saved before the CT zero");
+        log_model(active_model());
+        log_residuals(active_model());
+        return 0;
+    }
+
+    ESP_LOGW(__func__, "Unknown subcommand: %s", argv[1]);
+    return 0;
+}
+
+// "start,<voltage|current>" | "point,<reference>[,<averages>]" | "fit,<poly1|poly2|poly3|piecewise>" | "save" | "clear"
+// answered with "point,<index>,<measured>,<reference>" once measured, "fit,<rms>,<max>", "ok" or "error"
+static void parse_ble_command(char *buffer, unsigned length) {
+    if (AreStringsTheSame("start,", buffer, strlen("start,"))) {
+        CalibChannel channel;
+        bool ret = parse_channel(buffer + strlen("start,"), &channel) && CALIB_start(channel);
+        reply(ret ? "ok" : "error");
+        return;
+    }
+
+    if (AreStringsTheSame("point,", buffer, strlen("point,"))) {
+        char *end = NULL;
+        float reference = strtof(buffer + strlen("point,"), &end);
+        unsigned averages = *end == ',' ? strtoul(end + 1, NULL, 10) : DEFAULT_AVERAGES;
+        if (add_point(reference, averages, true) == false)
+            reply("error");
+        return;
+    }
+
+    if (AreStringsTheSame("fit,", buffer, strlen("fit,"))) {
+        unsigned degree;
+        CalibResiduals residuals;
+        if (parse_kind(buffer + strlen("fit,"), &degree) == false || CALIB_fit(degree, &residuals) == false) {
+            reply("error");
+            return;
+        }
+
+        char line[48];
+        snprintf(line, sizeof(line), "fit,%g,%g", residuals.rms, residuals.max);
+        reply(line);
+        return;
+    }
+
+    if (AreStringsTheSame("save", buffer, strlen("save"))) {
+        reply(CALIB_save() ? "ok" : "error");
+    } else if (AreStringsTheSame("clear", buffer, strlen("clear"))) {
+        reply(CALIB_start(ctx.channel) ? "ok" : "error");
+    } else {
+        reply("error");
+    }
+}
+
+void CALIB_init(void) {
+    CLI_register_command("calib",
+                         "[start <voltage|current>] [point <reference> [averages <n>]] [fit <poly1|poly2|poly3|piecewise>] [save] [clear] [status], current needs a CT zero",
+                         calib_command_execution);
+    BLE_setup_characteristic_callback(kCalibration, parse_ble_command);
+}
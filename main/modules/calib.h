@@ -0,0 +1,30 @@
+#ifndef CALIB_H
+#define CALIB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/core/calib_core.h"
+
+typedef enum {
+    kCalibVoltage = 0,      // divider output [mV] -> input [mV]
+    kCalibCurrent,          // zero corrected CT current [A] -> current [A], needs a CT zero
+// sentinel
+    kCalibLastChannel
+} CalibChannel;
+
+void CALIB_init(void);
+
+// clears the collected points and selects the channel they belong to
+bool CALIB_start(CalibChannel channel);
+
+// averages the uncorrected channel while the known reference is applied, runs in the background
+bool CALIB_add_point(float reference, unsigned averages);
+
+// degree 1..3, or 0 for piecewise linear
+bool CALIB_fit(unsigned degree, CalibResiduals *residuals);
+
+// stores the last fit in the configuration, active at once
+bool CALIB_save(void);
+
+#endif // CALIB_H
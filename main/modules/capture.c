@@ -0,0 +1,520 @@
+#include "modules/capture.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "modules/base/generic_fun.h"
+#include "modules/base/codec.h"
+#include "modules/cli.h"
+#include "modules/ble.h"
+#include "modules/adc.h"
+#include "modules/ct.h"
+#include "modules/power.h"
+#include "modules/worker.h"
+
+#define DUMP_LINE_BYTES 32
+#define PACKED_FRAMES 128           // at most per packed BLE notification
+#define LOAD_FRAMES 16
+
+static struct {
+    CaptureConfig config;
+    volatile CaptureState state;
+    volatile bool event_pending;
+
+    uint32_t period;            // microseconds
+    unsigned head;
+    unsigned filled;
+    unsigned trigger_index;
+    unsigned pre_available;
+    unsigned remaining;
+    uint32_t overruns;
+    int64_t trigger_time;
+
+    uint16_t samples[CAPTURE_MAX_FRAMES * CAPTURE_CHANNELS];
+    // codes per channel for the codec, packed BLE dump on the report worker only
+    int32_t packed[CAPTURE_CHANNELS][PACKED_FRAMES];
+} ctx = {
+    .config = {
+        .trigger    = kCaptureTriggerRising,
+        .channel    = 1,
+        .events     = kCaptureEventRelay | kCaptureEventPwm,
+        .threshold  = 2048,
+        .rate       = 10000,
+        .depth      = CAPTURE_MAX_FRAMES,
+        .pre        = CAPTURE_MAX_FRAMES / 4,
+        .timeout    = 10000,
+    },
+};
+
+WORKER_DEFINE(worker, "capture", TASK_STACK_SIZE, TASK_PRIORITY_CAPTURE, TASK_CORE_ACQUISITION);
+BUDGET_CHECK(sizeof(ctx) + WORKER_FOOTPRINT(TASK_STACK_SIZE), BUDGET_CAPTURE);
+
+static const char *trigger_names[] = {
+    [kCaptureTriggerNow]        = "now",
+    [kCaptureTriggerLevel]      = "level",
+    [kCaptureTriggerRising]     = "rising",
+    [kCaptureTriggerFalling]    = "falling",
+    [kCaptureTriggerEvent]      = "event",
+};
+
+static const char *state_names[] = {
+    [kCaptureIdle]      = "idle",
+    [kCaptureArmed]     = "armed",
+    [kCaptureTriggered] = "triggered",
+    [kCaptureDone]      = "done",
+};
+
+static char *FindArgumentValue(int argc, char **argv, const char *arg) {
+    for (int i = 1; i < argc - 1; i++) {
+        if (AreStringsTheSame(arg, argv[i], strlen(arg) + 1))
+            return argv[i + 1];
+    }
+    return NULL;
+}
+
+static bool check_trigger(uint16_t previous, uint16_t current) {
+    switch (ctx.config.trigger) {
+        case kCaptureTriggerNow:
+            return true;
+        case kCaptureTriggerLevel:
+            return current >= ctx.config.threshold;
+        case kCaptureTriggerRising:
+            return previous < ctx.config.threshold && current >= ctx.config.threshold;
+        case kCaptureTriggerFalling:
+            return previous >= ctx.config.threshold && current < ctx.config.threshold;
+        case kCaptureTriggerEvent:
+            return ctx.event_pending;
+    }
+    return false;
+}
+
+static void capture_task(void *arg) {
+    const unsigned depth = ctx.config.depth;
+    uint16_t previous = 0;
+    bool first = true;
+    const int64_t tick_us = portTICK_PERIOD_MS * 1000;
+    int64_t next = esp_timer_get_time();
+    const int64_t deadline = next + (int64_t)ctx.config.timeout * 1000;
+    int64_t yielded = next;
+
+    POWER_lock(kPowerCpu);
+    while (ctx.state == kCaptureArmed || ctx.state == kCaptureTriggered) {
+        int64_t now = esp_timer_get_time();
+        if (ctx.state == kCaptureArmed && now >= deadline) {
+            ctx.state = kCaptureIdle;
+            ESP_LOGW(__func__, "CAPTURE: no trigger in %" PRIu32 " ms", ctx.config.timeout);
+            break;
+        }
+
+        // the task runs at high priority on core 1, while armed IDLE1 gets a tick at
+        // least every CAPTURE_YIELD_MS to feed the task watchdog, which watches both
+        // idle tasks; the post-trigger window is bounded by CAPTURE_MAX_SPIN_MS
+        if (next - now > 2 * tick_us) {
+            vTaskDelay((next - now - tick_us) / tick_us);
+            yielded = esp_timer_get_time();
+        } else if (ctx.state == kCaptureArmed && now - yielded >= CAPTURE_YIELD_MS * 1000) {
+            vTaskDelay(1);
+            yielded = esp_timer_get_time();
+            // pre-trigger frames have to be evenly spaced, they start again after the tick
+            ctx.filled = 0;
+            first = true;
+            next = yielded;
+        }
+
+        now = esp_timer_get_time();
+        while (now < next)
+            now = esp_timer_get_time();
+
+        if (now - next >= ctx.period)
+            ctx.overruns += 1;
+        next += ctx.period;
+
+        uint16_t *frame = &ctx.samples[ctx.head * CAPTURE_CHANNELS];
+        frame[0] = ADC_read_raw();
+        frame[1] = CT_read_raw();
+
+        unsigned index = ctx.head;
+        ctx.head = ctx.head + 1 == depth ? 0 : ctx.head + 1;
+        if (ctx.filled < depth)
+            ctx.filled += 1;
+
+        uint16_t current = frame[ctx.config.channel];
+        if (first) {
+            previous = current;
+            first = false;
+        }
+
+        if (ctx.state == kCaptureArmed) {
+            if (check_trigger(previous, current)) {
+                ctx.trigger_index = index;
+                ctx.trigger_time = now;
+                ctx.pre_available = ctx.filled - 1 < ctx.config.pre ? ctx.filled - 1 : ctx.config.pre;
+                // trigger frame is the first post-trigger frame
+                ctx.remaining = depth - ctx.config.pre - 1;
+                ctx.state = ctx.remaining == 0 ? kCaptureDone : kCaptureTriggered;
+            }
+        } else if (--ctx.remaining == 0) {
+            ctx.state = kCaptureDone;
+        }
+
+        previous = current;
+    }
+    POWER_unlock(kPowerCpu);
+
+    ctx.event_pending = false;
+    if (ctx.state == kCaptureDone) {
+        ESP_LOGI(__func__, "CAPTURE: done [pre %u] [post %" PRIu32 "] [overruns %" PRIu32 "]",
+                 ctx.pre_available, ctx.config.depth - ctx.config.pre, ctx.overruns);
+    }
+}
+
+unsigned CAPTURE_get_header(CaptureHeader *header) {
+    if (ctx.state != kCaptureDone)
+        return 0;
+
+    unsigned post = ctx.config.depth - ctx.config.pre;
+    *header = (CaptureHeader) {
+        .magic          = CAPTURE_MAGIC,
+        .version        = 1,
+        .channels       = CAPTURE_CHANNELS,
+        .trigger        = ctx.config.trigger,
+        .channel        = ctx.config.channel,
+        .rate           = ctx.config.rate,
+        .pre            = ctx.pre_available,
+        .post           = post,
+        .overruns       = ctx.overruns,
+        .trigger_time   = ctx.trigger_time,
+    };
+    return ctx.pre_available + post;
+}
+
+unsigned CAPTURE_copy_frames(unsigned first, uint16_t *frames, unsigned count) {
+    if (ctx.state != kCaptureDone)
+        return 0;
+
+    const unsigned depth = ctx.config.depth;
+    unsigned total = ctx.pre_available + ctx.config.depth - ctx.config.pre;
+    if (first >= total)
+        return 0;
+    if (count > total - first)
+        count = total - first;
+
+    unsigned start = (ctx.trigger_index + depth - ctx.pre_available + first) % depth;
+    for (unsigned i = 0; i < count; ++i) {
+        memcpy(&frames[i * CAPTURE_CHANNELS], &ctx.samples[start * CAPTURE_CHANNELS], CAPTURE_CHANNELS * sizeof(uint16_t));
+        start = start + 1 == depth ? 0 : start + 1;
+    }
+    return count;
+}
+
+static void dump_bytes(unsigned offset, const uint8_t *data, unsigned length) {
+    char line[8 + 2 * DUMP_LINE_BYTES + 1];
+    while (length > 0) {
+        unsigned chunk = length < DUMP_LINE_BYTES ? length : DUMP_LINE_BYTES;
+        int pos = snprintf(line, sizeof(line), "%06X ", offset);
+        for (unsigned i = 0; i < chunk; ++i)
+            pos += snprintf(line + pos, sizeof(line) - pos, "%02X", data[i]);
+
+        printf("CAP %s\n", line);
+        offset += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+static void dump_cli(void) {
+    CaptureHeader header;
+    unsigned total = CAPTURE_get_header(&header);
+    if (total == 0) {
+        ESP_LOGW(__func__, "No finished capture");
+        return;
+    }
+
+    dump_bytes(0, (const uint8_t *)&header, sizeof(header));
+    unsigned offset = sizeof(header);
+
+    uint16_t frames[DUMP_LINE_BYTES / sizeof(uint16_t)];
+    const unsigned frames_per_line = DUMP_LINE_BYTES / (CAPTURE_CHANNELS * sizeof(uint16_t));
+    for (unsigned first = 0; first < total; first += frames_per_line) {
+        unsigned count = CAPTURE_copy_frames(first, frames, frames_per_line);
+        dump_bytes(offset, (const uint8_t *)frames, count * CAPTURE_CHANNELS * sizeof(uint16_t));
+        offset += count * CAPTURE_CHANNELS * sizeof(uint16_t);
+    }
+    printf("CAP END %u\n", offset);
+}
+
+// frames from first on, split per channel
+static unsigned load_channels(unsigned first, unsigned count) {
+    uint16_t frames[LOAD_FRAMES * CAPTURE_CHANNELS];
+    unsigned loaded = 0;
+    while (loaded < count) {
+        unsigned chunk = CAPTURE_copy_frames(first + loaded, frames, count - loaded < LOAD_FRAMES ? count - loaded : LOAD_FRAMES);
+        if (chunk == 0)
+            break;
+
+        for (unsigned i = 0; i < chunk; ++i) {
+            for (unsigned channel = 0; channel < CAPTURE_CHANNELS; ++channel)
+                ctx.packed[channel][loaded + i] = frames[i * CAPTURE_CHANNELS + channel];
+        }
+        loaded += chunk;
+    }
+    return loaded;
+}
+
+// the loaded frames that fit in max bytes, fewer frames until every channel fits in its share
+static unsigned pack_frames(uint8_t *out, unsigned max, unsigned *count) {
+    unsigned frames = *count;
+    while (frames > 0) {
+        unsigned pos = sizeof(uint16_t);
+        unsigned fitted = frames;
+        for (unsigned channel = 0; channel < CAPTURE_CHANNELS && fitted == frames; ++channel) {
+            unsigned share = (max - pos) / (CAPTURE_CHANNELS - channel);
+            if (share < 1 + CODEC_SIMPLE8B_WORD)
+                return 0;
+
+            size_t length = CODEC_encode_simple8b(ctx.packed[channel], frames, 0, out + pos + 1, share - 1, &fitted);
+            out[pos] = length / CODEC_SIMPLE8B_WORD;
+            pos += 1 + length;
+        }
+
+        if (fitted == frames) {
+            uint16_t header = frames;
+            memcpy(out, &header, sizeof(header));
+            *count = frames;
+            return pos;
+        }
+        frames = fitted;
+    }
+    return 0;
+}
+
+// every notification: uint16 sequence number + payload, sequence 0 carries the header
+static void dump_ble(bool packed) {
+    CaptureHeader header;
+    unsigned total = CAPTURE_get_header(&header);
+    if (total == 0) {
+        ESP_LOGW(__func__, "No finished capture");
+        return;
+    }
+    if (packed)
+        header.version = CAPTURE_PACKED_VERSION;
+
+    uint16_t packet[128];
+    unsigned payload = BLE_get_payload_size();
+    payload = payload < sizeof(packet) ? payload : sizeof(packet);
+    const unsigned frame_bytes = CAPTURE_CHANNELS * sizeof(uint16_t);
+    const unsigned frames_per_packet = (payload - sizeof(uint16_t)) / frame_bytes;
+
+    uint16_t sequence = 0;
+    packet[0] = sequence;
+    memcpy(&packet[1], &header, sizeof(header));
+    bool ok = BLE_stream_raw(kCapture, (const uint8_t *)packet, sizeof(sequence) + sizeof(header));
+
+    for (unsigned first = 0, count = 0; ok && first < total; first += count) {
+        packet[0] = ++sequence;
+        unsigned length;
+        if (packed) {
+            count = load_channels(first, total - first < PACKED_FRAMES ? total - first : PACKED_FRAMES);
+            length = pack_frames((uint8_t *)&packet[1], payload - sizeof(sequence), &count);
+        } else {
+            count = CAPTURE_copy_frames(first, &packet[1], frames_per_packet);
+            length = count * frame_bytes;
+        }
+        ok = count > 0 && BLE_stream_raw(kCapture, (const uint8_t *)packet, sizeof(sequence) + length);
+    }
+
+    ESP_LOGI(__func__, "CAPTURE: BLE dump %s [%u packets] [%u frames]", ok ? "finished" : "failed", sequence + 1,
+             total);
+}
+
+static void dump_ble_raw(void *arg) {
+    dump_ble(false);
+}
+
+static void dump_ble_packed(void *arg) {
+    dump_ble(true);
+}
+
+static bool parse_trigger(const char *name, CaptureTrigger *trigger) {
+    for (unsigned i = 0; i < sizeof(trigger_names) / sizeof(trigger_names[0]); ++i) {
+        if (AreStringsTheSame(trigger_names[i], name, strlen(trigger_names[i]) + 1)) {
+            *trigger = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int capture_command_execution(int argc, char **argv) {
+    if (argc == 1) {
+        ESP_LOGI(__func__, "CAPTURE: %s", state_names[ctx.state]);
+        return 0;
+    }
+
+    if (AreStringsTheSame("abort", argv[1], sizeof("abort"))) {
+        CAPTURE_abort();
+        return 0;
+    }
+
+    if (AreStringsTheSame("dump", argv[1], sizeof("dump"))) {
+        dump_cli();
+        return 0;
+    }
+
+    if (AreStringsTheSame("arm", argv[1], sizeof("arm")) == false) {
+        ESP_LOGW(__func__, "Unknown subcommand: %s", argv[1]);
+        return 0;
+    }
+
+    CaptureConfig config = ctx.config;
+    char *value = FindArgumentValue(argc, argv, "trigger");
+    if (value != NULL && parse_trigger(value, &config.trigger) == false) {
+        ESP_LOGW(__func__, "Unknown trigger: %s", value);
+        return 0;
+    }
+
+    value = FindArgumentValue(argc, argv, "channel");
+    if (value != NULL)
+        config.channel = AreStringsTheSame("voltage", value, sizeof("voltage")) ? 0 : 1;
+
+    value = FindArgumentValue(argc, argv, "event");
+    if (value != NULL) {
+        config.events = 0;
+        if (strstr(value, "relay") != NULL)
+            config.events |= kCaptureEventRelay;
+        if (strstr(value, "pwm") != NULL)
+            config.events |= kCaptureEventPwm;
+    }
+
+    value = FindArgumentValue(argc, argv, "threshold");
+    if (value != NULL)
+        config.threshold = strtoul(value, NULL, 0);
+
+    value = FindArgumentValue(argc, argv, "rate");
+    if (value != NULL)
+        config.rate = strtoul(value, NULL, 10);
+
+    value = FindArgumentValue(argc, argv, "depth");
+    if (value != NULL)
+        config.depth = strtoul(value, NULL, 10);
+
+    value = FindArgumentValue(argc, argv, "pre");
+    if (value != NULL)
+        config.pre = strtoul(value, NULL, 10);
+
+    value = FindArgumentValue(argc, argv, "timeout");
+    if (value != NULL)
+        config.timeout = strtoul(value, NULL, 10);
+
+    ESP_LOGI(__func__, "CAPTURE: %s", CAPTURE_arm(&config) ? "armed" : "errors occurs");
+    return 0;
+}
+
+// "dump" | "dump packed" | "<trigger>,<channel>,<threshold>,<rate>,<depth>,<pre>[,<timeout ms>]"
+static void parse_ble_command(char *buffer, unsigned length) {
+    if (length == 0)
+        return;
+
+    if (AreStringsTheSame("dump packed", buffer, strlen("dump packed"))) {
+        WORKER_report(dump_ble_packed, NULL);
+        return;
+    }
+
+    if (AreStringsTheSame("dump", buffer, strlen("dump"))) {
+        WORKER_report(dump_ble_raw, NULL);
+        return;
+    }
+
+    if (AreStringsTheSame("abort", buffer, strlen("abort"))) {
+        CAPTURE_abort();
+        return;
+    }
+
+    unsigned values[7] = { 0 };
+    unsigned count = ParseUnsignedList(buffer, values, 7, 0);
+    if (count < 6) {
+        ESP_LOGW(__func__, "Invalid capture command");
+        return;
+    }
+
+    CaptureConfig config = ctx.config;
+    config.trigger = values[0];
+    config.channel = values[1];
+    config.threshold = values[2];
+    config.rate = values[3];
+    config.depth = values[4];
+    config.pre = values[5];
+    if (count == 7)
+        config.timeout = values[6];
+    CAPTURE_arm(&config);
+}
+
+void CAPTURE_init(void) {
+    CLI_register_command("capture",
+                         "[arm] [abort] [dump] [trigger now|level|rising|falling|event] [channel voltage|current] "
+                         "[event relay,pwm] [threshold <raw>] [rate <Hz>] [depth <frames>] [pre <frames>] [timeout <ms>]",
+                         capture_command_execution);
+    WORKER_start(&worker);
+    BLE_setup_characteristic_callback(kCapture, parse_ble_command);
+}
+
+bool CAPTURE_arm(const CaptureConfig *config) {
+    if (ctx.state == kCaptureArmed || ctx.state == kCaptureTriggered) {
+        ESP_LOGW(__func__, "Capture already ongoing");
+        return false;
+    }
+
+    if (config->trigger > kCaptureTriggerEvent || config->channel >= CAPTURE_CHANNELS
+        || config->rate == 0 || config->rate > CAPTURE_MAX_RATE
+        || config->depth < 2 || config->depth > CAPTURE_MAX_FRAMES || config->pre >= config->depth
+        || config->timeout == 0 || config->timeout > CAPTURE_MAX_TIMEOUT) {
+        ESP_LOGW(__func__, "Invalid capture configuration");
+        return false;
+    }
+
+    // the sampler spins without yielding after the trigger when samples are less than two ticks apart
+    uint32_t period = 1000000 / config->rate;
+    if (period <= 2 * portTICK_PERIOD_MS * 1000
+        && (uint64_t)(config->depth - config->pre) * period > CAPTURE_MAX_SPIN_MS * 1000) {
+        ESP_LOGW(__func__, "Post-trigger window over %u ms, lower depth or raise rate", CAPTURE_MAX_SPIN_MS);
+        return false;
+    }
+
+    ctx.config = *config;
+    ctx.period = period;
+    ctx.head = 0;
+    ctx.filled = 0;
+    ctx.overruns = 0;
+    ctx.event_pending = false;
+    ctx.state = kCaptureArmed;
+
+    // the sampler spins on core 1 between samples and yields every CAPTURE_YIELD_MS while
+    // armed, see capture_task, the armed state ends after config.timeout without a trigger
+    if (WORKER_submit(&worker, capture_task, NULL) == false) {
+        ctx.state = kCaptureIdle;
+        return false;
+    }
+    return true;
+}
+
+void CAPTURE_abort(void) {
+    if (ctx.state == kCaptureArmed || ctx.state == kCaptureTriggered)
+        ctx.state = kCaptureIdle;
+}
+
+CaptureState CAPTURE_get_state(void) {
+    return ctx.state;
+}
+
+void CAPTURE_notify_event(CaptureEvent event) {
+    if (ctx.state == kCaptureArmed && ctx.config.trigger == kCaptureTriggerEvent && (ctx.config.events & event))
+        ctx.event_pending = true;
+}
@@ -0,0 +1,79 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/base/types.h"
+
+// static budget for raw samples, every frame holds one voltage and one current code
+#define CAPTURE_BUFFER_BYTES (16 * 1024)
+#define CAPTURE_CHANNELS 2
+#define CAPTURE_MAX_FRAMES (CAPTURE_BUFFER_BYTES / (CAPTURE_CHANNELS * sizeof(uint16_t)))
+#define CAPTURE_MAX_RATE 20000
+#define CAPTURE_MAX_TIMEOUT 600000  // ms
+#define CAPTURE_YIELD_MS 50         // longest armed spin before the sampler gives IDLE a tick
+#define CAPTURE_MAX_SPIN_MS 1000    // longest post-trigger spin, well below the task watchdog
+#define CAPTURE_MAGIC 0x54504143    // "CAPT"
+#define CAPTURE_PACKED_VERSION 2    // header version of a packed BLE dump
+
+typedef enum {
+    kCaptureTriggerNow = 0,
+    kCaptureTriggerLevel,
+    kCaptureTriggerRising,
+    kCaptureTriggerFalling,
+    kCaptureTriggerEvent,
+} CaptureTrigger;
+
+typedef enum {
+    kCaptureEventRelay  = 1 << 0,
+    kCaptureEventPwm    = 1 << 1,
+} CaptureEvent;
+
+typedef enum {
+    kCaptureIdle = 0,
+    kCaptureArmed,
+    kCaptureTriggered,
+    kCaptureDone,
+} CaptureState;
+
+typedef struct {
+    CaptureTrigger trigger;
+    uint8_t channel;        // trigger source: 0 voltage, 1 current
+    uint8_t events;         // CaptureEvent mask for kCaptureTriggerEvent
+    uint16_t threshold;     // raw ADC code
+    Herz rate;
+    uint32_t depth;         // frames in total
+    uint32_t pre;           // frames kept before the trigger
+    Milliseconds timeout;   // armed without a trigger for this long goes back to idle
+} CaptureConfig;
+
+// binary block header, little endian, followed by pre + post frames; a packed BLE
+// dump sends every notification after the header as
+//   u16 frames | per channel: u8 words | simple-8b words of the code differences from 0
+// see modules/base/codec.h
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t channels;
+    uint8_t trigger;
+    uint8_t channel;
+    uint32_t rate;
+    uint32_t pre;
+    uint32_t post;
+    uint32_t overruns;
+    int64_t trigger_time;
+} CaptureHeader;
+
+void CAPTURE_init(void);
+
+bool CAPTURE_arm(const CaptureConfig *config);
+void CAPTURE_abort(void);
+CaptureState CAPTURE_get_state(void);
+void CAPTURE_notify_event(CaptureEvent event);
+
+// linear view of the finished capture, returns number of frames
+unsigned CAPTURE_get_header(CaptureHeader *header);
+unsigned CAPTURE_copy_frames(unsigned first, uint16_t *frames, unsigned count);
+
+#endif // CAPTURE_H
@@ -0,0 +1,455 @@
+#include "modules/config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include "esp_log.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "modules/base/generic_fun.h"
+#include "modules/base/budget.h"
+#include "modules/cli.h"
+#include "modules/ble.h"
+#include "modules/worker.h"
+
+#define NVS_NAMESPACE "config"
+#define NVS_VERSION_KEY "version"
+#define VALUE_LENGTH 64
+
+// config list
+// config set adc.r1 1510
+// config commit
+
+// Every field has its own NVS key, a firmware that adds or moves fields keeps
+// the values it still knows and defaults the new ones. Names are longer than
+// an NVS key, the key is a hash of the name. Scalars are stored as their 32
+// bit pattern, relay pins and the calibration models with their piecewise
+// nodes as blobs.
+typedef struct {
+    const char *key;
+    size_t offset;
+} ConfigModelKey;
+
+static const ConfigModelKey kModels[] = {
+    { "adc.calib", offsetof(Config, adc.model) },
+    { "ct.calib", offsetof(Config, ct.model) },
+};
+
+#define MODEL_COUNT (sizeof(kModels) / sizeof(kModels[0]))
+
+static struct {
+    // readers take the active slot, a commit fills the other one and flips
+    Config slots[2];
+    volatile unsigned active;
+    Config staged;
+    bool dirty;
+
+    SemaphoreHandle_t lock;
+    StaticSemaphore_t lock_buffer;
+    // held from the flip until the last listener returned, commits notify in order
+    // and the slot a listener reads is not refilled under it
+    SemaphoreHandle_t commit_lock;
+    StaticSemaphore_t commit_lock_buffer;
+
+    ConfigListener listeners[CONFIG_MAX_LISTENERS];
+    unsigned listener_count;
+
+    volatile bool ble_list_ongoing;
+} ctx = { 0 };
+
+BUDGET_CHECK(sizeof(ctx), BUDGET_CONFIG);
+
+const Config *CONFIG_get(void) {
+    return &ctx.slots[ctx.active];
+}
+
+static bool init_nvs(void) {
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    return ret == ESP_OK ? true : false;
+}
+
+static void field_key(const ConfigField *field, char *key) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (const char *c = field->name; *c != '\0'; ++c)
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    snprintf(key, NVS_KEY_NAME_MAX_SIZE, "f%08" PRIx32, hash);
+}
+
+// on top of the defaults, a value out of range keeps the default of its field
+static unsigned load_fields(nvs_handle_t handle, Config *config) {
+    for (unsigned i = 0; i < MODEL_COUNT; ++i) {
+        CalibModel model;
+        size_t length = sizeof(model);
+        if (nvs_get_blob(handle, kModels[i].key, &model, &length) == ESP_OK && length == sizeof(model)
+            && CALIB_CORE_validate(&model))
+            memcpy((uint8_t *)config + kModels[i].offset, &model, sizeof(model));
+    }
+
+    unsigned loaded = 0;
+    for (unsigned i = 0; CONFIG_CORE_field(i) != NULL; ++i) {
+        const ConfigField *field = CONFIG_CORE_field(i);
+        char key[NVS_KEY_NAME_MAX_SIZE];
+        field_key(field, key);
+
+        uint8_t *target = (uint8_t *)config + field->offset;
+        const size_t size = field->type == kConfigPins ? sizeof(ConfigPins) : sizeof(uint32_t);
+        uint8_t previous[sizeof(ConfigPins)];
+        memcpy(previous, target, size);
+
+        bool found;
+        if (field->type == kConfigPins) {
+            size_t length = size;
+            found = nvs_get_blob(handle, key, target, &length) == ESP_OK && length == size;
+        } else {
+            uint32_t value;
+            found = nvs_get_u32(handle, key, &value) == ESP_OK;
+            if (found)
+                memcpy(target, &value, size);
+        }
+        if (found == false) {
+            memcpy(target, previous, size);
+            continue;
+        }
+
+        if (CONFIG_CORE_field_valid(config, field)) {
+            loaded += 1;
+        } else {
+            memcpy(target, previous, size);
+            ESP_LOGW(__func__, "Stored %s out of range, default kept", field->name);
+        }
+    }
+    return loaded;
+}
+
+static bool store(const Config *config) {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(__func__, "Opening NVS failed: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    // NVS skips values that didn't change; a power cut halfway leaves a mix of
+    // old and new values, each of them is range checked again at load
+    for (unsigned i = 0; i < MODEL_COUNT && err == ESP_OK; ++i)
+        err = nvs_set_blob(handle, kModels[i].key, (const uint8_t *)config + kModels[i].offset, sizeof(CalibModel));
+
+    for (unsigned i = 0; CONFIG_CORE_field(i) != NULL && err == ESP_OK; ++i) {
+        const ConfigField *field = CONFIG_CORE_field(i);
+        char key[NVS_KEY_NAME_MAX_SIZE];
+        field_key(field, key);
+
+        if (field->type == kConfigPins) {
+            err = nvs_set_blob(handle, key, &config->relay, sizeof(config->relay));
+        } else {
+            uint32_t value;
+            memcpy(&value, (const uint8_t *)config + field->offset, sizeof(value));
+            err = nvs_set_u32(handle, key, value);
+        }
+    }
+
+    if (err == ESP_OK)
+        err = nvs_set_u32(handle, NVS_VERSION_KEY, CONFIG_VERSION);
+    if (err == ESP_OK)
+        err = nvs_commit(handle);
+    nvs_close(handle);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(__func__, "Storing configuration failed: %s", esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+// false when nothing usable is stored, config then holds the defaults
+static bool load(Config *config) {
+    CONFIG_CORE_defaults(config);
+
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+        return false;
+
+    uint32_t version = CONFIG_VERSION;
+    nvs_get_u32(handle, NVS_VERSION_KEY, &version);
+    if (version != CONFIG_VERSION) {
+        nvs_close(handle);
+        ESP_LOGE(__func__, "Stored configuration of version %" PRIu32 " discarded: calibration, alarm limits and power "
+                 "settings are back to defaults", version);
+        return false;
+    }
+
+    unsigned loaded = load_fields(handle, config);
+    nvs_close(handle);
+
+    if (loaded == 0)
+        return false;
+
+    if (CONFIG_CORE_validate(config) == false) {
+        ESP_LOGE(__func__, "Stored configuration inconsistent and discarded: calibration, alarm limits and power "
+                 "settings are back to defaults");
+        CONFIG_CORE_defaults(config);
+        return false;
+    }
+
+    unsigned count = 0;
+    while (CONFIG_CORE_field(count) != NULL)
+        count += 1;
+
+    if (loaded < count) {
+        ESP_LOGW(__func__, "%u of %u fields stored, the others are defaults until the next commit", loaded, count);
+    }
+    return true;
+}
+
+void CONFIG_register_listener(ConfigListener listener) {
+    assert(ctx.listener_count < CONFIG_MAX_LISTENERS);
+    xSemaphoreTake(ctx.commit_lock, portMAX_DELAY);
+    ctx.listeners[ctx.listener_count++] = listener;
+    listener(CONFIG_get());
+    xSemaphoreGive(ctx.commit_lock);
+}
+
+bool CONFIG_set(const char *name, const char *value) {
+    const ConfigField *field = CONFIG_CORE_find(name);
+    if (field == NULL)
+        return false;
+
+    xSemaphoreTake(ctx.lock, portMAX_DELAY);
+    bool ret = CONFIG_CORE_parse(&ctx.staged, field, value);
+    ctx.dirty |= ret;
+    xSemaphoreGive(ctx.lock);
+    return ret;
+}
+
+void CONFIG_edit(ConfigEdit edit, const void *arg) {
+    xSemaphoreTake(ctx.lock, portMAX_DELAY);
+    edit(&ctx.staged, arg);
+    ctx.dirty = true;
+    xSemaphoreGive(ctx.lock);
+}
+
+// under the lock, validates and stores config and makes it the active one
+static bool activate(const Config *config) {
+    const Config *active = CONFIG_get();
+    if (CONFIG_CORE_validate(config) == false || store(config) == false)
+        return false;
+
+    for (unsigned i = 0; CONFIG_CORE_field(i) != NULL; ++i) {
+        const ConfigField *field = CONFIG_CORE_field(i);
+        if (field->reboot && CONFIG_CORE_field_differs(active, config, field))
+            ESP_LOGW(__func__, "%s takes effect after reboot", field->name);
+    }
+
+    unsigned next = ctx.active ^ 1;
+    if (config != &ctx.slots[next])
+        ctx.slots[next] = *config;
+    ctx.active = next;
+    return true;
+}
+
+static void notify_listeners(void) {
+    for (unsigned i = 0; i < ctx.listener_count; ++i)
+        ctx.listeners[i](CONFIG_get());
+}
+
+bool CONFIG_commit(void) {
+    xSemaphoreTake(ctx.commit_lock, portMAX_DELAY);
+    xSemaphoreTake(ctx.lock, portMAX_DELAY);
+    bool ret = activate(&ctx.staged);
+    if (ret)
+        ctx.dirty = false;
+    xSemaphoreGive(ctx.lock);
+
+    if (ret)
+        notify_listeners();
+    xSemaphoreGive(ctx.commit_lock);
+    return ret;
+}
+
+bool CONFIG_apply(ConfigEdit edit, const void *arg) {
+    // built in the spare slot, readers only see it once it is stored and flipped
+    xSemaphoreTake(ctx.commit_lock, portMAX_DELAY);
+    xSemaphoreTake(ctx.lock, portMAX_DELAY);
+    Config *spare = &ctx.slots[ctx.active ^ 1];
+    *spare = *CONFIG_get();
+    edit(spare, arg);
+    bool ret = activate(spare);
+    // pending edits stay pending, a later commit must not revert this one
+    if (ret)
+        edit(&ctx.staged, arg);
+    xSemaphoreGive(ctx.lock);
+
+    if (ret)
+        notify_listeners();
+    xSemaphoreGive(ctx.commit_lock);
+    return ret;
+}
+
+void CONFIG_discard(void) {
+    xSemaphoreTake(ctx.lock, portMAX_DELAY);
+    ctx.staged = *CONFIG_get();
+    ctx.dirty = false;
+    xSemaphoreGive(ctx.lock);
+}
+
+void CONFIG_stage_defaults(void) {
+    xSemaphoreTake(ctx.lock, portMAX_DELAY);
+    CONFIG_CORE_defaults(&ctx.staged);
+    ctx.dirty = true;
+    xSemaphoreGive(ctx.lock);
+}
+
+static bool format_field(const Config *config, const char *name, char *buffer, unsigned size) {
+    const ConfigField *field = CONFIG_CORE_find(name);
+    if (field == NULL)
+        return false;
+
+    int length = snprintf(buffer, size, "%s,", field->name);
+    CONFIG_CORE_format(config, field, buffer + length, size - length);
+    return true;
+}
+
+static void log_fields(const Config *config) {
+    char buffer[VALUE_LENGTH];
+    for (unsigned i = 0; CONFIG_CORE_field(i) != NULL; ++i) {
+        const ConfigField *field = CONFIG_CORE_field(i);
+        CONFIG_CORE_format(config, field, buffer, sizeof(buffer));
+        ESP_LOGI("config", "%-12s %s%s", field->name, buffer, field->reboot ? " (reboot)" : "");
+    }
+}
+
+static int config_command_execution(int argc, char **argv) {
+    if (argc == 1 || AreStringsTheSame("list", argv[1], sizeof("list"))) {
+        log_fields(CONFIG_get());
+        if (ctx.dirty)
+            ESP_LOGI(__func__, "CONFIG: uncommitted changes, 'config staged' lists them");
+        return 0;
+    }
+
+    if (AreStringsTheSame("staged", argv[1], sizeof("staged"))) {
+        log_fields(&ctx.staged);
+        return 0;
+    }
+
+    if (AreStringsTheSame("get", argv[1], sizeof("get")) && argc > 2) {
+        char buffer[VALUE_LENGTH];
+        if (format_field(CONFIG_get(), argv[2], buffer, sizeof(buffer)))
+            ESP_LOGI(__func__, "CONFIG: %s", buffer);
+        else
+            ESP_LOGW(__func__, "Unknown key: %s", argv[2]);
+        return 0;
+    }
+
+    if (AreStringsTheSame("set", argv[1], sizeof("set")) && argc > 3) {
+        ESP_LOGI(__func__, "CONFIG: %s %s", argv[2], CONFIG_set(argv[2], argv[3]) ? "staged" : "invalid");
+        return 0;
+    }
+
+    if (AreStringsTheSame("commit", argv[1], sizeof("commit"))) {
+        ESP_LOGI(__func__, "CONFIG: %s", CONFIG_commit() ? "committed" : "errors occurs");
+        return 0;
+    }
+
+    if (AreStringsTheSame("discard", argv[1], sizeof("discard"))) {
+        CONFIG_discard();
+        return 0;
+    }
+
+    if (AreStringsTheSame("defaults", argv[1], sizeof("defaults"))) {
+        CONFIG_stage_defaults();
+        return 0;
+    }
+
+    ESP_LOGW(__func__, "Unknown subcommand: %s", argv[1]);
+    return 0;
+}
+
+static void list_ble(void *arg) {
+    char buffer[VALUE_LENGTH];
+    const Config *config = CONFIG_get();
+    for (unsigned i = 0; CONFIG_CORE_field(i) != NULL; ++i) {
+        format_field(config, CONFIG_CORE_field(i)->name, buffer, sizeof(buffer));
+        if (BLE_stream_raw(kConfig, (const uint8_t *)buffer, strlen(buffer)) == false)
+            break;
+    }
+    BLE_stream_raw(kConfig, (const uint8_t *)"end", 3);
+    ctx.ble_list_ongoing = false;
+}
+
+static void reply(const char *text) {
+    BLE_notify_raw(kConfig, (const uint8_t *)text, strlen(text));
+}
+
+// "list" | "get,<key>" | "set,<key>,<value>" | "commit" | "discard" | "defaults"
+// answered with "<key>,<value>" lines and "end", or "ok" / "error"
+static void parse_ble_command(char *buffer, unsigned length) {
+    if (AreStringsTheSame("list", buffer, strlen("list"))) {
+        if (ctx.ble_list_ongoing)
+            return;
+        ctx.ble_list_ongoing = true;
+        if (WORKER_report(list_ble, NULL) == false)
+            ctx.ble_list_ongoing = false;
+        return;
+    }
+
+    if (AreStringsTheSame("get,", buffer, strlen("get,"))) {
+        char line[VALUE_LENGTH];
+        reply(format_field(CONFIG_get(), buffer + strlen("get,"), line, sizeof(line)) ? line : "error");
+        return;
+    }
+
+    if (AreStringsTheSame("set,", buffer, strlen("set,"))) {
+        // the value may hold commas itself, only the first one after the key separates
+        char *name = buffer + strlen("set,");
+        char *value = strchr(name, ',');
+        if (value == NULL) {
+            reply("error");
+            return;
+        }
+        *value++ = '\0';
+        reply(CONFIG_set(name, value) ? "ok" : "error");
+        return;
+    }
+
+    if (AreStringsTheSame("commit", buffer, strlen("commit"))) {
+        reply(CONFIG_commit() ? "ok" : "error");
+    } else if (AreStringsTheSame("discard", buffer, strlen("discard"))) {
+        CONFIG_discard();
+        reply("ok");
+    } else if (AreStringsTheSame("defaults", buffer, strlen("defaults"))) {
+        CONFIG_stage_defaults();
+        reply("ok");
+    } else {
+        reply("error");
+    }
+}
+
+bool CONFIG_init(void) {
+    ctx.lock = xSemaphoreCreateMutexStatic(&ctx.lock_buffer);
+    ctx.commit_lock = xSemaphoreCreateMutexStatic(&ctx.commit_lock_buffer);
+    bool ret = init_nvs();
+
+    Config *config = &ctx.slots[ctx.active];
+    if (ret == false || load(config) == false)
+        CONFIG_CORE_defaults(config);
+    ctx.staged = *config;
+
+    CLI_register_command("config", "[list] [staged] [get <key>] [set <key> <value>] [commit] [discard] [defaults], ct.a0..a3 map the zero corrected current",
+                         config_command_execution);
+    BLE_setup_characteristic_callback(kConfig, parse_ble_command);
+    return ret;
+}
@@ -0,0 +1,35 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/core/config_core.h"
+
+#define CONFIG_MAX_LISTENERS 8
+
+typedef void (*ConfigListener)(const Config *config);
+typedef void (*ConfigEdit)(Config *staged, const void *arg);
+
+// initializes NVS and loads the stored configuration field by field, a field
+// missing or out of range in flash keeps its default
+bool CONFIG_init(void);
+
+// active configuration, a RAM copy
+const Config *CONFIG_get(void);
+
+// called at registration and after every commit, one commit at a time in commit
+// order; a listener must not commit itself
+void CONFIG_register_listener(ConfigListener listener);
+
+// edits go to a staged copy, commit validates, stores it and makes it active at once
+bool CONFIG_set(const char *name, const char *value);
+// for values without a text form, runs under the lock
+void CONFIG_edit(ConfigEdit edit, const void *arg);
+bool CONFIG_commit(void);
+// edits the active configuration and stores it, staged edits are left pending
+bool CONFIG_apply(ConfigEdit edit, const void *arg);
+void CONFIG_discard(void);
+void CONFIG_stage_defaults(void);
+
+#endif // CONFIG_H
@@ -0,0 +1,59 @@
+#include "modules/core/adapt_core.h"
+
+#include <math.h>
+#include <string.h>
+
+bool ADAPT_CORE_validate(const AdaptConfig *config) {
+    return config->idle_rate > 0 && config->active_rate >= config->idle_rate;
+}
+
+void ADAPT_CORE_reset(AdaptState *state) {
+    memset(state, 0, sizeof(*state));
+}
+
+bool ADAPT_CORE_trigger(const AdaptConfig *config, AdaptState *state, int64_t now) {
+    state->active_until = now + (int64_t)config->hold * 1000;
+    bool changed = state->active == false;
+    state->active = true;
+    return changed;
+}
+
+bool ADAPT_CORE_update(const AdaptConfig *config, AdaptState *state, int64_t now, const int32_t *values,
+                       unsigned valid) {
+    if (state->primed == false) {
+        for (unsigned i = 0; i < ADAPT_CHANNELS; ++i)
+            state->baseline[i] = values[i];
+        state->primed = true;
+        state->last_time = now;
+        return false;
+    }
+
+    // the same time constant at either rate
+    float alpha = (float)(now - state->last_time) / ADAPT_BASELINE_US;
+    alpha = alpha < 1 ? alpha : 1;
+    state->last_time = now;
+
+    bool activity = false;
+    for (unsigned i = 0; i < ADAPT_CHANNELS; ++i) {
+        if ((valid & (1 << i)) == 0)
+            continue;
+
+        float distance = values[i] - state->baseline[i];
+        if (config->deltas[i] > 0 && fabsf(distance) > config->deltas[i])
+            activity = true;
+        state->baseline[i] += alpha * distance;
+    }
+
+    if (activity)
+        return ADAPT_CORE_trigger(config, state, now);
+
+    if (state->active && now >= state->active_until) {
+        state->active = false;
+        return true;
+    }
+    return false;
+}
+
+uint32_t ADAPT_CORE_rate(const AdaptConfig *config, const AdaptState *state) {
+    return state->active ? config->active_rate : config->idle_rate;
+}
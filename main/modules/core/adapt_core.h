@@ -0,0 +1,37 @@
+#ifndef ADAPT_CORE_H
+#define ADAPT_CORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ADAPT_CHANNELS 2            // [0] voltage mV, [1] current mA
+#define ADAPT_BASELINE_US 1000000   // time constant of the baseline activity is judged against
+
+typedef struct {
+    uint32_t idle_rate;             // Hz while the signals are stable
+    uint32_t active_rate;           // Hz after a change or a command
+    uint32_t hold;                  // ms at the active rate after the last activity
+    int32_t deltas[ADAPT_CHANNELS]; // distance from the baseline that counts as activity, 0 ignores the channel
+} AdaptConfig;
+
+typedef struct {
+    float baseline[ADAPT_CHANNELS];
+    int64_t last_time;
+    int64_t active_until;
+    bool primed;
+    bool active;
+} AdaptState;
+
+bool ADAPT_CORE_validate(const AdaptConfig *config);
+void ADAPT_CORE_reset(AdaptState *state);
+
+// one sample of the channels in valid (bit per channel); true when the rate changes
+bool ADAPT_CORE_update(const AdaptConfig *config, AdaptState *state, int64_t now, const int32_t *values,
+                       unsigned valid);
+
+// a PWM or relay command, the response follows at the active rate; true when the rate changes
+bool ADAPT_CORE_trigger(const AdaptConfig *config, AdaptState *state, int64_t now);
+
+uint32_t ADAPT_CORE_rate(const AdaptConfig *config, const AdaptState *state);
+
+#endif // ADAPT_CORE_H
@@ -0,0 +1,44 @@
+#include "modules/core/adc_core.h"
+
+#include <stdio.h>
+
+#include "modules/hal/hal_adc.h"
+#include "modules/hal/hal_time.h"
+
+static float divide(const AdcCoreConfig *config, float meas) {
+    return meas * (config->resistor_r1 + config->resistor_r2) / config->resistor_r1;
+}
+
+Millivolt ADC_CORE_to_input_voltage(const AdcCoreConfig *config, Millivolt meas) {
+    // Voltage divider, then the calibration model
+    return CALIB_CORE_eval(&config->model, divide(config, meas));
+}
+
+float ADC_CORE_counts_to_input(const AdcCoreConfig *config, float counts) {
+    int raw = (int)counts;
+    Millivolt low = HAL_ADC_raw_to_voltage(kHalAdcVoltage, raw);
+    Millivolt high = HAL_ADC_raw_to_voltage(kHalAdcVoltage, raw + 1);
+    return CALIB_CORE_eval(&config->model, divide(config, low + (high - low) * (counts - raw)));
+}
+
+float ADC_CORE_read_uncorrected(const AdcCoreConfig *config) {
+    unsigned sum = 0;
+    for (unsigned sample = 0; sample < config->samples; ++sample) {
+        sum += HAL_ADC_raw_to_voltage(kHalAdcVoltage, HAL_ADC_read_raw(kHalAdcVoltage));
+        HAL_TIME_delay_ms(config->step);
+    }
+
+    return divide(config, (float)sum / config->samples);
+}
+
+Millivolt ADC_CORE_read(const AdcCoreConfig *config) {
+    return CALIB_CORE_eval(&config->model, ADC_CORE_read_uncorrected(config));
+}
+
+Millivolt ADC_CORE_read_single(const AdcCoreConfig *config) {
+    return ADC_CORE_to_input_voltage(config, HAL_ADC_raw_to_voltage(kHalAdcVoltage, HAL_ADC_read_raw(kHalAdcVoltage)));
+}
+
+int ADC_CORE_format_ble(char *buffer, size_t size, Millivolt now, Millivolt max, Millivolt min, Millivolt avg) {
+    return snprintf(buffer, size, "%d,%d,%d,%d", now, max, min, avg);
+}
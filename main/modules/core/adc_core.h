@@ -0,0 +1,33 @@
+#ifndef ADC_CORE_H
+#define ADC_CORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "modules/base/types.h"
+#include "modules/core/calib_core.h"
+
+typedef struct {
+    unsigned resistor_r1;
+    unsigned resistor_r2;
+    unsigned samples;
+    Milliseconds step;
+    CalibModel model;       // divider output -> input voltage
+} AdcCoreConfig;
+
+// pin voltage -> voltage at the tester input, divider and nonlinearity corrected
+Millivolt ADC_CORE_to_input_voltage(const AdcCoreConfig *config, Millivolt meas);
+
+// filtered ADC code -> input voltage [mV], interpolated between the neighbouring codes
+float ADC_CORE_counts_to_input(const AdcCoreConfig *config, float counts);
+
+// averaged divider output [mV] before the calibration model, source of calibration points
+float ADC_CORE_read_uncorrected(const AdcCoreConfig *config);
+
+Millivolt ADC_CORE_read(const AdcCoreConfig *config);
+Millivolt ADC_CORE_read_single(const AdcCoreConfig *config);
+
+// BLE voltage value "<now>,<max>,<min>,<avg>" in mV, returns the snprintf length
+int ADC_CORE_format_ble(char *buffer, size_t size, Millivolt now, Millivolt max, Millivolt min, Millivolt avg);
+
+#endif // ADC_CORE_H
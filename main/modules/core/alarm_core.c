@@ -0,0 +1,58 @@
+#include "modules/core/alarm_core.h"
+
+bool ALARM_CORE_validate(const AlarmThreshold *threshold) {
+    if (threshold->debounce == 0)
+        return true;
+
+    // a value between the released limits must exist
+    return threshold->hysteresis >= 0 && (int64_t)threshold->low + threshold->hysteresis
+                                         < (int64_t)threshold->high - threshold->hysteresis;
+}
+
+void ALARM_CORE_reset(AlarmState *state) {
+    *state = (AlarmState) { .level = kAlarmNormal, .pending = kAlarmNormal, .count = 0 };
+}
+
+// level the value alone asks for, the limits widen by the hysteresis while in alarm
+static AlarmLevel classify(const AlarmThreshold *threshold, AlarmLevel level, int32_t value) {
+    const int32_t high = level == kAlarmHigh ? threshold->high - threshold->hysteresis : threshold->high;
+    const int32_t low = level == kAlarmLow ? threshold->low + threshold->hysteresis : threshold->low;
+
+    if (value > high)
+        return kAlarmHigh;
+    if (value < low)
+        return kAlarmLow;
+    return kAlarmNormal;
+}
+
+bool ALARM_CORE_update(const AlarmThreshold *threshold, AlarmState *state, int32_t value) {
+    if (threshold->debounce == 0)
+        return false;
+
+    AlarmLevel candidate = classify(threshold, state->level, value);
+    if (candidate == state->level) {
+        state->count = 0;
+        return false;
+    }
+
+    if (candidate != state->pending || state->count == 0) {
+        state->pending = candidate;
+        state->count = 0;
+    }
+    if (state->count < UINT16_MAX)
+        state->count += 1;
+    if (state->count < threshold->debounce)
+        return false;
+
+    state->level = candidate;
+    state->count = 0;
+    return true;
+}
+
+const char *ALARM_CORE_level_name(AlarmLevel level) {
+    switch (level) {
+        case kAlarmLow:     return "low";
+        case kAlarmHigh:    return "high";
+        default:            return "normal";
+    }
+}
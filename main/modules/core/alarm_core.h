@@ -0,0 +1,43 @@
+#ifndef ALARM_CORE_H
+#define ALARM_CORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    kAlarmVoltage = 0,      // mV
+    kAlarmCurrent,          // mA
+    kAlarmTemperature,      // 0.01 C
+// sentinel
+    kAlarmLastChannel
+} AlarmChannel;
+
+typedef enum {
+    kAlarmNormal = 0,
+    kAlarmLow,
+    kAlarmHigh,
+} AlarmLevel;
+
+// limits in the channel unit
+typedef struct {
+    int32_t low;            // alarm below
+    int32_t high;           // alarm above
+    int32_t hysteresis;     // back to normal only this far inside the limit
+    uint32_t debounce;      // consecutive samples before a transition, 0 disables the channel
+} AlarmThreshold;
+
+typedef struct {
+    uint8_t level;          // AlarmLevel
+    uint8_t pending;        // level the last samples voted for
+    uint16_t count;         // consecutive votes for pending
+} AlarmState;
+
+bool ALARM_CORE_validate(const AlarmThreshold *threshold);
+void ALARM_CORE_reset(AlarmState *state);
+
+// true when the sample completes a transition, the new level is in state->level
+bool ALARM_CORE_update(const AlarmThreshold *threshold, AlarmState *state, int32_t value);
+
+const char *ALARM_CORE_level_name(AlarmLevel level);
+
+#endif // ALARM_CORE_H
@@ -0,0 +1,55 @@
+#include "modules/core/bench_core.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "modules/hal/hal_time.h"
+
+static int compare_samples(const void *a, const void *b) {
+    uint32_t first = *(const uint32_t *)a;
+    uint32_t second = *(const uint32_t *)b;
+    return (first > second) - (first < second);
+}
+
+static uint32_t timer_overhead(void) {
+    uint32_t overhead = UINT32_MAX;
+    for (unsigned i = 0; i < 16; ++i) {
+        uint32_t start = HAL_TIME_cycles();
+        uint32_t elapsed = HAL_TIME_cycles() - start;
+        if (elapsed < overhead)
+            overhead = elapsed;
+    }
+    return overhead;
+}
+
+bool BENCH_CORE_run(const BenchCase *bench, unsigned runs, uint32_t *samples, BenchResult *result) {
+    if (runs == 0 || runs > BENCH_MAX_RUNS)
+        return false;
+
+    const uint32_t overhead = timer_overhead();
+    // warm caches and lazily initialized state before the first timed run
+    bench->fn(bench->arg);
+
+    for (unsigned i = 0; i < runs; ++i) {
+        uint32_t start = HAL_TIME_cycles();
+        bench->fn(bench->arg);
+        uint32_t elapsed = HAL_TIME_cycles() - start;
+        samples[i] = elapsed > overhead ? elapsed - overhead : 0;
+    }
+
+    qsort(samples, runs, sizeof(*samples), compare_samples);
+    result->name = bench->name;
+    result->runs = runs;
+    result->min = samples[0];
+    result->median = samples[runs / 2];
+    result->p99 = samples[(runs * 99) / 100];
+    result->max = samples[runs - 1];
+    return true;
+}
+
+int BENCH_CORE_format(const BenchResult *result, char *buffer, size_t size) {
+    uint64_t median_ns = (uint64_t)result->median * 1000 / HAL_TIME_cycles_per_us();
+    return snprintf(buffer, size, "BENCH,%s,%u,%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu64,
+                    result->name, result->runs, result->min, result->median, result->p99, result->max, median_ns);
+}
@@ -0,0 +1,34 @@
+#ifndef BENCH_CORE_H
+#define BENCH_CORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define BENCH_MAX_RUNS 1000
+
+typedef void (*BenchFn)(void *arg);
+
+typedef struct {
+    const char *name;
+    BenchFn fn;
+    void *arg;
+    unsigned runs;          // default, heavy paths use only a few
+} BenchCase;
+
+typedef struct {
+    const char *name;
+    unsigned runs;
+    uint32_t min;           // HAL_TIME_cycles units
+    uint32_t median;
+    uint32_t p99;
+    uint32_t max;
+} BenchResult;
+
+// times every call of fn separately, samples must hold runs entries
+bool BENCH_CORE_run(const BenchCase *bench, unsigned runs, uint32_t *samples, BenchResult *result);
+
+// "BENCH,<name>,<runs>,<min>,<median>,<p99>,<max>,<median ns>"
+int BENCH_CORE_format(const BenchResult *result, char *buffer, size_t size);
+
+#endif // BENCH_CORE_H
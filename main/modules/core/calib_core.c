@@ -0,0 +1,186 @@
+#include "modules/core/calib_core.h"
+
+#include <math.h>
+#include <string.h>
+
+void CALIB_CORE_identity(CalibModel *model) {
+    memset(model, 0, sizeof(*model));
+    model->kind = kCalibPolynomial;
+    model->coeffs[1] = 1;
+}
+
+static float eval_piecewise(const CalibModel *model, float x) {
+    // segment whose start is the last node <= x, the end segments extend outwards
+    unsigned low = 0;
+    unsigned high = model->count - 2;
+    while (low < high) {
+        unsigned mid = (low + high + 1) / 2;
+        if (model->x[mid] <= x)
+            low = mid;
+        else
+            high = mid - 1;
+    }
+
+    float slope = (model->y[low + 1] - model->y[low]) / (model->x[low + 1] - model->x[low]);
+    return model->y[low] + slope * (x - model->x[low]);
+}
+
+float CALIB_CORE_eval(const CalibModel *model, float x) {
+    if (model->kind == kCalibPiecewise)
+        return eval_piecewise(model, x);
+
+    const float *a = model->coeffs;
+    return a[0] + x * (a[1] + x * (a[2] + x * a[3]));
+}
+
+// Gauss-Jordan with partial pivoting on the augmented normal equations
+static bool solve(double matrix[CALIB_MAX_DEGREE + 1][CALIB_MAX_DEGREE + 2], unsigned size) {
+    for (unsigned column = 0; column < size; ++column) {
+        unsigned pivot = column;
+        for (unsigned row = column + 1; row < size; ++row) {
+            if (fabs(matrix[row][column]) > fabs(matrix[pivot][column]))
+                pivot = row;
+        }
+        if (fabs(matrix[pivot][column]) < 1e-12)
+            return false;
+
+        if (pivot != column) {
+            for (unsigned k = 0; k <= size; ++k) {
+                double swap = matrix[column][k];
+                matrix[column][k] = matrix[pivot][k];
+                matrix[pivot][k] = swap;
+            }
+        }
+
+        for (unsigned row = 0; row < size; ++row) {
+            if (row == column)
+                continue;
+            double factor = matrix[row][column] / matrix[column][column];
+            for (unsigned k = column; k <= size; ++k)
+                matrix[row][k] -= factor * matrix[column][k];
+        }
+    }
+
+    for (unsigned row = 0; row < size; ++row)
+        matrix[row][size] /= matrix[row][row];
+    return true;
+}
+
+bool CALIB_CORE_fit_polynomial(const CalibPoint *points, unsigned count, unsigned degree, CalibModel *model) {
+    if (degree > CALIB_MAX_DEGREE || count <= degree)
+        return false;
+
+    // scaled abscissa keeps the normal equations well conditioned for mV sized inputs
+    double scale = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        if (fabs(points[i].measured) > scale)
+            scale = fabs(points[i].measured);
+    }
+    if (scale == 0)
+        return false;
+
+    const unsigned size = degree + 1;
+    double matrix[CALIB_MAX_DEGREE + 1][CALIB_MAX_DEGREE + 2] = { { 0 } };
+    for (unsigned i = 0; i < count; ++i) {
+        double x = points[i].measured / scale;
+        double powers[2 * CALIB_MAX_DEGREE + 1];
+        powers[0] = 1;
+        for (unsigned k = 1; k <= 2 * degree; ++k)
+            powers[k] = powers[k - 1] * x;
+
+        for (unsigned row = 0; row < size; ++row) {
+            for (unsigned column = 0; column < size; ++column)
+                matrix[row][column] += powers[row + column];
+            matrix[row][size] += powers[row] * points[i].reference;
+        }
+    }
+
+    if (solve(matrix, size) == false)
+        return false;
+
+    memset(model, 0, sizeof(*model));
+    model->kind = kCalibPolynomial;
+    double factor = 1;
+    for (unsigned k = 0; k < size; ++k) {
+        model->coeffs[k] = matrix[k][size] / factor;
+        factor *= scale;
+    }
+    return true;
+}
+
+bool CALIB_CORE_fit_piecewise(const CalibPoint *points, unsigned count, CalibModel *model) {
+    if (count < 2 || count > CALIB_MAX_POINTS)
+        return false;
+
+    CalibModel fitted = { .kind = kCalibPiecewise, .count = 0 };
+    unsigned merged[CALIB_MAX_POINTS] = { 0 };
+
+    // insertion into the sorted node list, equal measurements are averaged
+    for (unsigned i = 0; i < count; ++i) {
+        float x = points[i].measured;
+        unsigned position = 0;
+        while (position < fitted.count && fitted.x[position] < x)
+            ++position;
+
+        if (position < fitted.count && fitted.x[position] == x) {
+            merged[position] += 1;
+            fitted.y[position] += (points[i].reference - fitted.y[position]) / merged[position];
+            continue;
+        }
+
+        for (unsigned k = fitted.count; k > position; --k) {
+            fitted.x[k] = fitted.x[k - 1];
+            fitted.y[k] = fitted.y[k - 1];
+            merged[k] = merged[k - 1];
+        }
+        fitted.x[position] = x;
+        fitted.y[position] = points[i].reference;
+        merged[position] = 1;
+        fitted.count += 1;
+    }
+
+    if (fitted.count < 2)
+        return false;
+
+    *model = fitted;
+    return true;
+}
+
+CalibResiduals CALIB_CORE_residuals(const CalibModel *model, const CalibPoint *points, unsigned count, float *residuals) {
+    CalibResiduals result = { 0 };
+    if (count == 0)
+        return result;
+
+    double sum = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        float residual = CALIB_CORE_eval(model, points[i].measured) - points[i].reference;
+        if (residuals != NULL)
+            residuals[i] = residual;
+        sum += (double)residual * residual;
+        if (fabsf(residual) > result.max)
+            result.max = fabsf(residual);
+    }
+    result.rms = sqrt(sum / count);
+    return result;
+}
+
+bool CALIB_CORE_validate(const CalibModel *model) {
+    if (model->kind == kCalibPolynomial) {
+        for (unsigned k = 0; k <= CALIB_MAX_DEGREE; ++k) {
+            if (isfinite(model->coeffs[k]) == false)
+                return false;
+        }
+        return true;
+    }
+
+    if (model->kind != kCalibPiecewise || model->count < 2 || model->count > CALIB_MAX_POINTS)
+        return false;
+
+    for (unsigned i = 0; i < model->count; ++i) {
+        if (isfinite(model->x[i]) == false || isfinite(model->y[i]) == false)
+            return false;
+        if (i > 0 && model->x[i] <= model->x[i - 1])
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef CALIB_CORE_H
+#define CALIB_CORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CALIB_MAX_POINTS 16
+#define CALIB_MAX_DEGREE 3
+
+typedef enum {
+    kCalibPolynomial = 0,   // a0 + a1 x + a2 x^2 + a3 x^3
+    kCalibPiecewise,        // linear between nodes, end segments extended
+} CalibKind;
+
+// measured value -> reference value in the channel unit
+typedef struct {
+    uint32_t kind;
+    uint32_t count;                         // piecewise nodes
+    float coeffs[CALIB_MAX_DEGREE + 1];
+    float x[CALIB_MAX_POINTS];              // strictly increasing
+    float y[CALIB_MAX_POINTS];
+} CalibModel;
+
+typedef struct {
+    float measured;
+    float reference;
+} CalibPoint;
+
+typedef struct {
+    float rms;
+    float max;              // largest absolute residual
+} CalibResiduals;
+
+void CALIB_CORE_identity(CalibModel *model);
+
+float CALIB_CORE_eval(const CalibModel *model, float x);
+
+// least squares, needs more distinct points than the degree
+bool CALIB_CORE_fit_polynomial(const CalibPoint *points, unsigned count, unsigned degree, CalibModel *model);
+// one node per distinct measured value, repeated values are averaged
+bool CALIB_CORE_fit_piecewise(const CalibPoint *points, unsigned count, CalibModel *model);
+
+// model(measured) - reference for every point, residuals may be NULL
+CalibResiduals CALIB_CORE_residuals(const CalibModel *model, const CalibPoint *points, unsigned count, float *residuals);
+
+bool CALIB_CORE_validate(const CalibModel *model);
+
+#endif // CALIB_CORE_H
@@ -0,0 +1,263 @@
+#include "modules/core/config_core.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "modules/base/generic_fun.h"
+
+#define FIELD(name_, type_, member, reboot_, min_, max_) \
+    { .name = name_, .type = type_, .offset = offsetof(Config, member), .reboot = reboot_, .min = min_, .max = max_ }
+
+#define GPIO_MAX 39
+#define COEFF_MAX 1e9f
+#define ADAPT_MAX_RATE 1000       // one sample per FreeRTOS tick
+
+static const ConfigField kFields[] = {
+    FIELD("adc.r1",          kConfigUnsigned, adc.resistor_r1,     false, 1, 1000000),
+    FIELD("adc.r2",          kConfigUnsigned, adc.resistor_r2,     false, 0, 10000000),
+    FIELD("adc.samples",     kConfigUnsigned, adc.samples,         false, 1, 1000),
+    FIELD("adc.model",       kConfigUnsigned, adc.model.kind,      false, kCalibPolynomial, kCalibPiecewise),
+    FIELD("adc.a0",          kConfigFloat,    adc.model.coeffs[0], false, -COEFF_MAX, COEFF_MAX),
+    FIELD("adc.a1",          kConfigFloat,    adc.model.coeffs[1], false, -COEFF_MAX, COEFF_MAX),
+    FIELD("adc.a2",          kConfigFloat,    adc.model.coeffs[2], false, -COEFF_MAX, COEFF_MAX),
+    FIELD("adc.a3",          kConfigFloat,    adc.model.coeffs[3], false, -COEFF_MAX, COEFF_MAX),
+    FIELD("ct.ratio",        kConfigUnsigned, ct.ratio,            false, 1, 10000),
+    FIELD("ct.step",         kConfigFloat,    ct.step,             false, 0.00001f, 10),
+    FIELD("ct.max",          kConfigFloat,    ct.max_current,      false, 0.1f, 1000),
+    FIELD("ct.samples",      kConfigUnsigned, ct.samples,          false, 1, 1000),
+    FIELD("ct.model",        kConfigUnsigned, ct.model.kind,       false, kCalibPolynomial, kCalibPiecewise),
+    FIELD("ct.a0",           kConfigFloat,    ct.model.coeffs[0],  false, -COEFF_MAX, COEFF_MAX),
+    FIELD("ct.a1",           kConfigFloat,    ct.model.coeffs[1],  false, -COEFF_MAX, COEFF_MAX),
+    FIELD("ct.a2",           kConfigFloat,    ct.model.coeffs[2],  false, -COEFF_MAX, COEFF_MAX),
+    FIELD("ct.a3",           kConfigFloat,    ct.model.coeffs[3],  false, -COEFF_MAX, COEFF_MAX),
+    FIELD("ct.zero_period",  kConfigUnsigned, ct.zero_period,      false, 0, 3600),
+    FIELD("ct.zero_shift",   kConfigUnsigned, ct.zero_shift,       false, 0, 10),
+    FIELD("pwm.pin",         kConfigInt,      pwm.pin,             true,  0, GPIO_MAX),
+    FIELD("ds.pin",          kConfigInt,      ds.pin,              true,  0, GPIO_MAX),
+    FIELD("relay.pins",      kConfigPins,     relay,               false, 0, 31),     // one GPIO register word
+    FIELD("alarm.voltage.low",          kConfigInt,      alarm[kAlarmVoltage].low,             false, -100000, 100000),
+    FIELD("alarm.voltage.high",         kConfigInt,      alarm[kAlarmVoltage].high,            false, -100000, 100000),
+    FIELD("alarm.voltage.hyst",         kConfigInt,      alarm[kAlarmVoltage].hysteresis,      false, 0, 100000),
+    FIELD("alarm.voltage.debounce",     kConfigUnsigned, alarm[kAlarmVoltage].debounce,        false, 0, 1000),
+    FIELD("alarm.current.low",          kConfigInt,      alarm[kAlarmCurrent].low,             false, -1000000, 1000000),
+    FIELD("alarm.current.high",         kConfigInt,      alarm[kAlarmCurrent].high,            false, -1000000, 1000000),
+    FIELD("alarm.current.hyst",         kConfigInt,      alarm[kAlarmCurrent].hysteresis,      false, 0, 1000000),
+    FIELD("alarm.current.debounce",     kConfigUnsigned, alarm[kAlarmCurrent].debounce,        false, 0, 1000),
+    FIELD("alarm.temperature.low",      kConfigInt,      alarm[kAlarmTemperature].low,         false, -20000, 20000),
+    FIELD("alarm.temperature.high",     kConfigInt,      alarm[kAlarmTemperature].high,        false, -20000, 20000),
+    FIELD("alarm.temperature.hyst",     kConfigInt,      alarm[kAlarmTemperature].hysteresis,  false, 0, 20000),
+    FIELD("alarm.temperature.debounce", kConfigUnsigned, alarm[kAlarmTemperature].debounce,    false, 0, 1000),
+    FIELD("notify.voltage.mode",        kConfigUnsigned, notify[kNotifyVoltage].mode,          false, kNotifyInterval, kNotifyOnChange),
+    FIELD("notify.voltage.min",         kConfigUnsigned, notify[kNotifyVoltage].min_interval,  false, 0, 3600000),
+    FIELD("notify.voltage.max",         kConfigUnsigned, notify[kNotifyVoltage].max_interval,  false, 0, 3600000),
+    FIELD("notify.voltage.deadband",    kConfigInt,      notify[kNotifyVoltage].deadband,      false, 0, 100000),
+    FIELD("notify.voltage.relative",    kConfigFloat,    notify[kNotifyVoltage].relative,      false, 0, 1),
+    FIELD("notify.current.mode",        kConfigUnsigned, notify[kNotifyCurrent].mode,          false, kNotifyInterval, kNotifyOnChange),
+    FIELD("notify.current.min",         kConfigUnsigned, notify[kNotifyCurrent].min_interval,  false, 0, 3600000),
+    FIELD("notify.current.max",         kConfigUnsigned, notify[kNotifyCurrent].max_interval,  false, 0, 3600000),
+    FIELD("notify.current.deadband",    kConfigInt,      notify[kNotifyCurrent].deadband,      false, 0, 1000000),
+    FIELD("notify.current.relative",    kConfigFloat,    notify[kNotifyCurrent].relative,      false, 0, 1),
+    FIELD("notify.temperature.mode",    kConfigUnsigned, notify[kNotifyTemperature].mode,      false, kNotifyInterval, kNotifyOnChange),
+    FIELD("notify.temperature.min",     kConfigUnsigned, notify[kNotifyTemperature].min_interval, false, 0, 3600000),
+    FIELD("notify.temperature.max",     kConfigUnsigned, notify[kNotifyTemperature].max_interval, false, 0, 3600000),
+    FIELD("notify.temperature.deadband", kConfigInt,      notify[kNotifyTemperature].deadband,  false, 0, 20000),
+    FIELD("notify.temperature.relative", kConfigFloat,    notify[kNotifyTemperature].relative,  false, 0, 1),
+    FIELD("adapt.enabled",              kConfigUnsigned, adapt.enabled,                        false, 0, 1),
+    FIELD("adapt.idle",                 kConfigUnsigned, adapt.rates.idle_rate,                false, 1, ADAPT_MAX_RATE),
+    FIELD("adapt.active",               kConfigUnsigned, adapt.rates.active_rate,              false, 1, ADAPT_MAX_RATE),
+    FIELD("adapt.hold",                 kConfigUnsigned, adapt.rates.hold,                     false, 0, 600000),
+    FIELD("adapt.voltage_delta",        kConfigInt,      adapt.rates.deltas[0],                false, 0, 100000),
+    FIELD("adapt.current_delta",        kConfigInt,      adapt.rates.deltas[1],                false, 0, 1000000),
+    FIELD("power.max_mhz",              kConfigUnsigned, power.max_mhz,                        false, 40, 240),
+    FIELD("power.min_mhz",              kConfigUnsigned, power.min_mhz,                        false, 40, 240),
+    FIELD("power.light_sleep",          kConfigUnsigned, power.light_sleep,                    false, 0, 1),
+    FIELD("ulp.period",                 kConfigUnsigned, ulp.period,                           false, 10, 60000),
+    FIELD("ulp.interval",               kConfigUnsigned, ulp.interval,                         false, 1, 3600),
+    FIELD("ulp.batch",                  kConfigUnsigned, ulp.batch,                            false, 1, ULP_RECORDS),
+    FIELD("ulp.linger",                 kConfigUnsigned, ulp.linger,                           false, 0, 600),
+};
+
+#define FIELD_COUNT (sizeof(kFields) / sizeof(kFields[0]))
+
+void CONFIG_CORE_defaults(Config *config) {
+    memset(config, 0, sizeof(*config));
+    config->adc.resistor_r1 = 1500;
+    config->adc.resistor_r2 = 8300;
+    config->adc.samples = 100;
+    // bench fit of the prototype, 'calib' replaces it per unit
+    CALIB_CORE_identity(&config->adc.model);
+    config->adc.model.coeffs[0] = -45.7f;
+    config->adc.model.coeffs[1] = 1.000991f;
+    config->adc.model.coeffs[2] = -0.00000169f;
+
+    config->ct.ratio = 4;
+    config->ct.step = 0.0125f;
+    config->ct.max_current = 50;
+    config->ct.samples = 100;
+    CALIB_CORE_identity(&config->ct.model);
+    config->ct.zero_period = 60;
+    config->ct.zero_shift = 3;
+
+    config->pwm.pin = 33;
+    config->ds.pin = 26;
+    config->relay.count = 1;
+    config->relay.pins[0] = 14;
+
+    // limits ready, 'config set alarm.<channel>.debounce' enables a channel
+    config->alarm[kAlarmVoltage] = (AlarmThreshold) { .low = 10000, .high = 15000, .hysteresis = 200 };
+    config->alarm[kAlarmCurrent] = (AlarmThreshold) { .low = -1000, .high = 40000, .hysteresis = 500 };
+    config->alarm[kAlarmTemperature] = (AlarmThreshold) { .low = -2000, .high = 8000, .hysteresis = 300 };
+
+    // the read loops notify once a second, deadbands ready for the on change mode
+    config->notify[kNotifyVoltage] = (NotifyPolicy) { .mode = kNotifyInterval, .min_interval = 1000, .max_interval = 60000, .deadband = 50 };
+    config->notify[kNotifyCurrent] = (NotifyPolicy) { .mode = kNotifyInterval, .min_interval = 1000, .max_interval = 60000, .deadband = 50 };
+    config->notify[kNotifyTemperature] = (NotifyPolicy) { .mode = kNotifyInterval, .min_interval = 1000, .max_interval = 60000, .deadband = 25 };
+
+    config->adapt.enabled = 0;
+    config->adapt.rates = (AdaptConfig) { .idle_rate = 10, .active_rate = 1000, .hold = 2000, .deltas = { 100, 100 } };
+
+    config->power.max_mhz = 240;
+    config->power.min_mhz = 80;
+    config->power.light_sleep = 1;
+
+    // a record a minute, a flush every two hours
+    config->ulp.period = 1000;
+    config->ulp.interval = 60;
+    config->ulp.batch = 120;
+    config->ulp.linger = 30;
+}
+
+const ConfigField *CONFIG_CORE_field(unsigned index) {
+    return index < FIELD_COUNT ? &kFields[index] : NULL;
+}
+
+const ConfigField *CONFIG_CORE_find(const char *name) {
+    for (unsigned i = 0; i < FIELD_COUNT; ++i) {
+        if (AreStringsTheSame(kFields[i].name, name, strlen(kFields[i].name) + 1))
+            return &kFields[i];
+    }
+    return NULL;
+}
+
+static bool in_range(const ConfigField *field, float value) {
+    return value >= field->min && value <= field->max;
+}
+
+bool CONFIG_CORE_parse(Config *config, const ConfigField *field, const char *value) {
+    void *target = (uint8_t *)config + field->offset;
+    char *end;
+
+    switch (field->type) {
+        case kConfigUnsigned: {
+            unsigned long parsed = strtoul(value, &end, 0);
+            if (end == value || *end != '\0' || value[0] == '-' || in_range(field, parsed) == false)
+                return false;
+            *(uint32_t *)target = parsed;
+            return true;
+        }
+        case kConfigInt: {
+            long parsed = strtol(value, &end, 0);
+            if (end == value || *end != '\0' || in_range(field, parsed) == false)
+                return false;
+            *(int32_t *)target = parsed;
+            return true;
+        }
+        case kConfigFloat: {
+            float parsed = strtof(value, &end);
+            if (end == value || *end != '\0' || in_range(field, parsed) == false)
+                return false;
+            *(float *)target = parsed;
+            return true;
+        }
+        case kConfigPins: {
+            unsigned pins[RELAY_MAX_OUTPUTS];
+            unsigned count = ParseUnsignedList(value, pins, RELAY_MAX_OUTPUTS, 10);
+            if (count == 0)
+                return false;
+            for (unsigned i = 0; i < count; ++i) {
+                if (in_range(field, pins[i]) == false)
+                    return false;
+            }
+
+            config->relay.count = count;
+            for (unsigned i = 0; i < RELAY_MAX_OUTPUTS; ++i)
+                config->relay.pins[i] = i < count ? (int32_t)pins[i] : 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+int CONFIG_CORE_format(const Config *config, const ConfigField *field, char *buffer, unsigned size) {
+    const void *source = (const uint8_t *)config + field->offset;
+
+    switch (field->type) {
+        case kConfigUnsigned:
+            return snprintf(buffer, size, "%lu", (unsigned long)*(const uint32_t *)source);
+        case kConfigInt:
+            return snprintf(buffer, size, "%ld", (long)*(const int32_t *)source);
+        case kConfigFloat:
+            return snprintf(buffer, size, "%g", *(const float *)source);
+        case kConfigPins: {
+            int length = 0;
+            buffer[0] = '\0';
+            for (unsigned i = 0; i < config->relay.count && length < (int)size; ++i)
+                length += snprintf(buffer + length, size - length, i == 0 ? "%ld" : ",%ld", (long)config->relay.pins[i]);
+            return length;
+        }
+    }
+    return 0;
+}
+
+bool CONFIG_CORE_field_valid(const Config *config, const ConfigField *field) {
+    const void *source = (const uint8_t *)config + field->offset;
+    bool valid = false;
+
+    switch (field->type) {
+        case kConfigUnsigned:
+            valid = in_range(field, *(const uint32_t *)source);
+            break;
+        case kConfigInt:
+            valid = in_range(field, *(const int32_t *)source);
+            break;
+        case kConfigFloat:
+            valid = in_range(field, *(const float *)source);
+            break;
+        case kConfigPins:
+            valid = config->relay.count > 0 && config->relay.count <= RELAY_MAX_OUTPUTS;
+            for (unsigned pin = 0; valid && pin < config->relay.count; ++pin)
+                valid = in_range(field, config->relay.pins[pin]);
+            break;
+    }
+    return valid;
+}
+
+bool CONFIG_CORE_validate(const Config *config) {
+    for (unsigned i = 0; i < FIELD_COUNT; ++i) {
+        if (CONFIG_CORE_field_valid(config, &kFields[i]) == false)
+            return false;
+    }
+    for (unsigned channel = 0; channel < kAlarmLastChannel; ++channel) {
+        if (ALARM_CORE_validate(&config->alarm[channel]) == false)
+            return false;
+    }
+    if (ADAPT_CORE_validate(&config->adapt.rates) == false)
+        return false;
+    if (POWER_CORE_validate(config->power.max_mhz, config->power.min_mhz) == false)
+        return false;
+    for (unsigned channel = 0; channel < kNotifyLastChannel; ++channel) {
+        if (NOTIFY_CORE_validate(&config->notify[channel]) == false)
+            return false;
+    }
+    return CALIB_CORE_validate(&config->adc.model) && CALIB_CORE_validate(&config->ct.model);
+}
+
+bool CONFIG_CORE_field_differs(const Config *first, const Config *second, const ConfigField *field) {
+    if (field->type == kConfigPins)
+        return memcmp(&first->relay, &second->relay, sizeof(first->relay)) != 0;
+
+    // every scalar field is 32 bit wide
+    return memcmp((const uint8_t *)first + field->offset, (const uint8_t *)second + field->offset, sizeof(uint32_t)) != 0;
+}
@@ -0,0 +1,99 @@
+#ifndef CONFIG_CORE_H
+#define CONFIG_CORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/base/types.h"
+#include "modules/core/relay_core.h"
+#include "modules/core/calib_core.h"
+#include "modules/core/adapt_core.h"
+#include "modules/core/alarm_core.h"
+#include "modules/core/notify_core.h"
+#include "modules/core/power_core.h"
+#include "modules/core/ulp_core.h"
+
+// stored next to the fields, bumped when a field keeps its name but changes meaning
+#define CONFIG_VERSION 1
+
+typedef struct {
+    uint32_t count;
+    int32_t pins[RELAY_MAX_OUTPUTS];
+} ConfigPins;
+
+// runtime configuration, one RAM copy read directly on the hot path
+typedef struct {
+    struct {
+        uint32_t resistor_r1;       // Ohm, divider
+        uint32_t resistor_r2;
+        uint32_t samples;
+        CalibModel model;           // divider output [mV] -> input voltage [mV]
+    } adc;
+    struct {
+        uint32_t ratio;
+        float step;                 // V per A at the burden
+        float max_current;          // A
+        uint32_t samples;
+        CalibModel model;           // zero corrected current [A] -> current [A], the zero is not part of a0
+        uint32_t zero_period;       // s between auto-zero measurements, 0 disables
+        uint32_t zero_shift;        // IIR time constant, 2^shift measurements
+    } ct;
+    struct {
+        int32_t pin;
+    } pwm;
+    struct {
+        int32_t pin;
+    } ds;
+    ConfigPins relay;
+    AlarmThreshold alarm[kAlarmLastChannel];
+    NotifyPolicy notify[kNotifyLastChannel];    // measurement characteristics
+    struct {
+        uint32_t enabled;           // continuous adaptive acquisition, follows commits
+        AdaptConfig rates;
+    } adapt;
+    struct {
+        uint32_t max_mhz;           // CPU while an acquisition lock is held
+        uint32_t min_mhz;           // otherwise
+        uint32_t light_sleep;       // automatic light sleep when every task is idle
+    } power;
+    struct {
+        uint32_t period;            // ms between ULP samples in deep sleep
+        uint32_t interval;          // samples per min/max record
+        uint32_t batch;             // records per flush wakeup
+        uint32_t linger;            // s awake with normal acquisition after a threshold wakeup
+    } ulp;
+} Config;
+
+typedef enum {
+    kConfigUnsigned = 0,
+    kConfigInt,
+    kConfigFloat,
+    kConfigPins,            // count + list, "14,15,16"
+} ConfigType;
+
+typedef struct {
+    const char *name;
+    ConfigType type;
+    uint16_t offset;
+    bool reboot;            // applied on the next boot only
+    float min;              // inclusive limits of the value, of every pin for lists
+    float max;
+} ConfigField;
+
+void CONFIG_CORE_defaults(Config *config);
+
+// NULL past the last field
+const ConfigField *CONFIG_CORE_field(unsigned index);
+const ConfigField *CONFIG_CORE_find(const char *name);
+
+// parses and range checks the value, config is left unchanged on error
+bool CONFIG_CORE_parse(Config *config, const ConfigField *field, const char *value);
+int CONFIG_CORE_format(const Config *config, const ConfigField *field, char *buffer, unsigned size);
+
+// one field within its limits, used on every value loaded from flash
+bool CONFIG_CORE_field_valid(const Config *config, const ConfigField *field);
+// every field within its limits and consistent with the others
+bool CONFIG_CORE_validate(const Config *config);
+bool CONFIG_CORE_field_differs(const Config *first, const Config *second, const ConfigField *field);
+
+#endif // CONFIG_CORE_H
@@ -0,0 +1,88 @@
+#include "modules/core/ct_core.h"
+
+#include <stdio.h>
+
+#include "modules/hal/hal_adc.h"
+#include "modules/hal/hal_time.h"
+
+static Amper to_uncorrected(const CtCoreConfig *config, float voltage, float ref_voltage) {
+    // diff against the doubled reference, then take into account ratio and step
+    Amper meas = (voltage - ref_voltage * 2) / (config->ratio * config->step);
+    return meas < 0.0f ? -meas : meas;
+}
+
+Amper CT_CORE_to_current(const CtCoreConfig *config, float voltage, float ref_voltage) {
+    return CALIB_CORE_eval(&config->model, to_uncorrected(config, voltage, ref_voltage));
+}
+
+void CT_CORE_zero_reset(CtZero *zero) {
+    zero->offset = 0;
+    zero->updates = 0;
+}
+
+void CT_CORE_zero_update(CtZero *zero, uint32_t raw_sum, unsigned count, unsigned shift) {
+    if (count == 0)
+        return;
+
+    int32_t mean = ((int64_t)raw_sum << CT_ZERO_FRACTION_BITS) / count;
+    if (zero->updates == 0)
+        zero->offset = mean;
+    else
+        zero->offset += (mean - zero->offset) >> shift;
+    zero->updates += 1;
+}
+
+bool CT_CORE_zero_valid(const CtZero *zero) {
+    return zero->updates != 0;
+}
+
+// fixed point counts -> mV, interpolated between the two neighbouring codes
+static float counts_to_voltage(int32_t counts) {
+    int raw = counts >> CT_ZERO_FRACTION_BITS;
+    float fraction = (float)(counts & ((1 << CT_ZERO_FRACTION_BITS) - 1)) / (1 << CT_ZERO_FRACTION_BITS);
+    Millivolt low = HAL_ADC_raw_to_voltage(kHalAdcCurrent, raw);
+    Millivolt high = HAL_ADC_raw_to_voltage(kHalAdcCurrent, raw + 1);
+    return low + (high - low) * fraction;
+}
+
+static Amper zeroed_to_current(const CtCoreConfig *config, const CtZero *zero, int32_t counts) {
+    float voltage = counts_to_voltage(counts) - counts_to_voltage(zero->offset);
+    return voltage / 1000 / (config->ratio * config->step);
+}
+
+static Amper read_zeroed(const CtCoreConfig *config, const CtZero *zero) {
+    uint32_t sum = 0;
+    for (unsigned sample = 0; sample < config->samples; ++sample) {
+        sum += HAL_ADC_read_raw(kHalAdcCurrent);
+        HAL_TIME_delay_ms(config->sample_step);
+    }
+
+    return zeroed_to_current(config, zero, ((int64_t)sum << CT_ZERO_FRACTION_BITS) / config->samples);
+}
+
+Amper CT_CORE_counts_to_current(const CtCoreConfig *config, const CtZero *zero, float counts) {
+    return CALIB_CORE_eval(&config->model, zeroed_to_current(config, zero, counts * (1 << CT_ZERO_FRACTION_BITS)));
+}
+
+Amper CT_CORE_read_uncorrected(const CtCoreConfig *config, const CtZero *zero) {
+    if (zero != NULL && CT_CORE_zero_valid(zero))
+        return read_zeroed(config, zero);
+
+    float sum = 0;
+    float ref_sum = 0;
+    for (unsigned sample = 0; sample < config->samples; ++sample) {
+        sum += HAL_ADC_raw_to_voltage(kHalAdcCurrent, HAL_ADC_read_raw(kHalAdcCurrent));
+        ref_sum += HAL_ADC_raw_to_voltage(kHalAdcCurrentRef, HAL_ADC_read_raw(kHalAdcCurrentRef));
+        HAL_TIME_delay_ms(config->sample_step);
+    }
+
+    return to_uncorrected(config, sum / 1000 / config->samples, ref_sum / 1000 / config->samples);
+}
+
+Amper CT_CORE_read(const CtCoreConfig *config, const CtZero *zero) {
+    return CALIB_CORE_eval(&config->model, CT_CORE_read_uncorrected(config, zero));
+}
+
+int CT_CORE_format_ble(char *buffer, size_t size, Amper now, Amper max, Amper min, Amper avg) {
+    return snprintf(buffer, size, "%.2f,%.2f,%.2f,%.2f", now, max, min, avg);
+}
@@ -0,0 +1,52 @@
+#ifndef CT_CORE_H
+#define CT_CORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "modules/base/types.h"
+#include "modules/core/calib_core.h"
+
+typedef struct {
+    unsigned ratio;
+    float step;             // V per A at the burden
+    unsigned samples;
+    Milliseconds sample_step;
+    CalibModel model;       // zero corrected current -> current, see CT_CORE_counts_to_current
+} CtCoreConfig;
+
+#define CT_ZERO_FRACTION_BITS 8
+
+// burden output at zero current in raw counts, measured while the outputs are
+// off and tracked with a first order IIR, it follows the slow thermal drift of
+// the reference and the burden
+typedef struct {
+    int32_t offset;         // raw counts << CT_ZERO_FRACTION_BITS
+    uint32_t updates;
+} CtZero;
+
+void CT_CORE_zero_reset(CtZero *zero);
+// sum of count raw samples taken at zero current, the first update seeds the
+// estimate, then each one moves it by 1 / 2^shift of the difference
+void CT_CORE_zero_update(CtZero *zero, uint32_t raw_sum, unsigned count, unsigned shift);
+bool CT_CORE_zero_valid(const CtZero *zero);
+
+// averaged burden and reference voltages [V] -> current magnitude
+Amper CT_CORE_to_current(const CtCoreConfig *config, float voltage, float ref_voltage);
+
+// with a valid zero only the burden is sampled and the result is signed, the
+// reference channel is read per sample until the first zero measurement
+Amper CT_CORE_read(const CtCoreConfig *config, const CtZero *zero);
+
+// filtered burden code -> current, needs a valid zero. The zero is subtracted
+// before the calibration model and 'calib' fits against zero corrected points,
+// so a0 holds only the residual offset of the transfer curve
+Amper CT_CORE_counts_to_current(const CtCoreConfig *config, const CtZero *zero, float counts);
+
+// averaged current before the calibration model, source of calibration points
+Amper CT_CORE_read_uncorrected(const CtCoreConfig *config, const CtZero *zero);
+
+// BLE current value "<now>,<max>,<min>,<avg>" in A, returns the snprintf length
+int CT_CORE_format_ble(char *buffer, size_t size, Amper now, Amper max, Amper min, Amper avg);
+
+#endif // CT_CORE_H
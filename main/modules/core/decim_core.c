@@ -0,0 +1,148 @@
+#include "modules/core/decim_core.h"
+
+#include <math.h>
+#include <string.h>
+
+#define DESIGN_GRID 256
+
+static unsigned ceil_log2(unsigned value) {
+    unsigned bits = 0;
+    while ((1u << bits) < value)
+        ++bits;
+    return bits;
+}
+
+bool DECIM_CORE_validate(const DecimConfig *config) {
+    if (config->order < 1 || config->order > DECIM_MAX_ORDER)
+        return false;
+    if (config->cic_ratio < 1 || config->cic_ratio > DECIM_MAX_CIC_RATIO)
+        return false;
+    if (config->taps < 1 || config->taps > DECIM_MAX_TAPS)
+        return false;
+
+    // Hogenauer: the registers need input bits + order * log2(ratio)
+    return DECIM_INPUT_BITS + config->order * ceil_log2(config->cic_ratio) <= 32;
+}
+
+// CIC magnitude at frequency in cycles per CIC output sample
+static double cic_magnitude(unsigned order, unsigned ratio, double frequency) {
+    double denominator = ratio * sin(M_PI * frequency / ratio);
+    if (fabs(denominator) < 1e-12)
+        return 1;
+    return pow(fabs(sin(M_PI * frequency) / denominator), order);
+}
+
+bool DECIM_CORE_design(DecimConfig *config, unsigned order, unsigned cic_ratio, unsigned taps, float cutoff) {
+    config->order = order;
+    config->cic_ratio = cic_ratio;
+    config->taps = taps;
+    if (DECIM_CORE_validate(config) == false || cutoff <= 0 || cutoff >= 0.5f / DECIM_FIR_RATIO)
+        return false;
+
+    // frequency sampling of 1 / |CIC| over the passband, then a Hamming window
+    const double center = (taps - 1) / 2.0;
+    const double step = (double)cutoff / DESIGN_GRID;
+    double sum = 0;
+    for (unsigned n = 0; n < taps; ++n) {
+        double value = 0;
+        for (unsigned k = 0; k < DESIGN_GRID; ++k) {
+            double frequency = (k + 0.5) * step;
+            value += cos(2 * M_PI * frequency * (n - center)) / cic_magnitude(order, cic_ratio, frequency);
+        }
+        value *= 2 * step;
+        if (taps > 1)
+            value *= 0.54 - 0.46 * cos(2 * M_PI * n / (taps - 1));
+
+        config->coeffs[n] = value;
+        sum += value;
+    }
+
+    if (fabs(sum) < 1e-12)
+        return false;
+    for (unsigned n = 0; n < taps; ++n)
+        config->coeffs[n] /= sum;
+    for (unsigned n = taps; n < DECIM_MAX_TAPS; ++n)
+        config->coeffs[n] = 0;
+    return true;
+}
+
+bool DECIM_CORE_init(DecimFilter *filter, const DecimConfig *config) {
+    if (DECIM_CORE_validate(config) == false)
+        return false;
+
+    filter->config = *config;
+    filter->gain = 1.0f / powf(config->cic_ratio, config->order);
+    DECIM_CORE_reset(filter);
+    return true;
+}
+
+void DECIM_CORE_reset(DecimFilter *filter) {
+    memset(filter->integrators, 0, sizeof(filter->integrators));
+    memset(filter->combs, 0, sizeof(filter->combs));
+    memset(filter->delay, 0, sizeof(filter->delay));
+    filter->cic_phase = 0;
+    filter->head = 0;
+    filter->fir_phase = 0;
+}
+
+unsigned DECIM_CORE_settling(const DecimConfig *config) {
+    return (config->order + config->taps + DECIM_FIR_RATIO - 1) / DECIM_FIR_RATIO;
+}
+
+unsigned DECIM_CORE_process(DecimFilter *filter, const uint16_t *input, unsigned count, unsigned stride,
+                            float *output, unsigned max_output) {
+    const unsigned order = filter->config.order;
+    const unsigned taps = filter->config.taps;
+    const float *coeffs = filter->config.coeffs;
+    unsigned written = 0;
+
+    for (unsigned i = 0; i < count; ++i) {
+        uint32_t value = input[i * stride];
+        for (unsigned s = 0; s < order; ++s) {
+            filter->integrators[s] += value;
+            value = filter->integrators[s];
+        }
+
+        if (++filter->cic_phase < filter->config.cic_ratio)
+            continue;
+        filter->cic_phase = 0;
+
+        for (unsigned s = 0; s < order; ++s) {
+            uint32_t previous = filter->combs[s];
+            filter->combs[s] = value;
+            value -= previous;
+        }
+
+        float sample = value * filter->gain;
+        filter->head = filter->head == 0 ? taps - 1 : filter->head - 1;
+        filter->delay[filter->head] = sample;
+        filter->delay[filter->head + taps] = sample;
+
+        if (++filter->fir_phase < DECIM_FIR_RATIO)
+            continue;
+        filter->fir_phase = 0;
+
+        if (written == max_output)
+            continue;
+
+        // newest sample first, a plain dot product over a contiguous window
+        const float *window = &filter->delay[filter->head];
+        float acc = 0;
+        for (unsigned k = 0; k < taps; ++k)
+            acc += coeffs[k] * window[k];
+        output[written++] = acc;
+    }
+    return written;
+}
+
+float DECIM_CORE_response(const DecimConfig *config, float frequency) {
+    // the FIR runs at the CIC output rate
+    double cic_frequency = (double)frequency * config->cic_ratio;
+    double re = 0;
+    double im = 0;
+    for (unsigned n = 0; n < config->taps; ++n) {
+        re += config->coeffs[n] * cos(2 * M_PI * cic_frequency * n);
+        im -= config->coeffs[n] * sin(2 * M_PI * cic_frequency * n);
+    }
+    return cic_magnitude(config->order, config->cic_ratio, cic_frequency) * sqrt(re * re + im * im);
+}
@@ -0,0 +1,57 @@
+#ifndef DECIM_CORE_H
+#define DECIM_CORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DECIM_MAX_ORDER 4
+#define DECIM_MAX_CIC_RATIO 64
+#define DECIM_MAX_TAPS 32
+#define DECIM_FIR_RATIO 2
+#define DECIM_INPUT_BITS 12         // ADC code width, bounds the CIC register growth
+
+// CIC decimator by cic_ratio followed by a FIR that flattens the CIC passband
+// droop and decimates by DECIM_FIR_RATIO, input rate / output rate = cic_ratio * 2
+typedef struct {
+    uint32_t order;                 // CIC integrator/comb pairs
+    uint32_t cic_ratio;
+    uint32_t taps;
+    float coeffs[DECIM_MAX_TAPS];
+} DecimConfig;
+
+typedef struct {
+    DecimConfig config;
+    float gain;                     // 1 / cic_ratio^order, unity DC gain of the CIC
+
+    // CIC registers wrap modulo 2^32, exact as long as the output fits (see validate)
+    uint32_t integrators[DECIM_MAX_ORDER];
+    uint32_t combs[DECIM_MAX_ORDER];
+    uint32_t cic_phase;
+
+    // the delay line is stored twice, the newest taps samples are always contiguous
+    float delay[2 * DECIM_MAX_TAPS];
+    uint32_t head;
+    uint32_t fir_phase;
+} DecimFilter;
+
+// order and ratio in range and the CIC register growth within 32 bits
+bool DECIM_CORE_validate(const DecimConfig *config);
+
+// compensating low pass for the FIR stage, passband up to cutoff (cycles per CIC
+// output sample, below 0.5 / DECIM_FIR_RATIO), coefficients sum to one
+bool DECIM_CORE_design(DecimConfig *config, unsigned order, unsigned cic_ratio, unsigned taps, float cutoff);
+
+bool DECIM_CORE_init(DecimFilter *filter, const DecimConfig *config);
+void DECIM_CORE_reset(DecimFilter *filter);
+
+// outputs still affected by the zero state after init or reset
+unsigned DECIM_CORE_settling(const DecimConfig *config);
+
+// every stride-th code of input, count codes, returns the number of outputs written
+unsigned DECIM_CORE_process(DecimFilter *filter, const uint16_t *input, unsigned count, unsigned stride,
+                            float *output, unsigned max_output);
+
+// magnitude of the whole chain at frequency in cycles per input sample
+float DECIM_CORE_response(const DecimConfig *config, float frequency);
+
+#endif // DECIM_CORE_H
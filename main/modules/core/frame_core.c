@@ -0,0 +1,102 @@
+#include "modules/core/frame_core.h"
+
+// COBS encoder writing straight to the output, no staging copy of the frame
+typedef struct {
+    uint8_t *out;
+    size_t max;
+    size_t pos;
+    size_t code_pos;
+    uint8_t code;
+    bool overflow;
+} CobsEncoder;
+
+uint16_t FRAME_CORE_crc16(uint16_t crc, const uint8_t *data, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (unsigned bit = 0; bit < 8; ++bit)
+            crc = crc & 0x8000 ? (uint16_t)(crc << 1) ^ 0x1021 : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+static void put(CobsEncoder *encoder, uint8_t byte) {
+    if (encoder->pos >= encoder->max) {
+        encoder->overflow = true;
+        return;
+    }
+    encoder->out[encoder->pos++] = byte;
+}
+
+static void close_block(CobsEncoder *encoder) {
+    if (encoder->overflow == false)
+        encoder->out[encoder->code_pos] = encoder->code;
+    encoder->code_pos = encoder->pos;
+    encoder->code = 1;
+    put(encoder, 0);
+}
+
+static void push(CobsEncoder *encoder, const uint8_t *data, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        if (data[i] == 0) {
+            close_block(encoder);
+            continue;
+        }
+        put(encoder, data[i]);
+        if (++encoder->code == 0xFF)
+            close_block(encoder);
+    }
+}
+
+size_t FRAME_CORE_encode(uint8_t type, uint8_t sequence, const uint8_t *payload, size_t length, uint8_t *out,
+                         size_t max) {
+    CobsEncoder encoder = { .out = out, .max = max };
+    put(&encoder, FRAME_DELIMITER);
+    encoder.code_pos = encoder.pos;
+    encoder.code = 1;
+    put(&encoder, 0);
+
+    const uint8_t header[FRAME_HEADER_SIZE] = { type, sequence };
+    uint16_t crc = FRAME_CORE_crc16(0xFFFF, header, sizeof(header));
+    crc = FRAME_CORE_crc16(crc, payload, length);
+    const uint8_t trailer[FRAME_CRC_SIZE] = { crc & 0xFF, crc >> 8 };
+
+    push(&encoder, header, sizeof(header));
+    push(&encoder, payload, length);
+    push(&encoder, trailer, sizeof(trailer));
+
+    if (encoder.overflow == false)
+        out[encoder.code_pos] = encoder.code;
+    put(&encoder, FRAME_DELIMITER);
+    return encoder.overflow ? 0 : encoder.pos;
+}
+
+bool FRAME_CORE_decode(uint8_t *chunk, size_t length, Frame *frame) {
+    size_t read = 0;
+    size_t write = 0;
+    while (read < length) {
+        uint8_t code = chunk[read++];
+        if (code == 0)
+            return false;
+        for (unsigned i = 1; i < code; ++i) {
+            if (read >= length || chunk[read] == 0)
+                return false;
+            chunk[write++] = chunk[read++];
+        }
+        if (code < 0xFF && read < length)
+            chunk[write++] = 0;
+    }
+
+    if (write < FRAME_HEADER_SIZE + FRAME_CRC_SIZE)
+        return false;
+
+    size_t body = write - FRAME_CRC_SIZE;
+    uint16_t crc = chunk[body] | (uint16_t)chunk[body + 1] << 8;
+    if (FRAME_CORE_crc16(0xFFFF, chunk, body) != crc)
+        return false;
+
+    frame->type = chunk[0];
+    frame->sequence = chunk[1];
+    frame->payload = chunk + FRAME_HEADER_SIZE;
+    frame->length = body - FRAME_HEADER_SIZE;
+    return true;
+}
@@ -0,0 +1,37 @@
+#ifndef FRAME_CORE_H
+#define FRAME_CORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Binary frames on a byte stream shared with console text:
+//   0x00 | COBS( type u8 | sequence u8 | payload | crc16 LE ) | 0x00
+// COBS leaves no 0x00 inside a frame and console text never holds one, so a
+// reader splits on 0x00 and takes every chunk that decodes with a good CRC as
+// a frame, the rest is text. CRC-16/CCITT-FALSE over type, sequence and payload.
+#define FRAME_HEADER_SIZE 2
+#define FRAME_CRC_SIZE 2
+#define FRAME_DELIMITER 0x00
+
+// worst case encoded size of a payload, with both delimiters
+#define FRAME_ENCODED_SIZE(payload) \
+    ((payload) + FRAME_HEADER_SIZE + FRAME_CRC_SIZE + ((payload) + FRAME_HEADER_SIZE + FRAME_CRC_SIZE) / 254 + 1 + 2)
+
+typedef struct {
+    uint8_t type;
+    uint8_t sequence;
+    const uint8_t *payload;     // into the decode buffer
+    size_t length;
+} Frame;
+
+uint16_t FRAME_CORE_crc16(uint16_t crc, const uint8_t *data, size_t length);
+
+// encoded frame length with delimiters, 0 when it doesn't fit in max
+size_t FRAME_CORE_encode(uint8_t type, uint8_t sequence, const uint8_t *payload, size_t length, uint8_t *out,
+                         size_t max);
+
+// one chunk between delimiters, decoded in place; false on a COBS or CRC error
+bool FRAME_CORE_decode(uint8_t *chunk, size_t length, Frame *frame);
+
+#endif // FRAME_CORE_H
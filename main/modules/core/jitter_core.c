@@ -0,0 +1,58 @@
+#include "modules/core/jitter_core.h"
+
+#include <string.h>
+
+void JITTER_CORE_reset(JitterHistogram *histogram) {
+    memset(histogram, 0, sizeof(*histogram));
+}
+
+unsigned JITTER_CORE_bin(Microseconds deviation) {
+    unsigned bin = 0;
+    while (deviation != 0 && bin < JITTER_BINS - 1) {
+        deviation >>= 1;
+        ++bin;
+    }
+    return bin;
+}
+
+void JITTER_CORE_add(JitterHistogram *histogram, int64_t timestamp) {
+    if (histogram->last_time == 0 || timestamp <= histogram->last_time) {
+        histogram->last_time = timestamp;
+        return;
+    }
+
+    Microseconds period = timestamp - histogram->last_time;
+    histogram->last_time = timestamp;
+
+    if (histogram->count == 0 || period < histogram->min_period)
+        histogram->min_period = period;
+    if (period > histogram->max_period)
+        histogram->max_period = period;
+
+    // the first period has nothing to be compared with
+    if (histogram->last_period != 0) {
+        Microseconds deviation = period > histogram->last_period ? period - histogram->last_period
+                                                                 : histogram->last_period - period;
+        histogram->bins[JITTER_CORE_bin(deviation)] += 1;
+    }
+    histogram->last_period = period;
+    histogram->count += 1;
+}
+
+Microseconds JITTER_CORE_percentile(const JitterHistogram *histogram, float fraction) {
+    uint32_t total = 0;
+    for (unsigned i = 0; i < JITTER_BINS; ++i)
+        total += histogram->bins[i];
+
+    if (total == 0)
+        return 0;
+
+    uint32_t target = total * fraction;
+    uint32_t seen = 0;
+    for (unsigned i = 0; i < JITTER_BINS; ++i) {
+        seen += histogram->bins[i];
+        if (seen > target || seen == total)
+            return i == 0 ? 0 : (1UL << i) - 1;
+    }
+    return (1UL << (JITTER_BINS - 1)) - 1;
+}
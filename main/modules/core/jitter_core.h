@@ -0,0 +1,28 @@
+#ifndef JITTER_CORE_H
+#define JITTER_CORE_H
+
+#include <stdint.h>
+
+#include "modules/base/types.h"
+
+#define JITTER_BINS 20
+
+// period-to-period jitter of a sample stream, bin k counts |period - previous period|
+// in [2^(k-1), 2^k) us, bin 0 exact repeats, the last bin everything above
+typedef struct {
+    int64_t last_time;
+    Microseconds last_period;
+    Microseconds min_period;
+    Microseconds max_period;
+    uint32_t count;
+    uint32_t bins[JITTER_BINS];
+} JitterHistogram;
+
+void JITTER_CORE_reset(JitterHistogram *histogram);
+void JITTER_CORE_add(JitterHistogram *histogram, int64_t timestamp);
+
+unsigned JITTER_CORE_bin(Microseconds deviation);
+// upper bound of the bin holding the given fraction [0..1] of the samples
+Microseconds JITTER_CORE_percentile(const JitterHistogram *histogram, float fraction);
+
+#endif // JITTER_CORE_H
@@ -0,0 +1,50 @@
+#include "modules/core/notify_core.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool NOTIFY_CORE_validate(const NotifyPolicy *policy) {
+    if (policy->mode > kNotifyOnChange || policy->deadband < 0 || policy->relative < 0)
+        return false;
+    return policy->max_interval == 0 || policy->max_interval >= policy->min_interval;
+}
+
+void NOTIFY_CORE_reset(NotifyState *state) {
+    memset(state, 0, sizeof(*state));
+}
+
+static bool changed(const NotifyPolicy *policy, const NotifyState *state, const int32_t *values, unsigned count) {
+    for (unsigned i = 0; i < count; ++i) {
+        int64_t difference = llabs((int64_t)values[i] - state->last[i]);
+        float relative = policy->relative * abs(state->last[i]);
+        int64_t deadband = relative > policy->deadband ? (int64_t)relative : policy->deadband;
+        if (difference > deadband)
+            return true;
+    }
+    return false;
+}
+
+bool NOTIFY_CORE_due(const NotifyPolicy *policy, NotifyState *state, int64_t now, const int32_t *values,
+                     unsigned count) {
+    count = count < NOTIFY_MAX_VALUES ? count : NOTIFY_MAX_VALUES;
+
+    bool due = state->valid == false;
+    if (due == false) {
+        const int64_t elapsed = now - state->last_time + NOTIFY_SLACK_US;
+        if (elapsed < (int64_t)policy->min_interval * 1000)
+            return false;
+
+        if (policy->mode == kNotifyInterval)
+            due = true;
+        else
+            due = (policy->max_interval != 0 && elapsed >= (int64_t)policy->max_interval * 1000)
+                  || changed(policy, state, values, count);
+    }
+
+    if (due) {
+        state->valid = true;
+        state->last_time = now;
+        memcpy(state->last, values, count * sizeof(values[0]));
+    }
+    return due;
+}
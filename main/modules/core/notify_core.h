@@ -0,0 +1,45 @@
+#ifndef NOTIFY_CORE_H
+#define NOTIFY_CORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define NOTIFY_MAX_VALUES 2         // values judged per notification, both temperature probes
+#define NOTIFY_SLACK_US 10000       // read loop jitter, a 1 s loop still meets a 1 s interval
+
+typedef enum {
+    kNotifyVoltage = 0,     // mV
+    kNotifyCurrent,         // mA
+    kNotifyTemperature,     // 0.01 C
+// sentinel
+    kNotifyLastChannel
+} NotifyChannel;
+
+typedef enum {
+    kNotifyInterval = 0,    // every min_interval
+    kNotifyOnChange,        // outside the deadband, within the interval bounds
+} NotifyMode;
+
+typedef struct {
+    uint32_t mode;          // NotifyMode
+    uint32_t min_interval;  // ms, never faster
+    uint32_t max_interval;  // ms, on change: sent at least this often, 0 only on change
+    int32_t deadband;       // channel unit, on change: smallest reported difference
+    float relative;         // fraction of the last sent value, the larger deadband wins
+} NotifyPolicy;
+
+typedef struct {
+    int64_t last_time;      // us, of the last sent value
+    int32_t last[NOTIFY_MAX_VALUES];
+    bool valid;
+} NotifyState;
+
+bool NOTIFY_CORE_validate(const NotifyPolicy *policy);
+void NOTIFY_CORE_reset(NotifyState *state);
+
+// true when the values are to be sent, the state then takes them as the last sent ones;
+// runs before any formatting so a suppressed sample costs a few compares
+bool NOTIFY_CORE_due(const NotifyPolicy *policy, NotifyState *state, int64_t now, const int32_t *values,
+                     unsigned count);
+
+#endif // NOTIFY_CORE_H
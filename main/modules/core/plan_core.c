@@ -0,0 +1,350 @@
+#include "modules/core/plan_core.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "modules/base/generic_fun.h"
+
+#define MAX_STATEMENT 64
+#define MAX_TOKENS 5
+#define MAX_DURATION_MS (10 * 60 * 1000)
+#define MAX_LOOPS 10000
+
+static const char *op_names[] = {
+    [kPlanRelay]    = "relay",
+    [kPlanPwm]      = "pwm",
+    [kPlanWait]     = "wait",
+    [kPlanMeasure]  = "measure",
+    [kPlanExpect]   = "expect",
+    [kPlanLoop]     = "loop",
+    [kPlanEnd]      = "end",
+};
+
+static const char *channel_names[] = {
+    [kPlanVoltage]  = "voltage",
+    [kPlanCurrent]  = "current",
+};
+
+static const char *stat_names[] = {
+    [kPlanAvg]          = "avg",
+    [kPlanMin]          = "min",
+    [kPlanMax]          = "max",
+    [kPlanPeakToPeak]   = "pp",
+};
+
+#define COUNT(array) (sizeof(array) / sizeof(array[0]))
+
+const char *PLAN_CORE_op_name(uint8_t code) {
+    return code >= kPlanRelay && code <= kPlanEnd ? op_names[code] : "?";
+}
+
+static bool same(const char *token, const char *name) {
+    return AreStringsTheSame(name, token, strlen(name) + 1);
+}
+
+static int lookup(const char *token, const char *const *names, unsigned count) {
+    for (unsigned i = 0; i < count; ++i) {
+        if (names[i] != NULL && same(token, names[i]))
+            return i;
+    }
+    return -1;
+}
+
+static bool parse_number(const char *token, int32_t min, int32_t max, int32_t *value) {
+    char *end = NULL;
+    long parsed = strtol(token, &end, 0);
+    if (end == token || *end != '\0' || parsed < min || parsed > max)
+        return false;
+    *value = parsed;
+    return true;
+}
+
+static bool parse_statement(char **tokens, unsigned count, PlanOp *op) {
+    memset(op, 0, sizeof(*op));
+    int code = lookup(tokens[0], op_names, COUNT(op_names));
+    if (code < 0)
+        return false;
+    op->code = code;
+
+    switch (op->code) {
+        case kPlanRelay:
+            if (count == 2 && (same(tokens[1], "on") || same(tokens[1], "off"))) {
+                op->a = -1;
+                op->b = same(tokens[1], "on") ? -1 : 0;
+                return true;
+            }
+            if (count == 3 && parse_number(tokens[1], 0, 15, &op->a) && (same(tokens[2], "on") || same(tokens[2], "off"))) {
+                op->a = 1 << op->a;
+                op->b = same(tokens[2], "on") ? op->a : 0;
+                return true;
+            }
+            return false;
+        case kPlanPwm:
+            if (count == 2 && same(tokens[1], "off"))
+                return true;
+            return count == 3 && parse_number(tokens[1], 1, 40000000, &op->a) && parse_number(tokens[2], 0, 100, &op->b);
+        case kPlanWait:
+            return count == 2 && parse_number(tokens[1], 0, MAX_DURATION_MS, &op->a);
+        case kPlanMeasure: {
+            int channel = count == 3 ? lookup(tokens[1], channel_names, COUNT(channel_names)) : -1;
+            op->select = channel;
+            return channel >= 0 && parse_number(tokens[2], 1, MAX_DURATION_MS, &op->a);
+        }
+        case kPlanExpect: {
+            int stat = count == 4 ? lookup(tokens[1], stat_names, COUNT(stat_names)) : -1;
+            op->select = stat;
+            return stat >= 0 && parse_number(tokens[2], INT32_MIN, INT32_MAX, &op->a)
+                   && parse_number(tokens[3], INT32_MIN, INT32_MAX, &op->b) && op->a <= op->b;
+        }
+        case kPlanLoop:
+            return count == 2 && parse_number(tokens[1], 1, MAX_LOOPS, &op->a);
+        case kPlanEnd:
+            return count == 1;
+    }
+    return false;
+}
+
+bool PLAN_CORE_compile(const char *text, PlanProgram *program, unsigned *error_statement) {
+    uint16_t loops[PLAN_MAX_DEPTH];
+    unsigned depth = 0;
+    unsigned statement = 0;
+
+    memset(program, 0, sizeof(*program));
+    program->version = PLAN_VERSION;
+    *error_statement = 0;
+
+    while (*text != '\0') {
+        size_t length = strcspn(text, ";\n");
+        char buffer[MAX_STATEMENT];
+        if (length >= sizeof(buffer)) {
+            *error_statement = statement;
+            return false;
+        }
+        memcpy(buffer, text, length);
+        buffer[length] = '\0';
+        text += length + (text[length] != '\0');
+
+        char *tokens[MAX_TOKENS];
+        unsigned count = 0;
+        for (char *token = strtok(buffer, " \t\r"); token != NULL; token = strtok(NULL, " \t\r")) {
+            if (count == MAX_TOKENS) {
+                *error_statement = statement;
+                return false;
+            }
+            tokens[count++] = token;
+        }
+        if (count == 0)
+            continue;
+
+        *error_statement = statement++;
+        if (program->count == PLAN_MAX_OPS)
+            return false;
+
+        PlanOp *op = &program->ops[program->count];
+        if (parse_statement(tokens, count, op) == false)
+            return false;
+
+        if (op->code == kPlanLoop) {
+            if (depth == PLAN_MAX_DEPTH)
+                return false;
+            loops[depth++] = program->count;
+        } else if (op->code == kPlanEnd) {
+            if (depth == 0)
+                return false;
+            op->jump = loops[--depth];
+        }
+        program->count += 1;
+    }
+
+    *error_statement = statement;
+    return depth == 0 && program->count > 0;
+}
+
+bool PLAN_CORE_validate(const PlanProgram *program) {
+    if (program->version != PLAN_VERSION || program->count == 0 || program->count > PLAN_MAX_OPS)
+        return false;
+
+    uint16_t loops[PLAN_MAX_DEPTH];
+    unsigned depth = 0;
+    for (unsigned i = 0; i < program->count; ++i) {
+        const PlanOp *op = &program->ops[i];
+        switch (op->code) {
+            case kPlanRelay:
+            case kPlanPwm:
+                break;
+            case kPlanWait:
+                if (op->a < 0 || op->a > MAX_DURATION_MS)
+                    return false;
+                break;
+            case kPlanMeasure:
+                if (op->select >= COUNT(channel_names) || op->a < 1 || op->a > MAX_DURATION_MS)
+                    return false;
+                break;
+            case kPlanExpect:
+                if (op->select >= COUNT(stat_names) || op->a > op->b)
+                    return false;
+                break;
+            case kPlanLoop:
+                if (depth == PLAN_MAX_DEPTH || op->a < 1 || op->a > MAX_LOOPS)
+                    return false;
+                loops[depth++] = i;
+                break;
+            case kPlanEnd:
+                if (depth == 0 || op->jump != loops[--depth])
+                    return false;
+                break;
+            default:
+                return false;
+        }
+    }
+    return depth == 0;
+}
+
+bool PLAN_CORE_format_op(const PlanOp *op, char *buffer, unsigned size) {
+    switch (op->code) {
+        case kPlanRelay:
+            if (op->a == -1)
+                snprintf(buffer, size, "relay %s", op->b != 0 ? "on" : "off");
+            else
+                snprintf(buffer, size, "relay %d %s", __builtin_ctz(op->a), op->b != 0 ? "on" : "off");
+            return true;
+        case kPlanPwm:
+            if (op->a == 0)
+                snprintf(buffer, size, "pwm off");
+            else
+                snprintf(buffer, size, "pwm %" PRId32 " %" PRId32, op->a, op->b);
+            return true;
+        case kPlanWait:
+        case kPlanLoop:
+            snprintf(buffer, size, "%s %" PRId32, op_names[op->code], op->a);
+            return true;
+        case kPlanMeasure:
+            snprintf(buffer, size, "measure %s %" PRId32, channel_names[op->select], op->a);
+            return true;
+        case kPlanExpect:
+            snprintf(buffer, size, "expect %s %" PRId32 " %" PRId32, stat_names[op->select], op->a, op->b);
+            return true;
+        case kPlanEnd:
+            snprintf(buffer, size, "end");
+            return true;
+    }
+    return false;
+}
+
+typedef struct {
+    int32_t min;
+    int32_t max;
+    int32_t avg;
+    bool valid;
+} Measurement;
+
+static void measure(const PlanOp *op, const PlanHooks *hooks, void *arg, int64_t begin, Measurement *result,
+                    PlanRecord *record) {
+    const int64_t end = begin + (int64_t)op->a * 1000;
+    int64_t sum = 0;
+    uint32_t count = 0;
+
+    result->min = INT32_MAX;
+    result->max = INT32_MIN;
+    for (int64_t time = begin; time < end; time += PLAN_SAMPLE_PERIOD_US) {
+        hooks->wait_until(time, arg);
+        if (count == 0)
+            record->late = hooks->now(arg) - begin;
+
+        int32_t value = hooks->sample(op->select, arg);
+        result->min = value < result->min ? value : result->min;
+        result->max = value > result->max ? value : result->max;
+        sum += value;
+        count += 1;
+    }
+    // the next step starts with the window closed
+    hooks->wait_until(end, arg);
+
+    result->avg = sum / count;
+    result->valid = true;
+    record->min = result->min;
+    record->max = result->max;
+    record->avg = result->avg;
+}
+
+static int32_t statistic(const Measurement *measurement, uint8_t stat) {
+    switch (stat) {
+        case kPlanMin:          return measurement->min;
+        case kPlanMax:          return measurement->max;
+        case kPlanPeakToPeak:   return measurement->max - measurement->min;
+        default:                return measurement->avg;
+    }
+}
+
+void PLAN_CORE_run(const PlanProgram *program, const PlanHooks *hooks, void *arg, PlanResult *result) {
+    struct {
+        uint16_t index;
+        int32_t remaining;
+    } loops[PLAN_MAX_DEPTH];
+    unsigned depth = 0;
+    Measurement last = { .valid = false };
+
+    memset(result, 0, sizeof(*result));
+    const int64_t start = hooks->now(arg);
+    // every step is scheduled against the plan start, a late step doesn't shift the next ones
+    int64_t deadline = start;
+
+    for (unsigned pc = 0; pc < program->count; ++pc) {
+        if (hooks->stopped(arg)) {
+            result->aborted = true;
+            break;
+        }
+
+        const PlanOp *op = &program->ops[pc];
+        PlanRecord record = { .step = pc, .code = op->code, .pass = true };
+        switch (op->code) {
+            case kPlanLoop:
+                loops[depth].index = pc;
+                loops[depth].remaining = op->a;
+                depth += 1;
+                continue;
+            case kPlanEnd:
+                if (--loops[depth - 1].remaining > 0)
+                    pc = loops[depth - 1].index;
+                else
+                    depth -= 1;
+                continue;
+            case kPlanRelay:
+                record.late = hooks->now(arg) - deadline;
+                record.pass = hooks->relay(op->a, op->b, arg);
+                break;
+            case kPlanPwm:
+                record.late = hooks->now(arg) - deadline;
+                record.pass = hooks->pwm(op->a, op->b, arg);
+                break;
+            case kPlanWait:
+                deadline += (int64_t)op->a * 1000;
+                hooks->wait_until(deadline, arg);
+                record.late = hooks->now(arg) - deadline;
+                break;
+            case kPlanMeasure:
+                measure(op, hooks, arg, deadline, &last, &record);
+                deadline += (int64_t)op->a * 1000;
+                break;
+            case kPlanExpect:
+                record.pass = last.valid;
+                if (last.valid) {
+                    record.min = last.min;
+                    record.max = last.max;
+                    record.avg = last.avg;
+                    record.value = statistic(&last, op->select);
+                    record.pass = record.value >= op->a && record.value <= op->b;
+                }
+                break;
+        }
+
+        record.start = hooks->now(arg) - start;
+        result->steps += 1;
+        result->failed += record.pass ? 0 : 1;
+        hooks->record(&record, arg);
+    }
+
+    result->duration = hooks->now(arg) - start;
+}
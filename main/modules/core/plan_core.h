@@ -0,0 +1,98 @@
+#ifndef PLAN_CORE_H
+#define PLAN_CORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/base/types.h"
+
+#define PLAN_VERSION 1
+#define PLAN_MAX_OPS 64
+#define PLAN_MAX_DEPTH 4                // nested loops
+#define PLAN_SAMPLE_PERIOD_US 1000      // measure windows sample once per millisecond
+
+// Test plan text, statements separated by ';' or new lines:
+//   relay on | relay off | relay <output> on|off
+//   pwm <freq Hz> <duty %> | pwm off
+//   wait <ms>
+//   measure voltage|current <ms>       min, max and average over the window
+//   expect avg|min|max|pp <low> <high> limits on the last measure, mV or mA
+//   loop <n> ... end
+// Every statement compiles to one fixed size op, the program is stored as is.
+typedef enum {
+    kPlanRelay = 1,
+    kPlanPwm,
+    kPlanWait,
+    kPlanMeasure,
+    kPlanExpect,
+    kPlanLoop,
+    kPlanEnd,
+} PlanOpcode;
+
+typedef enum {
+    kPlanVoltage = 0,       // mV
+    kPlanCurrent,           // mA
+} PlanChannel;
+
+typedef enum {
+    kPlanAvg = 0,
+    kPlanMin,
+    kPlanMax,
+    kPlanPeakToPeak,
+} PlanStat;
+
+typedef struct {
+    uint8_t code;           // PlanOpcode
+    uint8_t select;         // PlanChannel or PlanStat
+    uint16_t jump;          // kPlanEnd: index of its loop
+    int32_t a;              // mask, freq, ms, window, low limit, loop count
+    int32_t b;              // values, duty, high limit
+} PlanOp;
+
+typedef struct {
+    uint32_t version;
+    uint32_t count;
+    PlanOp ops[PLAN_MAX_OPS];
+} PlanProgram;
+
+typedef struct {
+    uint16_t step;          // op index
+    uint8_t code;
+    bool pass;
+    int64_t start;          // us since the plan start
+    int32_t late;           // us behind the schedule
+    int32_t min;
+    int32_t max;
+    int32_t avg;
+    int32_t value;          // checked statistic of expect
+} PlanRecord;
+
+typedef struct {
+    uint32_t steps;
+    uint32_t failed;
+    int64_t duration;       // us
+    bool aborted;
+} PlanResult;
+
+// target actions, the interpreter keeps the schedule and the statistics
+typedef struct {
+    bool (*relay)(uint32_t mask, uint32_t values, void *arg);
+    bool (*pwm)(uint32_t freq, uint32_t duty, void *arg);    // 0 Hz stops
+    int64_t (*now)(void *arg);
+    void (*wait_until)(int64_t time, void *arg);
+    int32_t (*sample)(PlanChannel channel, void *arg);
+    void (*record)(const PlanRecord *record, void *arg);
+    bool (*stopped)(void *arg);
+} PlanHooks;
+
+// false with the failing statement index (from 0) in error_statement
+bool PLAN_CORE_compile(const char *text, PlanProgram *program, unsigned *error_statement);
+bool PLAN_CORE_validate(const PlanProgram *program);
+
+// one statement back as text, false past the end
+bool PLAN_CORE_format_op(const PlanOp *op, char *buffer, unsigned size);
+const char *PLAN_CORE_op_name(uint8_t code);
+
+void PLAN_CORE_run(const PlanProgram *program, const PlanHooks *hooks, void *arg, PlanResult *result);
+
+#endif // PLAN_CORE_H
@@ -0,0 +1,61 @@
+#include "modules/core/power_core.h"
+
+// ESP32 datasheet, CPU running with the radio off, middle of the quoted ranges
+static const struct {
+    uint32_t mhz;
+    float ma;
+} kActiveCurrent[] = {
+    { 40,   13.0f },
+    { 80,   25.0f },
+    { 160,  35.0f },
+    { 240,  50.0f },
+};
+
+#define LIGHT_SLEEP_MA 0.8f
+
+bool POWER_CORE_valid_freq(uint32_t mhz) {
+    for (unsigned i = 0; i < sizeof(kActiveCurrent) / sizeof(kActiveCurrent[0]); ++i) {
+        if (kActiveCurrent[i].mhz == mhz)
+            return true;
+    }
+    return false;
+}
+
+bool POWER_CORE_validate(uint32_t max_mhz, uint32_t min_mhz) {
+    return POWER_CORE_valid_freq(max_mhz) && POWER_CORE_valid_freq(min_mhz) && min_mhz <= max_mhz;
+}
+
+static float clamp(float value) {
+    return value < 0 ? 0 : value > 1 ? 1 : value;
+}
+
+PowerResidency POWER_CORE_residency(float locked, float awake, const float *idle, unsigned cores,
+                                    bool sleep_possible) {
+    PowerResidency residency = { .max = clamp(locked) };
+
+    float both_idle = 1;
+    for (unsigned core = 0; core < cores; ++core)
+        both_idle = idle[core] < both_idle ? idle[core] : both_idle;
+
+    if (sleep_possible) {
+        // a held lock keeps the chip awake, the idle time outside it sleeps
+        float held = clamp(awake) > residency.max ? clamp(awake) : residency.max;
+        float sleep = clamp(both_idle) - held;
+        residency.sleep = sleep > 0 ? sleep : 0;
+    }
+    residency.min = clamp(1 - residency.max - residency.sleep);
+    return residency;
+}
+
+static float active_current(uint32_t mhz) {
+    for (unsigned i = 0; i < sizeof(kActiveCurrent) / sizeof(kActiveCurrent[0]); ++i) {
+        if (kActiveCurrent[i].mhz == mhz)
+            return kActiveCurrent[i].ma;
+    }
+    return kActiveCurrent[sizeof(kActiveCurrent) / sizeof(kActiveCurrent[0]) - 1].ma;
+}
+
+float POWER_CORE_current(const PowerResidency *residency, uint32_t max_mhz, uint32_t min_mhz) {
+    return residency->max * active_current(max_mhz) + residency->min * active_current(min_mhz)
+           + residency->sleep * LIGHT_SLEEP_MA;
+}
@@ -0,0 +1,27 @@
+#ifndef POWER_CORE_H
+#define POWER_CORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// share of the report window spent in each chip state
+typedef struct {
+    float max;              // an acquisition lock held, CPU at max_mhz
+    float min;              // awake at min_mhz
+    float sleep;            // light sleep
+} PowerResidency;
+
+// 40 (XTAL), 80, 160 or 240 MHz
+bool POWER_CORE_valid_freq(uint32_t mhz);
+bool POWER_CORE_validate(uint32_t max_mhz, uint32_t min_mhz);
+
+// locked: share with the CPU lock held, awake: share with any lock held, idle: per core idle
+// task share; light sleep needs both cores idle and no lock holding the chip awake
+PowerResidency POWER_CORE_residency(float locked, float awake, const float *idle, unsigned cores,
+                                    bool sleep_possible);
+
+// typical chip supply current in mA from the ESP32 datasheet figures, radio off; an
+// estimate for comparing acquisition modes, not a measurement
+float POWER_CORE_current(const PowerResidency *residency, uint32_t max_mhz, uint32_t min_mhz);
+
+#endif // POWER_CORE_H
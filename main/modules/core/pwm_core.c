@@ -0,0 +1,22 @@
+#include "modules/core/pwm_core.h"
+
+#include "modules/base/generic_fun.h"
+
+uint32_t PWM_CORE_duty_from_percent(Percent duty, unsigned resolution_bits) {
+    if (duty > 100)
+        duty = 100;
+
+    return ((1UL << resolution_bits) - 1) * duty / 100;
+}
+
+bool PWM_CORE_parse_ble_command(const char *buffer, PwmCommand *command) {
+    unsigned values[4] = { 0 };
+    if (ParseUnsignedList(buffer, values, 4, 10) == 0)
+        return false;
+
+    command->force = values[0] != 0;
+    command->duration = values[1];
+    command->duty = values[2];
+    command->freq = values[3];
+    return true;
+}
@@ -0,0 +1,22 @@
+#ifndef PWM_CORE_H
+#define PWM_CORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/base/types.h"
+
+typedef struct {
+    bool force;
+    Seconds duration;
+    Percent duty;
+    Herz freq;
+} PwmCommand;
+
+// duty above 100 % is clamped
+uint32_t PWM_CORE_duty_from_percent(Percent duty, unsigned resolution_bits);
+
+// "<force>,<duration>,<duty>,<freq>"
+bool PWM_CORE_parse_ble_command(const char *buffer, PwmCommand *command);
+
+#endif // PWM_CORE_H
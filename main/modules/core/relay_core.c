@@ -0,0 +1,126 @@
+#include "modules/core/relay_core.h"
+
+#include <stdlib.h>
+
+#include "modules/hal/hal_gpio.h"
+
+RelayMask RELAY_CORE_all_outputs(const RelayBank *bank) {
+    return (RelayMask)((1UL << bank->count) - 1);
+}
+
+bool RELAY_CORE_set_mask(RelayBank *bank, RelayMask mask, RelayMask values) {
+    if (mask & ~RELAY_CORE_all_outputs(bank))
+        return false;
+
+    uint32_t set = 0;
+    uint32_t clear = 0;
+    for (unsigned i = 0; i < bank->count; ++i) {
+        if ((mask & (1U << i)) == 0)
+            continue;
+
+        if (values & (1U << i))
+            set |= bank->gpio_bits[i];
+        else
+            clear |= bank->gpio_bits[i];
+    }
+
+    HAL_GPIO_write(set, clear);
+    bank->state = (bank->state & ~mask) | (values & mask);
+    return true;
+}
+
+bool RELAY_CORE_configure(RelayBank *bank, const int *pins, unsigned count) {
+    if (count == 0 || count > RELAY_MAX_OUTPUTS)
+        return false;
+
+    uint64_t pin_bit_mask = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        // single register write only covers the GPIO0-31 bank
+        if (pins[i] >= 32 || HAL_GPIO_is_valid_output(pins[i]) == false)
+            return false;
+        pin_bit_mask |= 1ULL << pins[i];
+    }
+
+    if (HAL_GPIO_config_outputs(pin_bit_mask) == false)
+        return false;
+
+    // release outputs that are no longer part of the bank
+    RELAY_CORE_set_mask(bank, RELAY_CORE_all_outputs(bank), 0);
+
+    for (unsigned i = 0; i < count; ++i) {
+        bank->pins[i] = pins[i];
+        bank->gpio_bits[i] = 1UL << pins[i];
+    }
+    bank->count = count;
+    bank->state = 0;
+
+    RELAY_CORE_set_mask(bank, RELAY_CORE_all_outputs(bank), 0);
+    return true;
+}
+
+unsigned RELAY_CORE_parse_pins(const char *text, int *pins, unsigned max_pins) {
+    unsigned count = 0;
+    char *end;
+    while (*text && count < max_pins) {
+        pins[count] = strtoul(text, &end, 10);
+        if (end == text)
+            return 0;
+
+        ++count;
+        while (*end == ',')
+            end++;
+        text = end;
+    }
+    return count;
+}
+
+unsigned RELAY_CORE_parse_pattern(const char *text, RelaySeqStep *steps, unsigned max_steps) {
+    unsigned count = 0;
+    char *end;
+    while (*text && count < max_steps) {
+        steps[count].state = strtoul(text, &end, 10) != 0;
+        if (end == text || *end != ':')
+            return 0;
+
+        text = end + 1;
+        steps[count].hold = strtoul(text, &end, 10);
+        if (end == text)
+            return 0;
+
+        ++count;
+        while (*end == ',')
+            end++;
+        text = end;
+    }
+    return count;
+}
+
+void RELAY_CORE_contact_start(ContactTracker *tracker, RelayActuation *result, int64_t command_time) {
+    tracker->command_time = command_time;
+    tracker->last_change = command_time;
+    tracker->level = !result->state;
+    tracker->reached = false;
+    result->timeout = true;
+}
+
+bool RELAY_CORE_contact_update(ContactTracker *tracker, RelayActuation *result, bool sample, int64_t now, Microseconds stable) {
+    if (sample != tracker->level) {
+        tracker->level = sample;
+        tracker->last_change = now;
+        if (tracker->level == result->state) {
+            if (tracker->reached)
+                result->bounces += 1;
+            else
+                result->actuation = now - tracker->command_time;
+
+            tracker->reached = true;
+            result->settle = now - tracker->command_time;
+        }
+    }
+
+    if (tracker->reached && tracker->level == result->state && now - tracker->last_change >= stable) {
+        result->timeout = false;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,56 @@
+#ifndef RELAY_CORE_H
+#define RELAY_CORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/base/types.h"
+
+#define RELAY_MAX_OUTPUTS 16
+
+typedef uint16_t RelayMask;
+
+typedef struct {
+    RelayMask state;
+    unsigned count;
+    int pins[RELAY_MAX_OUTPUTS];
+    // relay bit -> GPIO register bit, every bank pin is below 32 so one word covers all
+    uint32_t gpio_bits[RELAY_MAX_OUTPUTS];
+} RelayBank;
+
+typedef struct {
+    bool state;
+    Microseconds hold;
+} RelaySeqStep;
+
+typedef struct {
+    bool state;
+    bool timeout;
+    Microseconds actuation;     // command -> first crossing of the threshold
+    Microseconds settle;        // command -> last crossing, contact stable afterwards
+    Microseconds lateness;      // how late the command was against the schedule
+    unsigned bounces;
+} RelayActuation;
+
+typedef struct {
+    int64_t command_time;
+    int64_t last_change;
+    bool level;
+    bool reached;
+} ContactTracker;
+
+RelayMask RELAY_CORE_all_outputs(const RelayBank *bank);
+bool RELAY_CORE_configure(RelayBank *bank, const int *pins, unsigned count);
+// false and nothing written when the mask has bits outside the bank
+bool RELAY_CORE_set_mask(RelayBank *bank, RelayMask mask, RelayMask values);
+
+// "14,27,..." -> pins, 0 on a malformed list
+unsigned RELAY_CORE_parse_pins(const char *text, int *pins, unsigned max_pins);
+// "1:50000,0:50000" -> steps, 0 on a malformed pattern
+unsigned RELAY_CORE_parse_pattern(const char *text, RelaySeqStep *steps, unsigned max_steps);
+
+void RELAY_CORE_contact_start(ContactTracker *tracker, RelayActuation *result, int64_t command_time);
+// feeds one thresholded contact sample, true once the contact stayed in the commanded state for stable us
+bool RELAY_CORE_contact_update(ContactTracker *tracker, RelayActuation *result, bool sample, int64_t now, Microseconds stable);
+
+#endif // RELAY_CORE_H
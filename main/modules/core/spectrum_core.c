@@ -0,0 +1,132 @@
+#include "modules/core/spectrum_core.h"
+
+#include <math.h>
+
+float SPECTRUM_CORE_window(float *data, unsigned count) {
+    float sum = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        float w = 0.5f - 0.5f * cosf(2 * (float)M_PI * i / count);
+        data[i] *= w;
+        sum += w;
+    }
+    return sum;
+}
+
+float SPECTRUM_CORE_goertzel(const float *data, unsigned count, float frequency) {
+    const float coeff = 2 * cosf(2 * (float)M_PI * frequency);
+    float s1 = 0;
+    float s2 = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        float s0 = data[i] + coeff * s1 - s2;
+        s2 = s1;
+        s1 = s0;
+    }
+
+    float power = s1 * s1 + s2 * s2 - coeff * s1 * s2;
+    return power > 0 ? sqrtf(power) : 0;
+}
+
+// radix-2 decimation in time on interleaved re/im pairs
+static void fft(float *data, unsigned count) {
+    for (unsigned i = 1, j = 0; i < count; ++i) {
+        unsigned bit = count >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            float re = data[2 * i];
+            float im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = re;
+            data[2 * j + 1] = im;
+        }
+    }
+
+    for (unsigned length = 2; length <= count; length <<= 1) {
+        for (unsigned k = 0; k < length / 2; ++k) {
+            float angle = -2 * (float)M_PI * k / length;
+            float wr = cosf(angle);
+            float wi = sinf(angle);
+            for (unsigned start = 0; start < count; start += length) {
+                float *a = &data[2 * (start + k)];
+                float *b = &data[2 * (start + k + length / 2)];
+                float tr = b[0] * wr - b[1] * wi;
+                float ti = b[0] * wi + b[1] * wr;
+                b[0] = a[0] - tr;
+                b[1] = a[1] - ti;
+                a[0] += tr;
+                a[1] += ti;
+            }
+        }
+    }
+}
+
+bool SPECTRUM_CORE_rfft(float *data, unsigned count) {
+    if (count < 4 || count > SPECTRUM_MAX_SAMPLES || (count & (count - 1)) != 0)
+        return false;
+
+    // even samples are the real part, odd ones the imaginary part
+    fft(data, count / 2);
+    return true;
+}
+
+float SPECTRUM_CORE_rfft_bin(const float *data, unsigned count, unsigned bin) {
+    const unsigned half = count / 2;
+    if (bin == 0)
+        return fabsf(data[0] + data[1]);
+    if (bin >= half)
+        return fabsf(data[0] - data[1]);
+
+    // split Z[k] and Z[half - k] into the spectra of the even and odd samples
+    float zr = data[2 * bin];
+    float zi = data[2 * bin + 1];
+    float cr = data[2 * (half - bin)];
+    float ci = -data[2 * (half - bin) + 1];
+
+    float er = (zr + cr) / 2;
+    float ei = (zi + ci) / 2;
+    float or_ = (zi - ci) / 2;
+    float oi = -(zr - cr) / 2;
+
+    float angle = -2 * (float)M_PI * bin / count;
+    float wr = cosf(angle);
+    float wi = sinf(angle);
+    float re = er + or_ * wr - oi * wi;
+    float im = ei + or_ * wi + oi * wr;
+    return sqrtf(re * re + im * im);
+}
+
+static void finish_harmonics(SpectrumHarmonics *result) {
+    float distortion = 0;
+    for (unsigned h = 1; h < result->count; ++h)
+        distortion += result->amplitudes[h] * result->amplitudes[h];
+
+    result->thd = 0;
+    if (result->count > 0 && result->amplitudes[0] > 0)
+        result->thd = sqrtf(distortion) / result->amplitudes[0];
+}
+
+void SPECTRUM_CORE_harmonics(const float *data, unsigned count, float window_sum, float frequency,
+                             unsigned harmonics, SpectrumHarmonics *result) {
+    result->frequency = frequency;
+    result->count = 0;
+    if (harmonics > SPECTRUM_MAX_HARMONICS)
+        harmonics = SPECTRUM_MAX_HARMONICS;
+
+    for (unsigned h = 1; h <= harmonics && h * frequency < 0.5f; ++h)
+        result->amplitudes[result->count++] = 2 * SPECTRUM_CORE_goertzel(data, count, h * frequency) / window_sum;
+    finish_harmonics(result);
+}
+
+void SPECTRUM_CORE_harmonics_fft(const float *data, unsigned count, float window_sum, unsigned bin,
+                                 unsigned harmonics, SpectrumHarmonics *result) {
+    result->frequency = (float)bin / count;
+    result->count = 0;
+    if (harmonics > SPECTRUM_MAX_HARMONICS)
+        harmonics = SPECTRUM_MAX_HARMONICS;
+
+    for (unsigned h = 1; h <= harmonics && h * bin < count / 2; ++h)
+        result->amplitudes[result->count++] = 2 * SPECTRUM_CORE_rfft_bin(data, count, h * bin) / window_sum;
+    finish_harmonics(result);
+}
@@ -0,0 +1,36 @@
+#ifndef SPECTRUM_CORE_H
+#define SPECTRUM_CORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SPECTRUM_MAX_SAMPLES 1024
+#define SPECTRUM_MAX_HARMONICS 10
+
+typedef struct {
+    float frequency;                        // fundamental, cycles per sample
+    unsigned count;                         // harmonics below Nyquist, fundamental included
+    float amplitudes[SPECTRUM_MAX_HARMONICS];   // peak, [0] fundamental
+    float thd;                              // ratio, harmonics 2..count against the fundamental
+} SpectrumHarmonics;
+
+// Hann window in place, returns the sum of the window for amplitude scaling
+float SPECTRUM_CORE_window(float *data, unsigned count);
+
+// |X(frequency)| of one bin at any frequency in cycles per sample
+float SPECTRUM_CORE_goertzel(const float *data, unsigned count, float frequency);
+
+// real FFT in place through a half size complex FFT, count a power of two up
+// to SPECTRUM_MAX_SAMPLES, the result stays packed, read it with rfft_bin
+bool SPECTRUM_CORE_rfft(float *data, unsigned count);
+// |X[bin]| for bin 0..count/2 of a packed rfft result
+float SPECTRUM_CORE_rfft_bin(const float *data, unsigned count, unsigned bin);
+
+// Goertzel bins at the fundamental and its multiples of windowed data
+void SPECTRUM_CORE_harmonics(const float *data, unsigned count, float window_sum, float frequency,
+                             unsigned harmonics, SpectrumHarmonics *result);
+// the same from a packed rfft result, fundamental and harmonics on exact bins
+void SPECTRUM_CORE_harmonics_fft(const float *data, unsigned count, float window_sum, unsigned bin,
+                                 unsigned harmonics, SpectrumHarmonics *result);
+
+#endif // SPECTRUM_CORE_H
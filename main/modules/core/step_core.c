@@ -0,0 +1,52 @@
+#include "modules/core/step_core.h"
+
+#include <math.h>
+
+bool STEP_CORE_begin(StepAnalysis *analysis, float initial, float final, float min_step, float band,
+                     uint32_t tail) {
+    if (fabsf(final - initial) < min_step)
+        return false;
+
+    *analysis = (StepAnalysis) {
+        .initial    = initial,
+        .final      = final,
+        .band       = band,
+        .peak       = 0,
+        .count      = 0,
+        .tail       = tail,
+        .rise_start = -1,
+        .rise_end   = -1,
+        .outside    = -1,
+    };
+    return true;
+}
+
+void STEP_CORE_add(StepAnalysis *analysis, float value) {
+    // normalized, 0 before the step and 1 at the steady state in either direction
+    float y = (value - analysis->initial) / (analysis->final - analysis->initial);
+    int64_t index = analysis->count++;
+
+    if (analysis->rise_start < 0 && y >= 0.1f)
+        analysis->rise_start = index;
+    if (analysis->rise_end < 0 && y >= 0.9f)
+        analysis->rise_end = index;
+    if (y > analysis->peak)
+        analysis->peak = y;
+    if (fabsf(y - 1) > analysis->band)
+        analysis->outside = index;
+}
+
+void STEP_CORE_finish(const StepAnalysis *analysis, StepMetrics *metrics) {
+    const float step = analysis->final - analysis->initial;
+    const int64_t judged = (int64_t)analysis->count - analysis->tail;
+
+    metrics->initial = analysis->initial;
+    metrics->final = analysis->final;
+    metrics->peak = analysis->initial + analysis->peak * step;
+    metrics->overshoot = analysis->peak > 1 ? (analysis->peak - 1) * 100 : 0;
+    metrics->delay = analysis->rise_start < 0 ? analysis->count : analysis->rise_start;
+    metrics->rise = analysis->rise_start < 0 || analysis->rise_end < 0 ? analysis->count
+                                                                        : analysis->rise_end - analysis->rise_start;
+    metrics->settling = analysis->outside + 1;
+    metrics->settled = analysis->outside < judged;
+}
@@ -0,0 +1,39 @@
+#ifndef STEP_CORE_H
+#define STEP_CORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// step response of one channel, times in samples after the step, values in the input unit
+typedef struct {
+    float initial;
+    float final;            // steady state
+    float peak;             // furthest excursion in the step direction
+    float overshoot;        // percent of the step
+    uint32_t delay;         // step until 10 %
+    uint32_t rise;          // 10 % until 90 %
+    uint32_t settling;      // step until the last sample outside the band
+    bool settled;           // stayed within the band over the tail used for final
+} StepMetrics;
+
+typedef struct {
+    float initial;
+    float final;
+    float band;             // fraction of the step
+    float peak;
+    uint32_t count;
+    uint32_t tail;          // last samples averaged into final, not judged for settling
+    int64_t rise_start;     // -1 until crossed
+    int64_t rise_end;
+    int64_t outside;        // last sample outside the band
+} StepAnalysis;
+
+// initial from the samples before the step, final from the last tail samples,
+// false when the two are closer than min_step, nothing moved
+bool STEP_CORE_begin(StepAnalysis *analysis, float initial, float final, float min_step, float band,
+                     uint32_t tail);
+// every sample after the step in order, the tail included
+void STEP_CORE_add(StepAnalysis *analysis, float value);
+void STEP_CORE_finish(const StepAnalysis *analysis, StepMetrics *metrics);
+
+#endif // STEP_CORE_H
@@ -0,0 +1,35 @@
+#include "modules/core/trace_core.h"
+
+#include <string.h>
+
+void TRACE_CORE_record(TraceBuffer *trace, unsigned core, uint32_t cycles, TraceEvent event, uint16_t arg) {
+    if (trace->enabled == false || core >= TRACE_MAX_CORES)
+        return;
+
+    TraceRing *ring = &trace->rings[core];
+    uint32_t index = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    TraceRecord *record = &ring->records[index & (TRACE_RING_SIZE - 1)];
+    record->cycles = cycles;
+    record->event = event;
+    record->arg = arg;
+}
+
+unsigned TRACE_CORE_snapshot(const TraceBuffer *trace, unsigned core, TraceRecord *records, unsigned max_records) {
+    if (core >= TRACE_MAX_CORES)
+        return 0;
+
+    const TraceRing *ring = &trace->rings[core];
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    unsigned count = head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+    if (count > max_records)
+        count = max_records;
+
+    for (unsigned i = 0; i < count; ++i)
+        records[i] = ring->records[(head - count + i) & (TRACE_RING_SIZE - 1)];
+    return count;
+}
+
+void TRACE_CORE_clear(TraceBuffer *trace) {
+    for (unsigned core = 0; core < TRACE_MAX_CORES; ++core)
+        __atomic_store_n(&trace->rings[core].head, 0, __ATOMIC_RELEASE);
+}
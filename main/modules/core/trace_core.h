@@ -0,0 +1,44 @@
+#ifndef TRACE_CORE_H
+#define TRACE_CORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TRACE_MAX_CORES 2
+#define TRACE_RING_SIZE 512     // records per core, power of two
+
+typedef enum {
+    kTraceCommand = 1,      // BLE write reached its handler, arg: characteristic
+    kTraceSample,           // measurement taken, arg: characteristic it is reported on
+    kTraceNotifyQueued,     // notification handed to NimBLE, arg: characteristic
+    kTraceNotifySent,       // notification left the controller, arg: characteristic
+    kTracePwmUpdate,        // LEDC duty written, arg: duty %
+    kTraceRelayUpdate,      // relay bank written, arg: new state
+// sentinel
+    kTraceLastEvent
+} TraceEvent;
+
+typedef struct {
+    uint32_t cycles;
+    uint16_t event;
+    uint16_t arg;
+} TraceRecord;
+
+typedef struct {
+    uint32_t head;          // total records written, wraps
+    TraceRecord records[TRACE_RING_SIZE];
+} TraceRing;
+
+typedef struct {
+    bool enabled;
+    TraceRing rings[TRACE_MAX_CORES];
+} TraceBuffer;
+
+// lock free, every core writes its own ring and a preempting writer only takes the next slot
+void TRACE_CORE_record(TraceBuffer *trace, unsigned core, uint32_t cycles, TraceEvent event, uint16_t arg);
+
+// copies the retained records of one core oldest first, recording must be stopped meanwhile
+unsigned TRACE_CORE_snapshot(const TraceBuffer *trace, unsigned core, TraceRecord *records, unsigned max_records);
+void TRACE_CORE_clear(TraceBuffer *trace);
+
+#endif // TRACE_CORE_H
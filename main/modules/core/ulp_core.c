@@ -0,0 +1,303 @@
+#include "modules/core/ulp_core.h"
+
+#include <string.h>
+
+#define R0 0
+#define R1 1
+#define R2 2
+#define R3 3
+
+#define MAX_LABELS 32
+#define MAX_STEPS 10000     // one run never loops, except for the ready wait
+
+typedef enum {
+    kLabelNewMin = 1,
+    kLabelMax,
+    kLabelNewMax,
+    kLabelLevel,
+    kLabelStateLow,
+    kLabelStateHigh,
+    kLabelGoLow,
+    kLabelGoHigh,
+    kLabelSetLevel,
+    kLabelRecord,
+    kLabelFull,
+    kLabelReset,
+    kLabelDone,
+    kLabelWaitReady,
+    kLabelHalt,
+} Label;
+
+typedef struct {
+    UlpOp *ops;
+    unsigned max;
+    unsigned count;
+} Builder;
+
+static void emit(Builder *builder, uint8_t code, uint8_t dst, uint8_t src, uint8_t src2, uint16_t imm, uint16_t imm2) {
+    if (builder->count < builder->max)
+        builder->ops[builder->count] = (UlpOp) { code, dst, src, src2, imm, imm2 };
+    // counted past the end too, the caller sees the size it would need
+    builder->count += 1;
+}
+
+static void label(Builder *b, Label label) { emit(b, kUlpLabel, 0, 0, 0, label, 0); }
+static void jump(Builder *b, uint8_t code, Label label) { emit(b, code, 0, 0, 0, label, 0); }
+static void load(Builder *b, uint8_t dst, UlpVar var) { emit(b, kUlpLoad, dst, R3, 0, var, 0); }
+static void store(Builder *b, uint8_t src, UlpVar var) { emit(b, kUlpStore, 0, src, R3, var, 0); }
+
+// level machine: a limit crossing raises the level, the clear value ends it
+static void build_level(Builder *b) {
+    label(b, kLabelLevel);
+    load(b, R0, kUlpVarLevel);
+    emit(b, kUlpJumpAtLeast, 0, 0, 0, kLabelStateHigh, 2);
+    emit(b, kUlpJumpAtLeast, 0, 0, 0, kLabelStateLow, 1);
+
+    load(b, R0, kUlpVarLast);
+    load(b, R1, kUlpVarLow);
+    emit(b, kUlpSubReg, R2, R0, R1, 0, 0);          // sample < low
+    jump(b, kUlpJumpOverflow, kLabelGoLow);
+    load(b, R1, kUlpVarHigh);
+    emit(b, kUlpSubReg, R2, R1, R0, 0, 0);          // high < sample
+    jump(b, kUlpJumpOverflow, kLabelGoHigh);
+    jump(b, kUlpJump, kLabelRecord);
+
+    label(b, kLabelGoLow);
+    emit(b, kUlpMoveImm, R0, 0, 0, 1, 0);
+    jump(b, kUlpJump, kLabelSetLevel);
+    label(b, kLabelGoHigh);
+    emit(b, kUlpMoveImm, R0, 0, 0, 2, 0);
+    jump(b, kUlpJump, kLabelSetLevel);
+
+    label(b, kLabelStateLow);
+    load(b, R0, kUlpVarLast);
+    load(b, R1, kUlpVarLowClear);
+    emit(b, kUlpSubReg, R2, R0, R1, 0, 0);          // still below the clear value
+    jump(b, kUlpJumpOverflow, kLabelRecord);
+    emit(b, kUlpMoveImm, R0, 0, 0, 0, 0);
+    jump(b, kUlpJump, kLabelSetLevel);
+
+    label(b, kLabelStateHigh);
+    load(b, R0, kUlpVarLast);
+    load(b, R1, kUlpVarHighClear);
+    emit(b, kUlpSubReg, R2, R1, R0, 0, 0);          // still above the clear value
+    jump(b, kUlpJumpOverflow, kLabelRecord);
+    emit(b, kUlpMoveImm, R0, 0, 0, 0, 0);
+
+    label(b, kLabelSetLevel);
+    store(b, R0, kUlpVarLevel);
+    load(b, R0, kUlpVarWake);
+    emit(b, kUlpOrImm, R0, R0, 0, kUlpWakeLevel, 0);
+    store(b, R0, kUlpVarWake);
+}
+
+// every interval samples close a record, a full batch wakes the main CPU
+static void build_record(Builder *b) {
+    label(b, kLabelRecord);
+    load(b, R0, kUlpVarTicks);
+    emit(b, kUlpAddImm, R0, R0, 0, 1, 0);
+    store(b, R0, kUlpVarTicks);
+    load(b, R1, kUlpVarInterval);
+    emit(b, kUlpSubReg, R2, R0, R1, 0, 0);          // ticks < interval
+    jump(b, kUlpJumpOverflow, kLabelDone);
+
+    load(b, R0, kUlpVarCount);
+    emit(b, kUlpJumpAtLeast, 0, 0, 0, kLabelFull, ULP_RECORDS);
+    emit(b, kUlpAddReg, R1, R0, R0, 0, 0);
+    emit(b, kUlpAddReg, R1, R1, R0, 0, 0);          // 3 words a record
+    load(b, R2, kUlpVarMin);
+    emit(b, kUlpStore, 0, R2, R1, kUlpVarRecords, 0);
+    load(b, R2, kUlpVarMax);
+    emit(b, kUlpStore, 0, R2, R1, kUlpVarRecords + 1, 0);
+    load(b, R2, kUlpVarLast);
+    emit(b, kUlpStore, 0, R2, R1, kUlpVarRecords + 2, 0);
+    emit(b, kUlpAddImm, R0, R0, 0, 1, 0);
+    store(b, R0, kUlpVarCount);
+    jump(b, kUlpJump, kLabelReset);
+
+    label(b, kLabelFull);
+    load(b, R0, kUlpVarDropped);
+    emit(b, kUlpAddImm, R0, R0, 0, 1, 0);
+    store(b, R0, kUlpVarDropped);
+    load(b, R0, kUlpVarCount);
+
+    label(b, kLabelReset);
+    emit(b, kUlpMoveImm, R2, 0, 0, 0, 0);
+    store(b, R2, kUlpVarTicks);
+    store(b, R2, kUlpVarMax);
+    emit(b, kUlpMoveImm, R2, 0, 0, 0xFFFF, 0);
+    store(b, R2, kUlpVarMin);
+    load(b, R1, kUlpVarBatch);
+    emit(b, kUlpSubReg, R2, R0, R1, 0, 0);          // count < batch
+    jump(b, kUlpJumpOverflow, kLabelDone);
+    load(b, R0, kUlpVarWake);
+    emit(b, kUlpOrImm, R0, R0, 0, kUlpWakeBatch, 0);
+    store(b, R0, kUlpVarWake);
+}
+
+bool ULP_CORE_program(unsigned channel, UlpOp *ops, unsigned max, unsigned *count) {
+    Builder b = { .ops = ops, .max = max };
+
+    // R3 stays 0, every variable is addressed by its offset
+    emit(&b, kUlpMoveImm, R3, 0, 0, 0, 0);
+    emit(&b, kUlpMoveImm, R1, 0, 0, 0, 0);
+    for (unsigned i = 0; i < 1u << ULP_OVERSAMPLE_SHIFT; ++i) {
+        emit(&b, kUlpAdc, R0, 0, 0, channel, 0);
+        emit(&b, kUlpAddReg, R1, R1, R0, 0, 0);
+    }
+    emit(&b, kUlpShiftRightImm, R0, R1, 0, ULP_OVERSAMPLE_SHIFT, 0);
+    store(&b, R0, kUlpVarLast);
+
+    load(&b, R1, kUlpVarMin);
+    emit(&b, kUlpSubReg, R2, R0, R1, 0, 0);         // sample < min
+    jump(&b, kUlpJumpOverflow, kLabelNewMin);
+    jump(&b, kUlpJump, kLabelMax);
+    label(&b, kLabelNewMin);
+    store(&b, R0, kUlpVarMin);
+    label(&b, kLabelMax);
+    load(&b, R1, kUlpVarMax);
+    emit(&b, kUlpSubReg, R2, R1, R0, 0, 0);         // max < sample
+    jump(&b, kUlpJumpOverflow, kLabelNewMax);
+    jump(&b, kUlpJump, kLabelLevel);
+    label(&b, kLabelNewMax);
+    store(&b, R0, kUlpVarMax);
+
+    build_level(&b);
+    build_record(&b);
+
+    label(&b, kLabelDone);
+    load(&b, R0, kUlpVarWake);
+    emit(&b, kUlpJumpLess, 0, 0, 0, kLabelHalt, 1);
+    label(&b, kLabelWaitReady);
+    emit(&b, kUlpReady, R0, 0, 0, 0, 0);
+    emit(&b, kUlpAndImm, R0, R0, 0, 1, 0);
+    jump(&b, kUlpJumpZero, kLabelWaitReady);
+    emit(&b, kUlpWake, 0, 0, 0, 0, 0);
+    // the main CPU restarts the timer once the buffer is flushed
+    emit(&b, kUlpStopTimer, 0, 0, 0, 0, 0);
+    label(&b, kLabelHalt);
+    emit(&b, kUlpHalt, 0, 0, 0, 0, 0);
+
+    *count = b.count;
+    return b.count <= max;
+}
+
+bool ULP_CORE_validate(const UlpSettings *settings) {
+    return settings->interval > 0 && settings->batch > 0 && settings->batch <= ULP_RECORDS
+           && settings->low <= settings->low_clear && settings->high_clear <= settings->high
+           && settings->low_clear <= settings->high_clear;
+}
+
+void ULP_CORE_setup(uint32_t *memory, const UlpSettings *settings) {
+    memset(memory, 0, kUlpVarLastWord * sizeof(uint32_t));
+    memory[kUlpVarLow] = settings->low;
+    memory[kUlpVarLowClear] = settings->low_clear;
+    memory[kUlpVarHigh] = settings->high;
+    memory[kUlpVarHighClear] = settings->high_clear;
+    memory[kUlpVarInterval] = settings->interval;
+    memory[kUlpVarBatch] = settings->batch;
+    memory[kUlpVarMin] = 0xFFFF;
+}
+
+void ULP_CORE_clear_records(uint32_t *memory) {
+    memory[kUlpVarCount] = 0;
+    memory[kUlpVarDropped] = 0;
+    memory[kUlpVarWake] = 0;
+}
+
+bool ULP_CORE_simulate(const UlpOp *ops, unsigned count, uint32_t *memory, UlpAdcSource adc, void *arg,
+                       UlpRun *run) {
+    int labels[MAX_LABELS];
+    for (unsigned i = 0; i < MAX_LABELS; ++i)
+        labels[i] = -1;
+    for (unsigned pc = 0; pc < count; ++pc) {
+        if (ops[pc].code == kUlpLabel && ops[pc].imm < MAX_LABELS)
+            labels[ops[pc].imm] = pc;
+    }
+    for (unsigned pc = 0; pc < count; ++pc) {
+        bool branch = ops[pc].code >= kUlpJump && ops[pc].code <= kUlpJumpAtLeast;
+        if (branch && (ops[pc].imm >= MAX_LABELS || labels[ops[pc].imm] < 0))
+            return false;
+    }
+
+    uint16_t r[4] = { 0 };
+    bool overflow = false;
+    bool zero = false;
+    memset(run, 0, sizeof(*run));
+
+    for (unsigned pc = 0; pc < count; ++pc) {
+        if (++run->instructions > MAX_STEPS)
+            return false;
+
+        const UlpOp *op = &ops[pc];
+        uint32_t result = 0;
+        bool alu = false;
+        int target = -1;
+        switch (op->code) {
+            case kUlpAdc:
+                r[op->dst] = adc(arg) & 0xFFFF;
+                run->conversions += 1;
+                break;
+            case kUlpLoad:
+            case kUlpStore: {
+                unsigned address = r[op->code == kUlpLoad ? op->src : op->src2] + op->imm;
+                if (address >= kUlpVarLastWord)
+                    return false;
+                if (op->code == kUlpLoad)
+                    r[op->dst] = memory[address] & 0xFFFF;
+                else
+                    memory[address] = (uint32_t)pc << 16 | r[op->src];
+                break;
+            }
+            case kUlpMoveImm:       result = op->imm;                   alu = true; break;
+            case kUlpAddImm:        result = r[op->src] + op->imm;      alu = true; break;
+            case kUlpAddReg:        result = r[op->src] + r[op->src2];  alu = true; break;
+            case kUlpSubReg:        result = r[op->src] - r[op->src2];  alu = true; break;
+            case kUlpOrImm:         result = r[op->src] | op->imm;      alu = true; break;
+            case kUlpAndImm:        result = r[op->src] & op->imm;      alu = true; break;
+            case kUlpShiftRightImm: result = r[op->src] >> op->imm;     alu = true; break;
+            case kUlpLabel:
+                break;
+            case kUlpJump:
+                target = labels[op->imm];
+                break;
+            case kUlpJumpOverflow:
+                target = overflow ? labels[op->imm] : -1;
+                break;
+            case kUlpJumpZero:
+                target = zero ? labels[op->imm] : -1;
+                break;
+            case kUlpJumpLess:
+                target = r[R0] < op->imm2 ? labels[op->imm] : -1;
+                break;
+            case kUlpJumpAtLeast:
+                target = r[R0] >= op->imm2 ? labels[op->imm] : -1;
+                break;
+            case kUlpReady:
+                // the simulated SoC is always asleep and ready
+                r[R0] = 1;
+                break;
+            case kUlpWake:
+                run->woke = true;
+                break;
+            case kUlpStopTimer:
+                run->timer_stopped = true;
+                break;
+            case kUlpHalt:
+                return true;
+            default:
+                return false;
+        }
+
+        if (alu) {
+            // a borrow or a carry out of 16 bits sets the overflow flag
+            overflow = result > 0xFFFF;
+            r[op->dst] = result & 0xFFFF;
+            zero = r[op->dst] == 0;
+        }
+        if (target >= 0)
+            pc = target;
+    }
+    // ran off the end without a halt
+    return false;
+}
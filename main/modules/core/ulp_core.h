@@ -0,0 +1,111 @@
+#ifndef ULP_CORE_H
+#define ULP_CORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The ULP FSM program is built as a list of ops, the target translates every op
+// to one ulp_insn_t macro and the host runs the same list in ULP_CORE_simulate.
+// All values are 16 bit like the ULP registers, ADC values are raw counts.
+#define ULP_OVERSAMPLE_SHIFT 2          // 4 conversions averaged per sample
+#define ULP_RECORDS 192                 // min, max and last of every record interval
+#define ULP_MAX_OPS 128
+#define ULP_NO_LIMIT 0xFFFF             // high limit that never trips
+
+// RTC slow memory layout in 32 bit words, the ULP uses the low 16 bits of each
+typedef enum {
+    kUlpVarLow = 0,         // level low below this
+    kUlpVarLowClear,        // back to normal from low at or above this
+    kUlpVarHigh,            // level high above this
+    kUlpVarHighClear,       // back to normal from high at or below this
+    kUlpVarInterval,        // samples per record
+    kUlpVarBatch,           // records per flush wakeup
+    kUlpVarLevel,           // AlarmLevel numbering: 0 normal, 1 low, 2 high
+    kUlpVarTicks,           // samples in the open record
+    kUlpVarMin,
+    kUlpVarMax,
+    kUlpVarLast,
+    kUlpVarCount,           // closed records
+    kUlpVarDropped,         // records lost while the buffer was full
+    kUlpVarWake,            // UlpWakeReason bits since the last flush
+    kUlpVarRecords = 16,    // ULP_RECORDS x { min, max, last }
+    kUlpVarLastWord = kUlpVarRecords + 3 * ULP_RECORDS,
+} UlpVar;
+
+typedef enum {
+    kUlpWakeBatch = 1 << 0,
+    kUlpWakeLevel = 1 << 1,
+} UlpWakeReason;
+
+typedef enum {
+    kUlpAdc = 0,            // dst = ADC1 conversion of channel imm
+    kUlpLoad,               // dst = mem[src + imm]
+    kUlpStore,              // mem[src2 + imm] = src
+    kUlpMoveImm,            // dst = imm
+    kUlpAddImm,             // dst = src + imm
+    kUlpAddReg,             // dst = src + src2
+    kUlpSubReg,             // dst = src - src2, overflow when src < src2
+    kUlpOrImm,              // dst = src | imm
+    kUlpAndImm,             // dst = src & imm
+    kUlpShiftRightImm,      // dst = src >> imm
+    kUlpLabel,              // label imm
+    kUlpJump,               // to label imm
+    kUlpJumpOverflow,       // to label imm when the last ALU op overflowed
+    kUlpJumpZero,           // to label imm when the last ALU op gave 0
+    kUlpJumpLess,           // to label imm when R0 < imm2
+    kUlpJumpAtLeast,        // to label imm when R0 >= imm2
+    kUlpReady,              // R0 = SoC ready to be woken
+    kUlpWake,
+    kUlpStopTimer,          // no more periodic runs until the main CPU starts it again
+    kUlpHalt,               // end of this run
+} UlpOpcode;
+
+typedef struct {
+    uint8_t code;           // UlpOpcode
+    uint8_t dst;
+    uint8_t src;
+    uint8_t src2;
+    uint16_t imm;
+    uint16_t imm2;
+} UlpOp;
+
+typedef struct {
+    uint16_t low;           // raw counts, see kUlpVarLow..kUlpVarHighClear
+    uint16_t low_clear;
+    uint16_t high;
+    uint16_t high_clear;
+    uint16_t interval;
+    uint16_t batch;
+} UlpSettings;
+
+typedef struct {
+    bool woke;              // the run ended with a wakeup of the main CPU
+    bool timer_stopped;
+    uint32_t instructions;
+    uint32_t conversions;
+} UlpRun;
+
+// one ADC conversion in the simulation
+typedef uint16_t (*UlpAdcSource)(void *arg);
+
+// the sampling program for ADC1 channel, false when it doesn't fit in max ops
+bool ULP_CORE_program(unsigned channel, UlpOp *ops, unsigned max, unsigned *count);
+
+bool ULP_CORE_validate(const UlpSettings *settings);
+
+// settings in and the open record, level and buffer reset
+void ULP_CORE_setup(uint32_t *memory, const UlpSettings *settings);
+
+// after a flush, the open record and the level carry on
+void ULP_CORE_clear_records(uint32_t *memory);
+
+// one timer run of the program against memory as the ULP would execute it
+bool ULP_CORE_simulate(const UlpOp *ops, unsigned count, uint32_t *memory, UlpAdcSource adc, void *arg,
+                       UlpRun *run);
+
+static inline uint16_t ULP_CORE_read(const uint32_t *memory, unsigned word) {
+    // the upper half of a word stored by the ULP holds the PC of the store
+    return memory[word] & 0xFFFF;
+}
+
+#endif // ULP_CORE_H
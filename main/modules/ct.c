@@ -2,30 +2,29 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include <math.h>
 
-#include "driver/gpio.h"
 #include "esp_log.h"
 
-#include "hal/adc_types.h"
-#include "esp_adc/adc_cali.h"
-#include "esp_adc/adc_cali_scheme.h"
-#include "esp_adc/adc_oneshot.h"
-
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/timers.h"
 
+#include "modules/alarm.h"
 #include "modules/cli.h"
 #include "modules/ble.h"
-
-// Define constants
-#define ADC_MAX_VALUE 4095
-
-typedef struct {
-    Millivolt min;
-    Millivolt max;
-    Millivolt avg;
-} AdcMeas;
+#include "modules/config.h"
+#include "modules/datalog.h"
+#include "modules/power.h"
+#include "modules/pwm.h"
+#include "modules/relay.h"
+#include "modules/rollup.h"
+#include "modules/stats.h"
+#include "modules/stream.h"
+#include "modules/trace.h"
+#include "modules/worker.h"
+#include "modules/core/ct_core.h"
+#include "modules/hal/hal_adc.h"
+#include "modules/hal/hal_time.h"
 
 typedef struct {
     Amper min;
@@ -35,33 +34,79 @@ typedef struct {
 
 static struct {
     Amper max_current;
-    unsigned ratio;
-    float step;
-    float base;
+    // written by the config listener, the read paths work on a copy taken under the lock
+    CtCoreConfig config;
+    portMUX_TYPE lock;
 
     bool interupt_measurements;
-    bool calibrated;
 
     bool ongoing;
     Seconds duration;
 
-    adc_oneshot_unit_handle_t adc2_handle;
-    adc_cali_handle_t  adc2_cali_handle;
-    adc_channel_t default_channel;
-    adc_channel_t ref_channel;
-    adc_atten_t default_atten;
-    adc_bitwidth_t default_width;
+    // auto-zero, measured by the worker between sessions while the outputs are off
+    CtZero zero;
+    Seconds zero_period;
+    unsigned zero_shift;
+    unsigned zero_skipped;          // periods with an output on or a session running
+    TimerHandle_t zero_timer;
+    StaticTimer_t zero_timer_buffer;
 } ctx = {
-    .max_current        = 50,
-    .ratio              = 4,
-    // .step               = 12.5,
-    .step               = 0.0125,
-    .default_channel    = ADC_CHANNEL_8,
-    .ref_channel        = ADC_CHANNEL_7,
-    .default_atten      = ADC_ATTEN_DB_11,
-    .default_width      = ADC_BITWIDTH_DEFAULT
+    .config = {
+        .sample_step    = 10,
+    },
+    .lock = portMUX_INITIALIZER_UNLOCKED,
 };
 
+WORKER_DEFINE(worker, "current_read_for", TASK_STACK_SIZE, TASK_PRIORITY_MEASUREMENT, TASK_CORE_ACQUISITION);
+BUDGET_CHECK(sizeof(ctx) + WORKER_FOOTPRINT(TASK_STACK_SIZE), BUDGET_CT);
+
+
+static CtCoreConfig snapshot(void) {
+    taskENTER_CRITICAL(&ctx.lock);
+    CtCoreConfig config = ctx.config;
+    taskEXIT_CRITICAL(&ctx.lock);
+    return config;
+}
+
+static bool outputs_off(void) {
+    return RELAY_get_state() == 0 && PWM_is_active() == false;
+}
+
+static void measure_zero(void *arg) {
+    if (ctx.ongoing || outputs_off() == false) {
+        ctx.zero_skipped += 1;
+        return;
+    }
+
+    const CtCoreConfig config = snapshot();
+    uint32_t sum = 0;
+    for (unsigned sample = 0; sample < config.samples; ++sample) {
+        sum += HAL_ADC_read_raw(kHalAdcCurrent);
+        HAL_TIME_delay_ms(config.sample_step);
+    }
+
+    // an output switched on meanwhile, the window saw current
+    if (outputs_off() == false) {
+        ctx.zero_skipped += 1;
+        return;
+    }
+
+    CT_CORE_zero_update(&ctx.zero, sum, config.samples, ctx.zero_shift);
+    ESP_LOGD(__func__, "CT zero: [offset %.2f] [updates %u]",
+             (float)ctx.zero.offset / (1 << CT_ZERO_FRACTION_BITS), (unsigned)ctx.zero.updates);
+}
+
+static void zero_timer_callback(TimerHandle_t timer) {
+    // timer task, only queue the measurement
+    if (ctx.ongoing || outputs_off() == false || WORKER_submit(&worker, measure_zero, NULL) == false)
+        ctx.zero_skipped += 1;
+}
+
+static void log_zero(void) {
+    ESP_LOGI(__func__, "CT zero: [offset %.2f counts] [updates %u] [skipped %u] [period %u s]",
+             (float)ctx.zero.offset / (1 << CT_ZERO_FRACTION_BITS), (unsigned)ctx.zero.updates,
+             ctx.zero_skipped, (unsigned)ctx.zero_period);
+}
 
 static int ct_command_execution(int argc, char **argv) {
     if (argc == 1){
@@ -70,11 +115,20 @@ static int ct_command_execution(int argc, char **argv) {
 
     static const char now[] = "now";
     static const char duration[] = "duration";
+    static const char zero[] = "zero";
     for (int i = 1; i < argc; i++) {
         ESP_LOGI(__func__, "Arg %d: %s", i, argv[i]);
         if (strncmp(now, argv[i], sizeof(now)) == 0) {
             ESP_LOGI(__func__, "CT: %f A", CT_read());
         }
+        if (strncmp(zero, argv[i], sizeof(zero)) == 0) {
+            if (argc > i + 1 && strcmp(argv[i + 1], "reset") == 0)
+                CT_CORE_zero_reset(&ctx.zero);
+            else if (argc > i + 1 && strcmp(argv[i + 1], "now") == 0)
+                ESP_LOGI(__func__, "CT zero: %s", CT_zero() ? "measuring" : "outputs on or busy");
+            log_zero();
+            return 0;
+        }
         if (strncmp(duration, argv[i], sizeof(now)) == 0) {
             if (argc > i + 1) {
                 CT_read_for(atoi(argv[i + 1]));
@@ -90,130 +144,57 @@ static void parse_ble_command(char *buffer, unsigned length) {
     CT_read_for(strtoul(buffer, NULL, 0));
 }
 
-static bool adc_calibration_init(adc_unit_t unit, adc_channel_t channel, adc_atten_t atten, adc_cali_handle_t *out_handle) {
-    adc_cali_handle_t handle = NULL;
-    esp_err_t ret = ESP_FAIL;
-    bool calibrated = false;
-
-#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
-    if (!calibrated) {
-        ESP_LOGI(__func__`, "calibration scheme version is %s", "Curve Fitting");
-        adc_cali_curve_fitting_config_t cali_config = {
-            .unit_id = unit,
-            .chan = channel,
-            .atten = atten,
-            .bitwidth = ADC_BITWIDTH_DEFAULT,
-        };
-        ret = adc_cali_create_scheme_curve_fitting(&cali_config, &handle);
-        if (ret == ESP_OK) {
-            calibrated = true;
-        }
-    }
-#endif
-
-#if ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
-    if (!calibrated) {
-        ESP_LOGI(__func__, "calibration scheme version is %s", "Line Fitting");
-        adc_cali_line_fitting_config_t cali_config = {
-            .unit_id = unit,
-            .atten = atten,
-            .bitwidth = ctx.default_width,
-        };
-        ret = adc_cali_create_scheme_line_fitting(&cali_config, &handle);
-        if (ret == ESP_OK) {
-            calibrated = true;
-        }
-    }
-#endif
-
-    *out_handle = handle;
-    if (ret == ESP_OK) {
-        ESP_LOGI(__func__, "Calibration Success");
-    } else if (ret == ESP_ERR_NOT_SUPPORTED || !calibrated) {
-        ESP_LOGW(__func__, "eFuse not burnt, skip software calibration");
-    } else {
-        ESP_LOGE(__func__, "Invalid arg or no memory");
-    }
-
-    return calibrated;
+static void apply_config(const Config *config) {
+    ctx.max_current = config->ct.max_current;
+    taskENTER_CRITICAL(&ctx.lock);
+    ctx.config.ratio = config->ct.ratio;
+    ctx.config.step = config->ct.step;
+    ctx.config.samples = config->ct.samples;
+    ctx.config.model = config->ct.model;
+    taskEXIT_CRITICAL(&ctx.lock);
+
+    ctx.zero_shift = config->ct.zero_shift;
+    if (config->ct.zero_period == ctx.zero_period)
+        return;
+    ctx.zero_period = config->ct.zero_period;
+    if (ctx.zero_period == 0)
+        xTimerStop(ctx.zero_timer, 0);
+    else
+        xTimerChangePeriod(ctx.zero_timer, pdMS_TO_TICKS(ctx.zero_period * 1000), 0);
 }
 
 void CT_init(void) {
-    // Initialize ADC configuration here
-    adc_oneshot_unit_init_cfg_t init_config = {
-        .unit_id = ADC_UNIT_2,
-    };
-    ESP_ERROR_CHECK(adc_oneshot_new_unit(&init_config, &ctx.adc2_handle));
-
-    //-------------ADC1 Config---------------//
-    const adc_oneshot_chan_cfg_t config = {
-        .bitwidth = ctx.default_width,
-        .atten = ctx.default_atten,
-    };
-    ESP_ERROR_CHECK(adc_oneshot_config_channel(ctx.adc2_handle, ctx.default_channel, &config));
-    ESP_ERROR_CHECK(adc_oneshot_config_channel(ctx.adc2_handle, ctx.ref_channel, &config));
-
-    //-------------ADC1 Calibration Init---------------//
-    ctx.calibrated = adc_calibration_init(ADC_UNIT_2, ctx.default_channel, ctx.default_atten, &ctx.adc2_cali_handle);
-    ctx.calibrated = ctx.calibrated && adc_calibration_init(ADC_UNIT_2, ctx.ref_channel, ctx.default_atten, &ctx.adc2_cali_handle);
-
-    CLI_register_command("ct", "[now] [duration <time>]", ct_command_execution);
+    ctx.zero_timer = xTimerCreateStatic("ct_zero", 1, pdTRUE, NULL, zero_timer_callback, &ctx.zero_timer_buffer);
+    CONFIG_register_listener(apply_config);
+    if (HAL_ADC_init(kHalAdcCurrent) == false || HAL_ADC_init(kHalAdcCurrentRef) == false) {
+        ESP_LOGE(__func__, "CT channels initialization failed");
+        return;
+    }
+
+    WORKER_start(&worker);
+    // first zero right away, the outputs are off after boot
+    CT_zero();
+    CLI_register_command("ct", "[now] [duration <time>] [zero [now|reset]]", ct_command_execution);
     BLE_setup_characteristic_callback(kCurrent, parse_ble_command);
 }
 
 Amper CT_read(void) {
-    // Initialize variables
-    Amper meas;
-    unsigned sample = 0;
-    unsigned samples = 100;
-    unsigned step = 10;
-
-    int voltage = 0;
-    int ref_voltage = 0;
-    float sum = 0;
-    float ref_sum = 0;
-
-    while (sample < samples) {
-        // Read ADC value
-        int adc_value;
-        int adc_ref_value;
-        ESP_ERROR_CHECK(adc_oneshot_read(ctx.adc2_handle, ctx.default_channel, &adc_value));
-        ESP_ERROR_CHECK(adc_oneshot_read(ctx.adc2_handle, ctx.ref_channel, &adc_ref_value));
-
-        if (ctx.calibrated) {
-            ESP_ERROR_CHECK(adc_cali_raw_to_voltage(ctx.adc2_cali_handle, adc_value, &voltage));
-            ESP_ERROR_CHECK(adc_cali_raw_to_voltage(ctx.adc2_cali_handle, adc_ref_value, &ref_voltage));
-        }
-
-        sum += voltage;
-        ref_sum += ref_voltage;
-        sample += 1;
-        vTaskDelay(pdMS_TO_TICKS(step));
-    }
-
-    // calc avg ref
-    ref_sum = ((ref_sum / 1000) * 2 / samples);  // - ctx.base;
-    // calc avg V
-    meas = (sum / 1000) / samples;
-
-    ESP_LOGI(__func__, "CT V [in: %f, ref: %f]",  meas, ref_sum);
-
-    // diff, base -> offset
-    meas = meas - ref_sum;
-    // take into account ratio and step
-    meas = meas / (ctx.ratio * ctx.step);
-
-    // ct duration 1000
+    CtCoreConfig config = snapshot();
+    Amper meas = CT_CORE_read(&config, &ctx.zero);
+    ESP_LOGI(__func__, "CT C [Avg %f]", meas);
+    return meas;
+}
 
-    // Calculate average
-    ESP_LOGI(__func__, "CT C [Avg %f round: %f]", meas, round(meas));
-    if (meas < 0.0f)
-        meas *= -1.0f; 
+Amper CT_read_uncorrected(void) {
+    CtCoreConfig config = snapshot();
+    return CT_CORE_read_uncorrected(&config, &ctx.zero);
+}
 
-    return meas;
+uint16_t CT_read_raw(void) {
+    return HAL_ADC_read_raw(kHalAdcCurrent);
 }
 
-static void read_ct_for() {
+static void read_ct_for(void *arg) {
     CurrentMeas meas;
     // Initialize variables
     unsigned time = 0;
@@ -230,7 +211,16 @@ static void read_ct_for() {
     while (time < endTime) {
         memset(buffer, 0, sizeof(buffer));
         // Read ADC value
+        POWER_lock(kPowerCpu);
         amp = CT_read();
+        POWER_unlock(kPowerCpu);
+        int64_t now = HAL_TIME_now();
+        DATALOG_append(kDatalogCurrent, now, amp * 1000);
+        ROLLUP_add(kRollupCurrent, now, amp * 1000);
+        STATS_sample(kStatsCurrent, now);
+        ALARM_sample(kAlarmCurrent, now, amp * 1000);
+        STREAM_sample(kDatalogCurrent, now, amp * 1000);
+        TRACE_event(kTraceSample, kCurrent);
         // Update sum, min, and max
         sum += amp;
         if (amp < meas.min)
@@ -243,35 +233,59 @@ static void read_ct_for() {
 
         meas.avg = sum / (time / step);
         // ESP_LOGI(__func__, "CT: [now: %f A] [max %f A] [min %f A]", amp, meas.max, meas.min);
-        snprintf(buffer, sizeof(buffer), "%.2f,%.2f,%.2f,%.2f", amp, meas.max, meas.min, meas.avg);
-        BLE_update_value(kCurrent, buffer);
-        vTaskDelay(pdMS_TO_TICKS(step));
+        int32_t value = amp * 1000;
+        if (BLE_notify_due(kCurrent, now, &value, 1)) {
+            CT_CORE_format_ble(buffer, sizeof(buffer), amp, meas.max, meas.min, meas.avg);
+            BLE_update_value(kCurrent, buffer);
+        }
+        HAL_TIME_delay_ms(step);
     }
 
     ESP_LOGI(__func__, "CT: [avg %.2f A] [max %.2f A] [min %.2f A]", meas.avg, meas.max, meas.min);
-    vTaskDelete(NULL);
+    ctx.ongoing = false;
 }
 
-void CT_read_for(Seconds duration) {
+// check and set under the lock, the CLI, BLE and other modules start sessions concurrently
+static bool claim(void) {
+    taskENTER_CRITICAL(&ctx.lock);
+    bool busy = ctx.ongoing;
     ctx.ongoing = true;
+    taskEXIT_CRITICAL(&ctx.lock);
+    return busy == false;
+}
+
+bool CT_read_for(Seconds duration) {
+    if (duration == 0 || claim() == false)
+        return false;
+
     ctx.duration = duration;
-    xTaskCreate(read_ct_for, "current_read_for", 4096, NULL, 5, NULL);
+    if (WORKER_submit(&worker, read_ct_for, NULL) == false) {
+        ctx.ongoing = false;
+        return false;
+    }
+    return true;
 }
 
-static void example_adc_calibration_deinit(adc_cali_handle_t handle) {
-#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
-    ESP_LOGD(__func__, "deregister %s calibration scheme", "Curve Fitting");
-    ESP_ERROR_CHECK(adc_cali_delete_scheme_curve_fitting(handle));
+bool CT_counts_to_current(float counts, Amper *current) {
+    if (CT_CORE_zero_valid(&ctx.zero) == false)
+        return false;
+    CtCoreConfig config = snapshot();
+    *current = CT_CORE_counts_to_current(&config, &ctx.zero, counts);
+    return true;
+}
 
-#elif ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
-    ESP_LOGD(__func__, "deregister %s calibration scheme", "Line Fitting");
-    ESP_ERROR_CHECK(adc_cali_delete_scheme_line_fitting(handle));
-#endif
+bool CT_has_zero(void) {
+    return CT_CORE_zero_valid(&ctx.zero);
+}
+
+bool CT_zero(void) {
+    if (ctx.ongoing || outputs_off() == false)
+        return false;
+    return WORKER_submit(&worker, measure_zero, NULL);
 }
 
 void CT_deinit(void) {
-    ESP_ERROR_CHECK(adc_oneshot_del_unit(ctx.adc2_handle));
-    if (ctx.calibrated) {
-        example_adc_calibration_deinit(ctx.adc2_cali_handle);
-    }
-}
\ No newline at end of file
+    xTimerStop(ctx.zero_timer, 0);
+    HAL_ADC_deinit(kHalAdcCurrentRef);
+    HAL_ADC_deinit(kHalAdcCurrent);
+}
@@ -2,6 +2,7 @@
 #define CT_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "modules/base/types.h"
 
@@ -9,7 +10,17 @@
 void CT_init(void);
 
 Amper CT_read(void);
-void CT_read_for(Seconds duration);
+// current without the calibration model
+Amper CT_read_uncorrected(void);
+bool CT_read_for(Seconds duration);
+uint16_t CT_read_raw(void);
+
+// filtered raw code -> current, false until the first zero measurement
+bool CT_counts_to_current(float counts, Amper *current);
+
+bool CT_has_zero(void);
+// queues a zero offset measurement, refused while a relay or PWM output is on
+bool CT_zero(void);
 
 void CT_deinit(void);
 
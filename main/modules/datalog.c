@@ -0,0 +1,498 @@
+#include "modules/datalog.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "modules/base/generic_fun.h"
+#include "modules/base/budget.h"
+#include "modules/base/codec.h"
+#include "modules/base/tasks.h"
+#include "modules/cli.h"
+#include "modules/ble.h"
+#include "modules/worker.h"
+
+#define DUMP_LINE_BYTES 32
+#define FLASH_ENDURANCE 100000      // erase cycles per sector
+
+typedef struct {
+    DatalogPageHeader header;
+    uint8_t payload[DATALOG_PAYLOAD_SIZE];
+} DatalogPage;
+
+typedef struct {
+    DatalogPage page;
+    int64_t last_time;
+    int32_t last_value[kDatalogLastChannel];
+    volatile bool full;
+} PageBuffer;
+
+typedef bool (*PageVisitor)(const DatalogPage *page, void *arg);
+
+static struct {
+    const esp_partition_t *partition;
+    unsigned sectors;
+    unsigned next_sector;
+    uint32_t sequence;
+    bool enabled;
+    bool bench;                 // page buffer 0 and the partition hold bench pages
+
+    PageBuffer buffers[2];
+    unsigned active;
+    uint32_t queued;            // pages handed to the writer
+    volatile uint32_t completed;    // pages the writer is done with, written or failed
+    portMUX_TYPE lock;
+    SemaphoreHandle_t flash_lock;
+    StaticSemaphore_t flash_lock_buffer;
+    TaskHandle_t writer;
+    StaticTask_t writer_buffer;
+    StackType_t writer_stack[TASK_STACK_SIZE];
+    DatalogPage scratch;
+
+    uint32_t pages_written;
+    uint32_t dropped;
+    uint64_t flash_time;
+} ctx = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+BUDGET_CHECK(sizeof(ctx), BUDGET_DATALOG);
+
+static void reset_page(PageBuffer *buffer) {
+    buffer->page.header.records = 0;
+    buffer->page.header.length = 0;
+}
+
+static bool page_append(PageBuffer *buffer, DatalogChannel channel, int64_t timestamp, int32_t value) {
+    DatalogPageHeader *header = &buffer->page.header;
+    if (header->records == 0) {
+        header->base_time = timestamp;
+        buffer->last_time = timestamp;
+        memset(buffer->last_value, 0, sizeof(buffer->last_value));
+    }
+
+    int64_t dt = timestamp > buffer->last_time ? timestamp - buffer->last_time : 0;
+    int32_t delta = (int32_t)((uint32_t)value - (uint32_t)buffer->last_value[channel]);
+
+    uint8_t record[1 + CODEC_VARINT_MAX + CODEC_VARINT32_MAX];
+    unsigned length = 0;
+    record[length++] = channel;
+    length += CODEC_put_varint(record + length, dt);
+    length += CODEC_put_varint(record + length, CODEC_zigzag(delta));
+
+    if (header->length + length > DATALOG_PAYLOAD_SIZE)
+        return false;
+
+    memcpy(buffer->page.payload + header->length, record, length);
+    header->length += length;
+    header->records += 1;
+    buffer->last_time += dt;
+    buffer->last_value[channel] = value;
+    return true;
+}
+
+static uint32_t page_crc(const DatalogPage *page) {
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&page->header, offsetof(DatalogPageHeader, crc));
+    return esp_rom_crc32_le(crc, page->payload, page->header.length);
+}
+
+static bool write_page(DatalogPage *page) {
+    xSemaphoreTake(ctx.flash_lock, portMAX_DELAY);
+    page->header.magic = DATALOG_MAGIC;
+    page->header.sequence = ctx.sequence;
+    page->header.crc = page_crc(page);
+
+    size_t offset = ctx.next_sector * DATALOG_PAGE_SIZE;
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = esp_partition_erase_range(ctx.partition, offset, DATALOG_PAGE_SIZE);
+    if (err == ESP_OK)
+        err = esp_partition_write(ctx.partition, offset, page, sizeof(page->header) + page->header.length);
+    ctx.flash_time += esp_timer_get_time() - start;
+
+    if (err == ESP_OK) {
+        ctx.sequence += 1;
+        ctx.next_sector = ctx.next_sector + 1 == ctx.sectors ? 0 : ctx.next_sector + 1;
+        ctx.pages_written += 1;
+    }
+    xSemaphoreGive(ctx.flash_lock);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(__func__, "Writing page failed: %s", esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+static void writer_task(void *arg) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // the inactive buffer was filled first
+        unsigned order[2] = { ctx.active ^ 1, ctx.active };
+        for (unsigned i = 0; i < 2; ++i) {
+            PageBuffer *buffer = &ctx.buffers[order[i]];
+            if (buffer->full == false)
+                continue;
+
+            write_page(&buffer->page);
+            reset_page(buffer);
+            buffer->full = false;
+            ctx.completed += 1;
+        }
+    }
+}
+
+static bool read_valid_page(unsigned sector, DatalogPage *page) {
+    size_t offset = sector * DATALOG_PAGE_SIZE;
+    if (esp_partition_read(ctx.partition, offset, &page->header, sizeof(page->header)) != ESP_OK)
+        return false;
+
+    if (page->header.magic != DATALOG_MAGIC || page->header.length > DATALOG_PAYLOAD_SIZE)
+        return false;
+
+    if (esp_partition_read(ctx.partition, offset + sizeof(page->header), page->payload, page->header.length) != ESP_OK)
+        return false;
+
+    // torn writes after power loss fail here and are skipped
+    return page_crc(page) == page->header.crc;
+}
+
+static void recover(void) {
+    bool found = false;
+    uint32_t newest = 0;
+    unsigned newest_sector = 0;
+    unsigned valid = 0;
+
+    for (unsigned sector = 0; sector < ctx.sectors; ++sector) {
+        if (read_valid_page(sector, &ctx.scratch) == false)
+            continue;
+
+        valid += 1;
+        if (found == false || (int32_t)(ctx.scratch.header.sequence - newest) > 0) {
+            newest = ctx.scratch.header.sequence;
+            newest_sector = sector;
+            found = true;
+        }
+    }
+
+    ctx.sequence = found ? newest + 1 : 0;
+    ctx.next_sector = found ? (newest_sector + 1) % ctx.sectors : 0;
+    ESP_LOGI(__func__, "DATALOG: %u valid pages, next sequence %" PRIu32 " at sector %u", valid, ctx.sequence, ctx.next_sector);
+}
+
+// oldest to newest, the sector after the newest page is the oldest one once the log wrapped
+static unsigned for_each_page(PageVisitor visitor, void *arg) {
+    unsigned visited = 0;
+    xSemaphoreTake(ctx.flash_lock, portMAX_DELAY);
+    unsigned first = ctx.next_sector;
+    xSemaphoreGive(ctx.flash_lock);
+
+    for (unsigned i = 0; i < ctx.sectors; ++i) {
+        unsigned sector = (first + i) % ctx.sectors;
+        xSemaphoreTake(ctx.flash_lock, portMAX_DELAY);
+        bool valid = read_valid_page(sector, &ctx.scratch);
+        xSemaphoreGive(ctx.flash_lock);
+        if (valid == false)
+            continue;
+
+        visited += 1;
+        if (visitor(&ctx.scratch, arg) == false)
+            break;
+    }
+    return visited;
+}
+
+static bool dump_page_cli(const DatalogPage *page, void *arg) {
+    unsigned *offset = arg;
+    const uint8_t *data = (const uint8_t *)page;
+    unsigned length = sizeof(page->header) + page->header.length;
+
+    char line[8 + 2 * DUMP_LINE_BYTES + 1];
+    for (unsigned done = 0; done < length; done += DUMP_LINE_BYTES) {
+        unsigned chunk = length - done < DUMP_LINE_BYTES ? length - done : DUMP_LINE_BYTES;
+        int pos = snprintf(line, sizeof(line), "%06X ", *offset + done);
+        for (unsigned i = 0; i < chunk; ++i)
+            pos += snprintf(line + pos, sizeof(line) - pos, "%02X", data[done + i]);
+
+        printf("LOG %s\n", line);
+    }
+    *offset += length;
+    return true;
+}
+
+typedef struct {
+    uint16_t sequence;
+    uint16_t packet[128];
+    unsigned payload;
+} BleDump;
+
+// every notification: uint16 sequence number + consecutive bytes of the page images
+static bool dump_page_ble(const DatalogPage *page, void *arg) {
+    BleDump *dump = arg;
+    const uint8_t *data = (const uint8_t *)page;
+    unsigned length = sizeof(page->header) + page->header.length;
+
+    for (unsigned done = 0; done < length; done += dump->payload) {
+        unsigned chunk = length - done < dump->payload ? length - done : dump->payload;
+        dump->packet[0] = dump->sequence++;
+        memcpy(&dump->packet[1], data + done, chunk);
+        if (BLE_stream_raw(kLog, (const uint8_t *)dump->packet, sizeof(uint16_t) + chunk) == false)
+            return false;
+    }
+    return true;
+}
+
+static void dump_ble(void *arg) {
+    BleDump dump = { .sequence = 0 };
+    unsigned payload = BLE_get_payload_size();
+    payload = payload < sizeof(dump.packet) ? payload : sizeof(dump.packet);
+    dump.payload = payload - sizeof(uint16_t);
+
+    unsigned pages = for_each_page(dump_page_ble, &dump);
+    ESP_LOGI(__func__, "DATALOG: BLE dump of %u pages [%u packets]", pages, dump.sequence);
+}
+
+static bool find_page(const DatalogPage *page, void *arg) {
+    return false;
+}
+
+static void bench(unsigned pages) {
+    if (ctx.enabled || ctx.buffers[0].full || ctx.buffers[1].full
+        || ctx.buffers[0].page.header.records > 0 || ctx.buffers[1].page.header.records > 0) {
+        ESP_LOGW(__func__, "Stop logging before benchmarking");
+        return;
+    }
+
+    // bench pages go through the log sectors, only an empty log can take them
+    if (for_each_page(find_page, NULL) > 0) {
+        ESP_LOGW(__func__, "Log not empty, dump and erase it before benchmarking");
+        return;
+    }
+
+    ctx.bench = true;
+    PageBuffer *buffer = &ctx.buffers[0];
+    uint64_t flash_time = ctx.flash_time;
+    uint32_t max_page_time = 0;
+    unsigned records = 0;
+    int64_t timestamp = esp_timer_get_time();
+    int32_t value = 12000;
+
+    int64_t start = esp_timer_get_time();
+    for (unsigned i = 0; i < pages; ++i) {
+        reset_page(buffer);
+        // slow random walk, close to what the measurement loops produce
+        while (page_append(buffer, kDatalogBench, timestamp, value)) {
+            timestamp += 1000;
+            value += (int32_t)(esp_random() % 21) - 10;
+            records += 1;
+        }
+
+        uint64_t before = ctx.flash_time;
+        if (write_page(&buffer->page) == false)
+            break;
+
+        uint32_t page_time = ctx.flash_time - before;
+        if (page_time > max_page_time)
+            max_page_time = page_time;
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+    flash_time = ctx.flash_time - flash_time;
+
+    // leave the log empty again
+    reset_page(buffer);
+    bool erased = DATALOG_erase();
+    ctx.bench = false;
+    if (erased == false)
+        ESP_LOGE(__func__, "Erasing bench pages failed");
+    if (records == 0)
+        return;
+
+    float records_per_page = (float)records / pages;
+    float bytes_per_second = pages * (float)DATALOG_PAGE_SIZE * 1000000 / elapsed;
+    float records_per_second = records * 1000000.0f / elapsed;
+    // every sector is erased once per trip around the partition
+    float full_rate_hours = (float)FLASH_ENDURANCE * ctx.sectors * records_per_page / records_per_second / 3600;
+    float one_hz_years = (float)FLASH_ENDURANCE * ctx.sectors * records_per_page / (3600.0f * 24 * 365);
+
+    ESP_LOGI(__func__, "DATALOG BENCH: [pages %u] [records %u] [%.2f B/record]",
+             pages, records, (float)DATALOG_PAYLOAD_SIZE / records_per_page);
+    ESP_LOGI(__func__, "DATALOG BENCH: [avg %" PRIu64 " us/page] [max %" PRIu32 " us/page] [%.0f B/s] [%.0f records/s]",
+             flash_time / pages, max_page_time, bytes_per_second, records_per_second);
+    ESP_LOGI(__func__, "DATALOG BENCH: wear out after %.1f h at full rate, %.1f years at 1 record/s [%u sectors]",
+             full_rate_hours, one_hz_years, ctx.sectors);
+}
+
+static int log_command_execution(int argc, char **argv) {
+    if (argc == 1) {
+        ESP_LOGI(__func__, "DATALOG: %s [pages written %" PRIu32 "] [dropped %" PRIu32 "] [next sequence %" PRIu32 "]",
+                 ctx.enabled ? "on" : "off", ctx.pages_written, ctx.dropped, ctx.sequence);
+        return 0;
+    }
+
+    if (ctx.partition == NULL) {
+        ESP_LOGW(__func__, "No datalog partition");
+        return 0;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (AreStringsTheSame("start", argv[i], sizeof("start"))) {
+            DATALOG_start();
+        } else if (AreStringsTheSame("stop", argv[i], sizeof("stop"))) {
+            DATALOG_stop();
+        } else if (AreStringsTheSame("flush", argv[i], sizeof("flush"))) {
+            DATALOG_flush();
+        } else if (AreStringsTheSame("erase", argv[i], sizeof("erase"))) {
+            ESP_LOGI(__func__, "DATALOG: erase %s", DATALOG_erase() ? "done" : "failed");
+        } else if (AreStringsTheSame("dump", argv[i], sizeof("dump"))) {
+            unsigned offset = 0;
+            unsigned pages = for_each_page(dump_page_cli, &offset);
+            printf("LOG END %u %u\n", pages, offset);
+        } else if (AreStringsTheSame("bench", argv[i], sizeof("bench"))) {
+            unsigned pages = argc > i + 1 ? strtoul(argv[++i], NULL, 10) : 16;
+            bench(pages > 0 ? pages : 1);
+        }
+    }
+    return 0;
+}
+
+// "start" | "stop" | "dump" | "erase"
+static void parse_ble_command(char *buffer, unsigned length) {
+    if (length == 0 || ctx.partition == NULL)
+        return;
+
+    if (AreStringsTheSame("start", buffer, strlen("start"))) {
+        DATALOG_start();
+    } else if (AreStringsTheSame("stop", buffer, strlen("stop"))) {
+        DATALOG_stop();
+    } else if (AreStringsTheSame("dump", buffer, strlen("dump"))) {
+        WORKER_report(dump_ble, NULL);
+    } else if (AreStringsTheSame("erase", buffer, strlen("erase"))) {
+        DATALOG_erase();
+    }
+}
+
+bool DATALOG_init(void) {
+    CLI_register_command("log", "[start] [stop] [flush] [erase] [dump] [bench <pages>]", log_command_execution);
+    BLE_setup_characteristic_callback(kLog, parse_ble_command);
+
+    ctx.partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, DATALOG_PARTITION_SUBTYPE, DATALOG_PARTITION_LABEL);
+    if (ctx.partition == NULL) {
+        ESP_LOGW(__func__, "Partition '%s' not found", DATALOG_PARTITION_LABEL);
+        return false;
+    }
+
+    ctx.sectors = ctx.partition->size / DATALOG_PAGE_SIZE;
+    ctx.flash_lock = xSemaphoreCreateMutexStatic(&ctx.flash_lock_buffer);
+    recover();
+
+    ctx.writer = xTaskCreateStaticPinnedToCore(writer_task, "datalog_writer", TASK_STACK_SIZE, NULL, TASK_PRIORITY_DATALOG,
+                                               ctx.writer_stack, &ctx.writer_buffer, TASK_CORE_COMMS);
+    return ctx.writer != NULL;
+}
+
+void DATALOG_start(void) {
+    if (ctx.bench) {
+        ESP_LOGW(__func__, "Benchmark ongoing");
+        return;
+    }
+    ctx.enabled = ctx.partition != NULL;
+}
+
+void DATALOG_stop(void) {
+    ctx.enabled = false;
+    DATALOG_flush();
+}
+
+bool DATALOG_is_enabled(void) {
+    return ctx.enabled;
+}
+
+void DATALOG_append(DatalogChannel channel, int64_t timestamp, int32_t value) {
+    if (ctx.enabled == false || channel >= kDatalogLastChannel)
+        return;
+
+    bool notify = false;
+    taskENTER_CRITICAL(&ctx.lock);
+    PageBuffer *buffer = &ctx.buffers[ctx.active];
+    if (buffer->full == false && page_append(buffer, channel, timestamp, value) == false) {
+        // page is full, hand it to the writer and continue in the other buffer
+        buffer->full = true;
+        ctx.queued += 1;
+        notify = true;
+        ctx.active ^= 1;
+        buffer = &ctx.buffers[ctx.active];
+        if (buffer->full == false)
+            page_append(buffer, channel, timestamp, value);
+        else
+            ctx.dropped += 1;
+    } else if (buffer->full) {
+        ctx.dropped += 1;
+    }
+    taskEXIT_CRITICAL(&ctx.lock);
+
+    if (notify)
+        xTaskNotifyGive(ctx.writer);
+}
+
+// hands the active page to the writer, false when it still holds records because
+// the other page is being written, target is the number of pages queued so far
+static bool hand_over(uint32_t *target) {
+    taskENTER_CRITICAL(&ctx.lock);
+    PageBuffer *buffer = &ctx.buffers[ctx.active];
+    if (buffer->full == false && buffer->page.header.records > 0 && ctx.buffers[ctx.active ^ 1].full == false) {
+        buffer->full = true;
+        ctx.queued += 1;
+        ctx.active ^= 1;
+    }
+    bool queued = buffer->full || buffer->page.header.records == 0;
+    *target = ctx.queued;
+    taskEXIT_CRITICAL(&ctx.lock);
+
+    xTaskNotifyGive(ctx.writer);
+    return queued;
+}
+
+void DATALOG_flush(void) {
+    if (ctx.writer == NULL)
+        return;
+
+    uint32_t target;
+    hand_over(&target);
+}
+
+void DATALOG_sync(void) {
+    if (ctx.writer == NULL)
+        return;
+
+    // waits for the pages holding the records appended so far, appends after the
+    // snapshot go to a later page and don't extend the wait
+    uint32_t target;
+    while (hand_over(&target) == false)
+        vTaskDelay(1);
+
+    while ((int32_t)(ctx.completed - target) < 0)
+        vTaskDelay(1);
+}
+
+bool DATALOG_erase(void) {
+    if (ctx.partition == NULL)
+        return false;
+
+    xSemaphoreTake(ctx.flash_lock, portMAX_DELAY);
+    esp_err_t err = esp_partition_erase_range(ctx.partition, 0, ctx.sectors * DATALOG_PAGE_SIZE);
+    ctx.next_sector = 0;
+    xSemaphoreGive(ctx.flash_lock);
+    return err == ESP_OK;
+}
@@ -0,0 +1,52 @@
+#ifndef DATALOG_H
+#define DATALOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/base/types.h"
+
+#define DATALOG_PARTITION_LABEL "datalog"
+#define DATALOG_PARTITION_SUBTYPE 0x40
+#define DATALOG_PAGE_SIZE 4096      // one flash sector
+#define DATALOG_MAGIC 0x474F4C44    // "DLOG"
+
+typedef enum {
+    kDatalogVoltage = 0,    // mV
+    kDatalogCurrent,        // mA
+    kDatalogTemperature,    // 0.01 C, first probe
+    kDatalogTemperature2,   // 0.01 C, second probe
+    kDatalogBench,
+    kDatalogRate,           // Hz, adaptive acquisition rate from this record on
+    kDatalogVoltageMin,     // mV, ULP record minimum, kDatalogVoltage holds its last sample
+    kDatalogVoltageMax,     // mV, ULP record maximum
+// sentinel
+    kDatalogLastChannel
+} DatalogChannel;
+
+// every page starts with the header, payload holds records coded with modules/base/codec.h:
+// u8 channel | varint dt [us since previous record] | zigzag varint delta of the channel value
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t sequence;
+    int64_t base_time;      // us, esp_timer time of the first record
+    uint16_t records;
+    uint16_t length;        // payload bytes
+    uint32_t crc;           // crc32 of the header up to this field and the payload
+} DatalogPageHeader;
+
+#define DATALOG_PAYLOAD_SIZE (DATALOG_PAGE_SIZE - sizeof(DatalogPageHeader))
+
+bool DATALOG_init(void);
+
+void DATALOG_start(void);
+void DATALOG_stop(void);
+bool DATALOG_is_enabled(void);
+
+void DATALOG_append(DatalogChannel channel, int64_t timestamp, int32_t value);
+void DATALOG_flush(void);
+// flush and wait until the records appended before the call are in flash, before a deep sleep
+void DATALOG_sync(void);
+bool DATALOG_erase(void);
+
+#endif // DATALOG_H
@@ -0,0 +1,253 @@
+#include "modules/decim.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <math.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "modules/base/generic_fun.h"
+#include "modules/cli.h"
+#include "modules/adc.h"
+#include "modules/alarm.h"
+#include "modules/ct.h"
+#include "modules/datalog.h"
+#include "modules/power.h"
+#include "modules/rollup.h"
+#include "modules/stats.h"
+#include "modules/stream.h"
+#include "modules/worker.h"
+
+// decim rate 100
+// decim rate 50 input 20000 order 4 taps 31 channel current duration 60
+
+#define BLOCK_FRAMES 64
+#define BLOCK_OUTPUTS (BLOCK_FRAMES / DECIM_FIR_RATIO + 1)
+#define CUTOFF 0.2f                 // cycles per CIC output sample, -6 dB at 0.4 of the output rate
+
+typedef struct {
+    DecimFilter filter;
+    unsigned skip;              // settling outputs left
+    uint32_t count;
+    double sum;
+    double sum_squares;
+} DecimStream;
+
+static struct {
+    DecimSettings settings;
+    DecimStream streams[2];     // [0] voltage, [1] current
+    volatile bool ongoing;
+    volatile bool stop;
+    uint32_t overruns;
+} ctx = {
+    .settings = {
+        .input_rate     = 10000,
+        .output_rate    = 100,
+        .order          = 3,
+        .taps           = 21,
+        .channels       = kDecimVoltage | kDecimCurrent,
+        .duration       = 10,
+    },
+};
+
+// runs on the session worker
+BUDGET_CHECK(sizeof(ctx), BUDGET_DECIM);
+
+static char *FindArgumentValue(int argc, char **argv, const char *arg) {
+    for (int i = 1; i < argc - 1; i++) {
+        if (AreStringsTheSame(arg, argv[i], strlen(arg) + 1))
+            return argv[i + 1];
+    }
+    return NULL;
+}
+
+static void emit(unsigned channel, int64_t timestamp, float counts) {
+    DecimStream *stream = &ctx.streams[channel];
+    if (stream->skip > 0) {
+        stream->skip -= 1;
+        return;
+    }
+
+    float value;
+    if (channel == 0) {
+        value = ADC_counts_to_voltage(counts);
+        DATALOG_append(kDatalogVoltage, timestamp, value);
+        ROLLUP_add(kRollupVoltage, timestamp, value);
+        STATS_sample(kStatsVoltage, timestamp);
+        ALARM_sample(kAlarmVoltage, timestamp, value);
+        STREAM_sample(kDatalogVoltage, timestamp, value);
+    } else {
+        Amper current;
+        if (CT_counts_to_current(counts, &current) == false)
+            return;
+        value = current;
+        DATALOG_append(kDatalogCurrent, timestamp, current * 1000);
+        ROLLUP_add(kRollupCurrent, timestamp, current * 1000);
+        STATS_sample(kStatsCurrent, timestamp);
+        ALARM_sample(kAlarmCurrent, timestamp, current * 1000);
+        STREAM_sample(kDatalogCurrent, timestamp, current * 1000);
+    }
+
+    stream->count += 1;
+    stream->sum += value;
+    stream->sum_squares += (double)value * value;
+}
+
+static void log_stream(const char *name, const DecimStream *stream) {
+    if (stream->count == 0)
+        return;
+
+    double mean = stream->sum / stream->count;
+    double variance = stream->sum_squares / stream->count - mean * mean;
+    ESP_LOGI(__func__, "DECIM %s: [outputs %" PRIu32 "] [mean %f] [noise rms %f]",
+             name, stream->count, mean, variance > 0 ? sqrt(variance) : 0);
+}
+
+static void run(void *arg) {
+    const int64_t period = 1000000 / ctx.settings.input_rate;
+    const int64_t output_period = 1000000 / ctx.settings.output_rate;
+    const int64_t start = esp_timer_get_time();
+    const int64_t end = start + (int64_t)ctx.settings.duration * 1000000;
+
+    uint16_t frames[BLOCK_FRAMES * 2];
+    float outputs[BLOCK_OUTPUTS];
+    int64_t output_time[2] = { start, start };
+    int64_t next = start;
+
+    // the busy wait schedule never idles, the whole run is one burst
+    POWER_lock(kPowerCpu);
+    while (next < end && ctx.stop == false) {
+        for (unsigned f = 0; f < BLOCK_FRAMES; ++f) {
+            int64_t now = esp_timer_get_time();
+            while (now < next)
+                now = esp_timer_get_time();
+
+            if (now - next >= period)
+                ctx.overruns += 1;
+            next += period;
+
+            frames[f * 2] = ADC_read_raw();
+            frames[f * 2 + 1] = CT_read_raw();
+        }
+
+        // filtering runs between blocks, the next block starts late by its duration at most
+        for (unsigned channel = 0; channel < 2; ++channel) {
+            if ((ctx.settings.channels & (1 << channel)) == 0)
+                continue;
+
+            unsigned count = DECIM_CORE_process(&ctx.streams[channel].filter, &frames[channel], BLOCK_FRAMES, 2,
+                                                outputs, BLOCK_OUTPUTS);
+            for (unsigned i = 0; i < count; ++i) {
+                output_time[channel] += output_period;
+                emit(channel, output_time[channel], outputs[i]);
+            }
+        }
+    }
+    POWER_unlock(kPowerCpu);
+
+    log_stream("voltage", &ctx.streams[0]);
+    log_stream("current", &ctx.streams[1]);
+    ESP_LOGI(__func__, "DECIM: done [overruns %" PRIu32 "]", ctx.overruns);
+    ctx.ongoing = false;
+}
+
+bool DECIM_start(const DecimSettings *settings) {
+    if (ctx.ongoing)
+        return false;
+
+    if (settings->input_rate == 0 || settings->input_rate > DECIM_MAX_INPUT_RATE)
+        return false;
+    if (settings->output_rate == 0 || settings->output_rate > DECIM_MAX_OUTPUT_RATE || settings->duration == 0)
+        return false;
+
+    unsigned ratio = settings->input_rate / settings->output_rate;
+    if (ratio * settings->output_rate != settings->input_rate || ratio % DECIM_FIR_RATIO != 0)
+        return false;
+
+    DecimConfig config;
+    if (DECIM_CORE_design(&config, settings->order, ratio / DECIM_FIR_RATIO, settings->taps, CUTOFF) == false)
+        return false;
+
+    if ((settings->channels & kDecimCurrent) && CT_has_zero() == false) {
+        ESP_LOGW(__func__, "No CT zero yet, run 'ct zero now' with the outputs off");
+        return false;
+    }
+
+    for (unsigned channel = 0; channel < 2; ++channel) {
+        DecimStream *stream = &ctx.streams[channel];
+        memset(stream, 0, sizeof(*stream));
+        DECIM_CORE_init(&stream->filter, &config);
+        stream->skip = DECIM_CORE_settling(&config);
+    }
+
+    ctx.settings = *settings;
+    ctx.overruns = 0;
+    ctx.stop = false;
+    ctx.ongoing = true;
+    if (WORKER_session(run, NULL) == false) {
+        ctx.ongoing = false;
+        return false;
+    }
+    return true;
+}
+
+void DECIM_stop(void) {
+    ctx.stop = true;
+}
+
+static unsigned parse_channels(const char *name) {
+    if (AreStringsTheSame("voltage", name, sizeof("voltage")))
+        return kDecimVoltage;
+    if (AreStringsTheSame("current", name, sizeof("current")))
+        return kDecimCurrent;
+    return kDecimVoltage | kDecimCurrent;
+}
+
+static int decim_command_execution(int argc, char **argv) {
+    if (argc > 1 && AreStringsTheSame("stop", argv[1], sizeof("stop"))) {
+        DECIM_stop();
+        return 0;
+    }
+
+    DecimSettings settings = ctx.settings;
+    char *value = FindArgumentValue(argc, argv, "rate");
+    if (value != NULL)
+        settings.output_rate = strtoul(value, NULL, 10);
+
+    value = FindArgumentValue(argc, argv, "input");
+    if (value != NULL)
+        settings.input_rate = strtoul(value, NULL, 10);
+
+    value = FindArgumentValue(argc, argv, "order");
+    if (value != NULL)
+        settings.order = strtoul(value, NULL, 10);
+
+    value = FindArgumentValue(argc, argv, "taps");
+    if (value != NULL)
+        settings.taps = strtoul(value, NULL, 10);
+
+    value = FindArgumentValue(argc, argv, "channel");
+    if (value != NULL)
+        settings.channels = parse_channels(value);
+
+    value = FindArgumentValue(argc, argv, "duration");
+    if (value != NULL)
+        settings.duration = strtoul(value, NULL, 10);
+
+    bool ret = DECIM_start(&settings);
+    ESP_LOGI(__func__, "DECIM: %s [input %" PRIu32 " Hz] [output %" PRIu32 " Hz] [order %u] [taps %u]",
+             ret ? "ongoing" : "errors occurs", settings.input_rate, settings.output_rate, settings.order, settings.taps);
+    return 0;
+}
+
+void DECIM_init(void) {
+    CLI_register_command("decim",
+                         "[rate <Hz>] [input <Hz>] [order <1-4>] [taps <n>] [channel <voltage|current|both>] [duration <s>] | stop",
+                         decim_command_execution);
+}
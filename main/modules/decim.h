@@ -0,0 +1,33 @@
+#ifndef DECIM_H
+#define DECIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/base/types.h"
+#include "modules/core/decim_core.h"
+
+#define DECIM_MAX_INPUT_RATE 20000
+#define DECIM_MAX_OUTPUT_RATE 1000  // every output goes to the datalog and rollups
+
+typedef enum {
+    kDecimVoltage   = 1 << 0,
+    kDecimCurrent   = 1 << 1,
+} DecimChannel;
+
+typedef struct {
+    Herz input_rate;
+    Herz output_rate;           // input_rate / output_rate = 2 * CIC ratio
+    unsigned order;
+    unsigned taps;
+    unsigned channels;          // DecimChannel mask
+    Seconds duration;
+} DecimSettings;
+
+void DECIM_init(void);
+
+// samples both ADC channels at the input rate and streams the filtered, decimated values
+bool DECIM_start(const DecimSettings *settings);
+void DECIM_stop(void);
+
+#endif // DECIM_H
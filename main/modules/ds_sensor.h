@@ -2,6 +2,7 @@
 #define DS_SENSOR_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "modules/base/types.h"
 
 
@@ -13,7 +14,7 @@ typedef struct {
 void DS_SENSOR_init(void);
 
 Temperatures DS_SENSOR_read(void);
-void DS_SENSOR_read_for(Seconds duration);
+bool DS_SENSOR_read_for(Seconds duration);
 
 void DS_SENSOR_deinit(void);
 
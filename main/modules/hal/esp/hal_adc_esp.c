@@ -0,0 +1,171 @@
+#include "modules/hal/hal_adc.h"
+
+#include "esp_log.h"
+
+#include "hal/adc_types.h"
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "esp_adc/adc_oneshot.h"
+
+static struct {
+    adc_oneshot_unit_handle_t units[2];
+    unsigned unit_users[2];
+
+    struct {
+        adc_unit_t unit;
+        adc_channel_t channel;
+        adc_cali_handle_t cali_handle;
+        bool calibrated;
+    } channels[kHalAdcLastChannel];
+
+    adc_atten_t default_atten;
+    adc_bitwidth_t default_width;
+} ctx = {
+    .channels = {
+        [kHalAdcVoltage]    = { .unit = ADC_UNIT_1, .channel = ADC_CHANNEL_6 },
+        [kHalAdcCurrent]    = { .unit = ADC_UNIT_2, .channel = ADC_CHANNEL_8 },
+        [kHalAdcCurrentRef] = { .unit = ADC_UNIT_2, .channel = ADC_CHANNEL_7 },
+    },
+    .default_atten  = ADC_ATTEN_DB_11,
+    .default_width  = ADC_BITWIDTH_DEFAULT
+};
+
+static bool adc_calibration_init(adc_unit_t unit, adc_channel_t channel, adc_atten_t atten, adc_cali_handle_t *out_handle) {
+    adc_cali_handle_t handle = NULL;
+    esp_err_t ret = ESP_FAIL;
+    bool calibrated = false;
+
+#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
+    if (!calibrated) {
+        ESP_LOGI(__func__, "calibration scheme version is %s", "Curve Fitting");
+        adc_cali_curve_fitting_config_t cali_config = {
+            .unit_id = unit,
+            .chan = channel,
+            .atten = atten,
+            .bitwidth = ADC_BITWIDTH_DEFAULT,
+        };
+        ret = adc_cali_create_scheme_curve_fitting(&cali_config, &handle);
+        if (ret == ESP_OK) {
+            calibrated = true;
+        }
+    }
+#endif
+
+#if ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
+    if (!calibrated) {
+        ESP_LOGI(__func__, "calibration scheme version is %s", "Line Fitting");
+        adc_cali_line_fitting_config_t cali_config = {
+            .unit_id = unit,
+            .atten = atten,
+            .bitwidth = ctx.default_width,
+        };
+        ret = adc_cali_create_scheme_line_fitting(&cali_config, &handle);
+        if (ret == ESP_OK) {
+            calibrated = true;
+        }
+    }
+#endif
+
+    *out_handle = handle;
+    if (ret == ESP_OK) {
+        ESP_LOGI(__func__, "Calibration Success");
+    } else if (ret == ESP_ERR_NOT_SUPPORTED || !calibrated) {
+        ESP_LOGW(__func__, "eFuse not burnt, skip software calibration");
+    } else {
+        ESP_LOGE(__func__, "Invalid arg or no memory");
+    }
+
+    return calibrated;
+}
+
+static void adc_calibration_deinit(adc_cali_handle_t handle) {
+#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
+    ESP_LOGD(__func__, "deregister %s calibration scheme", "Curve Fitting");
+    ESP_ERROR_CHECK(adc_cali_delete_scheme_curve_fitting(handle));
+
+#elif ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
+    ESP_LOGD(__func__, "deregister %s calibration scheme", "Line Fitting");
+    ESP_ERROR_CHECK(adc_cali_delete_scheme_line_fitting(handle));
+#endif
+}
+
+bool HAL_ADC_init(HalAdcChannel channel) {
+    adc_unit_t unit = ctx.channels[channel].unit;
+    if (ctx.units[unit] == NULL) {
+        adc_oneshot_unit_init_cfg_t init_config = {
+            .unit_id = unit,
+        };
+        if (adc_oneshot_new_unit(&init_config, &ctx.units[unit]) != ESP_OK)
+            return false;
+    }
+    ctx.unit_users[unit] += 1;
+
+    const adc_oneshot_chan_cfg_t config = {
+        .bitwidth = ctx.default_width,
+        .atten = ctx.default_atten,
+    };
+    if (adc_oneshot_config_channel(ctx.units[unit], ctx.channels[channel].channel, &config) != ESP_OK)
+        return false;
+
+    ctx.channels[channel].calibrated = adc_calibration_init(unit, ctx.channels[channel].channel, ctx.default_atten,
+                                                            &ctx.channels[channel].cali_handle);
+    return true;
+}
+
+int HAL_ADC_read_raw(HalAdcChannel channel) {
+    int raw = 0;
+    ESP_ERROR_CHECK(adc_oneshot_read(ctx.units[ctx.channels[channel].unit], ctx.channels[channel].channel, &raw));
+    return raw;
+}
+
+Millivolt HAL_ADC_raw_to_voltage(HalAdcChannel channel, int raw) {
+    int voltage = 0;
+    if (ctx.channels[channel].calibrated) {
+        ESP_ERROR_CHECK(adc_cali_raw_to_voltage(ctx.channels[channel].cali_handle, raw, &voltage));
+    }
+    return voltage;
+}
+
+bool HAL_ADC_ulp_enable(HalAdcChannel channel, unsigned *ulp_channel) {
+    adc_unit_t unit = ctx.channels[channel].unit;
+    // the ULP FSM only reads ADC1
+    if (unit != ADC_UNIT_1)
+        return false;
+
+    if (ctx.channels[channel].calibrated) {
+        adc_calibration_deinit(ctx.channels[channel].cali_handle);
+        ctx.channels[channel].calibrated = false;
+    }
+    if (ctx.units[unit] != NULL) {
+        ESP_ERROR_CHECK(adc_oneshot_del_unit(ctx.units[unit]));
+        ctx.units[unit] = NULL;
+        ctx.unit_users[unit] = 0;
+    }
+
+    adc_oneshot_unit_init_cfg_t init_config = {
+        .unit_id = unit,
+        .ulp_mode = ADC_ULP_MODE_FSM,
+    };
+    if (adc_oneshot_new_unit(&init_config, &ctx.units[unit]) != ESP_OK)
+        return false;
+
+    const adc_oneshot_chan_cfg_t config = {
+        .bitwidth = ctx.default_width,
+        .atten = ctx.default_atten,
+    };
+    *ulp_channel = ctx.channels[channel].channel;
+    return adc_oneshot_config_channel(ctx.units[unit], ctx.channels[channel].channel, &config) == ESP_OK;
+}
+
+void HAL_ADC_deinit(HalAdcChannel channel) {
+    adc_unit_t unit = ctx.channels[channel].unit;
+    if (ctx.channels[channel].calibrated) {
+        adc_calibration_deinit(ctx.channels[channel].cali_handle);
+        ctx.channels[channel].calibrated = false;
+    }
+
+    if (ctx.unit_users[unit] > 0 && --ctx.unit_users[unit] == 0) {
+        ESP_ERROR_CHECK(adc_oneshot_del_unit(ctx.units[unit]));
+        ctx.units[unit] = NULL;
+    }
+}
@@ -0,0 +1,32 @@
+#include "modules/hal/hal_gpio.h"
+
+#include "driver/gpio.h"
+#include "soc/gpio_struct.h"
+#include "esp_log.h"
+
+bool HAL_GPIO_is_valid_output(int pin) {
+    return pin >= 0 && GPIO_IS_VALID_OUTPUT_GPIO(pin);
+}
+
+bool HAL_GPIO_config_outputs(uint64_t pin_mask) {
+    gpio_config_t io_conf = { 0 };
+
+    io_conf.pin_bit_mask    = pin_mask;
+    io_conf.intr_type       = GPIO_INTR_DISABLE;
+    io_conf.mode            = GPIO_MODE_OUTPUT;
+    io_conf.pull_down_en    = GPIO_PULLDOWN_DISABLE;
+    io_conf.pull_up_en      = GPIO_PULLUP_DISABLE;
+
+    esp_err_t err = gpio_config(&io_conf);
+    if (err != ESP_OK) {
+        ESP_LOGW(__func__, "Problem with initialization: %s", esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+void HAL_GPIO_write(uint32_t set, uint32_t clear) {
+    // one write per direction, every output going the same way switches on the same clock edge
+    GPIO.out_w1tc = clear;
+    GPIO.out_w1ts = set;
+}
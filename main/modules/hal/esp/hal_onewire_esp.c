@@ -0,0 +1,108 @@
+#include "modules/hal/hal_onewire.h"
+
+#include <stdio.h>
+
+#include "esp_log.h"
+
+#include "ds18b20.h"
+#include "owb.h"
+#include "owb_rmt.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define DS18B20_RESOLUTION (DS18B20_RESOLUTION_12_BIT)
+
+static struct {
+    owb_rmt_driver_info rmt_driver_info;
+    OneWireBus *owb;
+    DS18B20_Info device_info[HAL_ONEWIRE_MAX_DEVICES];
+    DS18B20_Info *devices[HAL_ONEWIRE_MAX_DEVICES];
+    OneWireBus_ROMCode device_rom_codes[HAL_ONEWIRE_MAX_DEVICES];
+    unsigned num_devices;
+} ctx = { 0 };
+
+unsigned HAL_ONEWIRE_init(int pin) {
+    // Create a 1-Wire bus, using the RMT timeslot driver
+    ctx.owb = owb_rmt_initialize(&ctx.rmt_driver_info, pin, RMT_CHANNEL_1, RMT_CHANNEL_0);
+    owb_use_crc(ctx.owb, true);  // enable CRC check for ROM code
+
+    // Stable readings require a brief period before communication
+    vTaskDelay(2000.0 / portTICK_PERIOD_MS);
+
+    // Find all connected devices
+    OneWireBus_SearchState search_state = {0};
+    bool found = false;
+    owb_search_first(ctx.owb, &search_state, &found);
+    while (found && ctx.num_devices < HAL_ONEWIRE_MAX_DEVICES) {
+        char rom_code_s[17];
+        owb_string_from_rom_code(search_state.rom_code, rom_code_s, sizeof(rom_code_s));
+        ESP_LOGI(__func__, "Temperature sensor %d : %s\n", ctx.num_devices, rom_code_s);
+        ctx.device_rom_codes[ctx.num_devices] = search_state.rom_code;
+        ++ctx.num_devices;
+        owb_search_next(ctx.owb, &search_state, &found);
+    }
+
+    ESP_LOGI(__func__, "Found %d device%s", ctx.num_devices, ctx.num_devices == 1 ? "" : "s");
+    for (unsigned i = 0; i < ctx.num_devices; ++i) {
+        ctx.devices[i] = &ctx.device_info[i];
+        if (ctx.num_devices == 1) {
+            ESP_LOGW(__func__, "Single device optimisations enabled");
+            ds18b20_init_solo(ctx.devices[i], ctx.owb);  // only one device on bus
+        } else {
+            ds18b20_init(ctx.devices[i], ctx.owb, ctx.device_rom_codes[i]);  // associate with bus and device
+        }
+        ds18b20_use_crc(ctx.devices[i], true);  // enable CRC check on all reads
+        ds18b20_set_resolution(ctx.devices[i], DS18B20_RESOLUTION);
+    }
+
+    // Check for parasitic-powered devices
+    bool parasitic_power = false;
+    ds18b20_check_for_parasite_power(ctx.owb, &parasitic_power);
+    if (parasitic_power) {
+        ESP_LOGW(__func__, "Parasitic-powered devices detected");
+    }
+
+    // In parasitic-power mode, devices cannot indicate when conversions are complete,
+    // so waiting for a temperature conversion must be done by waiting a prescribed duration
+    owb_use_parasitic_power(ctx.owb, parasitic_power);
+    return ctx.num_devices;
+}
+
+unsigned HAL_ONEWIRE_read(float *temperatures, unsigned max_count) {
+    if (ctx.num_devices == 0 || ctx.owb == NULL) {
+        ESP_LOGE(__func__, "No DS18B20 devices detected or no OWB!\n");
+        return 0;
+    }
+
+    // Read temperatures more efficiently by starting conversions on all devices at the same time
+    ds18b20_convert_all(ctx.owb);
+
+    // All devices use the same resolution, so the first can determine the delay
+    ds18b20_wait_for_conversion(ctx.devices[0]);
+
+    // Read the results immediately after conversion otherwise it may fail
+    // (using printf before reading may take too long)
+    unsigned count = ctx.num_devices < max_count ? ctx.num_devices : max_count;
+    DS18B20_ERROR errors[HAL_ONEWIRE_MAX_DEVICES] = {0};
+    for (unsigned i = 0; i < count; ++i) {
+        errors[i] = ds18b20_read_temp(ctx.devices[i], &temperatures[i]);
+    }
+
+    // Print results in a separate loop, after all have been read
+    for (unsigned i = 0; i < count; ++i) {
+        if (errors[i] != DS18B20_OK)
+            printf("\nTemperature readings error: %d\n", errors[i]);
+        ESP_LOGI(__func__, "Sensor %d: %.1f", i, temperatures[i]);
+    }
+    return count;
+}
+
+void HAL_ONEWIRE_deinit(void) {
+    for (unsigned i = 0; i < ctx.num_devices; ++i) {
+        ctx.devices[i] = NULL;
+    }
+    ctx.num_devices = 0;
+    owb_uninitialize(ctx.owb);
+    ctx.owb = NULL;
+}
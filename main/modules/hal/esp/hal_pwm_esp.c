@@ -0,0 +1,48 @@
+#include "modules/hal/hal_pwm.h"
+
+#include "driver/ledc.h"
+
+static struct {
+    unsigned speed_mode;
+    unsigned timer_num;
+    unsigned channel;
+} ctx = {
+    .speed_mode         = LEDC_HIGH_SPEED_MODE,
+    .timer_num          = LEDC_TIMER_0,
+    .channel            = LEDC_CHANNEL_0,
+};
+
+bool HAL_PWM_init(int pin, Herz freq, unsigned resolution_bits) {
+    ledc_timer_config_t pwm_timer = {
+        .speed_mode = ctx.speed_mode,
+        .duty_resolution = resolution_bits,
+        .timer_num = ctx.timer_num,
+        .freq_hz = freq,
+    };
+    bool ret = (ESP_OK == ledc_timer_config(&pwm_timer));
+
+    ledc_channel_config_t pwm_channel = {
+        .gpio_num = pin,
+        .speed_mode = ctx.speed_mode,
+        .channel = ctx.channel,
+        .intr_type = LEDC_INTR_DISABLE,
+        .timer_sel = ctx.timer_num,
+        .duty = 0,   // Initial duty cycle (0 to 2^PWM_LEDC_TIMER_BIT - 1)
+        .hpoint = 0,
+    };
+
+    return ret && (ESP_OK == ledc_channel_config(&pwm_channel));
+}
+
+bool HAL_PWM_set_freq(Herz freq) {
+    return ESP_OK == ledc_set_freq(ctx.speed_mode, ctx.timer_num, freq);
+}
+
+bool HAL_PWM_set_duty(uint32_t duty) {
+    return ESP_OK == ledc_set_duty(ctx.speed_mode, ctx.channel, duty)
+        && ESP_OK == ledc_update_duty(ctx.speed_mode, ctx.channel);
+}
+
+bool HAL_PWM_stop(void) {
+    return ESP_OK == ledc_stop(ctx.speed_mode, ctx.channel, 0);
+}
@@ -0,0 +1,39 @@
+#include "modules/hal/hal_time.h"
+
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+int64_t HAL_TIME_now(void) {
+    return esp_timer_get_time();
+}
+
+void HAL_TIME_delay_ms(Milliseconds delay) {
+    vTaskDelay(pdMS_TO_TICKS(delay));
+}
+
+int64_t HAL_TIME_wait_until(int64_t deadline) {
+    const int64_t tick_us = portTICK_PERIOD_MS * 1000;
+    int64_t remaining = deadline - esp_timer_get_time();
+
+    // sleep for the coarse part, spin for the last tick to hit the microsecond
+    if (remaining > 2 * tick_us)
+        vTaskDelay((remaining - tick_us) / tick_us);
+
+    int64_t now = esp_timer_get_time();
+    while (now < deadline)
+        now = esp_timer_get_time();
+
+    return now;
+}
+
+uint32_t HAL_TIME_cycles(void) {
+    return esp_cpu_get_cycle_count();
+}
+
+uint32_t HAL_TIME_cycles_per_us(void) {
+    return esp_rom_get_cpu_ticks_per_us();
+}
@@ -0,0 +1,27 @@
+#ifndef HAL_ADC_H
+#define HAL_ADC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/base/types.h"
+
+typedef enum {
+    kHalAdcVoltage = 0,     // ADC1, behind the voltage divider
+    kHalAdcCurrent,         // ADC2, CT burden output
+    kHalAdcCurrentRef,      // ADC2, CT mid-supply reference
+// sentinel
+    kHalAdcLastChannel
+} HalAdcChannel;
+
+bool HAL_ADC_init(HalAdcChannel channel);
+int HAL_ADC_read_raw(HalAdcChannel channel);
+// 0 mV when the channel has no calibration scheme
+Millivolt HAL_ADC_raw_to_voltage(HalAdcChannel channel, int raw);
+void HAL_ADC_deinit(HalAdcChannel channel);
+
+// hands the channel's ADC unit over to the ULP coprocessor, the main CPU can't read
+// the unit afterwards; ulp_channel is the channel number for the ULP ADC instruction
+bool HAL_ADC_ulp_enable(HalAdcChannel channel, unsigned *ulp_channel);
+
+#endif // HAL_ADC_H
@@ -0,0 +1,12 @@
+#ifndef HAL_GPIO_H
+#define HAL_GPIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+bool HAL_GPIO_is_valid_output(int pin);
+bool HAL_GPIO_config_outputs(uint64_t pin_mask);
+// GPIO0-31 only, clear is applied before set
+void HAL_GPIO_write(uint32_t set, uint32_t clear);
+
+#endif // HAL_GPIO_H
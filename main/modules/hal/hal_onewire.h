@@ -0,0 +1,15 @@
+#ifndef HAL_ONEWIRE_H
+#define HAL_ONEWIRE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define HAL_ONEWIRE_MAX_DEVICES (8)
+
+// returns number of DS18B20 probes found on the bus
+unsigned HAL_ONEWIRE_init(int pin);
+// converts on all probes at once, returns number of probes read
+unsigned HAL_ONEWIRE_read(float *temperatures, unsigned max_count);
+void HAL_ONEWIRE_deinit(void);
+
+#endif // HAL_ONEWIRE_H
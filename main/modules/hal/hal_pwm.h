@@ -0,0 +1,14 @@
+#ifndef HAL_PWM_H
+#define HAL_PWM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/base/types.h"
+
+bool HAL_PWM_init(int pin, Herz freq, unsigned resolution_bits);
+bool HAL_PWM_set_freq(Herz freq);
+bool HAL_PWM_set_duty(uint32_t duty);
+bool HAL_PWM_stop(void);
+
+#endif // HAL_PWM_H
@@ -0,0 +1,17 @@
+#ifndef HAL_TIME_H
+#define HAL_TIME_H
+
+#include <stdint.h>
+
+#include "modules/base/types.h"
+
+int64_t HAL_TIME_now(void);     // microseconds since boot
+void HAL_TIME_delay_ms(Milliseconds delay);
+// sleeps for the coarse part and spins the last tick, returns the time it woke up at
+int64_t HAL_TIME_wait_until(int64_t deadline);
+
+// free running counter for short intervals, CPU cycles on target, ns on host
+uint32_t HAL_TIME_cycles(void);
+uint32_t HAL_TIME_cycles_per_us(void);
+
+#endif // HAL_TIME_H
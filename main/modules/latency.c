@@ -0,0 +1,175 @@
+#include "modules/latency.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "modules/base/generic_fun.h"
+#include "modules/cli.h"
+#include "modules/ble.h"
+#include "modules/worker.h"
+#include "modules/core/jitter_core.h"
+#include "modules/hal/hal_time.h"
+
+// latency duration 30 period 10 load ble,cli
+// latency duration 30 period 10 load ble,cli core any
+
+#define UNPINNED_PRIORITY 5
+
+static struct {
+    Seconds duration;
+    Milliseconds period;
+    unsigned load;
+    bool pinned;
+
+    volatile bool ongoing;
+    // lateness of every wake-up against the ideal schedule, same log2 bins as the jitter stats
+    uint32_t bins[JITTER_BINS];
+    Microseconds max_late;
+    uint32_t count;
+} ctx = { 0 };
+
+// the core 1 sampler is the session worker, it runs at the measurement priority
+WORKER_DEFINE(unpinned_sampler, "latency_any", TASK_STACK_SIZE, UNPINNED_PRIORITY, tskNO_AFFINITY);
+WORKER_DEFINE(load_generator, "latency_load", TASK_STACK_SIZE_SMALL, TASK_PRIORITY_LOAD, TASK_CORE_COMMS);
+BUDGET_CHECK(sizeof(ctx) + WORKER_FOOTPRINT(TASK_STACK_SIZE) + WORKER_FOOTPRINT(TASK_STACK_SIZE_SMALL), BUDGET_LATENCY);
+
+static char *FindArgumentValue(int argc, char **argv, const char *arg) {
+    for (int i = 1; i < argc - 1; i++) {
+        if (AreStringsTheSame(arg, argv[i], strlen(arg) + 1))
+            return argv[i + 1];
+    }
+    return NULL;
+}
+
+static void load_job(void *arg) {
+    char buffer[] = "latency,load,0123456789";
+    unsigned line = 0;
+    while (ctx.ongoing) {
+        if (ctx.load & kLatencyLoadCli)
+            ESP_LOGI("latency", "load line %u 0123456789abcdef0123456789abcdef", line++);
+
+        if (ctx.load & kLatencyLoadBle) {
+            BLE_update_value(kDiagnostics, buffer);
+            vTaskDelay(1);
+        } else {
+            taskYIELD();
+        }
+    }
+}
+
+static void log_result(void) {
+    uint32_t total = 0;
+    for (unsigned i = 0; i < JITTER_BINS; ++i)
+        total += ctx.bins[i];
+
+    ESP_LOGI(__func__, "LATENCY [%s] [period %" PRIu32 " ms] [load%s%s%s] [n %" PRIu32 "] [max %" PRIu32 " us]",
+             ctx.pinned ? "core 1" : "unpinned", ctx.period,
+             ctx.load & kLatencyLoadBle ? " ble" : "", ctx.load & kLatencyLoadCli ? " cli" : "",
+             ctx.load == kLatencyLoadNone ? " none" : "", ctx.count, ctx.max_late);
+
+    uint32_t seen = 0;
+    for (unsigned i = 0; i < JITTER_BINS; ++i) {
+        if (ctx.bins[i] == 0)
+            continue;
+
+        seen += ctx.bins[i];
+        ESP_LOGI(__func__, "LATENCY [< %" PRIu32 " us] [%" PRIu32 "] [%.2f %%]",
+                 (uint32_t)1 << i, ctx.bins[i], 100.0f * seen / total);
+    }
+}
+
+static void sampler_job(void *arg) {
+    const TickType_t period = pdMS_TO_TICKS(ctx.period) != 0 ? pdMS_TO_TICKS(ctx.period) : 1;
+    const int64_t period_us = (int64_t)period * portTICK_PERIOD_MS * 1000;
+    const uint32_t samples = ctx.duration * 1000 / (period * portTICK_PERIOD_MS);
+
+    // align the schedule to a tick edge so only scheduling delay shows up as lateness
+    vTaskDelay(1);
+    TickType_t wake = xTaskGetTickCount();
+    int64_t start = HAL_TIME_now();
+
+    for (uint32_t i = 1; i <= samples; ++i) {
+        vTaskDelayUntil(&wake, period);
+        int64_t late = HAL_TIME_now() - (start + i * period_us);
+        if (late < 0)
+            late = 0;
+
+        ctx.bins[JITTER_CORE_bin(late)] += 1;
+        if (late > ctx.max_late)
+            ctx.max_late = late;
+        ctx.count += 1;
+    }
+
+    ctx.ongoing = false;
+    while (WORKER_is_idle(&load_generator) == false)
+        vTaskDelay(1);
+
+    log_result();
+}
+
+bool LATENCY_start(Seconds duration, Milliseconds period, unsigned load, bool pinned) {
+    if (ctx.ongoing || duration == 0 || period == 0 || WORKER_is_idle(&load_generator) == false)
+        return false;
+
+    ctx.duration = duration;
+    ctx.period = period;
+    ctx.load = load;
+    ctx.pinned = pinned;
+    ctx.max_late = 0;
+    ctx.count = 0;
+    memset(ctx.bins, 0, sizeof(ctx.bins));
+    ctx.ongoing = true;
+
+    bool submitted = pinned ? WORKER_session(sampler_job, NULL) : WORKER_submit(&unpinned_sampler, sampler_job, NULL);
+    if (submitted == false) {
+        ctx.ongoing = false;
+        return false;
+    }
+
+    if (load != kLatencyLoadNone)
+        WORKER_submit(&load_generator, load_job, NULL);
+    return true;
+}
+
+static int latency_command_execution(int argc, char **argv) {
+    Seconds duration = 10;
+    Milliseconds period = 10;
+    unsigned load = kLatencyLoadNone;
+    bool pinned = true;
+
+    char *value = FindArgumentValue(argc, argv, "duration");
+    if (value != NULL)
+        duration = strtoul(value, NULL, 10);
+
+    value = FindArgumentValue(argc, argv, "period");
+    if (value != NULL)
+        period = strtoul(value, NULL, 10);
+
+    value = FindArgumentValue(argc, argv, "load");
+    if (value != NULL) {
+        if (strstr(value, "ble") != NULL)
+            load |= kLatencyLoadBle;
+        if (strstr(value, "cli") != NULL)
+            load |= kLatencyLoadCli;
+    }
+
+    value = FindArgumentValue(argc, argv, "core");
+    if (value != NULL && AreStringsTheSame("any", value, sizeof("any")))
+        pinned = false;
+
+    ESP_LOGI(__func__, "LATENCY: %s", LATENCY_start(duration, period, load, pinned) ? "ongoing" : "errors occurs");
+    return 0;
+}
+
+void LATENCY_init(void) {
+    WORKER_start(&unpinned_sampler);
+    WORKER_start(&load_generator);
+    CLI_register_command("latency", "[duration <s>] [period <ms>] [load ble,cli] [core 1|any]", latency_command_execution);
+}
@@ -0,0 +1,21 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/base/types.h"
+
+typedef enum {
+    kLatencyLoadNone = 0,
+    kLatencyLoadBle = 1 << 0,      // back to back notifications
+    kLatencyLoadCli = 1 << 1,      // continuous console output
+} LatencyLoad;
+
+void LATENCY_init(void);
+
+// samples every period from a core 1 measurement priority task, or unpinned at
+// the old default priority, while the requested load runs on core 0
+bool LATENCY_start(Seconds duration, Milliseconds period, unsigned load, bool pinned);
+
+#endif // LATENCY_H
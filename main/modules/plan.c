@@ -0,0 +1,383 @@
+#include "modules/plan.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "modules/base/generic_fun.h"
+#include "modules/cli.h"
+#include "modules/ble.h"
+#include "modules/adc.h"
+#include "modules/ct.h"
+#include "modules/power.h"
+#include "modules/pwm.h"
+#include "modules/relay.h"
+#include "modules/worker.h"
+#include "modules/hal/hal_time.h"
+
+// plan save smoke "relay on; wait 100; measure voltage 200; expect avg 11500 12500; relay off"
+// plan save burst "loop 5; pwm 1000 80; wait 50; measure current 20; expect max 0 2000; pwm off; wait 50; end"
+// plan run smoke
+// plan show smoke
+
+#define NVS_NAMESPACE "plans"
+#define RECORD_RING 16              // records waiting for the report worker
+
+static struct {
+    PlanProgram program;
+    char name[PLAN_MAX_NAME + 1];
+    bool reply_ble;
+    volatile bool ongoing;
+    volatile bool stop;
+    PlanResult result;
+
+    // the plan task only copies records, formatting them would shift the schedule
+    PlanRecord records[RECORD_RING];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile bool draining;
+    uint32_t dropped;
+} ctx = { 0 };
+
+// programs run on the session worker
+BUDGET_CHECK(sizeof(ctx), BUDGET_PLAN);
+
+static bool valid_name(const char *name) {
+    size_t length = strlen(name);
+    return length > 0 && length <= PLAN_MAX_NAME;
+}
+
+static bool load(const char *name, PlanProgram *program) {
+    nvs_handle_t handle;
+    if (valid_name(name) == false || nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+        return false;
+
+    size_t length = sizeof(*program);
+    esp_err_t err = nvs_get_blob(handle, name, program, &length);
+    nvs_close(handle);
+
+    if (err != ESP_OK) {
+        ESP_LOGW(__func__, "No plan %s: %s", name, esp_err_to_name(err));
+        return false;
+    }
+
+    if (length < offsetof(PlanProgram, ops) || length != offsetof(PlanProgram, ops) + program->count * sizeof(PlanOp)
+        || PLAN_CORE_validate(program) == false) {
+        ESP_LOGW(__func__, "Stored plan %s is not valid for this firmware", name);
+        return false;
+    }
+    return true;
+}
+
+static bool store(const char *name, const PlanProgram *program) {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(__func__, "Opening NVS failed: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    // only the used ops are stored
+    err = nvs_set_blob(handle, name, program, offsetof(PlanProgram, ops) + program->count * sizeof(PlanOp));
+    if (err == ESP_OK)
+        err = nvs_commit(handle);
+    nvs_close(handle);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(__func__, "Storing plan %s failed: %s", name, esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+static void format_record(const PlanRecord *record, char *line, unsigned size) {
+    int length = snprintf(line, size, "%u,%s,%" PRId64 ",%" PRId32 ",%s",
+                          record->step, PLAN_CORE_op_name(record->code), record->start, record->late,
+                          record->pass ? "pass" : "fail");
+
+    if (record->code == kPlanMeasure || record->code == kPlanExpect)
+        length += snprintf(line + length, size - length, ",%" PRId32 ",%" PRId32 ",%" PRId32,
+                           record->min, record->max, record->avg);
+    if (record->code == kPlanExpect)
+        snprintf(line + length, size - length, ",%" PRId32, record->value);
+}
+
+static void emit(const char *line) {
+    if (ctx.reply_ble)
+        BLE_stream_raw(kPlan, (const uint8_t *)line, strlen(line));
+    else
+        ESP_LOGI("plan", "PLAN %s", line);
+}
+
+static void drain(void *arg) {
+    // records added from here on queue another drain
+    ctx.draining = false;
+
+    char line[96];
+    while (ctx.tail != ctx.head) {
+        format_record(&ctx.records[ctx.tail % RECORD_RING], line, sizeof(line));
+        ctx.tail += 1;
+        emit(line);
+    }
+}
+
+static void finish(void *arg) {
+    drain(NULL);
+
+    char line[96];
+    snprintf(line, sizeof(line), "end,%s,%" PRIu32 ",%" PRIu32 ",%" PRId64 ",%s%s",
+             ctx.name, ctx.result.steps, ctx.result.failed, ctx.result.duration,
+             ctx.result.failed == 0 && ctx.result.aborted == false ? "PASS" : "FAIL",
+             ctx.result.aborted ? ",stopped" : "");
+    emit(line);
+    if (ctx.dropped > 0)
+        ESP_LOGW(__func__, "PLAN %s: %" PRIu32 " records dropped", ctx.name, ctx.dropped);
+
+    if (ctx.reply_ble)
+        BLE_stream_raw(kPlan, (const uint8_t *)"end", 3);
+    ctx.ongoing = false;
+}
+
+static bool hook_relay(uint32_t mask, uint32_t values, void *arg) {
+    return RELAY_set_mask(mask, values);
+}
+
+static bool hook_pwm(uint32_t freq, uint32_t duty, void *arg) {
+    if (freq == 0)
+        return PWM_stop();
+    return PWM_set_freq(freq) && PWM_set_duty(duty);
+}
+
+static int64_t hook_now(void *arg) {
+    return esp_timer_get_time();
+}
+
+static void hook_wait_until(int64_t deadline, void *arg) {
+    HAL_TIME_wait_until(deadline);
+}
+
+static int32_t hook_sample(PlanChannel channel, void *arg) {
+    if (channel == kPlanVoltage)
+        return ADC_counts_to_voltage(ADC_read_raw());
+
+    Amper current = 0;
+    CT_counts_to_current(CT_read_raw(), &current);
+    return current * 1000;
+}
+
+static void hook_record(const PlanRecord *record, void *arg) {
+    if (ctx.head - ctx.tail >= RECORD_RING) {
+        ctx.dropped += 1;
+        return;
+    }
+
+    ctx.records[ctx.head % RECORD_RING] = *record;
+    ctx.head += 1;
+    if (ctx.draining == false) {
+        ctx.draining = true;
+        if (WORKER_report(drain, NULL) == false)
+            ctx.draining = false;
+    }
+}
+
+static bool hook_stopped(void *arg) {
+    return ctx.stop;
+}
+
+static const PlanHooks hooks = {
+    .relay      = hook_relay,
+    .pwm        = hook_pwm,
+    .now        = hook_now,
+    .wait_until = hook_wait_until,
+    .sample     = hook_sample,
+    .record     = hook_record,
+    .stopped    = hook_stopped,
+};
+
+static void run(void *arg) {
+    ctx.head = ctx.tail = 0;
+    ctx.dropped = 0;
+    POWER_lock(kPowerCpu);
+    PLAN_CORE_run(&ctx.program, &hooks, NULL, &ctx.result);
+    POWER_unlock(kPowerCpu);
+
+    if (ctx.result.aborted) {
+        PWM_stop();
+        RELAY_set_mask(RELAY_get_outputs(), 0);
+    }
+
+    if (WORKER_report(finish, NULL) == false)
+        finish(NULL);
+}
+
+static bool measures_current(const PlanProgram *program) {
+    for (unsigned i = 0; i < program->count; ++i) {
+        if (program->ops[i].code == kPlanMeasure && program->ops[i].select == kPlanCurrent)
+            return true;
+    }
+    return false;
+}
+
+static bool start(const char *name, bool reply_ble) {
+    if (ctx.ongoing || load(name, &ctx.program) == false)
+        return false;
+
+    if (measures_current(&ctx.program) && CT_has_zero() == false) {
+        ESP_LOGW(__func__, "No CT zero yet, run 'ct zero now' with the outputs off");
+        return false;
+    }
+
+    strcpy(ctx.name, name);     // length checked by load
+    ctx.reply_ble = reply_ble;
+    ctx.stop = false;
+    ctx.ongoing = true;
+    if (WORKER_session(run, NULL) == false) {
+        ctx.ongoing = false;
+        return false;
+    }
+    return true;
+}
+
+bool PLAN_run(const char *name) {
+    return start(name, false);
+}
+
+void PLAN_stop(void) {
+    ctx.stop = true;
+}
+
+bool PLAN_save(const char *name, const char *text) {
+    if (ctx.ongoing || valid_name(name) == false)
+        return false;
+
+    unsigned statement = 0;
+    if (PLAN_CORE_compile(text, &ctx.program, &statement) == false) {
+        ESP_LOGW(__func__, "PLAN %s: statement %u not valid", name, statement + 1);
+        return false;
+    }
+    return store(name, &ctx.program);
+}
+
+bool PLAN_delete(const char *name) {
+    nvs_handle_t handle;
+    if (valid_name(name) == false || nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+        return false;
+
+    esp_err_t err = nvs_erase_key(handle, name);
+    if (err == ESP_OK)
+        err = nvs_commit(handle);
+    nvs_close(handle);
+    return err == ESP_OK;
+}
+
+static void show(const char *name) {
+    if (ctx.ongoing || load(name, &ctx.program) == false) {
+        ESP_LOGI(__func__, "PLAN: errors occurs");
+        return;
+    }
+
+    char line[48];
+    for (unsigned i = 0; i < ctx.program.count; ++i) {
+        PLAN_CORE_format_op(&ctx.program.ops[i], line, sizeof(line));
+        ESP_LOGI(__func__, "PLAN %s [%u] %s", name, i, line);
+    }
+}
+
+static void list(void) {
+    nvs_iterator_t it = NULL;
+    esp_err_t err = nvs_entry_find(NVS_DEFAULT_PART_NAME, NVS_NAMESPACE, NVS_TYPE_BLOB, &it);
+    unsigned count = 0;
+    while (err == ESP_OK) {
+        nvs_entry_info_t info;
+        nvs_entry_info(it, &info);
+        ESP_LOGI(__func__, "PLAN %s", info.key);
+        count += 1;
+        err = nvs_entry_next(&it);
+    }
+    nvs_release_iterator(it);
+    ESP_LOGI(__func__, "PLAN: %u stored", count);
+}
+
+static int plan_command_execution(int argc, char **argv) {
+    if (argc < 2) {
+        ESP_LOGI(__func__, "No arguments");
+        return 0;
+    }
+
+    if (AreStringsTheSame("list", argv[1], sizeof("list"))) {
+        list();
+        return 0;
+    }
+
+    if (AreStringsTheSame("stop", argv[1], sizeof("stop"))) {
+        PLAN_stop();
+        return 0;
+    }
+
+    if (argc < 3) {
+        ESP_LOGW(__func__, "Missing plan name");
+        return 0;
+    }
+
+    if (AreStringsTheSame("save", argv[1], sizeof("save"))) {
+        if (argc < 4) {
+            ESP_LOGW(__func__, "Missing statements");
+            return 0;
+        }
+        ESP_LOGI(__func__, "PLAN: %s", PLAN_save(argv[2], argv[3]) ? "saved" : "errors occurs");
+        return 0;
+    }
+
+    if (AreStringsTheSame("run", argv[1], sizeof("run"))) {
+        ESP_LOGI(__func__, "PLAN: %s", PLAN_run(argv[2]) ? "started" : "errors occurs");
+        return 0;
+    }
+
+    if (AreStringsTheSame("show", argv[1], sizeof("show"))) {
+        show(argv[2]);
+        return 0;
+    }
+
+    if (AreStringsTheSame("delete", argv[1], sizeof("delete"))) {
+        ESP_LOGI(__func__, "PLAN: %s", PLAN_delete(argv[2]) ? "deleted" : "errors occurs");
+        return 0;
+    }
+
+    ESP_LOGW(__func__, "Unknown subcommand: %s", argv[1]);
+    return 0;
+}
+
+// "run,<name>" | "stop", a run is answered with
+// <step>,<op>,<t us>,<late us>,<pass|fail>[,<min>,<max>,<avg>[,<value>]]   one per step
+// end,<name>,<steps>,<failed>,<duration us>,<PASS|FAIL>[,stopped]
+// end
+static void parse_ble_command(char *buffer, unsigned length) {
+    if (AreStringsTheSame("run,", buffer, strlen("run,"))) {
+        if (start(buffer + strlen("run,"), true) == false)
+            BLE_notify_raw(kPlan, (const uint8_t *)"error", strlen("error"));
+        return;
+    }
+
+    if (AreStringsTheSame("stop", buffer, strlen("stop"))) {
+        PLAN_stop();
+        return;
+    }
+
+    BLE_notify_raw(kPlan, (const uint8_t *)"error", strlen("error"));
+}
+
+void PLAN_init(void) {
+    CLI_register_command("plan",
+                         "[save <name> \"<statements>\"] [run <name>] [show <name>] [delete <name>] [list] [stop]",
+                         plan_command_execution);
+    BLE_setup_characteristic_callback(kPlan, parse_ble_command);
+}
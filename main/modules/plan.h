@@ -0,0 +1,22 @@
+#ifndef PLAN_H
+#define PLAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/core/plan_core.h"
+
+#define PLAN_MAX_NAME 15            // NVS key length
+
+void PLAN_init(void);
+
+// compiles the statements and stores the program under name
+bool PLAN_save(const char *name, const char *text);
+bool PLAN_delete(const char *name);
+
+// loads the stored program and runs it in the background, one record per step
+bool PLAN_run(const char *name);
+// the running plan ends before its next step with the outputs off
+void PLAN_stop(void);
+
+#endif // PLAN_H
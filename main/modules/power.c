@@ -0,0 +1,281 @@
+#include "modules/power.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "driver/uart.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "modules/base/generic_fun.h"
+#include "modules/adapt.h"
+#include "modules/cli.h"
+#include "modules/config.h"
+#include "modules/worker.h"
+#include "modules/core/power_core.h"
+
+// config set power.min_mhz 40
+// config commit
+// power report 30
+
+#define REPORT_PERIOD 50            // ticks between wakeups of the latency probe
+#define CONSOLE_WAKEUP_EDGES 3      // RX edges that wake the chip, the first characters are dropped
+
+// The ESP32 BT controller keeps a no light sleep lock unless it runs from an
+// external 32 kHz crystal, the BLE stack is always up here.
+#if CONFIG_BT_ENABLED && !CONFIG_BTDM_CTRL_LPCLK_SEL_EXT_32K_XTAL
+#define SLEEP_WITH_BT false
+#else
+#define SLEEP_WITH_BT true
+#endif
+
+static const char *lock_names[kPowerLastLock] = {
+    [kPowerCpu]     = "cpu",
+    [kPowerNoSleep] = "no_sleep",
+    [kPowerApb]     = "apb",
+};
+
+#if CONFIG_PM_ENABLE
+static const esp_pm_lock_type_t lock_types[kPowerLastLock] = {
+    [kPowerCpu]     = ESP_PM_CPU_FREQ_MAX,
+    [kPowerNoSleep] = ESP_PM_NO_LIGHT_SLEEP,
+    [kPowerApb]     = ESP_PM_APB_FREQ_MAX,
+};
+#endif
+
+typedef struct {
+    int64_t time;
+    int64_t held[kPowerLastLock];
+    int64_t held_any;
+    uint32_t idle[portNUM_PROCESSORS];
+} PowerSnapshot;
+
+static struct {
+    // handles stay NULL without CONFIG_PM_ENABLE, the counting still runs
+    esp_pm_lock_handle_t handles[kPowerLastLock];
+    uint32_t max_mhz;
+    uint32_t min_mhz;
+    bool light_sleep;
+    bool configured;
+
+    // held time per lock and with any lock, us
+    portMUX_TYPE lock;
+    uint32_t count[kPowerLastLock];
+    uint32_t count_any;
+    int64_t since[kPowerLastLock];
+    int64_t since_any;
+    int64_t held[kPowerLastLock];
+    int64_t held_any;
+
+    volatile bool ongoing;
+    Seconds duration;
+    PowerSnapshot begin;
+    PowerSnapshot end;
+    Herz rate;
+    uint32_t wakeups;
+    int64_t late_min;
+    int64_t late_max;
+    int64_t late_sum;
+} ctx = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+// wakeups are probed from the session worker on the acquisition core, where the sampling loops sleep
+BUDGET_CHECK(sizeof(ctx), BUDGET_POWER);
+
+void POWER_lock(PowerLock lock) {
+    if (lock >= kPowerLastLock)
+        return;
+
+    if (ctx.handles[lock] != NULL)
+        esp_pm_lock_acquire(ctx.handles[lock]);
+
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&ctx.lock);
+    if (ctx.count[lock]++ == 0)
+        ctx.since[lock] = now;
+    if (ctx.count_any++ == 0)
+        ctx.since_any = now;
+    taskEXIT_CRITICAL(&ctx.lock);
+}
+
+void POWER_unlock(PowerLock lock) {
+    if (lock >= kPowerLastLock)
+        return;
+
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&ctx.lock);
+    if (ctx.count[lock] > 0 && --ctx.count[lock] == 0)
+        ctx.held[lock] += now - ctx.since[lock];
+    if (ctx.count_any > 0 && --ctx.count_any == 0)
+        ctx.held_any += now - ctx.since_any;
+    taskEXIT_CRITICAL(&ctx.lock);
+
+    if (ctx.handles[lock] != NULL)
+        esp_pm_lock_release(ctx.handles[lock]);
+}
+
+static void snapshot(PowerSnapshot *snapshot) {
+    memset(snapshot, 0, sizeof(*snapshot));
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    for (unsigned core = 0; core < portNUM_PROCESSORS; ++core) {
+        TaskStatus_t status;
+        vTaskGetInfo(xTaskGetIdleTaskHandleForCPU(core), &status, pdFALSE, eInvalid);
+        snapshot->idle[core] = status.ulRunTimeCounter;
+    }
+#endif
+
+    taskENTER_CRITICAL(&ctx.lock);
+    snapshot->time = esp_timer_get_time();
+    for (unsigned lock = 0; lock < kPowerLastLock; ++lock)
+        snapshot->held[lock] = ctx.held[lock] + (ctx.count[lock] > 0 ? snapshot->time - ctx.since[lock] : 0);
+    snapshot->held_any = ctx.held_any + (ctx.count_any > 0 ? snapshot->time - ctx.since_any : 0);
+    taskEXIT_CRITICAL(&ctx.lock);
+}
+
+static float share(int64_t part, int64_t window) {
+    return window > 0 ? (float)part / window : 0;
+}
+
+static void log_result(void *arg) {
+    const int64_t window = ctx.end.time - ctx.begin.time;
+    float idle[portNUM_PROCESSORS];
+    for (unsigned core = 0; core < portNUM_PROCESSORS; ++core) {
+        // the run time counter ticks in microseconds, esp_timer based
+        idle[core] = share((uint32_t)(ctx.end.idle[core] - ctx.begin.idle[core]), window);
+    }
+
+    float locked = share(ctx.end.held[kPowerCpu] - ctx.begin.held[kPowerCpu], window);
+    float awake = share(ctx.end.held_any - ctx.begin.held_any, window);
+    bool sleep_possible = ctx.light_sleep && ctx.configured && SLEEP_WITH_BT;
+    PowerResidency residency = POWER_CORE_residency(locked, awake, idle, portNUM_PROCESSORS, sleep_possible);
+    float current = POWER_CORE_current(&residency, ctx.max_mhz, ctx.min_mhz);
+
+    char mode[24];
+    if (ctx.rate != 0)
+        snprintf(mode, sizeof(mode), "adapt %" PRIu32 " Hz", ctx.rate);
+    else
+        snprintf(mode, sizeof(mode), "%s", locked > 0 ? "bursts" : "idle");
+
+    ESP_LOGI(__func__, "POWER [%s] [window %" PRId64 " ms] [dfs %" PRIu32 "/%" PRIu32 " MHz] [light sleep %s]",
+             mode, window / 1000, ctx.max_mhz, ctx.min_mhz,
+             sleep_possible ? "on" : ctx.light_sleep ? "blocked" : "off");
+    for (unsigned lock = 0; lock < kPowerLastLock; ++lock) {
+        ESP_LOGI(__func__, "POWER [lock %s] [held %.1f %%]", lock_names[lock],
+                 100 * share(ctx.end.held[lock] - ctx.begin.held[lock], window));
+    }
+    for (unsigned core = 0; core < portNUM_PROCESSORS; ++core)
+        ESP_LOGI(__func__, "POWER [core %u] [idle %.1f %%]", core, 100 * idle[core]);
+    ESP_LOGI(__func__, "POWER [max %.1f %%] [min %.1f %%] [sleep %.1f %%] [estimate %.1f mA]",
+             100 * residency.max, 100 * residency.min, 100 * residency.sleep, current);
+    if (ctx.wakeups > 0) {
+        ESP_LOGI(__func__, "POWER [wakeups %" PRIu32 "] [late min %" PRId64 " us] [avg %" PRId64 " us] [max %" PRId64 " us]",
+                 ctx.wakeups, ctx.late_min, ctx.late_sum / ctx.wakeups, ctx.late_max);
+    }
+#if CONFIG_PM_PROFILING
+    esp_pm_dump_locks(stdout);
+#endif
+    ctx.ongoing = false;
+}
+
+static void report_job(void *arg) {
+    const int64_t period_us = (int64_t)REPORT_PERIOD * portTICK_PERIOD_MS * 1000;
+    const uint32_t samples = ctx.duration * configTICK_RATE_HZ / REPORT_PERIOD;
+
+    ctx.wakeups = 0;
+    ctx.late_min = INT64_MAX;
+    ctx.late_max = 0;
+    ctx.late_sum = 0;
+    ctx.rate = ADAPT_get_rate();
+
+    // align to a tick edge, lateness is then the wakeup path alone: tick, sleep exit, frequency switch
+    vTaskDelay(1);
+    TickType_t wake = xTaskGetTickCount();
+    snapshot(&ctx.begin);
+
+    for (uint32_t i = 1; i <= samples; ++i) {
+        vTaskDelayUntil(&wake, REPORT_PERIOD);
+        int64_t late = esp_timer_get_time() - (ctx.begin.time + i * period_us);
+        if (late < 0)
+            late = 0;
+
+        ctx.late_min = late < ctx.late_min ? late : ctx.late_min;
+        ctx.late_max = late > ctx.late_max ? late : ctx.late_max;
+        ctx.late_sum += late;
+        ctx.wakeups += 1;
+    }
+
+    snapshot(&ctx.end);
+    // float formatting on the report worker stack
+    if (WORKER_report(log_result, NULL) == false)
+        ctx.ongoing = false;
+}
+
+bool POWER_report(Seconds duration) {
+    if (ctx.ongoing || duration == 0)
+        return false;
+
+    ctx.ongoing = true;
+    ctx.duration = duration;
+    if (WORKER_session(report_job, NULL) == false) {
+        ctx.ongoing = false;
+        return false;
+    }
+    return true;
+}
+
+static void apply_config(const Config *config) {
+    ctx.max_mhz = config->power.max_mhz;
+    ctx.min_mhz = config->power.min_mhz;
+    ctx.light_sleep = config->power.light_sleep != 0;
+
+#if CONFIG_PM_ENABLE
+    esp_pm_config_t pm = {
+        .max_freq_mhz = ctx.max_mhz,
+        .min_freq_mhz = ctx.min_mhz,
+        .light_sleep_enable = ctx.light_sleep,
+    };
+    esp_err_t err = esp_pm_configure(&pm);
+    ctx.configured = err == ESP_OK;
+    if (ctx.configured == false)
+        ESP_LOGE(__func__, "Power management not configured: %s", esp_err_to_name(err));
+#endif
+}
+
+static int power_command_execution(int argc, char **argv) {
+    if (argc > 1 && AreStringsTheSame("report", argv[1], sizeof("report"))) {
+        // run it once per acquisition mode: idle, adc/ct duration, adapt, capture
+        char *value = argc > 2 ? argv[2] : NULL;
+        Seconds duration = value != NULL ? strtoul(value, NULL, 0) : 10;
+        ESP_LOGI(__func__, "POWER: %s", POWER_report(duration) ? "ongoing" : "errors occurs");
+        return 0;
+    }
+
+    ESP_LOGI(__func__, "POWER: [dfs %" PRIu32 "/%" PRIu32 " MHz] [light sleep %s] [pm %s]", ctx.max_mhz, ctx.min_mhz,
+             ctx.light_sleep ? "on" : "off", ctx.configured ? "configured" : "off");
+    return 0;
+}
+
+void POWER_init(void) {
+#if CONFIG_PM_ENABLE
+    for (unsigned lock = 0; lock < kPowerLastLock; ++lock) {
+        if (esp_pm_lock_create(lock_types[lock], 0, lock_names[lock], &ctx.handles[lock]) != ESP_OK) {
+            ESP_LOGE(__func__, "PM lock %s not created", lock_names[lock]);
+            ctx.handles[lock] = NULL;
+        }
+    }
+#endif
+    // console input wakes the chip from light sleep
+    uart_set_wakeup_threshold(CONFIG_ESP_CONSOLE_UART_NUM, CONSOLE_WAKEUP_EDGES);
+    esp_sleep_enable_uart_wakeup(CONFIG_ESP_CONSOLE_UART_NUM);
+
+    CONFIG_register_listener(apply_config);
+    CLI_register_command("power", "[report <seconds>]", power_command_execution);
+}
@@ -0,0 +1,27 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/base/types.h"
+
+// Locks are counted, every module takes and gives its own around a burst;
+// without a lock the chip scales down to power.min_mhz and light sleeps when idle.
+typedef enum {
+    kPowerCpu = 0,          // acquisition bursts, CPU at power.max_mhz
+    kPowerNoSleep,          // BLE streams, awake at any frequency
+    kPowerApb,              // PWM output, LEDC counts the APB clock
+    kPowerLastLock,
+} PowerLock;
+
+// right after CONFIG_init, power.* is applied by its listener
+void POWER_init(void);
+
+void POWER_lock(PowerLock lock);
+void POWER_unlock(PowerLock lock);
+
+// residency, estimated current and wakeup latency over the window, printed on the CLI
+bool POWER_report(Seconds duration);
+
+#endif // POWER_H
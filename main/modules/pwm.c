@@ -7,51 +7,57 @@
 #include "driver/gpio.h"
 #include "esp_log.h"
 
-#include "driver/ledc.h"
-
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include <freertos/timers.h>
 
 #include "modules/base/generic_fun.h"
+#include "modules/adapt.h"
 #include "modules/cli.h"
 #include "modules/ble.h"
+#include "modules/config.h"
+#include "modules/capture.h"
+#include "modules/power.h"
+#include "modules/trace.h"
+#include "modules/core/pwm_core.h"
+#include "modules/hal/hal_pwm.h"
 
 
 static struct {
     Herz freq;
+    Percent duty;           // last applied, 0 once stopped
 
     bool ongoing;
+    bool clock_locked;      // LEDC counts the APB clock, DFS would shift the output frequency
     TimerHandle_t timer_duration;
+    StaticTimer_t timer_buffer;
 
-    unsigned speed_mode;
-    unsigned timer_num;
     unsigned timer_resolution;
-    unsigned channel;
     unsigned pin;
 } ctx = {
     .freq               = 1000,
-    .speed_mode         = LEDC_HIGH_SPEED_MODE,
-    .timer_num          = LEDC_TIMER_0,
-    .timer_resolution   = LEDC_TIMER_13_BIT,
-    .channel            = LEDC_CHANNEL_0,
-    // .pin                = GPIO_NUM_27,
-    .pin                = GPIO_NUM_33,
+    .timer_resolution   = 13,
 };
 
 // pwm duration 1000 duty 90 freq 10
 
 static unsigned GetDutyResolutionFromPercent(Percent duty) {
-    if (duty > 100) {
+    if (duty > 100)
         ESP_LOGW(__func__, "Duty out of range. Readjusted.");
-        duty = 100;
-    }
 
-    return ((1 << ctx.timer_resolution) - 1) * duty / 100;
+    return PWM_CORE_duty_from_percent(duty, ctx.timer_resolution);
+}
+
+static void HoldClock(bool active) {
+    if (active && ctx.clock_locked == false)
+        POWER_lock(kPowerApb);
+    else if (active == false && ctx.clock_locked)
+        POWER_unlock(kPowerApb);
+    ctx.clock_locked = active;
 }
 
 static void StopTimer(void) {
-    xTimerDelete(ctx.timer_duration, 0);
+    xTimerStop(ctx.timer_duration, 0);
     ctx.ongoing = false;
 }
 
@@ -131,54 +137,31 @@ static int update_command_execution(int argc, char **argv) {
     return 0;
 }
 
-// static void getValuesFromString(char *buffer, ) {
-
-// }
-
 static void parse_ble_command(char *buffer, unsigned length) {
-    unsigned values[4] = { 0 };
-    unsigned i = 0;
-    char *end = buffer;
-    while(*end) {
-        values[i] = strtoul(buffer, &end, 10);
-        while (*end == ',')
-            end++;
-        
-        buffer = end;
-        ++i;
-    }
+    PwmCommand command;
+    if (PWM_CORE_parse_ble_command(buffer, &command) == false)
+        return;
 
-    if (values[0] != 0) {    // force
+    if (command.force) {
         PWM_stop();
         StopTimer();
     }
 
-    if (values[1] != 0) {
-        ctx.freq = values[3]; 
-        PWM_trigger_for(values[1], values[2], ctx.freq);
+    if (command.duration != 0) {
+        PWM_trigger_for(command.duration, command.freq, command.duty);
     }
 }
 
 bool PWM_init(void) {
-    ledc_timer_config_t pwm_timer = {
-        .speed_mode = ctx.speed_mode,
-        .duty_resolution = ctx.timer_resolution,
-        .timer_num = ctx.timer_num,
-        .freq_hz = ctx.freq,
-    };
-    bool ret = (ESP_OK == ledc_timer_config(&pwm_timer));
-
-    ledc_channel_config_t pwm_channel = {
-        .gpio_num = ctx.pin,
-        .speed_mode = ctx.speed_mode,
-        .channel = ctx.channel,
-        .intr_type = LEDC_INTR_DISABLE,
-        .timer_sel = ctx.timer_num,
-        .duty = 0,   // Initial duty cycle (0 to 2^PWM_LEDC_TIMER_BIT - 1)
-        .hpoint = 0,
-    };
-
-    ret = ret && (ESP_OK == ledc_channel_config(&pwm_channel));
+    ctx.pin = CONFIG_get()->pwm.pin;
+    bool ret = HAL_PWM_init(ctx.pin, ctx.freq, ctx.timer_resolution);
+    // one timer for the whole uptime, every trigger only changes its period
+    ctx.timer_duration = xTimerCreateStatic("PWMTimer",
+                            1,                      // Timer period in ticks, set by every trigger
+                            pdFALSE,                // Auto-reload
+                            0,                      // Timer ID (not used here)
+                            timer_callback,         // Callback function
+                            &ctx.timer_buffer);
     if (ret) {
         CLI_register_command("pwm", "[force] [duration <time>] [duty <duty>] [freq <frequency>]", pwm_command_execution);
         CLI_register_command("pwm-update", "[duty <duty>] [freq <frequency>]", update_command_execution);
@@ -187,34 +170,50 @@ bool PWM_init(void) {
     return ret;
 }
 
-bool PWM_trigger_for(Seconds duration, Percent duty, Herz freq) {
+bool PWM_trigger_for(Seconds duration, Herz freq, Percent duty) {
     ctx.ongoing = true;
-    ctx.timer_duration = xTimerCreate("PWMTimer",
-                            pdMS_TO_TICKS(1000 * duration),  // Timer period in milliseconds
-                            pdFALSE,                // Auto-reload
-                            0,                      // Timer ID (not used here)
-                            timer_callback);        // Callback function
-
-    if (ctx.timer_duration == NULL)
-        ESP_LOGW(__func__, "Creating timer for PWM failed. Stop PWM manually!");
-
-    if (xTimerStart(ctx.timer_duration, 0) != pdPASS)
+    // changing the period starts the timer as well
+    if (xTimerChangePeriod(ctx.timer_duration, pdMS_TO_TICKS(1000 * duration), 0) != pdPASS)
         ESP_LOGW(__func__, "Starting timer for PWM failed. Stop PWM manually!");
 
-    return ESP_OK == ledc_set_freq(ctx.speed_mode, ctx.timer_num, freq)
-        && ESP_OK == ledc_set_duty(ctx.speed_mode, ctx.channel, GetDutyResolutionFromPercent(duty))
-        && ESP_OK == ledc_update_duty(ctx.speed_mode, ctx.channel);
+    HoldClock(duty != 0);
+    bool ret = HAL_PWM_set_freq(freq) && HAL_PWM_set_duty(GetDutyResolutionFromPercent(duty));
+    ctx.freq = freq;
+    ctx.duty = duty;
+    TRACE_event(kTracePwmUpdate, duty);
+    CAPTURE_notify_event(kCaptureEventPwm);
+    ADAPT_notify_command();
+    return ret;
 }
 
 bool PWM_set_duty(Percent duty) {
-    return ESP_OK == ledc_set_duty(ctx.speed_mode, ctx.channel, GetDutyResolutionFromPercent(duty))
-        && ESP_OK == ledc_update_duty(ctx.speed_mode, ctx.channel);
+    HoldClock(duty != 0);
+    bool ret = HAL_PWM_set_duty(GetDutyResolutionFromPercent(duty));
+    ctx.duty = duty;
+    TRACE_event(kTracePwmUpdate, duty);
+    CAPTURE_notify_event(kCaptureEventPwm);
+    ADAPT_notify_command();
+    return ret;
 }
 
 bool PWM_set_freq(Herz freq) {
-    return ESP_OK == ledc_set_freq(ctx.speed_mode, ctx.timer_num, freq);
+    ctx.freq = freq;
+    return HAL_PWM_set_freq(freq);
 }
 
 bool PWM_stop(void) {
-    return ESP_OK == ledc_stop(ctx.speed_mode, ctx.channel, 0);
+    TRACE_event(kTracePwmUpdate, 0);
+    ADAPT_notify_command();
+    ctx.duty = 0;
+    bool ret = HAL_PWM_stop();
+    HoldClock(false);
+    return ret;
+}
+
+bool PWM_is_active(void) {
+    return ctx.duty != 0;
+}
+
+Herz PWM_get_freq(void) {
+    return PWM_is_active() ? ctx.freq : 0;
 }
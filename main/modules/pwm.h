@@ -14,4 +14,9 @@ bool PWM_set_freq(Herz freq);
 
 bool PWM_stop(void);
 
+// output is driven with a non-zero duty
+bool PWM_is_active(void);
+// frequency of the driven output, 0 while stopped
+Herz PWM_get_freq(void);
+
 #endif // PWM_H
\ No newline at end of file
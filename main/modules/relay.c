@@ -4,26 +4,34 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#include "driver/gpio.h"
 #include "esp_log.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
 #include "modules/base/generic_fun.h"
+#include "modules/adapt.h"
 #include "modules/cli.h"
 #include "modules/ble.h"
+#include "modules/config.h"
+#include "modules/relay_seq.h"
+#include "modules/capture.h"
+#include "modules/trace.h"
 
 
 static struct {
-    bool last_state;
+    RelayBank bank;
+    ConfigPins stored;      // last applied stored list, 'relay pins' changes stay until it changes
+    portMUX_TYPE lock;      // CLI, BLE and the relay sequence update the state
 } ctx = {
-    .last_state     = 0
+    .bank = {
+        .state  = 0,
+    },
+    .lock = portMUX_INITIALIZER_UNLOCKED,
 };
 
 static bool FoundArgument(int argc, char **argv, const char *arg) {
     for (int i = 1; i < argc; i++) {
-        ESP_LOGI("arg", "arg: %s %s %s", argv[i], arg, AreStringsTheSame(arg, argv[i], strlen(arg)) ? "same" : "not");
         if (AreStringsTheSame(arg, argv[i], strlen(arg)) == false)
             continue;
 
@@ -32,6 +40,18 @@ static bool FoundArgument(int argc, char **argv, const char *arg) {
     return false;
 }
 
+static char *FindArgumentValue(int argc, char **argv, const char *arg, int offset) {
+    for (int i = 1; i < argc - offset; i++) {
+        if (AreStringsTheSame(arg, argv[i], strlen(arg) + 1))
+            return argv[i + offset];
+    }
+    return NULL;
+}
+
+static void log_state(const char *func) {
+    ESP_LOGI(func, "RELAY: 0x%04X [%s]", ctx.bank.state, ctx.bank.state & 1 ? "on" : "off");
+}
+
 static const char state_on[] = "on";
 static const char state_off[] = "off";
 static int relay_command_execution(int argc, char **argv) {
@@ -40,74 +60,130 @@ static int relay_command_execution(int argc, char **argv) {
         return 0;
     }
 
-    if (FoundArgument(argc, argv, state_on)){
-        RELAY_set_state(true);
-        ctx.last_state = true;
+    char *value = FindArgumentValue(argc, argv, "pins", 1);
+    if (value != NULL) {
+        int pins[RELAY_MAX_OUTPUTS];
+        unsigned count = RELAY_CORE_parse_pins(value, pins, RELAY_MAX_OUTPUTS);
+        if (count == 0 || RELAY_configure(pins, count) == false)
+            ESP_LOGW(__func__, "Invalid pins: %s", value);
     }
 
-    if (FoundArgument(argc, argv, state_off)){
+    if (FoundArgument(argc, argv, state_on))
+        RELAY_set_state(true);
+
+    if (FoundArgument(argc, argv, state_off))
         RELAY_set_state(false);
-        ctx.last_state = false;
-    }
 
-    ESP_LOGI(__func__, "RELAY: %s", ctx.last_state ? "on" : "off");
+    value = FindArgumentValue(argc, argv, "bits", 1);
+    if (value != NULL)
+        RELAY_set_mask(RELAY_CORE_all_outputs(&ctx.bank), strtoul(value, NULL, 0));
+
+    char *mask = FindArgumentValue(argc, argv, "mask", 1);
+    value = FindArgumentValue(argc, argv, "mask", 2);
+    if (mask != NULL && value != NULL && RELAY_set_mask(strtoul(mask, NULL, 0), strtoul(value, NULL, 0)) == false)
+        ESP_LOGW(__func__, "Mask outside of %u outputs: %s", ctx.bank.count, mask);
+
+    log_state(__func__);
     return 0;
 }
 
+// "on" | "off" | "<0|1>" | "mask,<mask>,<bits>" | "seq,..."
 static void parse_ble_command(char *buffer, unsigned length) {
     if (length == 0)
         return;
 
-    if (AreStringsTheSame(state_off, buffer, strlen(state_off)) == true) {
-        RELAY_set_state(false);
-        ctx.last_state = false;
+    if (AreStringsTheSame(RELAY_SEQ_BLE_PREFIX, buffer, strlen(RELAY_SEQ_BLE_PREFIX)) == true) {
+        RELAY_SEQ_parse_ble_command(buffer, length);
+        return;
     }
 
-    if (AreStringsTheSame(state_on, buffer, strlen(state_on)) == true) {
-        RELAY_set_state(true);
-        ctx.last_state = true;
+    static const char mask[] = "mask";
+    if (AreStringsTheSame(mask, buffer, strlen(mask)) == true) {
+        unsigned values[2] = { 0 };
+        if (ParseUnsignedList(buffer + strlen(mask), values, 2, 0) == 2)
+            RELAY_set_mask(values[0], values[1]);
+        log_state(__func__);
+        return;
+    }
+
+    bool state;
+    if (AreStringsTheSame(state_off, buffer, strlen(state_off)) == true) {
+        state = false;
+    } else if (AreStringsTheSame(state_on, buffer, strlen(state_on)) == true) {
+        state = true;
+    } else {
+        state = strtoul(buffer, NULL, 0) != 0;
     }
 
-    unsigned value = strtoul(buffer, buffer + length, 0);
-    RELAY_set_state(value);
-    ctx.last_state = value;
-    ESP_LOGI(__func__, "RELAY: %s", ctx.last_state ? "on" : "off");
+    RELAY_set_state(state);
+    log_state(__func__);
+}
+
+bool RELAY_set_mask(RelayMask mask, RelayMask values) {
+    taskENTER_CRITICAL(&ctx.lock);
+    bool valid = RELAY_CORE_set_mask(&ctx.bank, mask, values);
+    RelayMask state = ctx.bank.state;
+    taskEXIT_CRITICAL(&ctx.lock);
+    if (valid == false)
+        return false;
+
+    TRACE_event(kTraceRelayUpdate, state);
+    CAPTURE_notify_event(kCaptureEventRelay);
+    ADAPT_notify_command();
+    return true;
 }
 
 bool RELAY_set_state(bool state) {
-    esp_err_t err = gpio_set_level(GPIO_NUM_14, state);
-    if (err != ESP_OK) {
-        ESP_LOGW(__func__, "Problem with pin: %s", esp_err_to_name(err));
+    return RELAY_set_mask(1, state ? 1 : 0);
+}
+
+RelayMask RELAY_get_state(void) {
+    return ctx.bank.state;
+}
+
+unsigned RELAY_get_count(void) {
+    return ctx.bank.count;
+}
+
+RelayMask RELAY_get_outputs(void) {
+    return RELAY_CORE_all_outputs(&ctx.bank);
+}
+
+bool RELAY_configure(const int *pins, unsigned count) {
+    // GPIO setup can't run in a critical section, the new bank is built aside
+    // and swapped in with the old outputs released under the lock
+    RelayBank bank = { 0 };
+    if (RELAY_CORE_configure(&bank, pins, count) == false) {
+        ESP_LOGW(__func__, "Pins can't be used in relay bank");
         return false;
     }
 
+    taskENTER_CRITICAL(&ctx.lock);
+    RELAY_CORE_set_mask(&ctx.bank, RELAY_CORE_all_outputs(&ctx.bank), 0);
+    ctx.bank = bank;
+    taskEXIT_CRITICAL(&ctx.lock);
     return true;
 }
 
-// #define GPIO_OUTPUT_IO_0    CONFIG_GPIO_OUTPUT_0
-// #define GPIO_OUTPUT_IO_1    CONFIG_GPIO_OUTPUT_1
-// #define GPIO_OUTPUT_PIN_SEL  ((1ULL<<GPIO_OUTPUT_IO_0) | (1ULL<<GPIO_OUTPUT_IO_1))
+static void apply_config(const Config *config) {
+    int pins[RELAY_MAX_OUTPUTS];
+    for (unsigned i = 0; i < config->relay.count; ++i)
+        pins[i] = config->relay.pins[i];
+
+    if (memcmp(&ctx.stored, &config->relay, sizeof(ctx.stored)) == 0)
+        return;
+
+    ctx.stored = config->relay;
+    RELAY_configure(pins, config->relay.count);
+}
 
 bool RELAY_init(void) {
-    gpio_config_t io_conf = { 0 };
-
-    io_conf.pin_bit_mask    = (1ULL << GPIO_NUM_14),
-    io_conf.intr_type       = GPIO_INTR_DISABLE;
-    io_conf.mode            = GPIO_MODE_OUTPUT;
-    io_conf.pull_down_en    = GPIO_PULLDOWN_DISABLE;
-    io_conf.pull_up_en      = GPIO_PULLUP_DISABLE;
-    
-    esp_err_t err = gpio_config(&io_conf);
-
-    if (err != ESP_OK) {
-        ESP_LOGW(__func__, "Problem with initialization: %s", esp_err_to_name(err));
+    CONFIG_register_listener(apply_config);
+    if (ctx.bank.count == 0)
         return false;
-    }
-
 
-    CLI_register_command("relay", "[on] [off]", relay_command_execution);
+    CLI_register_command("relay", "[on] [off] [bits <bits>] [mask <mask> <bits>] [pins <gpio>,...]", relay_command_execution);
     BLE_setup_characteristic_callback(kRelay, parse_ble_command);
-    RELAY_set_state(false);
     return true;
 }
 
@@ -1,10 +1,19 @@
 #ifndef RELAY_H
 #define RELAY_H
 
+#include <stdint.h>
 #include <stdbool.h>
 
+#include "modules/core/relay_core.h"
+
 bool RELAY_init(void);
+bool RELAY_configure(const int *pins, unsigned count);
 
 bool RELAY_set_state(bool state);
+// false for mask bits outside the configured outputs
+bool RELAY_set_mask(RelayMask mask, RelayMask values);
+RelayMask RELAY_get_state(void);
+unsigned RELAY_get_count(void);
+RelayMask RELAY_get_outputs(void);
 
-#endif // RELAY_H
\ No newline at end of file
+#endif // RELAY_H
@@ -0,0 +1,243 @@
+#include "modules/relay_seq.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "modules/base/generic_fun.h"
+#include "modules/cli.h"
+#include "modules/adc.h"
+#include "modules/power.h"
+#include "modules/relay.h"
+#include "modules/worker.h"
+#include "modules/hal/hal_time.h"
+
+typedef struct {
+    unsigned count;
+    unsigned timeouts;
+    unsigned bounces;
+    Microseconds min;
+    Microseconds max;
+    uint64_t sum;
+} ActuationStats;
+
+static struct {
+    RelaySeqStep steps[RELAY_SEQ_MAX_STEPS];
+    unsigned count;
+    unsigned repeat;
+
+    RelaySeqDetect detect;
+
+    portMUX_TYPE lock;          // CLI and BLE start sequences from different tasks
+    bool ongoing;
+    ActuationStats stats[2];    // [0] break, [1] make
+} ctx = {
+    .detect = {
+        .threshold  = 6000,
+        .window     = 20000,
+        .stable     = 2000,
+    },
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+WORKER_DEFINE(worker, "relay_seq", TASK_STACK_SIZE, TASK_PRIORITY_RELAY_SEQ, TASK_CORE_ACQUISITION);
+BUDGET_CHECK(sizeof(ctx) + WORKER_FOOTPRINT(TASK_STACK_SIZE), BUDGET_RELAY_SEQ);
+
+// relay-seq pattern 1:50000,0:50000 repeat 10 threshold 6000
+
+static char *FindArgumentValue(int argc, char **argv, const char *arg) {
+    for (int i = 1; i < argc - 1; i++) {
+        if (AreStringsTheSame(arg, argv[i], strlen(arg) + 1))
+            return argv[i + 1];
+    }
+    return NULL;
+}
+
+static void measure_actuation(int64_t command_time, RelayActuation *result) {
+    ContactTracker tracker;
+    RELAY_CORE_contact_start(&tracker, result, command_time);
+
+    int64_t now = command_time;
+    while (now - command_time < ctx.detect.window) {
+        bool sample = ADC_read_single() > ctx.detect.threshold;
+        now = esp_timer_get_time();
+
+        if (RELAY_CORE_contact_update(&tracker, result, sample, now, ctx.detect.stable))
+            break;
+    }
+}
+
+static void update_stats(const RelayActuation *act) {
+    ActuationStats *stats = &ctx.stats[act->state ? 1 : 0];
+    if (act->timeout) {
+        stats->timeouts += 1;
+        return;
+    }
+
+    if (stats->count == 0 || act->actuation < stats->min)
+        stats->min = act->actuation;
+    if (act->actuation > stats->max)
+        stats->max = act->actuation;
+
+    stats->sum += act->actuation;
+    stats->bounces += act->bounces;
+    stats->count += 1;
+}
+
+static void log_stats(const char *name, const ActuationStats *stats) {
+    if (stats->count == 0) {
+        ESP_LOGI(__func__, "RELAY SEQ %s: no valid actuations [timeouts %u]", name, stats->timeouts);
+        return;
+    }
+
+    ESP_LOGI(__func__, "RELAY SEQ %s: [avg %" PRIu64 " us] [min %" PRIu32 " us] [max %" PRIu32 " us] [bounces %u] [timeouts %u]",
+             name, stats->sum / stats->count, stats->min, stats->max, stats->bounces, stats->timeouts);
+}
+
+static void run_sequence(void *arg) {
+    memset(ctx.stats, 0, sizeof(ctx.stats));
+    // contact timing is measured against esp_timer, the lock keeps the polling rate fixed
+    POWER_lock(kPowerCpu);
+    int64_t deadline = esp_timer_get_time();
+
+    for (unsigned r = 0; r < ctx.repeat; ++r) {
+        for (unsigned i = 0; i < ctx.count; ++i) {
+            RelayActuation act = { .state = ctx.steps[i].state };
+
+            int64_t command_time = HAL_TIME_wait_until(deadline);
+            RELAY_set_state(act.state);
+            act.lateness = command_time - deadline;
+
+            measure_actuation(command_time, &act);
+            update_stats(&act);
+            ESP_LOGI(__func__, "RELAY SEQ [%u.%u] %s: [actuation %" PRIu32 " us] [settle %" PRIu32 " us] [bounces %u] [late %" PRIu32 " us]%s",
+                     r, i, act.state ? "make" : "break", act.actuation, act.settle, act.bounces, act.lateness,
+                     act.timeout ? " timeout" : "");
+
+            deadline += ctx.steps[i].hold;
+        }
+    }
+
+    POWER_unlock(kPowerCpu);
+
+    log_stats("make", &ctx.stats[1]);
+    log_stats("break", &ctx.stats[0]);
+    ctx.ongoing = false;
+}
+
+static int relay_seq_command_execution(int argc, char **argv) {
+    if (argc == 1) {
+        ESP_LOGI(__func__, "No arguments");
+        return 0;
+    }
+
+    RelaySeqDetect detect = ctx.detect;
+    char *value = FindArgumentValue(argc, argv, "threshold");
+    if (value != NULL)
+        detect.threshold = atoi(value);
+
+    value = FindArgumentValue(argc, argv, "window");
+    if (value != NULL)
+        detect.window = strtoul(value, NULL, 10);
+
+    value = FindArgumentValue(argc, argv, "stable");
+    if (value != NULL)
+        detect.stable = strtoul(value, NULL, 10);
+
+    unsigned repeat = 1;
+    value = FindArgumentValue(argc, argv, "repeat");
+    if (value != NULL)
+        repeat = strtoul(value, NULL, 10);
+
+    value = FindArgumentValue(argc, argv, "pattern");
+    if (value == NULL) {
+        ESP_LOGW(__func__, "Missing pattern");
+        return 0;
+    }
+
+    RelaySeqStep steps[RELAY_SEQ_MAX_STEPS];
+    unsigned count = RELAY_CORE_parse_pattern(value, steps, RELAY_SEQ_MAX_STEPS);
+    if (count == 0) {
+        ESP_LOGW(__func__, "Invalid pattern: %s", value);
+        return 0;
+    }
+
+    ESP_LOGI(__func__, "RELAY SEQ: %s", RELAY_SEQ_start(steps, count, repeat, &detect) ? "ongoing" : "errors occurs");
+    return 0;
+}
+
+// seq,<on us>,<off us>,<repeat>[,<threshold mV>]
+void RELAY_SEQ_parse_ble_command(char *buffer, unsigned length) {
+    unsigned values[4] = { 0 };
+    unsigned i = ParseUnsignedList(buffer + strlen(RELAY_SEQ_BLE_PREFIX), values, 4, 10);
+    if (i < 3) {
+        ESP_LOGW(__func__, "Invalid sequence command");
+        return;
+    }
+
+    RelaySeqDetect detect = ctx.detect;
+    if (i == 4)
+        detect.threshold = values[3];
+
+    RelaySeqStep steps[] = {
+        { .state = true,  .hold = values[0] },
+        { .state = false, .hold = values[1] },
+    };
+    if (RELAY_SEQ_start(steps, 2, values[2], &detect) == false)
+        ESP_LOGW(__func__, "Sequence not started");
+}
+
+void RELAY_SEQ_init(void) {
+    CLI_register_command("relay-seq",
+                         "[pattern <state:us>,...] [repeat <n>] [threshold <mV>] [window <us>] [stable <us>]",
+                         relay_seq_command_execution);
+    WORKER_start(&worker);
+}
+
+static bool detect_valid(const RelaySeqDetect *detect) {
+    return detect->threshold > 0 && detect->window > 0 && detect->stable > 0 && detect->stable <= detect->window;
+}
+
+bool RELAY_SEQ_start(const RelaySeqStep *steps, unsigned count, unsigned repeat, const RelaySeqDetect *detect) {
+    if (count == 0 || count > RELAY_SEQ_MAX_STEPS || repeat == 0)
+        return false;
+
+    if (detect != NULL && detect_valid(detect) == false) {
+        ESP_LOGW(__func__, "Invalid detection: [threshold %d mV] [window %" PRIu32 " us] [stable %" PRIu32 " us]",
+                 detect->threshold, detect->window, detect->stable);
+        return false;
+    }
+
+    // the running sequence reads steps and detection without the lock, claim it first
+    taskENTER_CRITICAL(&ctx.lock);
+    bool busy = ctx.ongoing;
+    ctx.ongoing = true;
+    taskEXIT_CRITICAL(&ctx.lock);
+    if (busy) {
+        ESP_LOGW(__func__, "Sequence already ongoing");
+        return false;
+    }
+
+    memcpy(ctx.steps, steps, count * sizeof(*steps));
+    ctx.count = count;
+    ctx.repeat = repeat;
+    if (detect != NULL)
+        ctx.detect = *detect;
+
+    if (WORKER_submit(&worker, run_sequence, NULL) == false) {
+        ctx.ongoing = false;
+        return false;
+    }
+    return true;
+}
+
+bool RELAY_SEQ_is_running(void) {
+    return ctx.ongoing;
+}
@@ -0,0 +1,30 @@
+#ifndef RELAY_SEQ_H
+#define RELAY_SEQ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/base/types.h"
+#include "modules/core/relay_core.h"
+
+#define RELAY_SEQ_MAX_STEPS 16
+#define RELAY_SEQ_BLE_PREFIX "seq"
+
+// contact detection on the ADC, above threshold is closed, a level held for
+// stable us ends the measurement, window us without it is a timeout
+typedef struct {
+    Millivolt threshold;
+    Microseconds window;
+    Microseconds stable;
+} RelaySeqDetect;
+
+void RELAY_SEQ_init(void);
+
+// detect NULL keeps the current settings, nothing is changed when a sequence
+// is ongoing or an argument is invalid
+bool RELAY_SEQ_start(const RelaySeqStep *steps, unsigned count, unsigned repeat, const RelaySeqDetect *detect);
+bool RELAY_SEQ_is_running(void);
+
+void RELAY_SEQ_parse_ble_command(char *buffer, unsigned length);
+
+#endif // RELAY_SEQ_H
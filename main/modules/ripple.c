@@ -0,0 +1,254 @@
+#include "modules/ripple.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "modules/base/generic_fun.h"
+#include "modules/cli.h"
+#include "modules/ble.h"
+#include "modules/capture.h"
+#include "modules/ct.h"
+#include "modules/pwm.h"
+#include "modules/worker.h"
+
+// ripple
+// ripple freq 1000 harmonics 10 rate 20000 samples 512
+
+#define CAPTURE_TIMEOUT_MS 1000
+#define COPY_FRAMES 32
+
+typedef void (*ReportLine)(const char *line, void *arg);
+
+static struct {
+    RippleSettings settings;
+    float data[RIPPLE_MAX_SAMPLES];
+    bool reply_ble;
+    volatile bool ongoing;
+} ctx = {
+    .settings = {
+        .rate       = CAPTURE_MAX_RATE,
+        .samples    = RIPPLE_MAX_SAMPLES,
+        .harmonics  = SPECTRUM_MAX_HARMONICS,
+        .frequency  = 0,
+    },
+};
+
+BUDGET_CHECK(sizeof(ctx), BUDGET_RIPPLE);
+
+static char *FindArgumentValue(int argc, char **argv, const char *arg) {
+    for (int i = 1; i < argc - 1; i++) {
+        if (AreStringsTheSame(arg, argv[i], strlen(arg) + 1))
+            return argv[i + 1];
+    }
+    return NULL;
+}
+
+static bool acquire(void) {
+    CaptureConfig config = {
+        .trigger    = kCaptureTriggerNow,
+        .channel    = 1,
+        .rate       = ctx.settings.rate,
+        .depth      = ctx.settings.samples,
+        .pre        = 0,
+        .timeout    = 1000,
+    };
+    if (CAPTURE_arm(&config) == false)
+        return false;
+
+    for (unsigned waited = 0; CAPTURE_get_state() != kCaptureDone; waited += 10) {
+        if (waited >= CAPTURE_TIMEOUT_MS) {
+            CAPTURE_abort();
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    // the FFT and Goertzel bins assume evenly spaced samples
+    CaptureHeader header;
+    CAPTURE_get_header(&header);
+    if (header.overruns != 0) {
+        ESP_LOGW(__func__, "RIPPLE: %" PRIu32 " capture overruns, lower the rate", header.overruns);
+        return false;
+    }
+
+    uint16_t frames[COPY_FRAMES * CAPTURE_CHANNELS];
+    for (unsigned first = 0; first < ctx.settings.samples; first += COPY_FRAMES) {
+        unsigned count = CAPTURE_copy_frames(first, frames, COPY_FRAMES);
+        if (count == 0)
+            return false;
+        for (unsigned i = 0; i < count; ++i)
+            ctx.data[first + i] = frames[i * CAPTURE_CHANNELS + 1];
+    }
+    return true;
+}
+
+static void analyse(ReportLine emit, void *arg) {
+    char line[64];
+    const unsigned n = ctx.settings.samples;
+    const float rate = ctx.settings.rate;
+
+    float mean = 0;
+    for (unsigned i = 0; i < n; ++i)
+        mean += ctx.data[i];
+    mean /= n;
+
+    float squares = 0;
+    float low = ctx.data[0];
+    float high = ctx.data[0];
+    for (unsigned i = 0; i < n; ++i) {
+        low = ctx.data[i] < low ? ctx.data[i] : low;
+        high = ctx.data[i] > high ? ctx.data[i] : high;
+        ctx.data[i] -= mean;
+        squares += ctx.data[i] * ctx.data[i];
+    }
+
+    // amplitudes are small against the operating point, one local slope converts them all
+    Amper dc = 0;
+    Amper next = 0;
+    CT_counts_to_current(mean, &dc);
+    CT_counts_to_current(mean + 1, &next);
+    const float scale = fabsf(next - dc);
+
+    snprintf(line, sizeof(line), "ripple,%.4f,%.4f,%.4f", dc, sqrtf(squares / n) * scale, (high - low) * scale);
+    emit(line, arg);
+
+    float window_sum = SPECTRUM_CORE_window(ctx.data, n);
+
+    // Goertzel needs the windowed samples, the FFT below overwrites them
+    SpectrumHarmonics harmonics = { 0 };
+    float fundamental = ctx.settings.frequency != 0 ? ctx.settings.frequency : PWM_get_freq();
+    if (fundamental != 0)
+        SPECTRUM_CORE_harmonics(ctx.data, n, window_sum, fundamental / rate, ctx.settings.harmonics, &harmonics);
+
+    SPECTRUM_CORE_rfft(ctx.data, n);
+    unsigned peak = 1;
+    float peak_value = 0;
+    for (unsigned bin = 1; bin <= n / 2; ++bin) {
+        float value = SPECTRUM_CORE_rfft_bin(ctx.data, n, bin);
+        if (value > peak_value) {
+            peak = bin;
+            peak_value = value;
+        }
+    }
+    snprintf(line, sizeof(line), "peak,%.1f,%.4f", peak * rate / n, 2 * peak_value / window_sum * scale);
+    emit(line, arg);
+
+    // nothing to lock to, the strongest component is the fundamental
+    if (fundamental == 0) {
+        SPECTRUM_CORE_harmonics_fft(ctx.data, n, window_sum, peak, ctx.settings.harmonics, &harmonics);
+        fundamental = peak * rate / n;
+    }
+
+    for (unsigned h = 0; h < harmonics.count; ++h) {
+        snprintf(line, sizeof(line), "harmonic,%u,%.1f,%.4f", h + 1, (h + 1) * fundamental, harmonics.amplitudes[h] * scale);
+        emit(line, arg);
+    }
+    if (harmonics.count > 0) {
+        snprintf(line, sizeof(line), "thd,%.2f", harmonics.thd * 100);
+        emit(line, arg);
+    }
+}
+
+static void log_line(const char *line, void *arg) {
+    ESP_LOGI("ripple", "RIPPLE %s", line);
+}
+
+static void notify_line(const char *line, void *arg) {
+    BLE_stream_raw(kRipple, (const uint8_t *)line, strlen(line));
+}
+
+static void run(void *arg) {
+    ReportLine emit = ctx.reply_ble ? notify_line : log_line;
+    if (acquire())
+        analyse(emit, NULL);
+    else
+        emit("error,capture", NULL);
+
+    if (ctx.reply_ble)
+        BLE_stream_raw(kRipple, (const uint8_t *)"end", 3);
+    ctx.ongoing = false;
+}
+
+static bool start(const RippleSettings *settings, bool reply_ble) {
+    if (ctx.ongoing)
+        return false;
+
+    const unsigned n = settings->samples;
+    if (n < 4 || n > RIPPLE_MAX_SAMPLES || (n & (n - 1)) != 0)
+        return false;
+    if (settings->rate == 0 || settings->rate > CAPTURE_MAX_RATE)
+        return false;
+
+    if (CT_has_zero() == false) {
+        ESP_LOGW(__func__, "No CT zero yet, run 'ct zero now' with the outputs off");
+        return false;
+    }
+
+    ctx.settings = *settings;
+    ctx.reply_ble = reply_ble;
+    ctx.ongoing = true;
+    if (WORKER_session(run, NULL) == false) {
+        ctx.ongoing = false;
+        return false;
+    }
+    return true;
+}
+
+bool RIPPLE_start(const RippleSettings *settings) {
+    return start(settings, false);
+}
+
+static int ripple_command_execution(int argc, char **argv) {
+    RippleSettings settings = ctx.settings;
+    settings.frequency = 0;
+
+    char *value = FindArgumentValue(argc, argv, "freq");
+    if (value != NULL)
+        settings.frequency = strtoul(value, NULL, 10);
+
+    value = FindArgumentValue(argc, argv, "harmonics");
+    if (value != NULL)
+        settings.harmonics = strtoul(value, NULL, 10);
+
+    value = FindArgumentValue(argc, argv, "rate");
+    if (value != NULL)
+        settings.rate = strtoul(value, NULL, 10);
+
+    value = FindArgumentValue(argc, argv, "samples");
+    if (value != NULL)
+        settings.samples = strtoul(value, NULL, 10);
+
+    if (start(&settings, false) == false)
+        ESP_LOGI(__func__, "RIPPLE: errors occurs");
+    return 0;
+}
+
+// "[<fundamental Hz>[,<harmonics>]]", 0 or nothing follows the PWM, answered with
+// ripple,<dc A>,<rms A>,<peak to peak A>
+// peak,<Hz>,<A>                  largest FFT bin
+// harmonic,<n>,<Hz>,<A>          n = 1 is the fundamental
+// thd,<percent>
+// end
+static void parse_ble_command(char *buffer, unsigned length) {
+    RippleSettings settings = ctx.settings;
+    unsigned values[2] = { 0, settings.harmonics };
+    ParseUnsignedList(buffer, values, 2, 10);
+    settings.frequency = values[0];
+    settings.harmonics = values[1];
+
+    if (start(&settings, true) == false)
+        BLE_notify_raw(kRipple, (const uint8_t *)"error", strlen("error"));
+}
+
+void RIPPLE_init(void) {
+    CLI_register_command("ripple", "[freq <Hz>] [harmonics <n>] [rate <Hz>] [samples <n>]", ripple_command_execution);
+    BLE_setup_characteristic_callback(kRipple, parse_ble_command);
+}
@@ -0,0 +1,24 @@
+#ifndef RIPPLE_H
+#define RIPPLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/base/types.h"
+#include "modules/core/spectrum_core.h"
+
+#define RIPPLE_MAX_SAMPLES 512      // float copy of the capture, FFT in place
+
+typedef struct {
+    Herz rate;                  // capture rate
+    unsigned samples;           // power of two up to RIPPLE_MAX_SAMPLES
+    unsigned harmonics;
+    Herz frequency;             // fundamental, 0 follows the PWM or the FFT peak
+} RippleSettings;
+
+void RIPPLE_init(void);
+
+// captures the CT channel and reports DC, ripple, harmonic amplitudes and THD
+bool RIPPLE_start(const RippleSettings *settings);
+
+#endif // RIPPLE_H
@@ -0,0 +1,300 @@
+#include "modules/rollup.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "modules/base/generic_fun.h"
+#include "modules/cli.h"
+#include "modules/ble.h"
+#include "modules/worker.h"
+
+#define MAX_ENERGY_STEP 10      // seconds, longer gaps are not integrated
+#define POWER_VOLTAGE_AGE 2000000
+
+typedef struct {
+    Seconds period;
+    unsigned depth;
+    const char *name;
+} TierInfo;
+
+static const TierInfo kTiers[kRollupLastTier] = {
+    [kRollupSecond] = { .period = 1,    .depth = ROLLUP_SECONDS_DEPTH, .name = "second" },
+    [kRollupMinute] = { .period = 60,   .depth = ROLLUP_MINUTES_DEPTH, .name = "minute" },
+    [kRollupHour]   = { .period = 3600, .depth = ROLLUP_HOURS_DEPTH,   .name = "hour" },
+};
+
+static const char *channel_names[kRollupLastChannel] = {
+    [kRollupVoltage]        = "voltage",
+    [kRollupCurrent]        = "current",
+    [kRollupPower]          = "power",
+    [kRollupTemperature]    = "temperature",
+};
+
+static struct {
+    RollupBucket second[kRollupLastChannel][ROLLUP_SECONDS_DEPTH];
+    RollupBucket minute[kRollupLastChannel][ROLLUP_MINUTES_DEPTH];
+    RollupBucket hour[kRollupLastChannel][ROLLUP_HOURS_DEPTH];
+    uint32_t current[kRollupLastChannel][kRollupLastTier];
+    int64_t last_time[kRollupLastChannel];
+
+    int32_t last_voltage;
+    int64_t last_voltage_time;
+    portMUX_TYPE lock;
+
+    struct {
+        RollupChannel channel;
+        RollupTier tier;
+        unsigned count;
+        bool ongoing;
+    } ble_query;
+} ctx = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+BUDGET_CHECK(sizeof(ctx), BUDGET_ROLLUP);
+
+static RollupBucket *bucket_at(RollupChannel channel, RollupTier tier, uint32_t index) {
+    unsigned slot = index % kTiers[tier].depth;
+    switch (tier) {
+        case kRollupSecond:
+            return &ctx.second[channel][slot];
+        case kRollupMinute:
+            return &ctx.minute[channel][slot];
+        default:
+            return &ctx.hour[channel][slot];
+    }
+}
+
+static void add_to_tier(RollupChannel channel, RollupTier tier, Seconds now, int32_t value, float dt) {
+    uint32_t index = now / kTiers[tier].period;
+    uint32_t *current = &ctx.current[channel][tier];
+
+    int32_t ahead = (int32_t)(index - *current);
+    if (ahead > 0) {
+        // buckets skipped without samples must not keep data from the previous lap
+        uint32_t gap = ahead < (int32_t)kTiers[tier].depth ? (uint32_t)ahead : kTiers[tier].depth;
+        for (uint32_t k = 0; k < gap; ++k)
+            memset(bucket_at(channel, tier, index - k), 0, sizeof(RollupBucket));
+        *current = index;
+    } else if (ahead <= -(int32_t)kTiers[tier].depth) {
+        // a late sample whose bucket already left the ring
+        return;
+    }
+
+    RollupBucket *bucket = bucket_at(channel, tier, index);
+    if (bucket->count == 0) {
+        bucket->min = value;
+        bucket->max = value;
+    } else {
+        if (value < bucket->min)
+            bucket->min = value;
+        if (value > bucket->max)
+            bucket->max = value;
+    }
+    bucket->sum += value;
+    bucket->count += 1;
+    bucket->energy += value * dt;
+}
+
+static void add_sample(RollupChannel channel, int64_t timestamp, int32_t value) {
+    float dt = 0;
+    if (ctx.last_time[channel] != 0 && timestamp > ctx.last_time[channel]) {
+        dt = (timestamp - ctx.last_time[channel]) / 1000000.0f;
+        if (dt > MAX_ENERGY_STEP)
+            dt = 0;
+    }
+    ctx.last_time[channel] = timestamp;
+
+    Seconds now = timestamp / 1000000;
+    for (RollupTier tier = 0; tier < kRollupLastTier; ++tier)
+        add_to_tier(channel, tier, now, value, dt);
+}
+
+void ROLLUP_add(RollupChannel channel, int64_t timestamp, int32_t value) {
+    if (channel >= kRollupLastChannel)
+        return;
+
+    taskENTER_CRITICAL(&ctx.lock);
+    add_sample(channel, timestamp, value);
+
+    if (channel == kRollupVoltage) {
+        ctx.last_voltage = value;
+        ctx.last_voltage_time = timestamp;
+    } else if (channel == kRollupCurrent && ctx.last_voltage_time != 0
+               && timestamp - ctx.last_voltage_time < POWER_VOLTAGE_AGE) {
+        add_sample(kRollupPower, timestamp, (int64_t)ctx.last_voltage * value / 1000);
+    }
+    taskEXIT_CRITICAL(&ctx.lock);
+}
+
+unsigned ROLLUP_query(RollupChannel channel, RollupTier tier, Seconds from, Seconds to, RollupVisitor visitor, void *arg) {
+    if (channel >= kRollupLastChannel || tier >= kRollupLastTier || from > to)
+        return 0;
+
+    const Seconds period = kTiers[tier].period;
+    taskENTER_CRITICAL(&ctx.lock);
+    uint32_t current = ctx.current[channel][tier];
+    taskEXIT_CRITICAL(&ctx.lock);
+
+    uint32_t oldest = current >= kTiers[tier].depth ? current - kTiers[tier].depth + 1 : 0;
+    uint32_t first = from / period > oldest ? from / period : oldest;
+    uint32_t last = to / period < current ? to / period : current;
+
+    unsigned visited = 0;
+    for (uint32_t index = first; index <= last && index >= first; ++index) {
+        RollupEntry entry = { .start = index * period };
+        taskENTER_CRITICAL(&ctx.lock);
+        // the ring may have moved on while the previous entries were visited
+        bool valid = index + kTiers[tier].depth > ctx.current[channel][tier];
+        entry.bucket = *bucket_at(channel, tier, index);
+        taskEXIT_CRITICAL(&ctx.lock);
+
+        if (valid == false || entry.bucket.count == 0)
+            continue;
+
+        visited += 1;
+        if (visitor(&entry, arg) == false)
+            break;
+    }
+    return visited;
+}
+
+static bool parse_name(const char *name, const char *const *names, unsigned count, unsigned *index) {
+    for (unsigned i = 0; i < count; ++i) {
+        if (AreStringsTheSame(names[i], name, strlen(names[i]) + 1)) {
+            *index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_tier(const char *name, RollupTier *tier) {
+    for (unsigned i = 0; i < kRollupLastTier; ++i) {
+        if (AreStringsTheSame(kTiers[i].name, name, strlen(kTiers[i].name) + 1)) {
+            *tier = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static char *FindArgumentValue(int argc, char **argv, const char *arg) {
+    for (int i = 1; i < argc - 1; i++) {
+        if (AreStringsTheSame(arg, argv[i], strlen(arg) + 1))
+            return argv[i + 1];
+    }
+    return NULL;
+}
+
+static bool log_entry(const RollupEntry *entry, void *arg) {
+    RollupBucket *total = arg;
+    const RollupBucket *bucket = &entry->bucket;
+    ESP_LOGI("rollup", "[%" PRIu32 " s] [min %" PRId32 "] [max %" PRId32 "] [mean %" PRId64 "] [energy %.1f] [n %" PRIu32 "]",
+             entry->start, bucket->min, bucket->max, bucket->sum / bucket->count, bucket->energy, bucket->count);
+
+    if (total->count == 0 || bucket->min < total->min)
+        total->min = bucket->min;
+    if (total->count == 0 || bucket->max > total->max)
+        total->max = bucket->max;
+    total->sum += bucket->sum;
+    total->energy += bucket->energy;
+    total->count += bucket->count;
+    return true;
+}
+
+static Seconds now_seconds(void) {
+    return esp_timer_get_time() / 1000000;
+}
+
+static int rollup_command_execution(int argc, char **argv) {
+    unsigned channel = kRollupVoltage;
+    if (argc == 1 || parse_name(argv[1], channel_names, kRollupLastChannel, &channel) == false) {
+        ESP_LOGI(__func__, "Channel required: voltage, current, power, temperature");
+        return 0;
+    }
+
+    RollupTier tier = kRollupSecond;
+    char *value = FindArgumentValue(argc, argv, "tier");
+    if (value != NULL && parse_tier(value, &tier) == false) {
+        ESP_LOGW(__func__, "Unknown tier: %s", value);
+        return 0;
+    }
+
+    Seconds to = now_seconds();
+    Seconds from = 0;
+    value = FindArgumentValue(argc, argv, "last");
+    if (value != NULL) {
+        Seconds span = strtoul(value, NULL, 10) * kTiers[tier].period;
+        from = span < to ? to - span + 1 : 0;
+    }
+
+    value = FindArgumentValue(argc, argv, "from");
+    if (value != NULL)
+        from = strtoul(value, NULL, 10);
+
+    value = FindArgumentValue(argc, argv, "to");
+    if (value != NULL)
+        to = strtoul(value, NULL, 10);
+
+    RollupBucket total = { 0 };
+    unsigned buckets = ROLLUP_query(channel, tier, from, to, log_entry, &total);
+    if (buckets == 0) {
+        ESP_LOGI(__func__, "ROLLUP %s: no data in [%" PRIu32 ", %" PRIu32 "] s", channel_names[channel], from, to);
+        return 0;
+    }
+
+    ESP_LOGI(__func__, "ROLLUP %s [%" PRIu32 ", %" PRIu32 "] s: [min %" PRId32 "] [max %" PRId32 "] [mean %" PRId64 "] [energy %.1f] [buckets %u]",
+             channel_names[channel], from, to, total.min, total.max, total.sum / total.count, total.energy, buckets);
+    return 0;
+}
+
+static bool notify_entry(const RollupEntry *entry, void *arg) {
+    char buffer[11 + 11 + 11 + 11 + 16 + 11];
+    const RollupBucket *bucket = &entry->bucket;
+    int length = snprintf(buffer, sizeof(buffer), "%" PRIu32 ",%" PRId32 ",%" PRId32 ",%" PRId64 ",%.1f,%" PRIu32,
+                          entry->start, bucket->min, bucket->max, bucket->sum / bucket->count, bucket->energy, bucket->count);
+    return BLE_stream_raw(kRollup, (const uint8_t *)buffer, length);
+}
+
+static void query_ble(void *arg) {
+    Seconds to = now_seconds();
+    Seconds span = ctx.ble_query.count * kTiers[ctx.ble_query.tier].period;
+    Seconds from = span < to ? to - span + 1 : 0;
+
+    ROLLUP_query(ctx.ble_query.channel, ctx.ble_query.tier, from, to, notify_entry, NULL);
+    BLE_stream_raw(kRollup, (const uint8_t *)"end", 3);
+    ctx.ble_query.ongoing = false;
+}
+
+// "<channel>,<tier>,<count>" as numbers, answered with one "start,min,max,mean,energy,n" notification per bucket
+static void parse_ble_command(char *buffer, unsigned length) {
+    unsigned values[3] = { 0 };
+    unsigned i = ParseUnsignedList(buffer, values, 3, 10);
+    if (i < 3 || values[0] >= kRollupLastChannel || values[1] >= kRollupLastTier || ctx.ble_query.ongoing) {
+        ESP_LOGW(__func__, "Invalid rollup query");
+        return;
+    }
+
+    ctx.ble_query.channel = values[0];
+    ctx.ble_query.tier = values[1];
+    ctx.ble_query.count = values[2];
+    ctx.ble_query.ongoing = true;
+    if (WORKER_report(query_ble, NULL) == false)
+        ctx.ble_query.ongoing = false;
+}
+
+void ROLLUP_init(void) {
+    CLI_register_command("rollup",
+                         "<voltage|current|power|temperature> [tier second|minute|hour] [last <n>] [from <s>] [to <s>]",
+                         rollup_command_execution);
+    BLE_setup_characteristic_callback(kRollup, parse_ble_command);
+}
@@ -0,0 +1,52 @@
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/base/types.h"
+
+#define ROLLUP_SECONDS_DEPTH 60
+#define ROLLUP_MINUTES_DEPTH 60
+#define ROLLUP_HOURS_DEPTH 72
+
+typedef enum {
+    kRollupVoltage = 0,     // mV
+    kRollupCurrent,         // mA
+    kRollupPower,           // mW, derived from the latest voltage and every current sample
+    kRollupTemperature,     // 0.01 C
+// sentinel
+    kRollupLastChannel
+} RollupChannel;
+
+typedef enum {
+    kRollupSecond = 0,
+    kRollupMinute,
+    kRollupHour,
+// sentinel
+    kRollupLastTier
+} RollupTier;
+
+typedef struct {
+    int32_t min;
+    int32_t max;
+    int64_t sum;
+    float energy;           // time integral of the value [unit * s], mJ for the power channel
+    uint32_t count;
+} RollupBucket;
+
+typedef struct {
+    Seconds start;          // seconds since boot
+    RollupBucket bucket;
+} RollupEntry;
+
+typedef bool (*RollupVisitor)(const RollupEntry *entry, void *arg);
+
+void ROLLUP_init(void);
+
+void ROLLUP_add(RollupChannel channel, int64_t timestamp, int32_t value);
+
+// visits non-empty buckets with start in [from, to], oldest first, returns visited count
+unsigned ROLLUP_query(RollupChannel channel, RollupTier tier, Seconds from, Seconds to, RollupVisitor visitor, void *arg);
+
+#endif // ROLLUP_H
@@ -0,0 +1,126 @@
+#include "modules/soak.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "modules/base/generic_fun.h"
+#include "modules/base/budget.h"
+#include "modules/cli.h"
+#include "modules/adc.h"
+#include "modules/ct.h"
+#include "modules/ds_sensor.h"
+#include "modules/pwm.h"
+#include "modules/worker.h"
+
+// soak 1000
+// soak 5000 period 2500
+
+#define REPORT_EVERY 100
+
+static struct {
+    unsigned sessions;
+    Milliseconds period;
+    volatile bool ongoing;
+
+    size_t baseline;            // free heap after the first session
+    size_t min_free;
+    unsigned rejected;          // sessions a module refused, still running from before
+} ctx = { 0 };
+
+WORKER_DEFINE(worker, "soak", TASK_STACK_SIZE_SMALL, TASK_PRIORITY_REPORT, TASK_CORE_COMMS);
+BUDGET_CHECK(sizeof(ctx) + WORKER_FOOTPRINT(TASK_STACK_SIZE_SMALL), BUDGET_SOAK);
+
+static char *FindArgumentValue(int argc, char **argv, const char *arg) {
+    for (int i = 1; i < argc - 1; i++) {
+        if (AreStringsTheSame(arg, argv[i], strlen(arg) + 1))
+            return argv[i + 1];
+    }
+    return NULL;
+}
+
+// one session of every kind that used to allocate: measurement tasks, PWM timer, 1-Wire read
+static void run_session(void) {
+    bool accepted = ADC_read_for(1);
+    accepted &= CT_read_for(1);
+    accepted &= DS_SENSOR_read_for(1);
+    accepted &= PWM_trigger_for(1, 1000, 0);
+    if (accepted == false)
+        ctx.rejected += 1;
+}
+
+static void soak_job(void *arg) {
+    const size_t start_free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    ctx.min_free = start_free;
+
+    for (unsigned session = 1; session <= ctx.sessions && ctx.ongoing; ++session) {
+        run_session();
+        vTaskDelay(pdMS_TO_TICKS(ctx.period));
+
+        size_t free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+        if (free < ctx.min_free)
+            ctx.min_free = free;
+        if (session == 1)
+            ctx.baseline = free;
+
+        if (session % REPORT_EVERY == 0 || session == ctx.sessions) {
+            ESP_LOGI(__func__, "SOAK [session %u] [free %u] [min free %u] [largest %u] [rejected %u]",
+                     session, (unsigned)free, (unsigned)ctx.min_free,
+                     (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT), ctx.rejected);
+        }
+    }
+
+    size_t end_free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    int drift = (int)end_free - (int)ctx.baseline;
+    ESP_LOGI(__func__, "SOAK %s [start %u] [after first %u] [end %u] [drift %d] [min free %u]",
+             drift >= 0 ? "FLAT" : "LEAK", (unsigned)start_free, (unsigned)ctx.baseline,
+             (unsigned)end_free, drift, (unsigned)ctx.min_free);
+    ctx.ongoing = false;
+}
+
+bool SOAK_start(unsigned sessions, Milliseconds period) {
+    if (ctx.ongoing || sessions == 0)
+        return false;
+
+    ctx.sessions = sessions;
+    ctx.period = period;
+    ctx.rejected = 0;
+    ctx.ongoing = true;
+    if (WORKER_submit(&worker, soak_job, NULL) == false) {
+        ctx.ongoing = false;
+        return false;
+    }
+    return true;
+}
+
+static int soak_command_execution(int argc, char **argv) {
+    if (argc == 1) {
+        ESP_LOGI(__func__, "SOAK: %s", ctx.ongoing ? "ongoing" : "idle");
+        return 0;
+    }
+
+    if (AreStringsTheSame("stop", argv[1], sizeof("stop"))) {
+        ctx.ongoing = false;
+        return 0;
+    }
+
+    Milliseconds period = 2000;
+    char *value = FindArgumentValue(argc, argv, "period");
+    if (value != NULL)
+        period = strtoul(value, NULL, 10);
+
+    ESP_LOGI(__func__, "SOAK: %s", SOAK_start(strtoul(argv[1], NULL, 10), period) ? "ongoing" : "errors occurs");
+    return 0;
+}
+
+void SOAK_init(void) {
+    WORKER_start(&worker);
+    CLI_register_command("soak", "<sessions> [period <ms>] | stop", soak_command_execution);
+}
@@ -0,0 +1,14 @@
+#ifndef SOAK_H
+#define SOAK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/base/types.h"
+
+void SOAK_init(void);
+
+// runs back to back measurement sessions and checks that the free heap stays flat
+bool SOAK_start(unsigned sessions, Milliseconds period);
+
+#endif // SOAK_H
@@ -0,0 +1,225 @@
+#include "modules/stats.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "modules/base/generic_fun.h"
+#include "modules/cli.h"
+#include "modules/ble.h"
+#include "modules/worker.h"
+#include "modules/core/jitter_core.h"
+
+static const char *stream_names[kStatsLastStream] = {
+    [kStatsVoltage]     = "voltage",
+    [kStatsCurrent]     = "current",
+    [kStatsTemperature] = "temperature",
+};
+
+typedef struct {
+    char name[configMAX_TASK_NAME_LEN];
+    int core;
+    unsigned priority;
+    unsigned cpu_permille;      // since the previous report
+    uint32_t stack_free;        // bytes never used
+} TaskReport;
+
+typedef struct {
+    size_t free;
+    size_t min_free;
+    size_t largest;
+} HeapReport;
+
+typedef void (*ReportLine)(const char *line, void *arg);
+
+static struct {
+    JitterHistogram jitter[kStatsLastStream];
+    portMUX_TYPE lock;
+
+    // run time counters from the previous report, CPU load is the difference
+    struct {
+        TaskHandle_t handle;
+        uint32_t runtime;
+    } previous[STATS_MAX_TASKS];
+    unsigned previous_count;
+    uint32_t previous_total;
+
+    bool ble_ongoing;
+} ctx = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+BUDGET_CHECK(sizeof(ctx), BUDGET_STATS);
+
+void STATS_sample(StatsStream stream, int64_t timestamp) {
+    if (stream >= kStatsLastStream)
+        return;
+
+    taskENTER_CRITICAL(&ctx.lock);
+    JITTER_CORE_add(&ctx.jitter[stream], timestamp);
+    taskEXIT_CRITICAL(&ctx.lock);
+}
+
+void STATS_reset_jitter(void) {
+    taskENTER_CRITICAL(&ctx.lock);
+    for (unsigned i = 0; i < kStatsLastStream; ++i)
+        JITTER_CORE_reset(&ctx.jitter[i]);
+    taskEXIT_CRITICAL(&ctx.lock);
+}
+
+static void read_heap(HeapReport *heap) {
+    heap->free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    heap->min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    heap->largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+}
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+static uint32_t previous_runtime(TaskHandle_t handle) {
+    for (unsigned i = 0; i < ctx.previous_count; ++i) {
+        if (ctx.previous[i].handle == handle)
+            return ctx.previous[i].runtime;
+    }
+    return 0;
+}
+#endif
+
+// fills at most max_tasks reports, returns the number of tasks in the system
+static unsigned read_tasks(TaskReport *reports, unsigned max_tasks) {
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    static TaskStatus_t status[STATS_MAX_TASKS];
+    uint32_t total = 0;
+    unsigned count = uxTaskGetSystemState(status, STATS_MAX_TASKS, &total);
+    if (count == 0)
+        return uxTaskGetNumberOfTasks();
+
+    // the counter runs on every core
+    uint32_t elapsed = (total - ctx.previous_total) * portNUM_PROCESSORS;
+    for (unsigned i = 0; i < count && i < max_tasks; ++i) {
+        TaskReport *report = &reports[i];
+        strncpy(report->name, status[i].pcTaskName, sizeof(report->name) - 1);
+        report->name[sizeof(report->name) - 1] = '\0';
+        report->priority = status[i].uxCurrentPriority;
+        report->stack_free = status[i].usStackHighWaterMark * sizeof(StackType_t);
+#if CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+        report->core = status[i].xCoreID == tskNO_AFFINITY ? -1 : status[i].xCoreID;
+#else
+        report->core = -1;
+#endif
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        uint32_t runtime = status[i].ulRunTimeCounter - previous_runtime(status[i].xHandle);
+        report->cpu_permille = elapsed != 0 ? (uint64_t)runtime * 1000 / elapsed : 0;
+#else
+        report->cpu_permille = 0;
+#endif
+    }
+
+    ctx.previous_count = count;
+    for (unsigned i = 0; i < count; ++i) {
+        ctx.previous[i].handle = status[i].xHandle;
+        ctx.previous[i].runtime = status[i].ulRunTimeCounter;
+    }
+    ctx.previous_total = total;
+    return count;
+#else
+    return 0;
+#endif
+}
+
+static void report(ReportLine emit, void *arg) {
+    char line[96];
+
+    HeapReport heap;
+    read_heap(&heap);
+    snprintf(line, sizeof(line), "heap,%u,%u,%u", (unsigned)heap.free, (unsigned)heap.min_free, (unsigned)heap.largest);
+    emit(line, arg);
+
+    static TaskReport tasks[STATS_MAX_TASKS];
+    unsigned count = read_tasks(tasks, STATS_MAX_TASKS);
+    if (count > STATS_MAX_TASKS) {
+        snprintf(line, sizeof(line), "tasks,%u,truncated", count);
+        emit(line, arg);
+        count = STATS_MAX_TASKS;
+    }
+    for (unsigned i = 0; i < count; ++i) {
+        snprintf(line, sizeof(line), "task,%s,%d,%u,%u,%" PRIu32,
+                 tasks[i].name, tasks[i].core, tasks[i].priority, tasks[i].cpu_permille, tasks[i].stack_free);
+        emit(line, arg);
+    }
+
+    for (unsigned i = 0; i < kStatsLastStream; ++i) {
+        JitterHistogram jitter;
+        taskENTER_CRITICAL(&ctx.lock);
+        jitter = ctx.jitter[i];
+        taskEXIT_CRITICAL(&ctx.lock);
+        if (jitter.count == 0)
+            continue;
+
+        snprintf(line, sizeof(line), "jitter,%s,%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32,
+                 stream_names[i], jitter.count, jitter.min_period, jitter.max_period,
+                 JITTER_CORE_percentile(&jitter, 0.5f), JITTER_CORE_percentile(&jitter, 0.99f));
+        emit(line, arg);
+
+        unsigned last = JITTER_BINS;
+        while (last > 0 && jitter.bins[last - 1] == 0)
+            --last;
+
+        int pos = snprintf(line, sizeof(line), "bins,%s", stream_names[i]);
+        for (unsigned k = 0; k < last && pos < (int)sizeof(line); ++k)
+            pos += snprintf(line + pos, sizeof(line) - pos, ",%" PRIu32, jitter.bins[k]);
+        emit(line, arg);
+    }
+}
+
+static void log_line(const char *line, void *arg) {
+    ESP_LOGI("stats", "STATS %s", line);
+}
+
+static int stats_command_execution(int argc, char **argv) {
+    if (argc > 1 && AreStringsTheSame("reset", argv[1], sizeof("reset"))) {
+        STATS_reset_jitter();
+        return 0;
+    }
+
+    report(log_line, NULL);
+    return 0;
+}
+
+static void notify_line(const char *line, void *arg) {
+    BLE_stream_raw(kDiagnostics, (const uint8_t *)line, strlen(line));
+}
+
+static void report_ble(void *arg) {
+    report(notify_line, NULL);
+    BLE_stream_raw(kDiagnostics, (const uint8_t *)"end", 3);
+    ctx.ble_ongoing = false;
+}
+
+// "reset" clears the jitter histograms, anything else streams one report:
+// heap,<free>,<min free>,<largest block>
+// task,<name>,<core>,<priority>,<cpu permille>,<stack free bytes>
+// jitter,<stream>,<periods>,<min us>,<max us>,<p50 us>,<p99 us>
+// bins,<stream>,<count 0 us>,<count 1 us>,<count 2-3 us>,...
+static void parse_ble_command(char *buffer, unsigned length) {
+    if (AreStringsTheSame("reset", buffer, strlen("reset"))) {
+        STATS_reset_jitter();
+        return;
+    }
+
+    if (ctx.ble_ongoing)
+        return;
+
+    ctx.ble_ongoing = true;
+    if (WORKER_report(report_ble, NULL) == false)
+        ctx.ble_ongoing = false;
+}
+
+void STATS_init(void) {
+    CLI_register_command("stats", "[reset]", stats_command_execution);
+    BLE_setup_characteristic_callback(kDiagnostics, parse_ble_command);
+}
@@ -0,0 +1,25 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/base/types.h"
+
+#define STATS_MAX_TASKS 24
+
+typedef enum {
+    kStatsVoltage = 0,
+    kStatsCurrent,
+    kStatsTemperature,
+// sentinel
+    kStatsLastStream
+} StatsStream;
+
+void STATS_init(void);
+
+// called by measurement loops once per sample, O(1)
+void STATS_sample(StatsStream stream, int64_t timestamp);
+void STATS_reset_jitter(void);
+
+#endif // STATS_H
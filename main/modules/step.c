@@ -0,0 +1,231 @@
+#include "modules/step.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "modules/base/generic_fun.h"
+#include "modules/cli.h"
+#include "modules/adc.h"
+#include "modules/capture.h"
+#include "modules/ct.h"
+#include "modules/pwm.h"
+#include "modules/worker.h"
+#include "modules/core/step_core.h"
+
+// step 80
+// step 60 from 20 freq 1000 rate 20000 depth 4000 band 5
+
+#define COPY_FRAMES 32
+#define TAIL_DIVIDER 10             // last tenth of the post-step frames is the steady state
+#define MIN_STEP_COUNTS 8           // smaller code differences are noise
+#define CAPTURE_TIMEOUT_MS 2000
+
+static struct {
+    StepSettings settings;
+    volatile bool ongoing;
+} ctx = {
+    .settings = {
+        .from   = 0,
+        .to     = 50,
+        .freq   = 1000,
+        .hold   = 500,
+        .rate   = CAPTURE_MAX_RATE,
+        .depth  = CAPTURE_MAX_FRAMES,
+        .band   = 0.02f,
+    },
+};
+
+BUDGET_CHECK(sizeof(ctx), BUDGET_STEP);
+
+static const char *channel_names[CAPTURE_CHANNELS] = { "voltage", "current" };
+
+static char *FindArgumentValue(int argc, char **argv, const char *arg) {
+    for (int i = 1; i < argc - 1; i++) {
+        if (AreStringsTheSame(arg, argv[i], strlen(arg) + 1))
+            return argv[i + 1];
+    }
+    return NULL;
+}
+
+// mean of one channel over frames [first, first + count)
+static float mean_counts(unsigned channel, unsigned first, unsigned count) {
+    uint16_t frames[COPY_FRAMES * CAPTURE_CHANNELS];
+    uint32_t sum = 0;
+    for (unsigned done = 0; done < count;) {
+        unsigned chunk = count - done < COPY_FRAMES ? count - done : COPY_FRAMES;
+        chunk = CAPTURE_copy_frames(first + done, frames, chunk);
+        if (chunk == 0)
+            break;
+        for (unsigned i = 0; i < chunk; ++i)
+            sum += frames[i * CAPTURE_CHANNELS + channel];
+        done += chunk;
+    }
+    return count != 0 ? (float)sum / count : 0;
+}
+
+static float to_unit(unsigned channel, float counts) {
+    if (channel == 0)
+        return ADC_counts_to_voltage(counts);
+
+    Amper current = 0;
+    CT_counts_to_current(counts, &current);
+    return current;
+}
+
+static void analyse(unsigned channel, const CaptureHeader *header, int64_t step_time) {
+    const unsigned tail = header->post / TAIL_DIVIDER;
+    float initial = mean_counts(channel, 0, header->pre);
+    float final = mean_counts(channel, header->pre + header->post - tail, tail);
+
+    StepAnalysis analysis;
+    if (STEP_CORE_begin(&analysis, initial, final, MIN_STEP_COUNTS, ctx.settings.band, tail) == false) {
+        ESP_LOGI(__func__, "STEP %s: no step [level %.1f]", channel_names[channel], to_unit(channel, final));
+        return;
+    }
+
+    uint16_t frames[COPY_FRAMES * CAPTURE_CHANNELS];
+    for (unsigned first = 0; first < header->post; first += COPY_FRAMES) {
+        unsigned count = CAPTURE_copy_frames(header->pre + first, frames, COPY_FRAMES);
+        for (unsigned i = 0; i < count; ++i)
+            STEP_CORE_add(&analysis, frames[i * CAPTURE_CHANNELS + channel]);
+    }
+
+    StepMetrics metrics;
+    STEP_CORE_finish(&analysis, &metrics);
+
+    // the trigger frame is the first sample at or after the duty write
+    const uint32_t period = 1000000 / header->rate;
+    const uint32_t offset = header->trigger_time - step_time;
+    ESP_LOGI(__func__, "STEP %s,%.3f,%.3f,%.3f,%.1f,%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%s",
+             channel_names[channel], to_unit(channel, metrics.initial), to_unit(channel, metrics.final),
+             to_unit(channel, metrics.peak), metrics.overshoot,
+             offset + metrics.delay * period, metrics.rise * period, offset + metrics.settling * period,
+             metrics.settled ? "settled" : "unsettled");
+}
+
+static void run(void *arg) {
+    const StepSettings *settings = &ctx.settings;
+    bool ok = PWM_set_freq(settings->freq) && PWM_set_duty(settings->from);
+    vTaskDelay(pdMS_TO_TICKS(settings->hold));
+
+    CaptureConfig config = {
+        .trigger    = kCaptureTriggerEvent,
+        .channel    = 1,
+        .events     = kCaptureEventPwm,
+        .rate       = settings->rate,
+        .depth      = settings->depth,
+        .pre        = settings->depth / 8,
+        .timeout    = 1000 + settings->depth / 8 * 1000 / settings->rate,
+    };
+    ok = ok && CAPTURE_arm(&config);
+    if (ok == false) {
+        ESP_LOGW(__func__, "STEP: PWM or capture refused");
+        ctx.ongoing = false;
+        return;
+    }
+
+    // fill the pre-step frames, then step
+    vTaskDelay(pdMS_TO_TICKS(config.pre * 1000 / config.rate + 10));
+    int64_t step_time = esp_timer_get_time();
+    PWM_set_duty(settings->to);
+
+    for (unsigned waited = 0; CAPTURE_get_state() != kCaptureDone; waited += 10) {
+        if (waited >= CAPTURE_TIMEOUT_MS) {
+            CAPTURE_abort();
+            ESP_LOGW(__func__, "STEP: capture timeout");
+            ctx.ongoing = false;
+            return;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    CaptureHeader header;
+    CAPTURE_get_header(&header);
+    // times come from frame indices, a late frame shifts every one after it
+    if (header.overruns != 0) {
+        ESP_LOGW(__func__, "STEP: %" PRIu32 " capture overruns, no result, lower the rate", header.overruns);
+        ctx.ongoing = false;
+        return;
+    }
+
+    // channel,initial,final,peak,overshoot %,delay us,rise us,settling us,settled
+    analyse(0, &header, step_time);
+    analyse(1, &header, step_time);
+    ctx.ongoing = false;
+}
+
+bool STEP_start(const StepSettings *settings) {
+    if (ctx.ongoing)
+        return false;
+
+    if (settings->from > 100 || settings->to > 100 || settings->from == settings->to)
+        return false;
+    if (settings->rate == 0 || settings->rate > CAPTURE_MAX_RATE)
+        return false;
+    if (settings->depth < 16 || settings->depth > CAPTURE_MAX_FRAMES || settings->band <= 0)
+        return false;
+
+    if (CT_has_zero() == false) {
+        ESP_LOGW(__func__, "No CT zero yet, run 'ct zero now' with the outputs off");
+        return false;
+    }
+
+    ctx.settings = *settings;
+    ctx.ongoing = true;
+    if (WORKER_session(run, NULL) == false) {
+        ctx.ongoing = false;
+        return false;
+    }
+    return true;
+}
+
+static int step_command_execution(int argc, char **argv) {
+    if (argc == 1) {
+        ESP_LOGI(__func__, "No arguments");
+        return 0;
+    }
+
+    StepSettings settings = ctx.settings;
+    settings.to = strtoul(argv[1], NULL, 10);
+
+    char *value = FindArgumentValue(argc, argv, "from");
+    if (value != NULL)
+        settings.from = strtoul(value, NULL, 10);
+
+    value = FindArgumentValue(argc, argv, "freq");
+    if (value != NULL)
+        settings.freq = strtoul(value, NULL, 10);
+
+    value = FindArgumentValue(argc, argv, "hold");
+    if (value != NULL)
+        settings.hold = strtoul(value, NULL, 10);
+
+    value = FindArgumentValue(argc, argv, "rate");
+    if (value != NULL)
+        settings.rate = strtoul(value, NULL, 10);
+
+    value = FindArgumentValue(argc, argv, "depth");
+    if (value != NULL)
+        settings.depth = strtoul(value, NULL, 10);
+
+    value = FindArgumentValue(argc, argv, "band");
+    if (value != NULL)
+        settings.band = strtof(value, NULL) / 100;
+
+    ESP_LOGI(__func__, "STEP: %s", STEP_start(&settings) ? "ongoing" : "errors occurs");
+    return 0;
+}
+
+void STEP_init(void) {
+    CLI_register_command("step",
+                         "<duty> [from <duty>] [freq <Hz>] [hold <ms>] [rate <Hz>] [depth <frames>] [band <%>]",
+                         step_command_execution);
+}
@@ -0,0 +1,25 @@
+#ifndef STEP_H
+#define STEP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/base/types.h"
+
+typedef struct {
+    Percent from;               // duty held before the step
+    Percent to;
+    Herz freq;                  // PWM frequency
+    Milliseconds hold;          // at the from duty before arming
+    Herz rate;                  // capture rate
+    uint32_t depth;             // frames in total, an eighth of them before the step
+    float band;                 // settling band, fraction of the step
+} StepSettings;
+
+void STEP_init(void);
+
+// PWM duty step with a capture of both channels triggered by it, reports one
+// record per channel; the output stays at the step duty
+bool STEP_start(const StepSettings *settings);
+
+#endif // STEP_H
@@ -0,0 +1,354 @@
+#include "modules/stream.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/uart.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+
+#include "modules/base/generic_fun.h"
+#include "modules/base/budget.h"
+#include "modules/base/codec.h"
+#include "modules/cli.h"
+#include "modules/power.h"
+#include "modules/worker.h"
+#include "modules/core/frame_core.h"
+
+// stream start baud 921600
+// adapt start
+// stream stop
+// tools/stream_capture.py --port /dev/ttyUSB0 --stream-baud 921600 --seconds 60 -o samples.csv
+
+#define STREAM_UART CONFIG_ESP_CONSOLE_UART_NUM
+#define FLUSH_PERIOD_MS 50          // longest wait of a sample in a partly filled packet
+#define MIN_BAUD 9600
+#define MAX_BAUD 5000000
+#define TEST_SPACING_US 100         // timestamps of the 'stream test' ramp
+#define STOP_RETRY_MS 10
+#define RECORD_MAX_SIZE (1 + CODEC_VARINT32_MAX + CODEC_VARINT32_MAX)
+
+typedef struct {
+    uint8_t payload[STREAM_PAYLOAD_SIZE];
+    uint16_t length;
+    uint8_t count;
+    int64_t last_time;
+    int32_t last_value[kDatalogLastChannel];
+    volatile bool full;
+} StreamPacket;
+
+static struct {
+    volatile bool active;
+    volatile bool stopping;
+    uint32_t baud;
+    uint32_t console_baud;
+
+    // filled by the acquisition loops, sent by the report worker
+    StreamPacket packets[2];
+    unsigned current;
+    uint16_t dropped;           // since the last sealed packet
+    portMUX_TYPE lock;
+    bool send_queued;
+    TimerHandle_t flush_timer;
+    StaticTimer_t flush_timer_buffer;
+
+    // report worker only
+    uint8_t frame[FRAME_ENCODED_SIZE(STREAM_PAYLOAD_SIZE)];
+    uint8_t sequence;
+    uint32_t packets_sent;
+    uint32_t samples_sent;
+    uint32_t dropped_total;
+    uint32_t bytes_sent;
+} ctx = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+BUDGET_CHECK(sizeof(ctx), BUDGET_STREAM);
+
+static void put_u16(uint8_t *out, uint16_t value) {
+    memcpy(out, &value, sizeof(value));
+}
+
+static void put_u32(uint8_t *out, uint32_t value) {
+    memcpy(out, &value, sizeof(value));
+}
+
+static bool packet_append(StreamPacket *packet, DatalogChannel channel, int64_t timestamp, int32_t value) {
+    if (packet->count == 0) {
+        memcpy(packet->payload + 3, &timestamp, sizeof(timestamp));
+        packet->length = STREAM_HEADER_SIZE;
+        packet->last_time = timestamp;
+        memset(packet->last_value, 0, sizeof(packet->last_value));
+    }
+    if (packet->length + RECORD_MAX_SIZE > STREAM_PAYLOAD_SIZE || packet->count == UINT8_MAX)
+        return false;
+
+    int64_t dt = timestamp > packet->last_time ? timestamp - packet->last_time : 0;
+    dt = dt > UINT32_MAX ? UINT32_MAX : dt;
+    int32_t delta = (int32_t)((uint32_t)value - (uint32_t)packet->last_value[channel]);
+    uint8_t *record = packet->payload + packet->length;
+    unsigned length = 0;
+    record[length++] = channel;
+    length += CODEC_put_varint(record + length, dt);
+    length += CODEC_put_varint(record + length, CODEC_zigzag(delta));
+    packet->length += length;
+    packet->count += 1;
+    packet->last_time += dt;
+    packet->last_value[channel] = value;
+    return true;
+}
+
+// under ctx.lock
+static void seal(StreamPacket *packet) {
+    packet->payload[0] = packet->count;
+    put_u16(packet->payload + 1, ctx.dropped);
+    ctx.dropped = 0;
+    packet->full = true;
+}
+
+// under ctx.lock, the open packet is sealed when the other one is free to take the next samples
+static bool seal_current(void) {
+    StreamPacket *packet = &ctx.packets[ctx.current];
+    if (packet->full || packet->count == 0 || ctx.packets[ctx.current ^ 1].full)
+        return false;
+
+    seal(packet);
+    ctx.current ^= 1;
+    return true;
+}
+
+// one write per frame, the driver's TX lock keeps console text out of it
+static bool write_frame(StreamFrameType type, const uint8_t *payload, size_t length) {
+    size_t size = FRAME_CORE_encode(type, ctx.sequence++, payload, length, ctx.frame, sizeof(ctx.frame));
+    if (size == 0 || uart_write_bytes(STREAM_UART, ctx.frame, size) != (int)size)
+        return false;
+
+    ctx.packets_sent += 1;
+    ctx.bytes_sent += size;
+    return true;
+}
+
+static void send_packets(void) {
+    // the other packet was sealed first
+    unsigned order[2] = { ctx.current ^ 1, ctx.current };
+    for (unsigned i = 0; i < 2; ++i) {
+        StreamPacket *packet = &ctx.packets[order[i]];
+        if (packet->full == false)
+            continue;
+
+        if (write_frame(kStreamSamples, packet->payload, packet->length))
+            ctx.samples_sent += packet->count;
+        packet->count = 0;
+        packet->length = 0;
+        packet->full = false;
+    }
+}
+
+static void send_job(void *arg) {
+    taskENTER_CRITICAL(&ctx.lock);
+    ctx.send_queued = false;
+    taskEXIT_CRITICAL(&ctx.lock);
+    send_packets();
+}
+
+static void queue_send(void) {
+    taskENTER_CRITICAL(&ctx.lock);
+    bool queued = ctx.send_queued;
+    ctx.send_queued = true;
+    taskEXIT_CRITICAL(&ctx.lock);
+
+    // a full report queue leaves the packets sealed, the next seal or flush queues them again
+    if (queued == false && WORKER_report(send_job, NULL) == false) {
+        taskENTER_CRITICAL(&ctx.lock);
+        ctx.send_queued = false;
+        taskEXIT_CRITICAL(&ctx.lock);
+    }
+}
+
+static bool append(DatalogChannel channel, int64_t timestamp, int32_t value) {
+    bool sealed = false;
+    bool stored = true;
+    taskENTER_CRITICAL(&ctx.lock);
+    StreamPacket *packet = &ctx.packets[ctx.current];
+    if (packet->full == false && packet_append(packet, channel, timestamp, value) == false) {
+        // packet is full, hand it to the report worker and continue in the other one
+        seal(packet);
+        sealed = true;
+        ctx.current ^= 1;
+        packet = &ctx.packets[ctx.current];
+        stored = packet->full == false && packet_append(packet, channel, timestamp, value);
+    } else if (packet->full) {
+        stored = false;
+    }
+    taskEXIT_CRITICAL(&ctx.lock);
+
+    if (sealed)
+        queue_send();
+    return stored;
+}
+
+void STREAM_sample(DatalogChannel channel, int64_t timestamp, int32_t value) {
+    if (ctx.active == false || channel >= kDatalogLastChannel)
+        return;
+
+    if (append(channel, timestamp, value))
+        return;
+
+    taskENTER_CRITICAL(&ctx.lock);
+    ctx.dropped = ctx.dropped < UINT16_MAX ? ctx.dropped + 1 : UINT16_MAX;
+    ctx.dropped_total += 1;
+    taskEXIT_CRITICAL(&ctx.lock);
+}
+
+static void flush_timer_callback(TimerHandle_t timer) {
+    taskENTER_CRITICAL(&ctx.lock);
+    bool sealed = seal_current();
+    taskEXIT_CRITICAL(&ctx.lock);
+
+    if (sealed)
+        queue_send();
+}
+
+static void set_baud(uint32_t baud) {
+    uart_wait_tx_done(STREAM_UART, portMAX_DELAY);
+    uart_set_baudrate(STREAM_UART, baud);
+}
+
+static void end_job(void *arg) {
+    // everything still buffered, then the totals
+    send_packets();
+    taskENTER_CRITICAL(&ctx.lock);
+    seal_current();
+    taskEXIT_CRITICAL(&ctx.lock);
+    send_packets();
+
+    uint8_t totals[3 * sizeof(uint32_t)];
+    put_u32(totals, ctx.packets_sent);
+    put_u32(totals + 4, ctx.samples_sent);
+    put_u32(totals + 8, ctx.dropped_total);
+    write_frame(kStreamEnd, totals, sizeof(totals));
+
+    if (ctx.baud != 0)
+        set_baud(ctx.console_baud);
+    POWER_unlock(kPowerNoSleep);
+    POWER_unlock(kPowerApb);
+
+    ESP_LOGI(__func__, "STREAM: stopped [packets %" PRIu32 "] [samples %" PRIu32 "] [dropped %" PRIu32 "] [bytes %" PRIu32 "]",
+             ctx.packets_sent, ctx.samples_sent, ctx.dropped_total, ctx.bytes_sent);
+    ctx.stopping = false;
+}
+
+bool STREAM_start(uint32_t baud) {
+    if (ctx.active || ctx.stopping || ctx.flush_timer == NULL)
+        return false;
+    if (baud != 0 && (baud < MIN_BAUD || baud > MAX_BAUD))
+        return false;
+
+    memset(ctx.packets, 0, sizeof(ctx.packets));
+    ctx.current = 0;
+    ctx.dropped = 0;
+    ctx.sequence = 0;
+    ctx.packets_sent = 0;
+    ctx.samples_sent = 0;
+    ctx.dropped_total = 0;
+    ctx.bytes_sent = 0;
+
+    // the baud divider counts the APB clock and the TX FIFO only drains while awake
+    POWER_lock(kPowerApb);
+    POWER_lock(kPowerNoSleep);
+    ctx.baud = baud;
+    if (baud != 0) {
+        uart_get_baudrate(STREAM_UART, &ctx.console_baud);
+        set_baud(baud);
+    }
+
+    ctx.active = true;
+    xTimerStart(ctx.flush_timer, 0);
+    return true;
+}
+
+void STREAM_stop(void) {
+    if (ctx.active == false)
+        return;
+
+    ctx.active = false;
+    ctx.stopping = true;
+    xTimerStop(ctx.flush_timer, 0);
+    // the end frame and the baud switch back go after the packets already queued
+    while (WORKER_report(end_job, NULL) == false)
+        vTaskDelay(pdMS_TO_TICKS(STOP_RETRY_MS));
+}
+
+bool STREAM_is_active(void) {
+    return ctx.active;
+}
+
+// ramp on the bench channel with no gaps, tools/stream_capture.py --check verifies it;
+// waits for the UART instead of dropping, so it runs under QEMU without any sensor
+static uint32_t run_test(uint32_t samples) {
+    const int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < samples; ++i) {
+        while (append(kDatalogBench, start + (int64_t)i * TEST_SPACING_US, (int32_t)i) == false) {
+            if (ctx.active == false)
+                return i;
+            vTaskDelay(1);
+        }
+    }
+    return samples;
+}
+
+static char *FindArgumentValue(int argc, char **argv, const char *arg) {
+    for (int i = 1; i < argc - 1; i++) {
+        if (AreStringsTheSame(arg, argv[i], strlen(arg) + 1))
+            return argv[i + 1];
+    }
+    return NULL;
+}
+
+static int stream_command_execution(int argc, char **argv) {
+    if (argc == 1 || AreStringsTheSame("status", argv[1], sizeof("status"))) {
+        ESP_LOGI(__func__, "STREAM: [%s] [baud %" PRIu32 "] [packets %" PRIu32 "] [samples %" PRIu32 "] [dropped %" PRIu32 "] [bytes %" PRIu32 "]",
+                 ctx.active ? "on" : "off", ctx.baud != 0 ? ctx.baud : ctx.console_baud, ctx.packets_sent,
+                 ctx.samples_sent, ctx.dropped_total, ctx.bytes_sent);
+        return 0;
+    }
+
+    if (AreStringsTheSame("start", argv[1], sizeof("start"))) {
+        char *value = FindArgumentValue(argc, argv, "baud");
+        uint32_t baud = value != NULL ? strtoul(value, NULL, 0) : 0;
+        ESP_LOGI(__func__, "STREAM: %s", STREAM_start(baud) ? "started" : "errors occurs");
+        return 0;
+    }
+
+    if (AreStringsTheSame("stop", argv[1], sizeof("stop"))) {
+        STREAM_stop();
+        return 0;
+    }
+
+    if (AreStringsTheSame("test", argv[1], sizeof("test"))) {
+        uint32_t samples = argc > 2 ? strtoul(argv[2], NULL, 0) : 1000;
+        if (ctx.active == false) {
+            ESP_LOGW(__func__, "STREAM: not started");
+            return 0;
+        }
+        ESP_LOGI(__func__, "STREAM: test [samples %" PRIu32 "]", run_test(samples));
+        return 0;
+    }
+
+    ESP_LOGW(__func__, "Unknown subcommand: %s", argv[1]);
+    return 0;
+}
+
+void STREAM_init(void) {
+    ctx.console_baud = STREAM_DEFAULT_BAUD;
+    uart_get_baudrate(STREAM_UART, &ctx.console_baud);
+    ctx.flush_timer = xTimerCreateStatic("stream_flush", pdMS_TO_TICKS(FLUSH_PERIOD_MS), pdTRUE, NULL,
+                                         flush_timer_callback, &ctx.flush_timer_buffer);
+    CLI_register_command("stream", "[status] [start [baud <n>]] [stop] [test <samples>]", stream_command_execution);
+}
@@ -0,0 +1,35 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/datalog.h"
+
+#define STREAM_PAYLOAD_SIZE 200
+#define STREAM_DEFAULT_BAUD 115200
+
+// Frames on the console UART, see modules/core/frame_core.h for the framing.
+// The console keeps working while streaming, its text goes out between frames.
+typedef enum {
+    kStreamSamples = 1,     // u8 count | u16 dropped before this packet | i64 base time us | records
+    kStreamEnd,             // u32 sample packets | u32 samples | u32 dropped, last frame of a session
+} StreamFrameType;
+
+// kStreamSamples records as in a datalog page, see modules/base/codec.h:
+// u8 DatalogChannel | varint dt [us since previous record] | zigzag varint delta of the channel value,
+// every packet starts from 0 on all channels so a lost one doesn't break the next
+#define STREAM_HEADER_SIZE (1 + 2 + 8)
+
+void STREAM_init(void);
+
+// baud 0 keeps the console rate, otherwise the UART switches until STREAM_stop
+bool STREAM_start(uint32_t baud);
+void STREAM_stop(void);
+bool STREAM_is_active(void);
+
+// called by the acquisition loops next to DATALOG_append, value in the channel unit;
+// a no-op when not streaming, samples are dropped and counted while the UART lags
+void STREAM_sample(DatalogChannel channel, int64_t timestamp, int32_t value);
+
+#endif // STREAM_H
@@ -0,0 +1,104 @@
+#include "modules/trace.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+#include "esp_ipc.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "modules/base/generic_fun.h"
+#include "modules/base/budget.h"
+#include "modules/cli.h"
+#include "modules/hal/hal_time.h"
+
+#define RECORDS_PER_LINE 16
+
+typedef struct {
+    int64_t time;
+    uint32_t cycles;
+} TraceSync;
+
+static struct {
+    TraceBuffer trace;
+    TraceRecord snapshot[TRACE_RING_SIZE];
+} ctx = {
+    .trace = { .enabled = true },
+};
+
+BUDGET_CHECK(sizeof(ctx), BUDGET_TRACE);
+
+void TRACE_event(TraceEvent event, uint16_t arg) {
+    TRACE_CORE_record(&ctx.trace, xPortGetCoreID(), HAL_TIME_cycles(), event, arg);
+}
+
+void TRACE_enable(bool enable) {
+    ctx.trace.enabled = enable;
+}
+
+static void capture_sync(void *arg) {
+    TraceSync *sync = arg;
+    sync->cycles = HAL_TIME_cycles();
+    sync->time = HAL_TIME_now();
+}
+
+// the cycle counters of both cores run unsynchronised, each ring gets its own reference point
+static void dump(void) {
+    bool enabled = ctx.trace.enabled;
+    ctx.trace.enabled = false;
+    // let a writer preempted in the middle of a record finish it
+    vTaskDelay(1);
+
+    unsigned total = 0;
+    for (unsigned core = 0; core < portNUM_PROCESSORS && core < TRACE_MAX_CORES; ++core) {
+        TraceSync sync = { 0 };
+        if (esp_ipc_call_blocking(core, capture_sync, &sync) != ESP_OK)
+            continue;
+
+        printf("TRACE SYNC %u %" PRId64 " %" PRIu32 " %" PRIu32 "\n", core, sync.time, sync.cycles, HAL_TIME_cycles_per_us());
+
+        unsigned count = TRACE_CORE_snapshot(&ctx.trace, core, ctx.snapshot, TRACE_RING_SIZE);
+        for (unsigned i = 0; i < count; i += RECORDS_PER_LINE) {
+            char line[RECORDS_PER_LINE * sizeof(TraceRecord) * 2 + 1];
+            int pos = 0;
+            for (unsigned k = i; k < count && k < i + RECORDS_PER_LINE; ++k) {
+                const TraceRecord *record = &ctx.snapshot[k];
+                pos += snprintf(line + pos, sizeof(line) - pos, "%08" PRIX32 "%04X%04X",
+                                record->cycles, record->event, record->arg);
+            }
+            printf("TRACE %u %s\n", core, line);
+        }
+        total += count;
+    }
+
+    printf("TRACE END %u\n", total);
+    ctx.trace.enabled = enabled;
+}
+
+static int trace_command_execution(int argc, char **argv) {
+    if (argc == 1) {
+        ESP_LOGI(__func__, "TRACE: %s", ctx.trace.enabled ? "on" : "off");
+        return 0;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (AreStringsTheSame("on", argv[i], sizeof("on")))
+            TRACE_enable(true);
+        else if (AreStringsTheSame("off", argv[i], sizeof("off")))
+            TRACE_enable(false);
+        else if (AreStringsTheSame("clear", argv[i], sizeof("clear")))
+            TRACE_CORE_clear(&ctx.trace);
+        else if (AreStringsTheSame("dump", argv[i], sizeof("dump")))
+            dump();
+        else
+            ESP_LOGW(__func__, "Unknown argument: %s", argv[i]);
+    }
+    return 0;
+}
+
+void TRACE_init(void) {
+    CLI_register_command("trace", "[on] [off] [clear] [dump]", trace_command_execution);
+}
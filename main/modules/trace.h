@@ -0,0 +1,14 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/core/trace_core.h"
+
+void TRACE_init(void);
+
+void TRACE_event(TraceEvent event, uint16_t arg);
+void TRACE_enable(bool enable);
+
+#endif // TRACE_H
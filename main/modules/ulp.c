@@ -0,0 +1,284 @@
+#include "modules/ulp.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "esp32/ulp.h"
+#include "soc/rtc_cntl_reg.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+
+#include "modules/base/generic_fun.h"
+#include "modules/adc.h"
+#include "modules/cli.h"
+#include "modules/config.h"
+#include "modules/datalog.h"
+#include "modules/worker.h"
+#include "modules/hal/hal_adc.h"
+
+// config set ulp.interval 60
+// config set alarm.voltage.debounce 1
+// config commit
+// ulp start
+
+#define PROGRAM_WORD kUlpVarLastWord        // program right behind the data
+#define RTC_MAGIC 0x554C5031                // "ULP1"
+#define MAX_COUNTS 4095
+
+_Static_assert((PROGRAM_WORD + ULP_MAX_OPS) * sizeof(uint32_t) <= CONFIG_ULP_COPROC_RESERVE_MEM,
+               "ULP data and program exceed the reserved RTC slow memory");
+
+// survives deep sleep, cleared by a power cycle or a reset
+static RTC_DATA_ATTR struct {
+    uint32_t magic;
+    uint32_t wakeups;
+    uint32_t level_wakeups;
+    uint32_t records;
+    uint32_t dropped;
+    // esp_timer starts at 0 after every wakeup, record times carry on from the
+    // esp_timer of the boot that started the mode, the ULP samples count the sleep
+    int64_t elapsed;            // us at the last deep sleep
+    uint32_t open_ticks;        // samples already in the open record at that sleep
+} rtc;
+
+static struct {
+    UlpOp ops[ULP_MAX_OPS];
+    ulp_insn_t program[ULP_MAX_OPS];
+    UlpSettings settings;
+    uint32_t period;            // ms
+    Seconds linger;
+
+    TimerHandle_t linger_timer;
+    StaticTimer_t linger_timer_buffer;
+} ctx = { 0 };
+
+BUDGET_CHECK(sizeof(ctx) + sizeof(rtc), BUDGET_ULP);
+
+static bool translate(const UlpOp *op, ulp_insn_t *insn) {
+    switch (op->code) {
+        case kUlpAdc:           *insn = (ulp_insn_t)I_ADC(op->dst, 0, op->imm);                  return true;
+        case kUlpLoad:          *insn = (ulp_insn_t)I_LD(op->dst, op->src, op->imm);             return true;
+        case kUlpStore:         *insn = (ulp_insn_t)I_ST(op->src, op->src2, op->imm);            return true;
+        case kUlpMoveImm:       *insn = (ulp_insn_t)I_MOVI(op->dst, op->imm);                    return true;
+        case kUlpAddImm:        *insn = (ulp_insn_t)I_ADDI(op->dst, op->src, op->imm);           return true;
+        case kUlpAddReg:        *insn = (ulp_insn_t)I_ADDR(op->dst, op->src, op->src2);          return true;
+        case kUlpSubReg:        *insn = (ulp_insn_t)I_SUBR(op->dst, op->src, op->src2);          return true;
+        case kUlpOrImm:         *insn = (ulp_insn_t)I_ORI(op->dst, op->src, op->imm);            return true;
+        case kUlpAndImm:        *insn = (ulp_insn_t)I_ANDI(op->dst, op->src, op->imm);           return true;
+        case kUlpShiftRightImm: *insn = (ulp_insn_t)I_RSHI(op->dst, op->src, op->imm);           return true;
+        case kUlpLabel:         *insn = (ulp_insn_t)M_LABEL(op->imm);                            return true;
+        case kUlpJump:          *insn = (ulp_insn_t)M_BX(op->imm);                               return true;
+        case kUlpJumpOverflow:  *insn = (ulp_insn_t)M_BXF(op->imm);                              return true;
+        case kUlpJumpZero:      *insn = (ulp_insn_t)M_BXZ(op->imm);                              return true;
+        case kUlpJumpLess:      *insn = (ulp_insn_t)M_BL(op->imm, op->imm2);                     return true;
+        case kUlpJumpAtLeast:   *insn = (ulp_insn_t)M_BGE(op->imm, op->imm2);                    return true;
+        case kUlpReady:
+            *insn = (ulp_insn_t)I_RD_REG(RTC_CNTL_LOW_POWER_ST_REG, RTC_CNTL_RDY_FOR_WAKEUP_S, RTC_CNTL_RDY_FOR_WAKEUP_S);
+            return true;
+        case kUlpWake:          *insn = (ulp_insn_t)I_WAKE();                                    return true;
+        case kUlpStopTimer:
+            *insn = (ulp_insn_t)I_WR_REG_BIT(RTC_CNTL_STATE0_REG, RTC_CNTL_ULP_CP_SLP_TIMER_EN_S, 0);
+            return true;
+        case kUlpHalt:          *insn = (ulp_insn_t)I_HALT();                                    return true;
+    }
+    return false;
+}
+
+// first raw code at or above the input voltage, the calibration is monotonic
+static uint16_t counts_for(int32_t millivolts) {
+    unsigned low = 0;
+    unsigned high = MAX_COUNTS + 1;
+    while (low < high) {
+        unsigned middle = (low + high) / 2;
+        if (ADC_counts_to_voltage(middle) < millivolts)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+// last raw code at or below the input voltage
+static uint16_t counts_at_most(int32_t millivolts) {
+    uint16_t counts = counts_for(millivolts + 1);
+    return counts > 0 ? counts - 1 : 0;
+}
+
+static void apply_config(const Config *config) {
+    const AlarmThreshold *alarm = &config->alarm[kAlarmVoltage];
+    ctx.period = config->ulp.period;
+    ctx.linger = config->ulp.linger;
+    ctx.settings = (UlpSettings) {
+        .interval = config->ulp.interval,
+        .batch = config->ulp.batch,
+        .high = ULP_NO_LIMIT,
+        .high_clear = ULP_NO_LIMIT,
+    };
+    // a disabled voltage alarm wakes on full batches only
+    if (alarm->debounce != 0) {
+        ctx.settings.low = counts_for(alarm->low);
+        ctx.settings.low_clear = counts_for(alarm->low + alarm->hysteresis);
+        ctx.settings.high = counts_at_most(alarm->high);
+        ctx.settings.high_clear = counts_at_most(alarm->high - alarm->hysteresis);
+    }
+}
+
+static bool load_program(void) {
+    unsigned count = 0;
+    unsigned channel = 0;
+    if (HAL_ADC_ulp_enable(kHalAdcVoltage, &channel) == false)
+        return false;
+    if (ULP_CORE_program(channel, ctx.ops, ULP_MAX_OPS, &count) == false)
+        return false;
+
+    for (unsigned i = 0; i < count; ++i) {
+        if (translate(&ctx.ops[i], &ctx.program[i]) == false)
+            return false;
+    }
+    size_t size = count;
+    return ulp_process_macros_and_load(PROGRAM_WORD, ctx.program, &size) == ESP_OK;
+}
+
+static void sleep_job(void *arg) {
+    bool resume = rtc.magic == RTC_MAGIC;
+    if (resume)
+        ULP_CORE_clear_records(RTC_SLOW_MEM);
+    else if (ULP_CORE_validate(&ctx.settings))
+        ULP_CORE_setup(RTC_SLOW_MEM, &ctx.settings);
+    else {
+        ESP_LOGE(__func__, "ULP settings rejected, check alarm.voltage and ulp.*");
+        return;
+    }
+
+    if (load_program() == false) {
+        ESP_LOGE(__func__, "ULP program not loaded");
+        return;
+    }
+
+    if (resume == false) {
+        memset(&rtc, 0, sizeof(rtc));
+        rtc.magic = RTC_MAGIC;
+    }
+    ESP_LOGI(__func__, "ULP: deep sleep [period %" PRIu32 " ms] [interval %u] [batch %u] [limits %u..%u counts]",
+             ctx.period, ctx.settings.interval, ctx.settings.batch, ctx.settings.low, ctx.settings.high);
+
+    rtc.elapsed += esp_timer_get_time();
+    rtc.open_ticks = ULP_CORE_read(RTC_SLOW_MEM, kUlpVarTicks);
+
+    ulp_set_wakeup_period(0, ctx.period * 1000);
+    esp_sleep_enable_ulp_wakeup();
+    ulp_run(PROGRAM_WORD);
+    esp_deep_sleep_start();
+}
+
+static void linger_timer_callback(TimerHandle_t timer) {
+    if (rtc.magic == RTC_MAGIC)
+        WORKER_report(sleep_job, NULL);
+}
+
+// records back to mV in the datalog, record i closed (i + 1) * interval - open_ticks
+// samples after the deep sleep started
+static void flush_job(void *arg) {
+    const uint32_t *memory = RTC_SLOW_MEM;
+    const unsigned count = ULP_CORE_read(memory, kUlpVarCount);
+    const unsigned ticks = ULP_CORE_read(memory, kUlpVarTicks);
+    const unsigned wake = ULP_CORE_read(memory, kUlpVarWake);
+    const unsigned dropped = ULP_CORE_read(memory, kUlpVarDropped);
+    const int64_t period = (int64_t)ctx.period * 1000;
+    const int64_t interval = ctx.settings.interval;
+
+    bool logging = DATALOG_is_enabled();
+    DATALOG_start();
+    for (unsigned i = 0; i < count; ++i) {
+        const unsigned record = kUlpVarRecords + 3 * i;
+        int64_t time = rtc.elapsed + ((i + 1) * interval - rtc.open_ticks) * period;
+        DATALOG_append(kDatalogVoltageMin, time, ADC_counts_to_voltage(ULP_CORE_read(memory, record)));
+        DATALOG_append(kDatalogVoltageMax, time, ADC_counts_to_voltage(ULP_CORE_read(memory, record + 1)));
+        DATALOG_append(kDatalogVoltage, time, ADC_counts_to_voltage(ULP_CORE_read(memory, record + 2)));
+    }
+    DATALOG_sync();
+    if (logging == false)
+        DATALOG_stop();
+
+    rtc.elapsed += ((count + dropped) * interval + ticks - rtc.open_ticks) * period;
+    rtc.wakeups += 1;
+    rtc.records += count;
+    rtc.dropped += dropped;
+    ESP_LOGI(__func__, "ULP: flushed %u records [wakeups %" PRIu32 "] [records %" PRIu32 "] [dropped %" PRIu32 "]",
+             count, rtc.wakeups, rtc.records, rtc.dropped);
+
+    if ((wake & kUlpWakeLevel) == 0 || ctx.linger == 0) {
+        sleep_job(NULL);
+        return;
+    }
+
+    // the normal acquisition runs the alarm path and a BLE client has time to connect
+    rtc.level_wakeups += 1;
+    unsigned level = ULP_CORE_read(memory, kUlpVarLevel);
+    ESP_LOGW(__func__, "ULP: voltage %s [%d mV], awake for %" PRIu32 " s",
+             ALARM_CORE_level_name(level), (int)ADC_counts_to_voltage(ULP_CORE_read(memory, kUlpVarLast)), ctx.linger);
+    ADC_read_for(ctx.linger);
+    // a second past the acquisition, the ADC unit goes back to the ULP
+    xTimerChangePeriod(ctx.linger_timer, pdMS_TO_TICKS(1000 * (ctx.linger + 1)), 0);
+}
+
+bool ULP_start(void) {
+    // while lingering after a threshold wakeup the soak carries on at once
+    xTimerStop(ctx.linger_timer, 0);
+    return WORKER_report(sleep_job, NULL);
+}
+
+void ULP_stop(void) {
+    xTimerStop(ctx.linger_timer, 0);
+    rtc.magic = 0;
+}
+
+static void log_status(void) {
+    ESP_LOGI(__func__, "ULP: %s [period %" PRIu32 " ms] [interval %u] [batch %u] [limits %u/%u..%u/%u counts]",
+             rtc.magic == RTC_MAGIC ? "lingering" : "off", ctx.period, ctx.settings.interval, ctx.settings.batch,
+             ctx.settings.low, ctx.settings.low_clear, ctx.settings.high_clear, ctx.settings.high);
+    if (rtc.magic == RTC_MAGIC) {
+        ESP_LOGI(__func__, "ULP: [wakeups %" PRIu32 "] [threshold %" PRIu32 "] [records %" PRIu32 "] [dropped %" PRIu32 "]",
+                 rtc.wakeups, rtc.level_wakeups, rtc.records, rtc.dropped);
+    }
+}
+
+static int ulp_command_execution(int argc, char **argv) {
+    if (argc == 1 || AreStringsTheSame("status", argv[1], sizeof("status"))) {
+        log_status();
+        return 0;
+    }
+
+    if (AreStringsTheSame("start", argv[1], sizeof("start"))) {
+        ESP_LOGI(__func__, "ULP: %s", ULP_start() ? "entering deep sleep" : "errors occurs");
+        return 0;
+    }
+
+    if (AreStringsTheSame("stop", argv[1], sizeof("stop"))) {
+        ULP_stop();
+        return 0;
+    }
+
+    ESP_LOGW(__func__, "Unknown subcommand: %s", argv[1]);
+    return 0;
+}
+
+void ULP_init(void) {
+    ctx.linger_timer = xTimerCreateStatic("ulp_linger", 1, pdFALSE, NULL, linger_timer_callback,
+                                          &ctx.linger_timer_buffer);
+    CONFIG_register_listener(apply_config);
+    CLI_register_command("ulp", "[status] [start] [stop]", ulp_command_execution);
+
+    // any other boot ends the mode, ulp start begins a new one
+    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_ULP && rtc.magic == RTC_MAGIC)
+        WORKER_report(flush_job, NULL);
+    else
+        rtc.magic = 0;
+}
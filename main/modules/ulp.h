@@ -0,0 +1,21 @@
+#ifndef ULP_H
+#define ULP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "modules/base/types.h"
+#include "modules/core/ulp_core.h"
+
+// last in app_main: after a ULP wakeup the batch is flushed to the datalog and the
+// chip goes back to deep sleep, after a threshold wakeup only once ulp.linger is over
+void ULP_init(void);
+
+// deep sleep with the ULP sampling the supply voltage every ulp.period ms, min/max
+// records in RTC memory and the alarm.voltage limits as wakeup thresholds
+bool ULP_start(void);
+
+// ends the mode while the chip is awake, the next boot runs normally
+void ULP_stop(void);
+
+#endif // ULP_H
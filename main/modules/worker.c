@@ -0,0 +1,80 @@
+#include "modules/worker.h"
+
+#include "esp_log.h"
+
+WORKER_DEFINE(report_worker, "report", TASK_STACK_SIZE, TASK_PRIORITY_REPORT, TASK_CORE_COMMS);
+WORKER_DEFINE(session_worker, "session", TASK_STACK_SIZE, TASK_PRIORITY_MEASUREMENT, TASK_CORE_ACQUISITION);
+BUDGET_CHECK(2 * WORKER_FOOTPRINT(TASK_STACK_SIZE), BUDGET_WORKER);
+
+static void worker_task(void *arg) {
+    Worker *worker = arg;
+    WorkerRequest request;
+    while (1) {
+        if (xQueueReceive(worker->queue, &request, portMAX_DELAY) != pdPASS)
+            continue;
+
+        request.job(request.arg);
+        __atomic_fetch_sub(&worker->pending, 1, __ATOMIC_RELEASE);
+    }
+}
+
+bool WORKER_start(Worker *worker) {
+    if (worker->task != NULL)
+        return true;
+
+    worker->queue = xQueueCreateStatic(WORKER_QUEUE_DEPTH, sizeof(WorkerRequest), worker->queue_storage, &worker->queue_buffer);
+    worker->task = xTaskCreateStaticPinnedToCore(worker_task, worker->name, worker->stack_size, worker, worker->priority,
+                                                 worker->stack, &worker->task_buffer, worker->core);
+    if (worker->queue == NULL || worker->task == NULL) {
+        ESP_LOGE(__func__, "Worker %s not started", worker->name);
+        return false;
+    }
+    return true;
+}
+
+bool WORKER_submit(Worker *worker, WorkerJob job, void *arg) {
+    if (worker->queue == NULL)
+        return false;
+
+    WorkerRequest request = { .job = job, .arg = arg };
+    __atomic_fetch_add(&worker->pending, 1, __ATOMIC_ACQUIRE);
+    if (xQueueSend(worker->queue, &request, 0) != pdPASS) {
+        __atomic_fetch_sub(&worker->pending, 1, __ATOMIC_RELEASE);
+        ESP_LOGW(__func__, "Worker %s busy", worker->name);
+        return false;
+    }
+    return true;
+}
+
+bool WORKER_report(WorkerJob job, void *arg) {
+    return WORKER_submit(&report_worker, job, arg);
+}
+
+bool WORKER_session(WorkerJob job, void *arg) {
+    if (session_worker.queue == NULL)
+        return false;
+
+    // the slot is taken before queueing, two callers can't both see an idle worker
+    uint32_t idle = 0;
+    if (__atomic_compare_exchange_n(&session_worker.pending, &idle, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) == false) {
+        ESP_LOGW(__func__, "Worker %s busy", session_worker.name);
+        return false;
+    }
+
+    WorkerRequest request = { .job = job, .arg = arg };
+    if (xQueueSend(session_worker.queue, &request, 0) != pdPASS) {
+        __atomic_fetch_sub(&session_worker.pending, 1, __ATOMIC_RELEASE);
+        ESP_LOGW(__func__, "Worker %s busy", session_worker.name);
+        return false;
+    }
+    return true;
+}
+
+bool WORKER_is_idle(const Worker *worker) {
+    return __atomic_load_n(&worker->pending, __ATOMIC_ACQUIRE) == 0;
+}
+
+void WORKER_init(void) {
+    WORKER_start(&report_worker);
+    WORKER_start(&session_worker);
+}
@@ -0,0 +1,70 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#include "modules/base/tasks.h"
+#include "modules/base/budget.h"
+
+#define WORKER_QUEUE_DEPTH 4
+
+typedef void (*WorkerJob)(void *arg);
+
+typedef struct {
+    WorkerJob job;
+    void *arg;
+} WorkerRequest;
+
+// Task, stack and job queue of a worker are static and created once at init,
+// every measurement session or report is a job queued to an existing task.
+typedef struct {
+    const char *name;
+    uint32_t stack_size;
+    UBaseType_t priority;
+    BaseType_t core;
+    StackType_t *stack;
+
+    StaticTask_t task_buffer;
+    StaticQueue_t queue_buffer;
+    uint8_t queue_storage[WORKER_QUEUE_DEPTH * sizeof(WorkerRequest)];
+    TaskHandle_t task;
+    QueueHandle_t queue;
+    uint32_t pending;           // queued and running jobs
+} Worker;
+
+// static RAM of one worker with its stack
+#define WORKER_FOOTPRINT(stack_size) (sizeof(Worker) + (stack_size) * sizeof(StackType_t))
+
+#define WORKER_DEFINE(var, name_, stack_size_, priority_, core_)   \
+    static StackType_t var##_stack[stack_size_];                    \
+    static Worker var = {                                           \
+        .name = name_,                                              \
+        .stack_size = stack_size_,                                  \
+        .priority = priority_,                                      \
+        .core = core_,                                              \
+        .stack = var##_stack,                                       \
+    }
+
+// starts the shared core 0 report worker and core 1 session worker
+void WORKER_init(void);
+
+bool WORKER_start(Worker *worker);
+
+// false when the worker is not started or its queue is full
+bool WORKER_submit(Worker *worker, WorkerJob job, void *arg);
+
+// BLE dumps, queries and reports, run one after another on core 0
+bool WORKER_report(WorkerJob job, void *arg);
+
+// calibration points, decimation runs, plans, ripple and step responses, power and
+// latency probes: one measurement session at a time on core 1, false while another one runs
+bool WORKER_session(WorkerJob job, void *arg);
+
+bool WORKER_is_idle(const Worker *worker);
+
+#endif // WORKER_H
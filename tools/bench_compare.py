@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+"""Compare two benchmark runs and fail on regressions.
+
+Inputs are console captures of the 'bench' command (or output of the host
+controller_bench executable); only BENCH,<name>,... lines are read.
+"""
+
+import argparse
+import sys
+
+FIELDS = ['runs', 'min', 'median', 'p99', 'max', 'median_ns']
+
+
+def read_results(path):
+    results = {}
+    with open(path, 'r', errors='replace') as f:
+        for line in f:
+            line = line.strip()
+            # console lines may carry a prompt or log prefix before the record
+            pos = line.find('BENCH,')
+            if pos < 0:
+                continue
+            parts = line[pos:].split(',')
+            if len(parts) != 2 + len(FIELDS) or parts[1] == 'name':
+                continue
+            results[parts[1]] = dict(zip(FIELDS, (int(value) for value in parts[2:])))
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('baseline', help='capture of the reference run')
+    parser.add_argument('current', help='capture of the run under test')
+    parser.add_argument('--metric', choices=['min', 'median', 'p99'], default='median')
+    parser.add_argument('--threshold', type=float, default=10.0, help='allowed slowdown in percent')
+    args = parser.parse_args()
+
+    baseline = read_results(args.baseline)
+    current = read_results(args.current)
+    if not baseline or not current:
+        print('no BENCH records found', file=sys.stderr)
+        return 2
+
+    regressions = 0
+    print('%-20s %12s %12s %8s' % ('name', 'baseline', 'current', 'change'))
+    for name in sorted(set(baseline) | set(current)):
+        if name not in baseline or name not in current:
+            print('%-20s %s' % (name, 'only in baseline' if name in baseline else 'new'))
+            continue
+
+        old = baseline[name][args.metric]
+        new = current[name][args.metric]
+        change = (new - old) * 100.0 / old if old else 0.0
+        flag = ''
+        if change > args.threshold:
+            flag = ' REGRESSION'
+            regressions += 1
+        print('%-20s %12d %12d %+7.1f%%%s' % (name, old, new, change, flag))
+
+    return 1 if regressions else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
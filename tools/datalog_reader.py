@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+"""Decode the on-device flash data log into CSV.
+
+Input is either a raw image of the 'datalog' partition
+(parttool.py read_partition --partition-name datalog --output log.bin)
+or a console capture of the 'log dump' command (LOG <offset> <hex> lines).
+"""
+
+import argparse
+import csv
+import re
+import struct
+import sys
+import zlib
+
+MAGIC = 0x474F4C44
+PAGE_SIZE = 4096
+HEADER = struct.Struct('<IIqHHI')
+CRC_OFFSET = HEADER.size - 4
+CHANNELS = ['voltage_mV', 'current_mA', 'temperature_cC', 'temperature2_cC', 'bench', 'rate_Hz',
+            'voltage_min_mV', 'voltage_max_mV']
+
+LOG_LINE = re.compile(r'^LOG ([0-9A-F]{6}) ([0-9A-F]+)\s*$')
+
+
+def read_varint(data, pos):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        if byte < 0x80:
+            return value, pos
+        shift += 7
+
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def parse_page(data):
+    """Returns (header, payload) or None when the page is not a valid log page."""
+    if len(data) < HEADER.size:
+        return None
+    magic, sequence, base_time, records, length, crc = HEADER.unpack_from(data)
+    if magic != MAGIC or HEADER.size + length > min(len(data), PAGE_SIZE):
+        return None
+    payload = data[HEADER.size:HEADER.size + length]
+    if zlib.crc32(payload, zlib.crc32(data[:CRC_OFFSET])) != crc:
+        return None
+    return (sequence, base_time, records, length), payload
+
+
+def decode_records(base_time, records, payload):
+    last_time = base_time
+    last_value = [0] * len(CHANNELS)
+    pos = 0
+    for _ in range(records):
+        channel = payload[pos]
+        dt, pos = read_varint(payload, pos + 1)
+        delta, pos = read_varint(payload, pos)
+        last_time += dt
+        last_value[channel] = (last_value[channel] + unzigzag(delta)) & 0xFFFFFFFF
+        value = last_value[channel] - (1 << 32) if last_value[channel] & 0x80000000 else last_value[channel]
+        yield last_time, channel, value
+
+
+def pages_from_image(image):
+    for offset in range(0, len(image) - PAGE_SIZE + 1, PAGE_SIZE):
+        page = parse_page(image[offset:offset + PAGE_SIZE])
+        if page is not None:
+            yield page
+
+
+def pages_from_stream(stream):
+    """Consecutive page images as sent by 'log dump' and the BLE log characteristic."""
+    pos = 0
+    while pos + HEADER.size <= len(stream):
+        length = HEADER.unpack_from(stream, pos)[4]
+        page = parse_page(stream[pos:pos + HEADER.size + length])
+        if page is None:
+            raise ValueError('corrupted page at offset 0x%X' % pos)
+        yield page
+        pos += HEADER.size + length
+
+
+def read_console_dump(lines):
+    stream = bytearray()
+    for line in lines:
+        match = LOG_LINE.match(line.strip())
+        if match is None:
+            continue
+        offset = int(match.group(1), 16)
+        if offset != len(stream):
+            raise ValueError('missing dump data before offset 0x%X' % offset)
+        stream += bytes.fromhex(match.group(2))
+    return bytes(stream)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('input', help='partition image (.bin) or console capture')
+    parser.add_argument('-o', '--output', help='CSV file, stdout by default')
+    parser.add_argument('--raw', action='store_true', help='input is a raw partition image')
+    args = parser.parse_args()
+
+    if args.raw:
+        with open(args.input, 'rb') as f:
+            pages = list(pages_from_image(f.read()))
+    else:
+        with open(args.input, 'r', errors='replace') as f:
+            pages = list(pages_from_stream(read_console_dump(f)))
+
+    pages.sort(key=lambda page: page[0][0])
+
+    out = open(args.output, 'w', newline='') if args.output else sys.stdout
+    writer = csv.writer(out)
+    writer.writerow(['boot', 'sequence', 'time_us', 'channel', 'value'])
+
+    # esp_timer restarts on every boot, a step back in page time marks a reboot
+    boot = 0
+    previous_base = None
+    for (sequence, base_time, records, _), payload in pages:
+        if previous_base is not None and base_time < previous_base:
+            boot += 1
+        previous_base = base_time
+        for time_us, channel, value in decode_records(base_time, records, payload):
+            name = CHANNELS[channel] if channel < len(CHANNELS) else str(channel)
+            writer.writerow([boot, sequence, time_us, name, value])
+
+    if out is not sys.stdout:
+        out.close()
+    print('%d pages decoded' % len(pages), file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
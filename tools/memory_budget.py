@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""Report static RAM per firmware module against main/modules/base/budget.h.
+
+Reads the linker map written by 'idf.py build' (build/controller-tester.map),
+sums the .bss/.data input sections of every main component object and fails
+when a module is over its BUDGET_<MODULE> line or the total over BUDGET_LIMIT.
+"""
+
+import argparse
+import os
+import re
+import sys
+from collections import defaultdict
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+BUDGET_HEADER = os.path.join(ROOT, 'main', 'modules', 'base', 'budget.h')
+DEFAULT_MAP = os.path.join(ROOT, 'build', 'controller-tester.map')
+
+DEFINE = re.compile(r'^#define\s+BUDGET_(\w+)\s+\(([\d\s*+]+)\)')
+SECTION = re.compile(r'^ (\.(?:bss|sbss|data|sdata|dram1)\S*|COMMON)(?:\s+(0x[0-9a-f]+)\s+(0x[0-9a-f]+)\s+(\S+))?\s*$')
+PLACEMENT = re.compile(r'^\s+(0x[0-9a-f]+)\s+(0x[0-9a-f]+)\s+(\S+)\s*$')
+MAIN_OBJECT = re.compile(r'libmain\.a\((?:.*/)?(\w+)\.c\.obj\)')
+
+
+def read_budgets(path):
+    budgets = {}
+    with open(path) as f:
+        for line in f:
+            match = DEFINE.match(line)
+            # only plain arithmetic on numbers, sums of other budgets are skipped
+            if match is not None:
+                budgets[match.group(1)] = eval(match.group(2), {'__builtins__': {}})
+    return budgets
+
+
+def read_map(path):
+    usage = defaultdict(int)
+    in_memory_map = False
+    pending = False
+    with open(path, errors='replace') as f:
+        for line in f:
+            if not in_memory_map:
+                in_memory_map = line.startswith('Linker script and memory map')
+                continue
+
+            if pending:
+                pending = False
+                match = PLACEMENT.match(line)
+                if match is not None:
+                    add_section(usage, match.group(2), match.group(3))
+                continue
+
+            match = SECTION.match(line)
+            if match is None:
+                continue
+            if match.group(2) is None:
+                # long section names put address, size and object on the next line
+                pending = True
+            else:
+                add_section(usage, match.group(3), match.group(4))
+    return usage
+
+
+def add_section(usage, size, obj):
+    match = MAIN_OBJECT.search(obj)
+    if match is not None:
+        usage[match.group(1)] += int(size, 16)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('map', nargs='?', default=DEFAULT_MAP, help='linker map file')
+    parser.add_argument('--budget', default=BUDGET_HEADER, help='budget header')
+    args = parser.parse_args()
+
+    budgets = read_budgets(args.budget)
+    limit = budgets.pop('LIMIT', None)
+    usage = read_map(args.map)
+    if not usage:
+        print('no main component objects found in %s' % args.map, file=sys.stderr)
+        return 1
+
+    failed = False
+    print('%-12s %10s %10s %6s' % ('module', 'static', 'budget', 'use'))
+    for module in sorted(usage, key=lambda name: -usage[name]):
+        budget = budgets.get(module.upper())
+        if budget is None:
+            print('%-12s %10d %10s %6s' % (module, usage[module], '-', ''))
+            continue
+        over = usage[module] > budget
+        failed |= over
+        print('%-12s %10d %10d %5d%%%s' % (module, usage[module], budget, 100 * usage[module] // budget,
+                                           '  OVER' if over else ''))
+
+    total = sum(usage.values())
+    print('%-12s %10d %10s' % ('total', total, limit if limit is not None else '-'))
+    if limit is not None and total > limit:
+        print('total static RAM over BUDGET_LIMIT', file=sys.stderr)
+        failed = True
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
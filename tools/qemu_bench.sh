@@ -0,0 +1,37 @@
+#!/usr/bin/env bash
+# Runs the 'bench' command on the firmware under the devcontainer's QEMU and
+# keeps the BENCH lines, e.g.
+#   tools/qemu_bench.sh > bench_new.txt
+#   tools/bench_compare.py bench_base.txt bench_new.txt
+#
+# QEMU has no ADC, BLE radio or 1-Wire bus, the peripheral cases only time the
+# driver paths there. Use a board for absolute numbers.
+set -euo pipefail
+
+BENCH_ARGS="${BENCH_ARGS:-}"
+BOOT_WAIT="${BOOT_WAIT:-8}"
+RUN_WAIT="${RUN_WAIT:-60}"
+BUILD_DIR="${BUILD_DIR:-build}"
+IMAGE="${BUILD_DIR}/flash_qemu.bin"
+
+cd "$(dirname "$0")/.."
+
+idf.py build >&2
+(cd "${BUILD_DIR}" && esptool.py --chip esp32 merge_bin --fill-flash-size 4MB -o flash_qemu.bin @flash_args) >&2
+
+LOG="$(mktemp)"
+trap 'rm -f "${LOG}"' EXIT
+
+# console input is fed through stdin, the run ends once 'BENCH END' shows up or RUN_WAIT expires
+{
+    sleep "${BOOT_WAIT}"
+    printf 'bench %s\r\n' "${BENCH_ARGS}"
+    for _ in $(seq "${RUN_WAIT}"); do
+        sleep 1
+        grep -q 'BENCH END' "${LOG}" && break
+    done
+} | timeout $((BOOT_WAIT + RUN_WAIT + 10)) qemu-system-xtensa -nographic -machine esp32 \
+        -drive "file=${IMAGE},if=mtd,format=raw" > "${LOG}" || true
+
+grep -a 'BENCH' "${LOG}" | sed 's/^.*\(BENCH\)/\1/'
+grep -q 'BENCH END' "${LOG}"
@@ -0,0 +1,40 @@
+#!/usr/bin/env bash
+# Streams a 'stream test' ramp from the firmware under the devcontainer's QEMU
+# and checks every frame and sample on the host side, e.g.
+#   tools/qemu_stream.sh
+#   SAMPLES=100000 tools/qemu_stream.sh -o ramp.csv
+#
+# QEMU's UART passes the frames through stdio and ignores the baud rate, the
+# capture only checks framing, CRC and ordering. Use a board for throughput.
+set -euo pipefail
+
+SAMPLES="${SAMPLES:-20000}"
+BOOT_WAIT="${BOOT_WAIT:-8}"
+RUN_WAIT="${RUN_WAIT:-30}"
+BUILD_DIR="${BUILD_DIR:-build}"
+IMAGE="${BUILD_DIR}/flash_qemu.bin"
+
+cd "$(dirname "$0")/.."
+
+idf.py build >&2
+(cd "${BUILD_DIR}" && esptool.py --chip esp32 merge_bin --fill-flash-size 4MB -o flash_qemu.bin @flash_args) >&2
+
+LOG="$(mktemp)"
+trap 'rm -f "${LOG}"' EXIT
+
+# the run ends once the test reports its sample count or RUN_WAIT expires
+{
+    sleep "${BOOT_WAIT}"
+    printf 'stream start\r\n'
+    sleep 1
+    printf 'stream test %s\r\n' "${SAMPLES}"
+    for _ in $(seq "${RUN_WAIT}"); do
+        sleep 1
+        grep -aq 'STREAM: test' "${LOG}" && break
+    done
+    printf 'stream stop\r\n'
+    sleep 2
+} | timeout $((BOOT_WAIT + RUN_WAIT + 15)) qemu-system-xtensa -nographic -machine esp32 \
+        -drive "file=${IMAGE},if=mtd,format=raw" > "${LOG}" || true
+
+tools/stream_capture.py "${LOG}" --check "$@" 2> >(grep -a 'STREAM\|CHECK\|frames' >&2)
@@ -0,0 +1,264 @@
+#!/usr/bin/env python3
+"""Capture the framed sample stream of the 'stream' command into CSV or column files.
+
+Frames and console text share the UART (see main/modules/core/frame_core.h):
+  0x00 | COBS(type u8 | sequence u8 | payload | crc16 LE) | 0x00
+every chunk between 0x00 bytes that decodes with a good CRC is a frame, the
+rest is console text and goes to stderr.
+
+Input is a serial port (needs pyserial), a TCP serial port such as QEMU's
+-serial tcp::5555,server, or a raw capture file. On a port the tool starts the
+stream, optionally switches both ends to --stream-baud, and stops it again:
+  tools/stream_capture.py --port /dev/ttyUSB0 --stream-baud 921600 --seconds 60 -o samples.csv
+  tools/stream_capture.py --tcp localhost:5555 --test 20000 --check --columns out/
+  tools/stream_capture.py capture.bin --check
+"""
+
+import argparse
+import binascii
+import csv
+import json
+import os
+import socket
+import struct
+import sys
+import time
+
+from datalog_reader import CHANNELS, decode_records
+
+STREAM_SAMPLES = 1
+STREAM_END = 2
+SAMPLES_HEADER = struct.Struct('<BHq')
+END = struct.Struct('<III')
+BENCH_CHANNEL = CHANNELS.index('bench')
+
+COLUMNS = [('time_us', '<i8', 'q'), ('channel', '<u1', 'B'), ('value', '<i4', 'i')]
+
+
+def cobs_decode(chunk):
+    out = bytearray()
+    pos = 0
+    while pos < len(chunk):
+        code = chunk[pos]
+        pos += 1
+        if code == 0 or pos + code - 1 > len(chunk):
+            return None
+        out += chunk[pos:pos + code - 1]
+        pos += code - 1
+        if code < 0xFF and pos < len(chunk):
+            out.append(0)
+    return bytes(out)
+
+
+def decode_frame(chunk):
+    """Returns (type, sequence, payload) or None when the chunk is not a valid frame."""
+    data = cobs_decode(chunk)
+    if data is None or len(data) < 4:
+        return None
+    crc = data[-2] | data[-1] << 8
+    if binascii.crc_hqx(data[:-2], 0xFFFF) != crc:
+        return None
+    return data[0], data[1], data[2:-2]
+
+
+class Decoder:
+    def __init__(self, text):
+        self.pending = bytearray()
+        self.text = text
+        self.rows = []
+        self.frames = 0
+        self.sequence = None
+        self.lost_frames = 0
+        self.bad_packets = 0
+        self.dropped = 0
+        self.end = None
+
+    def feed(self, data):
+        self.pending += data
+        *chunks, self.pending = self.pending.split(b'\x00')
+        for chunk in chunks:
+            if chunk:
+                self.chunk(bytes(chunk))
+
+    def chunk(self, chunk):
+        frame = decode_frame(chunk)
+        if frame is None:
+            self.text.write(chunk.decode('utf-8', errors='replace'))
+            return
+
+        kind, sequence, payload = frame
+        if self.sequence is not None and sequence != (self.sequence + 1) & 0xFF:
+            self.lost_frames += (sequence - self.sequence - 1) & 0xFF
+        self.sequence = sequence
+        self.frames += 1
+
+        if kind == STREAM_SAMPLES:
+            self.samples(payload)
+        elif kind == STREAM_END and len(payload) == END.size:
+            self.end = END.unpack(payload)
+
+    def samples(self, payload):
+        if len(payload) < SAMPLES_HEADER.size:
+            self.bad_packets += 1
+            return
+        # records are coded as in a datalog page
+        count, dropped, base_time = SAMPLES_HEADER.unpack_from(payload)
+        try:
+            rows = list(decode_records(base_time, count, payload[SAMPLES_HEADER.size:]))
+        except IndexError:
+            self.bad_packets += 1
+            return
+        self.dropped += dropped
+        self.rows += rows
+
+
+def write_csv(rows, path):
+    out = open(path, 'w', newline='') if path else sys.stdout
+    writer = csv.writer(out)
+    writer.writerow(['time_us', 'channel', 'value'])
+    for time_us, channel, value in rows:
+        writer.writerow([time_us, CHANNELS[channel] if channel < len(CHANNELS) else str(channel), value])
+    if out is not sys.stdout:
+        out.close()
+
+
+def write_columns(rows, directory):
+    """One little endian array per column, numpy.fromfile(path, dtype) reads each back."""
+    os.makedirs(directory, exist_ok=True)
+    schema = {'rows': len(rows), 'channels': CHANNELS, 'columns': []}
+    for index, (name, dtype, code) in enumerate(COLUMNS):
+        path = name + '.bin'
+        packer = struct.Struct('<' + code)
+        with open(os.path.join(directory, path), 'wb') as f:
+            f.write(b''.join(packer.pack(row[index]) for row in rows))
+        schema['columns'].append({'name': name, 'dtype': dtype, 'file': path})
+    with open(os.path.join(directory, 'schema.json'), 'w') as f:
+        json.dump(schema, f, indent=2)
+
+
+def check(decoder):
+    """Every frame and sample arrived, and a 'stream test' ramp has no gaps."""
+    errors = []
+    if decoder.end is None:
+        errors.append('no end frame')
+    else:
+        packets, samples, dropped = decoder.end
+        received = decoder.frames - 1
+        if received != packets:
+            errors.append('%d of %d packets received' % (received, packets))
+        if len(decoder.rows) != samples:
+            errors.append('%d of %d samples received' % (len(decoder.rows), samples))
+        if dropped != decoder.dropped:
+            errors.append('device dropped %d samples, packets report %d' % (dropped, decoder.dropped))
+    if decoder.lost_frames or decoder.bad_packets:
+        errors.append('%d frames lost, %d malformed' % (decoder.lost_frames, decoder.bad_packets))
+
+    ramp = [value for _, channel, value in decoder.rows if channel == BENCH_CHANNEL]
+    if ramp and ramp != list(range(len(ramp))):
+        errors.append('test ramp broken')
+    return errors
+
+
+class Port:
+    def __init__(self, args):
+        self.serial = None
+        self.socket = None
+        if args.tcp:
+            host, port = args.tcp.rsplit(':', 1)
+            self.socket = socket.create_connection((host, int(port)))
+            self.socket.settimeout(0.1)
+        else:
+            import serial
+            self.serial = serial.Serial(args.port, args.baud, timeout=0.1)
+
+    def write(self, line):
+        data = (line + '\r\n').encode()
+        if self.socket:
+            self.socket.sendall(data)
+        else:
+            self.serial.write(data)
+
+    def read(self):
+        if self.socket:
+            try:
+                return self.socket.recv(65536)
+            except socket.timeout:
+                return b''
+        return self.serial.read(max(1, self.serial.in_waiting))
+
+    def set_baud(self, baud):
+        # the emulated UART ignores the rate
+        if self.serial:
+            self.serial.baudrate = baud
+
+
+def read_for(port, decoder, raw, seconds, until_end=False):
+    deadline = time.monotonic() + seconds
+    while time.monotonic() < deadline and not (until_end and decoder.end):
+        data = port.read()
+        if raw:
+            raw.write(data)
+        decoder.feed(data)
+
+
+def capture(args, decoder, raw):
+    port = Port(args)
+    start = 'stream start' + (' baud %d' % args.stream_baud if args.stream_baud else '')
+    port.write(start)
+    # the command echo still goes out at the console rate
+    read_for(port, decoder, raw, 0.3)
+    if args.stream_baud:
+        port.set_baud(args.stream_baud)
+    if args.test:
+        port.write('stream test %d' % args.test)
+    read_for(port, decoder, raw, args.seconds)
+    port.write('stream stop')
+    read_for(port, decoder, raw, 5, until_end=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('input', nargs='?', help='raw capture file instead of a port')
+    parser.add_argument('--port', help='serial port, needs pyserial')
+    parser.add_argument('--tcp', help='host:port of a TCP serial port, e.g. QEMU')
+    parser.add_argument('--baud', type=int, default=115200, help='console baud rate')
+    parser.add_argument('--stream-baud', type=int, help='switch the UART to this rate while streaming')
+    parser.add_argument('--seconds', type=float, default=10, help='capture length')
+    parser.add_argument('--test', type=int, help="run 'stream test' with this many samples")
+    parser.add_argument('--check', action='store_true', help='fail on lost frames, samples or a broken test ramp')
+    parser.add_argument('--save', help='keep the raw capture in this file')
+    parser.add_argument('-o', '--output', help='CSV file, stdout by default')
+    parser.add_argument('--columns', help='directory for column files and schema.json instead of CSV')
+    args = parser.parse_args()
+
+    if (args.input is None) == (args.port is None and args.tcp is None):
+        parser.error('give a capture file or one of --port and --tcp')
+
+    decoder = Decoder(sys.stderr)
+    if args.input:
+        with open(args.input, 'rb') as f:
+            decoder.feed(f.read())
+    else:
+        raw = open(args.save, 'wb') if args.save else None
+        capture(args, decoder, raw)
+        if raw:
+            raw.close()
+    decoder.feed(b'\x00')
+
+    if args.columns:
+        write_columns(decoder.rows, args.columns)
+    else:
+        write_csv(decoder.rows, args.output)
+
+    print('\n%d frames, %d samples, %d dropped on the device' % (decoder.frames, len(decoder.rows), decoder.dropped),
+          file=sys.stderr)
+    if args.check:
+        errors = check(decoder)
+        for error in errors:
+            print('CHECK: ' + error, file=sys.stderr)
+        print('STREAM CHECK ' + ('FAILED' if errors else 'OK'), file=sys.stderr)
+        sys.exit(1 if errors else 0)
+
+
+if __name__ == '__main__':
+    main()
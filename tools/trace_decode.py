@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+"""Decode a 'trace dump' console capture.
+
+Prints latency histograms for
+  BLE write -> PWM/relay output, sample -> notification queued,
+  notification queued -> sent
+and optionally writes a Chrome trace (chrome://tracing, ui.perfetto.dev).
+"""
+
+import argparse
+import json
+import re
+import sys
+from collections import defaultdict
+
+EVENTS = {
+    1: 'command',
+    2: 'sample',
+    3: 'notify_queued',
+    4: 'notify_sent',
+    5: 'pwm_update',
+    6: 'relay_update',
+}
+
+# Characteristic enum from main/modules/ble.h, None is the kLastMeasurementChr sentinel
+CHARACTERISTICS = ['voltage', 'current', 'temperature', 'capture', 'log', 'rollup', 'diagnostics',
+                   'config', 'calibration', 'ripple', 'plan', 'alarm', None, 'pwm', 'relay']
+
+SYNC_LINE = re.compile(r'TRACE SYNC (\d+) (-?\d+) (\d+) (\d+)')
+DATA_LINE = re.compile(r'TRACE (\d+) ([0-9A-F]+)\s*$')
+RECORD_CHARS = 16
+
+
+def characteristic(arg):
+    if arg < len(CHARACTERISTICS) and CHARACTERISTICS[arg] is not None:
+        return CHARACTERISTICS[arg]
+    return str(arg)
+
+
+def read_dump(lines):
+    syncs = {}
+    records = defaultdict(list)
+    for line in lines:
+        match = SYNC_LINE.search(line)
+        if match:
+            core, time, cycles, per_us = (int(value) for value in match.groups())
+            syncs[core] = (time, cycles, per_us)
+            continue
+
+        match = DATA_LINE.search(line)
+        if match:
+            core = int(match.group(1))
+            data = match.group(2)
+            for pos in range(0, len(data) - RECORD_CHARS + 1, RECORD_CHARS):
+                chunk = data[pos:pos + RECORD_CHARS]
+                records[core].append((int(chunk[0:8], 16), int(chunk[8:12], 16), int(chunk[12:16], 16)))
+    return syncs, records
+
+
+def to_timeline(syncs, records):
+    """Cycle stamps -> microseconds since boot, the 32 bit counter is unwrapped along each ring."""
+    events = []
+    for core, ring in records.items():
+        if core not in syncs or not ring:
+            continue
+
+        sync_time, sync_cycles, per_us = syncs[core]
+        unwrapped = []
+        total = 0
+        previous = ring[0][0]
+        for cycles, event, arg in ring:
+            total += (cycles - previous) & 0xFFFFFFFF
+            previous = cycles
+            unwrapped.append((total, event, arg))
+
+        # the sync point was taken after the last record
+        sync_total = total + ((sync_cycles - previous) & 0xFFFFFFFF)
+        for total, event, arg in unwrapped:
+            time = sync_time - (sync_total - total) / per_us
+            events.append((time, core, EVENTS.get(event, str(event)), arg))
+
+    events.sort(key=lambda item: item[0])
+    return events
+
+
+def latencies(events):
+    """Pairs every start event with the first matching end event after it."""
+    pending = {}
+    pairs = defaultdict(list)
+    for time, core, name, arg in events:
+        if name == 'command' and characteristic(arg) in ('pwm', 'relay'):
+            pending[characteristic(arg) + '_update'] = (time, core, 'command->' + characteristic(arg))
+        elif name in ('pwm_update', 'relay_update') and name in pending:
+            start, start_core, label = pending.pop(name)
+            pairs[label].append((start, time, start_core, core))
+        elif name == 'sample':
+            pending[('queued', arg)] = (time, core, 'sample->queued ' + characteristic(arg))
+        elif name == 'notify_queued':
+            if ('queued', arg) in pending:
+                start, start_core, label = pending.pop(('queued', arg))
+                pairs[label].append((start, time, start_core, core))
+            pending[('sent', arg)] = (time, core, 'queued->sent ' + characteristic(arg))
+        elif name == 'notify_sent' and ('sent', arg) in pending:
+            start, start_core, label = pending.pop(('sent', arg))
+            pairs[label].append((start, time, start_core, core))
+    return pairs
+
+
+def print_histogram(label, pairs):
+    values = sorted(end - start for start, end, _, _ in pairs)
+    buckets = defaultdict(int)
+    for value in values:
+        bucket = 0
+        while (1 << bucket) <= value:
+            bucket += 1
+        buckets[bucket] += 1
+
+    print('%s: n=%d min=%.1f us median=%.1f us p99=%.1f us max=%.1f us' % (
+        label, len(values), values[0], values[len(values) // 2], values[len(values) * 99 // 100], values[-1]))
+    widest = max(buckets.values())
+    for bucket in sorted(buckets):
+        low = 0 if bucket == 0 else 1 << (bucket - 1)
+        print('  %8d - %-8d us %6d %s' % (low, (1 << bucket) - 1, buckets[bucket], '#' * (40 * buckets[bucket] // widest)))
+
+
+def chrome_trace(events, pairs):
+    trace = []
+    for time, core, name, arg in events:
+        trace.append({'name': name, 'ph': 'i', 's': 't', 'ts': time, 'pid': 0, 'tid': core,
+                      'args': {'arg': arg, 'characteristic': characteristic(arg)}})
+    for label, items in pairs.items():
+        for start, end, start_core, _ in items:
+            trace.append({'name': label, 'ph': 'X', 'ts': start, 'dur': end - start, 'pid': 0, 'tid': start_core})
+    return {'traceEvents': trace, 'displayTimeUnit': 'ns'}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('input', help='console capture containing a trace dump')
+    parser.add_argument('--chrome', help='write Chrome trace JSON to this file')
+    args = parser.parse_args()
+
+    with open(args.input, 'r', errors='replace') as f:
+        syncs, records = read_dump(f)
+
+    events = to_timeline(syncs, records)
+    if not events:
+        print('no trace records found', file=sys.stderr)
+        return 1
+
+    pairs = latencies(events)
+    print('%d events on %d core(s), %.3f s' % (len(events), len(records), (events[-1][0] - events[0][0]) / 1e6))
+    for label in sorted(pairs):
+        print_histogram(label, pairs[label])
+
+    if args.chrome:
+        with open(args.chrome, 'w') as f:
+            json.dump(chrome_trace(events, pairs), f)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())